@@ -45,6 +45,9 @@
 #include <TMSITable.h>
 #include <RadioResource.h>
 #include <CallControl.h>
+#include <MediaEngine.h>
+#include <SMSQueue.h>
+#include <sqlite3util.h>
 
 #include <Globals.h>
 
@@ -628,7 +631,7 @@ int endcall(int argc, char **argv, ostream& os)
 {
 	if (argc!=2) return BAD_NUM_ARGS;
 	unsigned transID = atoi(argv[1]);
-	Control::TransactionEntry* target = gTransactionTable.find(transID);
+	Control::TransactionRef target = gTransactionTable.find(transID);
 	if (!target) {
 		os << transID << " not found in table";
 		return BAD_VALUE;
@@ -679,8 +682,8 @@ int chans(int argc, char **argv, ostream& os)
 	while (sChanItr != gBTS.SDCCHPool().end()) {
 		const GSM::SDCCHLogicalChannel* sChan = *sChanItr;
 		if (sChan->active()) {
-			Control::TransactionEntry *trans = gTransactionTable.find(sChan);
-			if (trans) printChanInfo(trans->ID(),sChan,os);
+			Control::TransactionRef trans = gTransactionTable.find(sChan);
+			if (trans.get()) printChanInfo(trans->ID(),sChan,os);
 			else printChanInfo(0,sChan,os);
 		}
 		++sChanItr;
@@ -691,8 +694,8 @@ int chans(int argc, char **argv, ostream& os)
 	while (tChanItr != gBTS.TCHPool().end()) {
 		const GSM::TCHFACCHLogicalChannel* tChan = *tChanItr;
 		if (tChan->active()) {
-			Control::TransactionEntry *trans = gTransactionTable.find(tChan);
-			if (trans) printChanInfo(trans->ID(),tChan,os);
+			Control::TransactionRef trans = gTransactionTable.find(tChan);
+			if (trans.get()) printChanInfo(trans->ID(),tChan,os);
 			else printChanInfo(0,tChan,os);
 		}
 		++tChanItr;
@@ -772,6 +775,8 @@ int crashme(int argc, char** argv, ostream& os)
 
 int stats(int argc, char** argv, ostream& os)
 {
+	// The counters are kept in memory; get them into the table first.
+	gReports.flush();
 
 	char cmd[200];
 	if (argc==2)
@@ -794,6 +799,34 @@ int stats(int argc, char** argv, ostream& os)
 }
 
 
+/** Print the latency histograms of the cached database queries. */
+int dblatency(int argc, char** argv, ostream& os)
+{
+	if (argc!=1) return BAD_NUM_ARGS;
+	sqlite3_dump_latency(os);
+	return SUCCESS;
+}
+
+
+/** Print jitter buffer statistics for active calls. */
+int media(int argc, char** argv, ostream& os)
+{
+	if (argc!=1) return BAD_NUM_ARGS;
+	os << gMediaEngine.size() << " active media streams" << endl;
+	gMediaEngine.dump(os);
+	return SUCCESS;
+}
+
+
+/** Print the MT-SMS queue. */
+int smsqueue(int argc, char** argv, ostream& os)
+{
+	if (argc!=1) return BAD_NUM_ARGS;
+	gSMSQueue.dump(os);
+	return SUCCESS;
+}
+
+
 //@} // CLI commands
 
 
@@ -826,6 +859,9 @@ void Parser::addCommands()
 	addCommand("endcall", endcall,"trans# -- terminate the given transaction");
 	addCommand("crashme", crashme, "force crash of OpenBTS for testing purposes");
 	addCommand("stats", stats,"[patt] -- print all, or selected, performance statistics");
+	addCommand("dblatency", dblatency,"-- print latency histograms of cached database queries");
+	addCommand("media", media,"-- print jitter buffer delay and loss statistics for active calls");
+	addCommand("smsqueue", smsqueue,"-- print the MT-SMS waiting in the SMS queue");
 }
 
 
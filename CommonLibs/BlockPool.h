@@ -0,0 +1,114 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef BLOCKPOOL_H
+#define BLOCKPOOL_H
+
+#include <stddef.h>
+#include <new>
+
+#include "Threads.h"
+
+
+/**
+	A free list of fixed-size memory blocks, for class-specific operator new/delete.
+	Objects that are created and deleted at a high rate get their blocks back
+	from here instead of from the heap.  Requests of any other size, and frees
+	beyond the cap, go to the global operator new/delete.
+*/
+class BlockPool {
+
+	private:
+
+	struct Block { Block *mNext; };
+
+	Mutex mLock;
+	Block *mFree;			///< freed blocks
+	unsigned mCount;		///< number of blocks in mFree
+	unsigned mMax;			///< most blocks to keep in mFree
+	size_t mSize;			///< block size
+
+	public:
+
+	BlockPool(size_t wSize, unsigned wMax)
+		:mFree(NULL),mCount(0),mMax(wMax),mSize(wSize)
+	{ }
+
+	~BlockPool()
+	{
+		while (mFree) {
+			Block *block = mFree;
+			mFree = block->mNext;
+			::operator delete(block);
+		}
+	}
+
+	size_t blockSize() const { return mSize; }
+
+	/** Number of blocks waiting to be reused. */
+	unsigned count() const { return mCount; }
+
+	/** Get a block of at least size bytes. */
+	void* get(size_t size)
+	{
+		if (size>mSize) return ::operator new(size);
+		mLock.lock();
+		Block *block = mFree;
+		if (block) {
+			mFree = block->mNext;
+			mCount--;
+		}
+		mLock.unlock();
+		if (!block) return ::operator new(mSize);
+		return block;
+	}
+
+	/** Return a block from get(); size must be what was asked of get(). */
+	void put(void* ptr, size_t size)
+	{
+		if (!ptr) return;
+		if (size>mSize) {
+			::operator delete(ptr);
+			return;
+		}
+		mLock.lock();
+		if (mCount<mMax) {
+			Block *block = (Block*)ptr;
+			block->mNext = mFree;
+			mFree = block;
+			mCount++;
+			ptr = NULL;
+		}
+		mLock.unlock();
+		if (ptr) ::operator delete(ptr);
+	}
+
+};
+
+
+#endif
+
+// vim: ts=4 sw=4
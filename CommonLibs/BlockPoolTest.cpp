@@ -0,0 +1,67 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "BlockPool.h"
+#include <iostream>
+
+using namespace std;
+
+
+struct Small {
+	char mData[40];
+	static BlockPool& pool() { static BlockPool sPool(sizeof(Small),2); return sPool; }
+	static void* operator new(size_t size) { return pool().get(size); }
+	static void operator delete(void* ptr, size_t size) { pool().put(ptr,size); }
+};
+
+
+int main(int argc, char *argv[])
+{
+	// Freed blocks come back on the next allocation.
+	Small *a = new Small;
+	void *first = a;
+	delete a;
+	cout << "pooled: " << Small::pool().count() << endl;
+	Small *b = new Small;
+	cout << "reused: " << (first==(void*)b) << endl;
+
+	// The pool keeps no more than its cap.
+	Small *c = new Small;
+	Small *d = new Small;
+	delete b;
+	delete c;
+	delete d;
+	cout << "pooled after 3 frees with cap 2: " << Small::pool().count() << endl;
+
+	// Oversize requests bypass the pool.
+	BlockPool pool(16,4);
+	void *big = pool.get(64);
+	pool.put(big,64);
+	cout << "pooled after oversize free: " << pool.count() << endl;
+}
+
+// vim: ts=4 sw=4
@@ -74,6 +74,9 @@ ConfigurationTable::ConfigurationTable(const char* filename, const char *wCmdNam
 		mDB = NULL;
 		return;
 	}
+	if (!sqlite3_setup(mDB)) {
+		gLogEarly(LOG_WARNING, "cannot set WAL mode or busy timeout on configuration database at %s", filename);
+	}
 	// Create the table, if needed.
 	if (!sqlite3_command(mDB,createConfigTable)) {
 		gLogEarly(LOG_EMERG, "cannot create configuration table in database at %s, error message: %s", filename, sqlite3_errmsg(mDB));
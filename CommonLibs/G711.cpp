@@ -0,0 +1,141 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "G711.h"
+
+
+// The per-sample conversions follow the classic Sun reference code.
+// They are only used to fill the tables.
+
+static const int ULAW_BIAS = 0x84;
+static const int ULAW_CLIP = 32635;
+
+static unsigned char linearToUlaw(int pcm)
+{
+	int sign = 0;
+	if (pcm < 0) {
+		pcm = -pcm;
+		sign = 0x80;
+	}
+	if (pcm > ULAW_CLIP) pcm = ULAW_CLIP;
+	pcm += ULAW_BIAS;
+	int exponent = 7;
+	for (int mask = 0x4000; exponent > 0 && !(pcm & mask); mask >>= 1) exponent--;
+	int mantissa = (pcm >> (exponent+3)) & 0x0F;
+	return ~(sign | (exponent<<4) | mantissa);
+}
+
+static int16_t ulawToLinear(unsigned char ulaw)
+{
+	ulaw = ~ulaw;
+	int t = ((ulaw & 0x0F) << 3) + ULAW_BIAS;
+	t <<= (ulaw & 0x70) >> 4;
+	return (ulaw & 0x80) ? (ULAW_BIAS - t) : (t - ULAW_BIAS);
+}
+
+static unsigned char linearToAlaw(int pcm)
+{
+	int mask = 0xD5;
+	if (pcm < 0) {
+		mask = 0x55;
+		pcm = -pcm - 1;
+	}
+	// 13-bit magnitude.
+	pcm >>= 3;
+	int seg = 0;
+	while (seg < 8 && pcm > ((0x20 << seg) - 1)) seg++;
+	if (seg >= 8) return 0x7F ^ mask;
+	unsigned char aval = seg << 4;
+	if (seg < 2) aval |= (pcm >> 1) & 0x0F;
+	else aval |= (pcm >> seg) & 0x0F;
+	return aval ^ mask;
+}
+
+static int16_t alawToLinear(unsigned char alaw)
+{
+	alaw ^= 0x55;
+	int t = (alaw & 0x0F) << 4;
+	int seg = (alaw & 0x70) >> 4;
+	switch (seg) {
+		case 0: t += 8; break;
+		case 1: t += 0x108; break;
+		default: t += 0x108; t <<= seg-1;
+	}
+	return (alaw & 0x80) ? t : -t;
+}
+
+
+/** Lookup tables for all four directions. */
+struct G711Tables {
+
+	unsigned char mUlawEncode[1<<14];		///< indexed by the top 14 bits of the sample
+	unsigned char mAlawEncode[1<<13];		///< indexed by the top 13 bits of the sample
+	int16_t mUlawDecode[256];
+	int16_t mAlawDecode[256];
+
+	G711Tables()
+	{
+		for (int i=0; i<(1<<14); i++) mUlawEncode[i] = linearToUlaw((int16_t)(i<<2));
+		for (int i=0; i<(1<<13); i++) mAlawEncode[i] = linearToAlaw((int16_t)(i<<3));
+		for (int i=0; i<256; i++) {
+			mUlawDecode[i] = ulawToLinear(i);
+			mAlawDecode[i] = alawToLinear(i);
+		}
+	}
+};
+
+static const G711Tables& tables()
+{
+	static const G711Tables sTables;
+	return sTables;
+}
+
+
+void ulawEncode(const int16_t *pcm, unsigned char *ulaw, unsigned count)
+{
+	const unsigned char *table = tables().mUlawEncode;
+	for (unsigned i=0; i<count; i++) ulaw[i] = table[((uint16_t)pcm[i])>>2];
+}
+
+void ulawDecode(const unsigned char *ulaw, int16_t *pcm, unsigned count)
+{
+	const int16_t *table = tables().mUlawDecode;
+	for (unsigned i=0; i<count; i++) pcm[i] = table[ulaw[i]];
+}
+
+void alawEncode(const int16_t *pcm, unsigned char *alaw, unsigned count)
+{
+	const unsigned char *table = tables().mAlawEncode;
+	for (unsigned i=0; i<count; i++) alaw[i] = table[((uint16_t)pcm[i])>>3];
+}
+
+void alawDecode(const unsigned char *alaw, int16_t *pcm, unsigned count)
+{
+	const int16_t *table = tables().mAlawDecode;
+	for (unsigned i=0; i<count; i++) pcm[i] = table[alaw[i]];
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,55 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef G711_H
+#define G711_H
+
+#include <stdint.h>
+
+
+/**@name ITU-T G.711 companding.
+	All of these work on whole buffers through lookup tables,
+	so the per-sample cost is one load.
+	The tables are built on first use.
+*/
+//@{
+
+/** Encode 16-bit linear PCM to mu-law. */
+void ulawEncode(const int16_t *pcm, unsigned char *ulaw, unsigned count);
+
+/** Decode mu-law to 16-bit linear PCM. */
+void ulawDecode(const unsigned char *ulaw, int16_t *pcm, unsigned count);
+
+/** Encode 16-bit linear PCM to A-law. */
+void alawEncode(const int16_t *pcm, unsigned char *alaw, unsigned count);
+
+/** Decode A-law to 16-bit linear PCM. */
+void alawDecode(const unsigned char *alaw, int16_t *pcm, unsigned count);
+
+//@}
+
+
+#endif
+// vim: ts=4 sw=4
@@ -0,0 +1,79 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "G711.h"
+#include <iostream>
+#include <stdlib.h>
+
+using namespace std;
+
+
+int main(int argc, char *argv[])
+{
+	// Every code word should survive decode/encode.
+	unsigned char codes[256];
+	unsigned char recoded[256];
+	int16_t pcm[256];
+	for (unsigned i=0; i<256; i++) codes[i] = i;
+
+	ulawDecode(codes,pcm,256);
+	ulawEncode(pcm,recoded,256);
+	unsigned ulawBad = 0;
+	for (unsigned i=0; i<256; i++) {
+		// 0x7F and 0xFF are both zero.
+		if (recoded[i]!=codes[i] && pcm[i]!=0) ulawBad++;
+	}
+	cout << "mu-law code words not preserved: " << ulawBad << endl;
+
+	alawDecode(codes,pcm,256);
+	alawEncode(pcm,recoded,256);
+	unsigned alawBad = 0;
+	for (unsigned i=0; i<256; i++) if (recoded[i]!=codes[i]) alawBad++;
+	cout << "A-law code words not preserved: " << alawBad << endl;
+
+	// Quantization error over the full range should be within one step.
+	int16_t in[1024], out[1024];
+	unsigned char coded[1024];
+	for (unsigned i=0; i<1024; i++) in[i] = (int16_t)(i*64 - 32768);
+	ulawEncode(in,coded,1024);
+	ulawDecode(coded,out,1024);
+	int ulawWorst = 0;
+	for (unsigned i=0; i<1024; i++) {
+		int err = abs(in[i]-out[i]);
+		if (err>ulawWorst) ulawWorst = err;
+	}
+	alawEncode(in,coded,1024);
+	alawDecode(coded,out,1024);
+	int alawWorst = 0;
+	for (unsigned i=0; i<1024; i++) {
+		int err = abs(in[i]-out[i]);
+		if (err>alawWorst) alawWorst = err;
+	}
+	cout << "worst mu-law error: " << ulawWorst << endl;
+	cout << "worst A-law error: " << alawWorst << endl;
+}
+
+// vim: ts=4 sw=4
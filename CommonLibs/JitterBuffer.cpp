@@ -0,0 +1,219 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "JitterBuffer.h"
+#include "Timeval.h"
+
+#include <string.h>
+#include <math.h>
+
+
+JitterBuffer::JitterBuffer(unsigned wFrameSamples, unsigned wSampleRate, unsigned wMaxDepth)
+	:mFrameSamples(wFrameSamples),mSampleRate(wSampleRate),mMaxDepth(1),
+	mStarted(false),mLastTimestamp(0),mLastExtended(0),
+	mPrimed(false),mPlaying(false),mNext(0),mConcealing(0),
+	mHaveTransit(false),mLastTransit(0),mJitter(0),
+	mReceived(0),mLate(0),mDuplicates(0),mLost(0),
+	mConcealed(0),mDropped(0),mUnderruns(0),mResets(0)
+{
+	maxDepth(wMaxDepth);
+}
+
+
+void JitterBuffer::maxDepth(unsigned wMaxDepth)
+{
+	mMaxDepth = wMaxDepth ? wMaxDepth : 1;
+}
+
+
+void JitterBuffer::reset()
+{
+	mFrames.clear();
+	mStarted = false;
+	mPrimed = false;
+	mPlaying = false;
+	mConcealing = 0;
+	mLastGood.clear();
+	mHaveTransit = false;
+}
+
+
+int64_t JitterBuffer::extend(uint32_t timestamp)
+{
+	if (!mStarted) {
+		mStarted = true;
+		mLastTimestamp = timestamp;
+		mLastExtended = timestamp;
+		mNext = timestamp;
+		return mLastExtended;
+	}
+	// The signed difference handles wraparound in either direction.
+	int32_t delta = (int32_t)(timestamp - mLastTimestamp);
+	mLastTimestamp = timestamp;
+	mLastExtended += delta;
+	return mLastExtended;
+}
+
+
+void JitterBuffer::updateJitter(int64_t timestamp, double arrival)
+{
+	double transit = arrival - (double)timestamp*1000.0/mSampleRate;
+	if (mHaveTransit) {
+		double D = fabs(transit - mLastTransit);
+		mJitter += (D - mJitter)/16.0;
+	}
+	mLastTransit = transit;
+	mHaveTransit = true;
+}
+
+
+unsigned JitterBuffer::targetDepth() const
+{
+	// Enough to cover twice the mean deviation, plus the frame being played.
+	unsigned target = (unsigned)ceil(2.0*mJitter/frameMs()) + 1;
+	if (target > mMaxDepth) target = mMaxDepth;
+	return target;
+}
+
+
+bool JitterBuffer::write(uint32_t timestamp, const unsigned char* data, size_t length, double arrival)
+{
+	int64_t ts = extend(timestamp);
+
+	// A large jump means the far end restarted its timestamps.
+	int64_t gap = ts - mNext;
+	if (gap < 0) gap = -gap;
+	if (gap > (int64_t)MaxGap*mFrameSamples) {
+		mResets++;
+		reset();
+		ts = extend(timestamp);
+	}
+
+	updateJitter(ts,arrival);
+
+	if (mPlaying && ts < mNext) {
+		mLate++;
+		return false;
+	}
+	if (mFrames.find(ts) != mFrames.end()) {
+		mDuplicates++;
+		return false;
+	}
+
+	mFrames[ts].assign(data,data+length);
+	mReceived++;
+	return true;
+}
+
+
+bool JitterBuffer::write(uint32_t timestamp, const unsigned char* data, size_t length)
+{
+	Timeval now;
+	double arrival = (double)now.sec()*1000.0 + (double)now.usec()/1000.0;
+	return write(timestamp,data,length,arrival);
+}
+
+
+size_t JitterBuffer::play(const Frame& frame, unsigned char* data, size_t maxLength)
+{
+	size_t length = frame.size();
+	if (length > maxLength) length = maxLength;
+	if (length) memcpy(data,&frame[0],length);
+	return length;
+}
+
+
+size_t JitterBuffer::conceal(unsigned char* data, size_t maxLength)
+{
+	if (mConcealing >= MaxConcealment || mLastGood.empty()) return 0;
+	mConcealing++;
+	mConcealed++;
+	return play(mLastGood,data,maxLength);
+}
+
+
+size_t JitterBuffer::read(unsigned char* data, size_t maxLength)
+{
+	unsigned target = targetDepth();
+
+	if (!mPrimed) {
+		// Before the first frame there is nothing to conceal with.
+		// After an underrun, conceal until the buffer has refilled.
+		if (mFrames.size() < target) return conceal(data,maxLength);
+		mPrimed = true;
+		mPlaying = true;
+		mNext = mFrames.begin()->first;
+	}
+
+	// Drop from the head if we are running too deep.
+	// One frame per read keeps the cut inaudible.
+	if (mFrames.size() > target+1) {
+		mFrames.erase(mFrames.begin());
+		mDropped++;
+		mNext = mFrames.begin()->first;
+	}
+
+	if (mFrames.empty()) {
+		// Re-prime, concealing through the window while the buffer refills.
+		mUnderruns++;
+		mPrimed = false;
+		mNext += mFrameSamples;
+		return conceal(data,maxLength);
+	}
+
+	FrameMap::iterator itr = mFrames.begin();
+	if (itr->first == mNext) {
+		mLastGood.swap(itr->second);
+		mFrames.erase(itr);
+		mNext += mFrameSamples;
+		mConcealing = 0;
+		return play(mLastGood,data,maxLength);
+	}
+
+	// The frame for this slot is missing but later ones are here.
+	mLost++;
+	mNext += mFrameSamples;
+	return conceal(data,maxLength);
+}
+
+
+std::ostream& operator<<(std::ostream& os, const JitterBuffer& jb)
+{
+	os << "depth=" << jb.depth() << "/" << jb.targetDepth();
+	os << " delay=" << jb.delay() << "ms";
+	os << " jitter=" << jb.jitter() << "ms";
+	os << " received=" << jb.received();
+	os << " late=" << jb.late();
+	os << " dup=" << jb.duplicates();
+	os << " lost=" << jb.lost();
+	os << " concealed=" << jb.concealed();
+	os << " dropped=" << jb.dropped();
+	os << " underruns=" << jb.underruns();
+	os << " resets=" << jb.resets();
+	return os;
+}
+
+
+// vim: ts=4 sw=4
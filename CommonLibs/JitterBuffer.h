@@ -0,0 +1,189 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef JITTERBUFFER_H
+#define JITTERBUFFER_H
+
+#include <stdint.h>
+#include <map>
+#include <vector>
+#include <iostream>
+
+
+/**
+	An adaptive playout buffer for fixed-duration media frames, keyed on RTP timestamp.
+
+	The writer puts frames in as they arrive, in any order.
+	The reader takes out one frame per frame period, at whatever moment
+	its own schedule calls for the next frame.
+	The buffer tracks interarrival jitter as per RFC-3550 6.4.1 and
+	holds just enough frames to ride out that jitter:
+	- It primes to the target depth before starting playout.
+	- It drops frames when the depth runs more than one frame over the target.
+	- It conceals a lost frame by repeating the last good one, a few times at most.
+	- It re-primes after an underrun, concealing while it refills, and resets on a large timestamp jump.
+
+	This class is not thread-safe; the caller provides locking.
+*/
+class JitterBuffer {
+
+	public:
+
+	/** Maximum number of consecutive frames concealed by repetition. */
+	static const unsigned MaxConcealment = 3;
+
+	/** Timestamp jump, in frames, treated as a discontinuity. */
+	static const unsigned MaxGap = 50;
+
+	private:
+
+	typedef std::vector<unsigned char> Frame;
+	typedef std::map<int64_t,Frame> FrameMap;
+
+	FrameMap mFrames;				///< buffered frames, by extended timestamp
+	unsigned mFrameSamples;			///< timestamp units per frame
+	unsigned mSampleRate;			///< timestamp units per second
+	unsigned mMaxDepth;				///< depth limit, in frames
+
+	/**@name Timestamp unwrapping. */
+	//@{
+	bool mStarted;					///< true after the first write
+	uint32_t mLastTimestamp;		///< last raw timestamp written
+	int64_t mLastExtended;			///< extended version of mLastTimestamp
+	//@}
+
+	/**@name Playout state. */
+	//@{
+	bool mPrimed;					///< true while playout is running
+	bool mPlaying;					///< true once playout has started, even through underruns
+	int64_t mNext;					///< extended timestamp of the next frame to play
+	Frame mLastGood;				///< last frame played, for concealment
+	unsigned mConcealing;			///< consecutive concealed frames
+	//@}
+
+	/**@name Jitter estimate, RFC-3550 6.4.1. */
+	//@{
+	bool mHaveTransit;
+	double mLastTransit;			///< relative transit time of the previous packet, ms
+	double mJitter;					///< smoothed jitter, ms
+	//@}
+
+	/**@name Statistics. */
+	//@{
+	unsigned mReceived;				///< frames accepted
+	unsigned mLate;					///< frames discarded for arriving after their playout time
+	unsigned mDuplicates;			///< frames discarded as duplicates
+	unsigned mLost;					///< frames missing at playout time
+	unsigned mConcealed;			///< frames replaced by repetition
+	unsigned mDropped;				///< frames dropped to reduce delay
+	unsigned mUnderruns;			///< times the buffer ran dry
+	unsigned mResets;				///< discontinuities
+	//@}
+
+	public:
+
+	/**
+		Create an empty jitter buffer.
+		@param wFrameSamples Timestamp units per frame, 160 for 20 ms at 8 kHz.
+		@param wSampleRate Timestamp units per second.
+		@param wMaxDepth Maximum depth, in frames.
+	*/
+	JitterBuffer(unsigned wFrameSamples=160, unsigned wSampleRate=8000, unsigned wMaxDepth=8);
+
+	/** Set the depth limit, in frames, at least 1. */
+	void maxDepth(unsigned wMaxDepth);
+
+	/**
+		Add a frame.
+		@param timestamp The RTP timestamp of the frame.
+		@param data The frame payload.
+		@param length The payload length.
+		@param arrival The arrival time, in ms on any monotonic clock.
+		@return false if the frame was discarded as late or duplicate.
+	*/
+	bool write(uint32_t timestamp, const unsigned char* data, size_t length, double arrival);
+
+	/** Add a frame that just arrived. */
+	bool write(uint32_t timestamp, const unsigned char* data, size_t length);
+
+	/**
+		Get the frame for the next playout slot.
+		@param data Buffer for the frame payload.
+		@param maxLength Size of the buffer.
+		@return The payload length, or 0 if there is nothing to play.
+	*/
+	size_t read(unsigned char* data, size_t maxLength);
+
+	/** Discard all frames and playout state; keep the statistics. */
+	void reset();
+
+	/** Current depth in frames. */
+	unsigned depth() const { return mFrames.size(); }
+
+	/** Depth, in frames, the buffer is aiming for given the current jitter. */
+	unsigned targetDepth() const;
+
+	/** Current buffering delay in ms. */
+	unsigned delay() const { return depth()*frameMs(); }
+
+	/** Smoothed interarrival jitter in ms. */
+	double jitter() const { return mJitter; }
+
+	/**@name Statistics. */
+	//@{
+	unsigned received() const { return mReceived; }
+	unsigned late() const { return mLate; }
+	unsigned duplicates() const { return mDuplicates; }
+	unsigned lost() const { return mLost; }
+	unsigned concealed() const { return mConcealed; }
+	unsigned dropped() const { return mDropped; }
+	unsigned underruns() const { return mUnderruns; }
+	unsigned resets() const { return mResets; }
+	//@}
+
+	private:
+
+	unsigned frameMs() const { return mFrameSamples*1000/mSampleRate; }
+
+	/** Convert a 32-bit timestamp to a monotonic 64-bit one. */
+	int64_t extend(uint32_t timestamp);
+
+	/** Update the jitter estimate with a new arrival. */
+	void updateJitter(int64_t timestamp, double arrival);
+
+	/** Copy a frame to the caller's buffer and remember it for concealment. */
+	size_t play(const Frame& frame, unsigned char* data, size_t maxLength);
+
+	/** Repeat the last good frame if the concealment window allows, else return 0. */
+	size_t conceal(unsigned char* data, size_t maxLength);
+
+};
+
+
+std::ostream& operator<<(std::ostream& os, const JitterBuffer&);
+
+
+#endif
+// vim: ts=4 sw=4
@@ -0,0 +1,89 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "JitterBuffer.h"
+#include <iostream>
+#include <stdlib.h>
+
+using namespace std;
+
+
+int main(int argc, char *argv[])
+{
+	unsigned char frame[33];
+	unsigned char out[33];
+
+	// A steady stream near the timestamp wrap point,
+	// with a reordered pair and a lost frame.
+	JitterBuffer jb(160,8000,4);
+	uint32_t ts = 0xFFFFFFFF - 5*160;
+	for (unsigned i=0; i<20; i++) {
+		unsigned n = i;
+		if (i==10) n = 11;
+		if (i==11) n = 10;
+		frame[0] = n;
+		if (n!=7) jb.write(ts+n*160,frame,sizeof(frame),i*20.0);
+		size_t len = jb.read(out,sizeof(out));
+		if (len) cout << (int)out[0] << " ";
+		else cout << "- ";
+	}
+	cout << endl << jb << endl;
+
+	// Jittery arrivals: the target depth should grow.
+	JitterBuffer jb2(160,8000,8);
+	srandom(1);
+	for (unsigned i=0; i<200; i++) {
+		frame[0] = i;
+		double arrival = i*20.0 + (random()%60);
+		jb2.write(i*160,frame,sizeof(frame),arrival);
+		if (i>10) jb2.read(out,sizeof(out));
+	}
+	cout << jb2 << endl;
+
+	// Late and duplicate frames are discarded.
+	JitterBuffer jb3;
+	for (unsigned i=0; i<5; i++) jb3.write(i*160,frame,sizeof(frame),i*20.0);
+	for (unsigned i=0; i<2; i++) jb3.read(out,sizeof(out));
+	jb3.write(0,frame,sizeof(frame),100.0);
+	jb3.write(4*160,frame,sizeof(frame),100.0);
+	// A timestamp jump resets the buffer.
+	jb3.write(100000,frame,sizeof(frame),120.0);
+	cout << jb3 << endl;
+
+	// An underrun with a deep target: concealment continues while the buffer refills.
+	JitterBuffer jb4(160,8000,4);
+	for (unsigned i=0; i<40; i++) {
+		frame[0] = i;
+		// Jittery arrivals, then a 100 ms gap.
+		if (i<20 || i>=25) jb4.write(i*160,frame,sizeof(frame),i*20.0 + (i%2)*30);
+		size_t len = jb4.read(out,sizeof(out));
+		if (len) cout << (int)out[0] << " ";
+		else cout << "- ";
+	}
+	cout << endl << jb4 << endl;
+}
+
+// vim: ts=4 sw=4
@@ -25,8 +25,10 @@
 
 #include "Reporting.h"
 #include "Logger.h"
+#include "Timeval.h"
 #include <stdio.h>
 #include <string.h>
+#include <vector>
 
 static const char* createReportingTable = {
 	"CREATE TABLE IF NOT EXISTS REPORTING ("
@@ -39,6 +41,7 @@ static const char* createReportingTable = {
 
 
 ReportingTable::ReportingTable(const char* filename)
+	:mRunning(false)
 {
 	gLogEarly(LOG_INFO | mFacility, "opening reporting table from path %s", filename);
 	// Connect to the database.
@@ -49,6 +52,9 @@ ReportingTable::ReportingTable(const char* filename)
 		mDB = NULL;
 		return;
 	}
+	if (!sqlite3_setup(mDB)) {
+		gLogEarly(LOG_WARNING | mFacility, "cannot set WAL mode or busy timeout on reporting database at %s", filename);
+	}
 	// Create the table, if needed.
 	if (!sqlite3_command(mDB,createReportingTable)) {
 		gLogEarly(LOG_EMERG | mFacility, "cannot create reporting table in database at %s, error message: %s", filename, sqlite3_errmsg(mDB));
@@ -69,14 +75,134 @@ bool ReportingTable::create(const char* paramName)
 
 
 
-bool ReportingTable::incr(const char* paramName)
+ReportingTable::~ReportingTable()
 {
-	char cmd[200];
-	sprintf(cmd,"UPDATE REPORTING SET VALUE=VALUE+1, UPDATETIME=%ld WHERE NAME=\"%s\"", time(NULL), paramName);
-	if (!sqlite3_command(mDB,cmd)) {
-		gLogEarly(LOG_CRIT|mFacility, "cannot increment reporting parameter %s, error message: %s", paramName, sqlite3_errmsg(mDB));
+	// The flush thread is never stopped, but mFlushLock keeps it out of our way.
+	flush();
+	ScopedLock lock(mFlushLock);
+	if (!mDB) return;
+	sqlite3_release_statements(mDB);
+	sqlite3_close(mDB);
+	mDB = NULL;
+}
+
+
+void ReportingTable::start()
+{
+	if (mRunning) return;
+	mRunning = true;
+	mFlushThread.start((void*(*)(void*))ReportingFlushAdapter,this);
+}
+
+
+void ReportingTable::flushLoop()
+{
+	while (true) {
+		msleep(ReportingFlushInterval);
+		flush();
+	}
+}
+
+
+void* ReportingFlushAdapter(ReportingTable* table)
+{
+	table->flushLoop();
+	return NULL;
+}
+
+
+ReportingCounter& ReportingTable::counter(const char* paramName)
+{
+	mCountersLock.readLock();
+	CounterMap::iterator itr = mCounters.find(paramName);
+	if (itr != mCounters.end()) {
+		ReportingCounter *ctr = itr->second;
+		mCountersLock.unlock();
+		return *ctr;
+	}
+	mCountersLock.unlock();
+	ScopedWriteLock lock(mCountersLock);
+	// Check again, since someone may have beaten us to it.
+	ReportingCounter*& ctr = mCounters[paramName];
+	if (!ctr) ctr = new ReportingCounter;
+	return *ctr;
+}
+
+
+/** Values written by a flush, to be cleared from the counter after the commit. */
+struct WrittenValue {
+	ReportingCounter* mCounter;
+	long mDelta;
+	unsigned mMax;
+};
+
+
+bool ReportingTable::flush()
+{
+	ScopedLock lock(mFlushLock);
+	if (!mDB) return false;
+	time_t now = time(NULL);
+	sqlite3_stmt *incrStmt = sqlite3_checkout(mDB,"UPDATE REPORTING SET VALUE=VALUE+?, UPDATETIME=? WHERE NAME=?");
+	sqlite3_stmt *maxStmt = sqlite3_checkout(mDB,"UPDATE REPORTING SET VALUE=MAX(VALUE,?), UPDATETIME=? WHERE NAME=?");
+	if (!incrStmt || !maxStmt) {
+		sqlite3_checkin(incrStmt);
+		sqlite3_checkin(maxStmt);
+		return false;
+	}
+	std::vector<WrittenValue> written;
+	bool retVal = true;
+	bool inTransaction = false;
+	// Counters are never deleted, so a read lock is enough.
+	ScopedReadLock countersLock(mCountersLock);
+	for (CounterMap::iterator itr = mCounters.begin(); itr != mCounters.end(); ++itr) {
+		long delta = itr->second->delta();
+		unsigned maxVal = itr->second->pendingMax();
+		if (!delta && !maxVal) continue;
+		if (!inTransaction) {
+			inTransaction = sqlite3_command(mDB,"BEGIN TRANSACTION");
+			if (!inTransaction) { retVal = false; break; }
+		}
+		WrittenValue entry = { itr->second, delta, maxVal };
+		written.push_back(entry);
+		const char* name = itr->first.c_str();
+		if (delta) {
+			sqlite3_bind_int64(incrStmt,1,delta);
+			sqlite3_bind_int64(incrStmt,2,now);
+			sqlite3_bind_text(incrStmt,3,name,-1,SQLITE_STATIC);
+			if (sqlite3_run_query(mDB,incrStmt)!=SQLITE_DONE) {
+				gLogEarly(LOG_CRIT|mFacility, "cannot increment reporting parameter %s, error message: %s", name, sqlite3_errmsg(mDB));
+				retVal = false;
+			}
+			sqlite3_reset(incrStmt);
+		}
+		if (maxVal) {
+			sqlite3_bind_int64(maxStmt,1,maxVal);
+			sqlite3_bind_int64(maxStmt,2,now);
+			sqlite3_bind_text(maxStmt,3,name,-1,SQLITE_STATIC);
+			if (sqlite3_run_query(mDB,maxStmt)!=SQLITE_DONE) {
+				gLogEarly(LOG_CRIT|mFacility, "cannot maximize reporting parameter %s, error message: %s", name, sqlite3_errmsg(mDB));
+				retVal = false;
+			}
+			sqlite3_reset(maxStmt);
+		}
+	}
+	sqlite3_checkin(incrStmt);
+	sqlite3_checkin(maxStmt);
+	if (!inTransaction) return retVal;
+	// Keep everything pending for the next flush unless the whole batch goes in.
+	if (!retVal || !sqlite3_command(mDB,"COMMIT TRANSACTION")) {
+		sqlite3_command(mDB,"ROLLBACK TRANSACTION");
 		return false;
 	}
+	for (unsigned i=0; i<written.size(); i++) written[i].mCounter->written(written[i].mDelta,written[i].mMax);
+	return retVal;
+}
+
+
+
+bool ReportingTable::incr(const char* paramName)
+{
+	counter(paramName).incr();
 	return true;
 }
 
@@ -84,18 +210,18 @@ bool ReportingTable::incr(const char* paramName)
 
 bool ReportingTable::max(const char* paramName, unsigned newVal)
 {
-	char cmd[200];
-	sprintf(cmd,"UPDATE REPORTING SET VALUE=MAX(VALUE,%u), UPDATETIME=%ld WHERE NAME=\"%s\"", newVal, time(NULL), paramName);
-	if (!sqlite3_command(mDB,cmd)) {
-		gLogEarly(LOG_CRIT|mFacility, "cannot maximize reporting parameter %s, error message: %s", paramName, sqlite3_errmsg(mDB));
-		return false;
-	}
+	counter(paramName).max(newVal);
 	return true;
 }
 
 
 bool ReportingTable::clear(const char* paramName)
 {
+	// Discard anything pending, then clear the database now.
+	ScopedLock lock(mFlushLock);
+	ReportingCounter& ctr = counter(paramName);
+	ctr.takeDelta();
+	ctr.takeMax();
 	char cmd[200];
 	sprintf(cmd,"UPDATE REPORTING SET VALUE=0, UPDATETIME=0, CLEAREDTIME=%ld WHERE NAME=\"%s\"", time(NULL), paramName);
 	if (!sqlite3_command(mDB,cmd)) {
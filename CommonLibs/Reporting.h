@@ -28,19 +28,94 @@
 
 #include <sqlite3util.h>
 #include <ostream>
+#include <map>
+#include <string>
+
+#include "Threads.h"
+
+
+/** Interval between flushes of the in-memory counters to the database, in ms. */
+const unsigned ReportingFlushInterval = 10000;
+
+
+/**
+	The in-memory state of one reporting parameter.
+	All operations are lock-free; the pending values are
+	collected and written to the database by ReportingTable::flush.
+	Get one from ReportingTable::counter and keep it; it is never deleted.
+*/
+class ReportingCounter {
+
+	private:
+
+	volatile long mDelta;		///< pending increments
+	volatile unsigned mMax;		///< pending max, 0 if none
+
+	public:
+
+	ReportingCounter()
+		:mDelta(0),mMax(0)
+	{}
+
+	/** Increment the counter. */
+	void incr(long delta=1) { __sync_fetch_and_add(&mDelta,delta); }
+
+	/** Take a max of the counter. */
+	void max(unsigned newVal)
+	{
+		unsigned oldVal = mMax;
+		while (newVal>oldVal) {
+			unsigned prev = __sync_val_compare_and_swap(&mMax,oldVal,newVal);
+			if (prev==oldVal) break;
+			oldVal = prev;
+		}
+	}
+
+	/** Return the pending increments. */
+	long delta() const { return mDelta; }
+
+	/** Return the pending max. */
+	unsigned pendingMax() const { return mMax; }
+
+	/**
+		Remove values that have been committed to the database.
+		Increments and maxima that arrived since they were read are kept.
+	*/
+	void written(long delta, unsigned maxVal)
+	{
+		__sync_fetch_and_sub(&mDelta,delta);
+		__sync_bool_compare_and_swap(&mMax,maxVal,0);
+	}
+
+	/** Return and zero the pending increments. */
+	long takeDelta() { return __sync_fetch_and_and(&mDelta,0); }
+
+	/** Return and zero the pending max. */
+	unsigned takeMax() { return __sync_fetch_and_and(&mMax,0); }
+
+};
 
 
 /**
 	Collect performance statistics into a database.
 	Parameters are counters or max/min trackers, all integer.
+	Counting is done in memory; a background thread started by start()
+	writes the accumulated changes in one transaction every ReportingFlushInterval ms.
 */
 class ReportingTable {
 
 	private:
 
+	typedef std::map<std::string,ReportingCounter*> CounterMap;
+
 	sqlite3* mDB;				///< database connection
 	int mFacility;				///< rsyslogd facility
 
+	CounterMap mCounters;		///< in-memory counters, by name
+	mutable RWLock mCountersLock;	///< protects mCounters, but not the counters themselves
+	Mutex mFlushLock;			///< serializes flushes
+	Thread mFlushThread;		///< thread for periodic flushes
+	volatile bool mRunning;		///< true if the flush thread is running
 
 
 	public:
@@ -51,6 +126,24 @@ class ReportingTable {
 	*/
 	ReportingTable(const char* filename);
 
+	/** Flush pending values and close the connection. */
+	~ReportingTable();
+
+	/** Start the periodic flush thread. */
+	void start();
+
+	/**
+		Write all pending values to the database now.
+		The pending values are cleared only once the transaction commits.
+	*/
+	bool flush();
+
+	/**
+		Get the in-memory counter for a parameter, creating it if needed.
+		Callers on hot paths should look this up once and keep the reference.
+	*/
+	ReportingCounter& counter(const char* paramName);
+
 	/** Create a new parameter. */
 	bool create(const char* paramName);
 
@@ -78,8 +171,19 @@ class ReportingTable {
 	/** Dump the database to a stream. */
 	void dump(std::ostream&) const;
 
+	private:
+
+	/** The periodic flush loop. */
+	void flushLoop();
+
+	friend void *ReportingFlushAdapter(ReportingTable*);
+
 };
 
+
+/** C-style adapter for the flush thread. */
+void *ReportingFlushAdapter(ReportingTable*);
+
 #endif
 
 
@@ -200,6 +200,36 @@ int DatagramSocket::read(char* buffer)
 }
 
 
+int DatagramSocket::read(char* const* buffers, unsigned* lengths, unsigned count)
+{
+	if (count>MAX_UDP_BATCH) count = MAX_UDP_BATCH;
+	struct mmsghdr msgs[MAX_UDP_BATCH];
+	struct iovec iovecs[MAX_UDP_BATCH];
+	struct sockaddr_storage sources[MAX_UDP_BATCH];
+	memset(msgs,0,sizeof(msgs));
+	for (unsigned i=0; i<count; i++) {
+		iovecs[i].iov_base = buffers[i];
+		iovecs[i].iov_len = MAX_UDP_LENGTH;
+		msgs[i].msg_hdr.msg_iov = &iovecs[i];
+		msgs[i].msg_hdr.msg_iovlen = 1;
+		msgs[i].msg_hdr.msg_name = &sources[i];
+		msgs[i].msg_hdr.msg_namelen = sizeof(sources[i]);
+	}
+	int numRead = recvmmsg(mSocketFD,msgs,count,MSG_WAITFORONE,NULL);
+	if ((numRead==-1) && (errno!=EAGAIN)) {
+		perror("DatagramSocket::read() recvmmsg() failed");
+		throw SocketError();
+	}
+	for (int i=0; i<numRead; i++) lengths[i] = msgs[i].msg_len;
+	if (numRead>0) {
+		socklen_t len = msgs[numRead-1].msg_hdr.msg_namelen;
+		if (len>sizeof(mSource)) len = sizeof(mSource);
+		memcpy(mSource,&sources[numRead-1],len);
+	}
+	return numRead;
+}
+
+
 int DatagramSocket::read(char* buffer, unsigned timeout)
 {
 	fd_set fds;
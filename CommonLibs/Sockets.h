@@ -43,6 +43,9 @@
 
 #define MAX_UDP_LENGTH 1500
 
+/** Maximum number of packets in one batch read. */
+#define MAX_UDP_BATCH 32
+
 /** A function to resolve IP host names. */
 bool resolveAddress(struct sockaddr_in *address, const char *host, unsigned short port);
 
@@ -118,6 +121,18 @@ public:
 	*/
 	int read(char* buffer, unsigned timeout);
 
+	/**
+		Receive a batch of packets with one system call.
+		Blocks (on a blocking socket) until at least one packet is available,
+		then takes whatever else is already queued.
+		The source address is that of the last packet in the batch.
+		@param buffers Up to MAX_UDP_BATCH char[MAX_UDP_LENGTH] procured by the caller.
+		@param lengths Set to the length of each packet received.
+		@param count The number of buffers.
+		@return The number of packets received or -1 on non-blocking pass.
+	*/
+	int read(char* const* buffers, unsigned* lengths, unsigned count);
+
 
 	/** Send a packet to a given destination, other than the default. */
 	int send(const struct sockaddr *dest, const char * buffer, size_t length);
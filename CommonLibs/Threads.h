@@ -103,6 +103,56 @@ class ScopedLock {
 
 
 
+/**
+	A class for reader/writer locks based on pthread_rwlock.
+	Unlike Mutex, this lock is NOT recursive for writers.
+*/
+class RWLock {
+
+	private:
+
+	pthread_rwlock_t mLock;
+
+	public:
+
+	RWLock() { int s = pthread_rwlock_init(&mLock,NULL); assert(!s); }
+
+	~RWLock() { pthread_rwlock_destroy(&mLock); }
+
+	void readLock() { pthread_rwlock_rdlock(&mLock); }
+
+	void writeLock() { pthread_rwlock_wrlock(&mLock); }
+
+	void unlock() { pthread_rwlock_unlock(&mLock); }
+
+};
+
+
+class ScopedReadLock {
+
+	private:
+	RWLock& mLock;
+
+	public:
+	ScopedReadLock(RWLock& wLock) :mLock(wLock) { mLock.readLock(); }
+	~ScopedReadLock() { mLock.unlock(); }
+
+};
+
+
+class ScopedWriteLock {
+
+	private:
+	RWLock& mLock;
+
+	public:
+	ScopedWriteLock(RWLock& wLock) :mLock(wLock) { mLock.writeLock(); }
+	~ScopedWriteLock() { mLock.unlock(); }
+
+};
+
+
+
 
 /** A C++ interthread signal based on pthread condition variables. */
 class Signal {
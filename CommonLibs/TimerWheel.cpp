@@ -0,0 +1,212 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "TimerWheel.h"
+#include "Timeval.h"
+
+
+using namespace std;
+
+
+TimerWheel::TimerWheel(unsigned wTickMs)
+	:mTickMs(wTickMs),mNow(0),mFree(None),mPendingCount(0)
+{
+	assert(mTickMs);
+	for (unsigned level=0; level<Levels; level++) {
+		for (unsigned slot=0; slot<Slots; slot++) mWheel[level][slot] = None;
+	}
+}
+
+
+void TimerWheel::start()
+{
+	mThread.start((void*(*)(void*))TimerWheelServiceLoop,this);
+}
+
+
+uint32_t TimerWheel::allocate()
+{
+	if (mFree==None) {
+		// Double the slab and thread the new entries onto the free list.
+		// Entries are addressed by index, so moving them is harmless.
+		size_t old = mSlab.size();
+		size_t grown = old ? 2*old : InitialSlab;
+		assert(grown < None);
+		mSlab.resize(grown);
+		for (size_t i=old; i<grown; i++) {
+			mSlab[i].mGeneration = 1;
+			mSlab[i].mPending = false;
+			mSlab[i].mNext = (i+1<grown) ? i+1 : None;
+		}
+		mFree = old;
+	}
+	uint32_t index = mFree;
+	mFree = mSlab[index].mNext;
+	return index;
+}
+
+
+void TimerWheel::release(uint32_t index)
+{
+	Timer& timer = mSlab[index];
+	timer.mPending = false;
+	if (++timer.mGeneration==0) timer.mGeneration = 1;
+	timer.mNext = mFree;
+	mFree = index;
+}
+
+
+void TimerWheel::insert(uint32_t index)
+{
+	Timer& timer = mSlab[index];
+	uint64_t delta = timer.mExpires - mNow;
+	// Anything past the top level waits in the top level;
+	// when its slot comes round it is re-inserted, one span nearer.
+	unsigned level = 0;
+	while (level<Levels-1 && delta >= ((uint64_t)1 << (SlotBits*(level+1)))) level++;
+	unsigned slot = (timer.mExpires >> (SlotBits*level)) & (Slots-1);
+	timer.mLevel = level;
+	timer.mSlot = slot;
+	timer.mPrev = None;
+	timer.mNext = mWheel[level][slot];
+	if (timer.mNext!=None) mSlab[timer.mNext].mPrev = index;
+	mWheel[level][slot] = index;
+}
+
+
+void TimerWheel::unlink(uint32_t index)
+{
+	Timer& timer = mSlab[index];
+	if (timer.mNext!=None) mSlab[timer.mNext].mPrev = timer.mPrev;
+	if (timer.mPrev!=None) mSlab[timer.mPrev].mNext = timer.mNext;
+	else mWheel[timer.mLevel][timer.mSlot] = timer.mNext;
+}
+
+
+void TimerWheel::cascade(unsigned level)
+{
+	unsigned slot = (mNow >> (SlotBits*level)) & (Slots-1);
+	uint32_t index = mWheel[level][slot];
+	mWheel[level][slot] = None;
+	while (index!=None) {
+		uint32_t next = mSlab[index].mNext;
+		insert(index);
+		index = next;
+	}
+}
+
+
+TimerWheel::Handle TimerWheel::schedule(unsigned delayMs, TimerCallback callback, void *object, unsigned tag)
+{
+	ScopedLock lock(mLock);
+	uint32_t index = allocate();
+	Timer& timer = mSlab[index];
+	// Round up, and never expire in the tick that is already running.
+	uint64_t ticks = (delayMs + (uint64_t)mTickMs - 1) / mTickMs;
+	if (ticks==0) ticks = 1;
+	timer.mPending = true;
+	timer.mExpires = mNow + ticks;
+	timer.mCallback = callback;
+	timer.mObject = object;
+	timer.mTag = tag;
+	insert(index);
+	mPendingCount++;
+	return ((Handle)timer.mGeneration << 32) | (index+1);
+}
+
+
+bool TimerWheel::cancel(Handle handle)
+{
+	ScopedLock lock(mLock);
+	uint32_t low = handle & 0xFFFFFFFF;
+	if (low==0 || low>mSlab.size()) return false;
+	uint32_t index = low-1;
+	Timer& timer = mSlab[index];
+	// A stale handle has an old generation, even if the entry is in use again.
+	if (!timer.mPending || timer.mGeneration != (uint32_t)(handle>>32)) return false;
+	unlink(index);
+	release(index);
+	mPendingCount--;
+	return true;
+}
+
+
+void TimerWheel::tick()
+{
+	mExpired.clear();
+	mLock.lock();
+	mNow++;
+	// Move timers down from the higher levels as the lower levels wrap.
+	for (unsigned level=1; level<Levels; level++) {
+		if (mNow & (((uint64_t)1 << (SlotBits*level)) - 1)) break;
+		cascade(level);
+	}
+	unsigned slot = mNow & (Slots-1);
+	uint32_t index = mWheel[0][slot];
+	mWheel[0][slot] = None;
+	while (index!=None) {
+		Timer& timer = mSlab[index];
+		uint32_t next = timer.mNext;
+		assert(timer.mExpires==mNow);
+		Expired expired = { timer.mCallback, timer.mObject, timer.mTag };
+		mExpired.push_back(expired);
+		release(index);
+		mPendingCount--;
+		index = next;
+	}
+	mLock.unlock();
+
+	for (unsigned i=0; i<mExpired.size(); i++) {
+		mExpired[i].mCallback(mExpired[i].mObject,mExpired[i].mTag);
+	}
+}
+
+
+size_t TimerWheel::size() const
+{
+	ScopedLock lock(mLock);
+	return mPendingCount;
+}
+
+
+void *TimerWheelServiceLoop(TimerWheel *wheel)
+{
+	Timeval start;
+	uint64_t ticks = 0;
+	while (true) {
+		uint64_t target = start.elapsed() / wheel->mTickMs;
+		// Catch up after a late wakeup rather than stretching the timers.
+		while (ticks < target) {
+			wheel->tick();
+			ticks++;
+		}
+		msleep(wheel->mTickMs);
+	}
+	return NULL;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,174 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include <stdint.h>
+#include <vector>
+#include "Threads.h"
+
+
+/**
+	Timer callback.
+	@param object The object given to TimerWheel::schedule.
+	@param tag The tag given to TimerWheel::schedule.
+*/
+typedef void (*TimerCallback)(void *object, unsigned tag);
+
+
+/**
+	A hierarchical timing wheel, for large numbers of one-shot timers.
+
+	Time advances in ticks of a fixed length.  Each level of the wheel
+	has TimerWheelSlots slots; a timer goes in the lowest level whose
+	span covers its delay and moves down a level each time the level
+	below wraps.  Delays beyond the span of the top level, 2^24 ticks,
+	wait in the top level and go round again until they are in range.
+
+	Timers live in a slab that is grown, never shrunk, and recycled
+	through a free list, and a handle carries the timer's slab index
+	and a generation count, so scheduling and cancellation are constant
+	time with no allocation once the slab is big enough, and a stale
+	handle never cancels a timer that reused its slot.
+
+	Callbacks run in the thread that advances the wheel, with no lock held,
+	so they may schedule and cancel timers.  Because of that, a callback
+	can still run shortly after a cancel() that returned false;
+	a tag the callback checks against its own state sorts that out.
+*/
+class TimerWheel {
+
+	public:
+
+	/**
+		Timer handle: the generation in the high 32 bits, the slab index plus one in the low 32.
+		0 is never a valid handle.
+	*/
+	typedef uint64_t Handle;
+
+	private:
+
+	/** Index value meaning "no timer". */
+	static const uint32_t None = 0xFFFFFFFF;
+
+	/** A timer slab entry, linked into one wheel slot or the free list. */
+	struct Timer {
+		uint32_t mGeneration;		///< bumped each time the entry is freed
+		bool mPending;				///< true while in the wheel
+		uint8_t mLevel;				///< wheel position, for unlinking
+		uint8_t mSlot;
+		uint64_t mExpires;			///< expiration, in ticks
+		TimerCallback mCallback;
+		void *mObject;
+		unsigned mTag;
+		uint32_t mPrev;
+		uint32_t mNext;				///< also the free list link
+	};
+
+	/** An expired timer's callback, copied out of the slab to run unlocked. */
+	struct Expired {
+		TimerCallback mCallback;
+		void *mObject;
+		unsigned mTag;
+	};
+
+	static const unsigned Levels = 4;
+	static const unsigned SlotBits = 6;
+	static const unsigned Slots = 1<<SlotBits;
+
+	/** Initial slab size; it doubles as needed. */
+	static const unsigned InitialSlab = 64;
+
+	mutable Mutex mLock;
+	unsigned mTickMs;				///< tick length in ms
+	uint64_t mNow;					///< current time, in ticks
+	std::vector<Timer> mSlab;		///< all timer entries, pending or free
+	uint32_t mFree;					///< free list head
+	size_t mPendingCount;			///< timers in the wheel
+	uint32_t mWheel[Levels][Slots];	///< list heads
+	std::vector<Expired> mExpired;	///< scratch for tick(), which runs in one thread at a time
+	Thread mThread;
+
+	/** Take an entry from the free list, growing the slab if needed; caller holds mLock. */
+	uint32_t allocate();
+
+	/** Return an entry to the free list, invalidating its handles; caller holds mLock. */
+	void release(uint32_t index);
+
+	/** Put a timer in the slot for its expiration; caller holds mLock. */
+	void insert(uint32_t index);
+
+	/** Take a timer out of its slot; caller holds mLock. */
+	void unlink(uint32_t index);
+
+	/** Re-insert all timers from a slot at a higher level; caller holds mLock. */
+	void cascade(unsigned level);
+
+	public:
+
+	/** @param wTickMs The timer resolution. */
+	TimerWheel(unsigned wTickMs=10);
+
+	/** Start a thread to run the wheel in real time. */
+	void start();
+
+	/**
+		Schedule a one-shot timer.
+		@param delayMs Delay in ms, rounded up to the next tick.
+		@param callback The function to call at expiration.
+		@param object The first callback argument.
+		@param tag The second callback argument.
+		@return A handle for cancel().
+	*/
+	Handle schedule(unsigned delayMs, TimerCallback callback, void *object, unsigned tag=0);
+
+	/**
+		Cancel a timer.
+		@return true if the timer was pending and will not run.
+	*/
+	bool cancel(Handle handle);
+
+	/** Advance the wheel one tick and run the timers that expire. */
+	void tick();
+
+	/** Number of pending timers. */
+	size_t size() const;
+
+	unsigned tickMs() const { return mTickMs; }
+
+	friend void *TimerWheelServiceLoop(TimerWheel*);
+
+};
+
+
+/** Real-time driver for a TimerWheel. */
+void *TimerWheelServiceLoop(TimerWheel*);
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -0,0 +1,127 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "TimerWheel.h"
+#include <iostream>
+#include <stdlib.h>
+#include <vector>
+
+using namespace std;
+
+
+struct Expected {
+	unsigned due;			///< tick when the timer should fire
+	unsigned fired;			///< tick when the timer fired, or 0
+	bool cancelled;
+};
+
+vector<Expected> gExpected;
+unsigned gTick = 0;
+unsigned gRescheduled = 0;
+
+
+void record(void *object, unsigned tag)
+{
+	Expected& e = gExpected[tag];
+	if (e.fired) cout << "timer " << tag << " fired twice" << endl;
+	e.fired = gTick;
+	// Scheduling from inside a callback is allowed.
+	if (object && gRescheduled<10) {
+		gRescheduled++;
+		TimerWheel *wheel = (TimerWheel*)object;
+		Expected again = { gTick+5, 0, false };
+		gExpected.push_back(again);
+		wheel->schedule(5*wheel->tickMs(),record,NULL,gExpected.size()-1);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	// Tick by hand, so there are no real-time effects.
+	TimerWheel wheel(10);
+	srandom(1);
+
+	const unsigned count = 20000;
+	vector<TimerWheel::Handle> handles;
+	gExpected.reserve(count+20);
+	for (unsigned i=0; i<count; i++) {
+		// Cover all levels, including zero delay.
+		unsigned ticks = random() % (1 << (random()%20));
+		Expected e = { ticks ? ticks : 1, 0, false };
+		gExpected.push_back(e);
+		handles.push_back(wheel.schedule(ticks*10,record,i<10 ? &wheel : NULL,i));
+	}
+	for (unsigned i=0; i<count; i+=7) {
+		if (wheel.cancel(handles[i])) gExpected[i].cancelled = true;
+	}
+	// Cancelling twice fails.
+	if (wheel.cancel(handles[0])) cout << "double cancel succeeded" << endl;
+	cout << "pending " << wheel.size() << endl;
+
+	for (gTick=1; gTick <= (1<<20); gTick++) wheel.tick();
+
+	unsigned late = 0, early = 0, missed = 0, spurious = 0;
+	for (unsigned i=0; i<gExpected.size(); i++) {
+		const Expected& e = gExpected[i];
+		if (e.cancelled) {
+			if (e.fired) spurious++;
+			continue;
+		}
+		if (!e.fired) missed++;
+		else if (e.fired < e.due) early++;
+		else if (e.fired > e.due) late++;
+	}
+	cout << "timers " << gExpected.size() << " rescheduled " << gRescheduled << endl;
+	cout << "early " << early << " late " << late << " missed " << missed << " cancelled but fired " << spurious << endl;
+	cout << "pending " << wheel.size() << endl;
+
+	// A handle is stale once its timer has fired or been cancelled,
+	// even after the slab entry is reused.
+	TimerWheel::Handle stale = handles[1];
+	TimerWheel::Handle fresh = wheel.schedule(10,record,NULL,0);
+	if (wheel.cancel(stale)) cout << "stale handle cancelled a timer" << endl;
+	if (!wheel.cancel(fresh)) cout << "fresh handle did not cancel" << endl;
+
+	// Delays past the top level span, 2^24 ticks, go round again and fire on time.
+	TimerWheel longWheel(1);
+	gExpected.clear();
+	gTick = 0;
+	const unsigned longDelays[] = { (1<<24)-1, (1<<24), (1<<24)+100, (1<<24)+(1<<18)+7 };
+	for (unsigned i=0; i<4; i++) {
+		Expected e = { longDelays[i], 0, false };
+		gExpected.push_back(e);
+		longWheel.schedule(longDelays[i],record,NULL,i);
+	}
+	for (gTick=1; gTick <= (1<<24)+(1<<18)+100; gTick++) longWheel.tick();
+	for (unsigned i=0; i<4; i++) {
+		cout << "delay " << longDelays[i] << " fired " << gExpected[i].fired << endl;
+	}
+	cout << "pending " << longWheel.size() << endl;
+}
+
+// vim: ts=4 sw=4
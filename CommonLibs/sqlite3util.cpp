@@ -6,39 +6,64 @@
 
 #include "sqlite3.h"
 #include "sqlite3util.h"
+#include "Threads.h"
+#include "Timeval.h"
 
 #include <string.h>
 #include <unistd.h>
 #include <stdio.h>
 
+#include <map>
+#include <string>
+#include <vector>
+
 
 // Wrappers to sqlite operations.
 // These will eventually get moved to commonlibs.
 
+
+/**
+	Number of times to retry on SQLITE_BUSY.
+	Each attempt already waits up to the busy timeout inside sqlite3,
+	so there is no need to sleep between attempts.
+*/
+static const unsigned SQLITE3_BUSY_RETRIES = 5;
+
+
+bool sqlite3_setup(sqlite3* DB, unsigned busyTimeout)
+{
+	if (sqlite3_busy_timeout(DB,busyTimeout)) {
+		fprintf(stderr,"sqlite3_busy_timeout failed: %s\n",sqlite3_errmsg(DB));
+		return false;
+	}
+	// This pragma returns the resulting mode as a row.
+	// In-memory databases stay in "memory" mode, which is fine.
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(DB,&stmt,"PRAGMA journal_mode=WAL")) return false;
+	int src = sqlite3_run_query(DB,stmt);
+	sqlite3_finalize(stmt);
+	return src==SQLITE_ROW || src==SQLITE_DONE;
+}
+
+
 int sqlite3_prepare_statement(sqlite3* DB, sqlite3_stmt **stmt, const char* query)
 {
-        int src = SQLITE_BUSY;
-        while (src==SQLITE_BUSY) {
-                src = sqlite3_prepare_v2(DB,query,strlen(query),stmt,NULL);
-                if (src==SQLITE_BUSY) {
-                        usleep(100000);
-                }
-        }
-        if (src) {
-                fprintf(stderr,"sqlite3_prepare_v2 failed for \"%s\": %s\n",query,sqlite3_errmsg(DB));
-                sqlite3_finalize(*stmt);
-        }
-        return src;
+	int src = SQLITE_BUSY;
+	for (unsigned i=0; src==SQLITE_BUSY && i<=SQLITE3_BUSY_RETRIES; i++) {
+		src = sqlite3_prepare_v2(DB,query,strlen(query),stmt,NULL);
+	}
+	if (src) {
+		fprintf(stderr,"sqlite3_prepare_v2 failed for \"%s\": %s\n",query,sqlite3_errmsg(DB));
+		sqlite3_finalize(*stmt);
+	}
+	return src;
 }
 
 int sqlite3_run_query(sqlite3* DB, sqlite3_stmt *stmt)
 {
 	int src = SQLITE_BUSY;
-	while (src==SQLITE_BUSY) {
+	for (unsigned i=0; src==SQLITE_BUSY && i<=SQLITE3_BUSY_RETRIES; i++) {
 		src = sqlite3_step(stmt);
-		if (src==SQLITE_BUSY) {
-			usleep(100000);
-		}
 	}
 	if ((src!=SQLITE_DONE) && (src!=SQLITE_ROW)) {
 		fprintf(stderr,"sqlite3_run_query failed: %s: %s\n", sqlite3_sql(stmt), sqlite3_errmsg(DB));
@@ -47,18 +72,124 @@ int sqlite3_run_query(sqlite3* DB, sqlite3_stmt *stmt)
 }
 
 
+
+// The statement cache.
+// These are function-level statics because the cache is used by
+// ConfigurationTable constructors during static initialization.
+// They are never destroyed, since the destructors of those same globals
+// release their statements after any static built during their construction is gone.
+
+/** Latency histogram buckets, powers of 2 microseconds. */
+static const unsigned SQLITE3_LATENCY_BUCKETS = 24;
+
+struct StatementCacheEntry {
+	std::vector<sqlite3_stmt*> mIdle;					///< prepared statements not in use
+	unsigned mLatency[SQLITE3_LATENCY_BUCKETS];			///< latency histogram
+	StatementCacheEntry() { memset(mLatency,0,sizeof(mLatency)); }
+};
+
+typedef std::pair<sqlite3*,std::string> StatementKey;
+typedef std::map<StatementKey,StatementCacheEntry> StatementCache;
+typedef std::map<sqlite3_stmt*,Timeval> CheckoutMap;
+
+static Mutex& statementCacheLock()
+{
+	static Mutex *lock = new Mutex;
+	return *lock;
+}
+
+static StatementCache& statementCache()
+{
+	static StatementCache *cache = new StatementCache;
+	return *cache;
+}
+
+static CheckoutMap& checkouts()
+{
+	static CheckoutMap *map = new CheckoutMap;
+	return *map;
+}
+
+
+sqlite3_stmt* sqlite3_checkout(sqlite3* DB, const char* query)
+{
+	ScopedLock lock(statementCacheLock());
+	StatementCacheEntry& entry = statementCache()[StatementKey(DB,query)];
+	sqlite3_stmt *stmt = NULL;
+	if (entry.mIdle.size()) {
+		stmt = entry.mIdle.back();
+		entry.mIdle.pop_back();
+	} else {
+		if (sqlite3_prepare_statement(DB,&stmt,query)) return NULL;
+	}
+	checkouts()[stmt] = Timeval();
+	return stmt;
+}
+
+
+void sqlite3_checkin(sqlite3_stmt* stmt)
+{
+	if (!stmt) return;
+	sqlite3_reset(stmt);
+	sqlite3_clear_bindings(stmt);
+	ScopedLock lock(statementCacheLock());
+	StatementCacheEntry& entry = statementCache()[StatementKey(sqlite3_db_handle(stmt),sqlite3_sql(stmt))];
+	CheckoutMap::iterator itr = checkouts().find(stmt);
+	if (itr != checkouts().end()) {
+		Timeval now;
+		long us = (long)(now.sec() - itr->second.sec())*1000000 + (long)now.usec() - (long)itr->second.usec();
+		unsigned bucket = 0;
+		while (us>1 && bucket<SQLITE3_LATENCY_BUCKETS-1) { us >>= 1; bucket++; }
+		entry.mLatency[bucket]++;
+		checkouts().erase(itr);
+	}
+	entry.mIdle.push_back(stmt);
+}
+
+
+void sqlite3_release_statements(sqlite3* DB)
+{
+	ScopedLock lock(statementCacheLock());
+	StatementCache& cache = statementCache();
+	StatementCache::iterator itr = cache.begin();
+	while (itr != cache.end()) {
+		if (itr->first.first != DB) { ++itr; continue; }
+		std::vector<sqlite3_stmt*>& idle = itr->second.mIdle;
+		for (unsigned i=0; i<idle.size(); i++) sqlite3_finalize(idle[i]);
+		cache.erase(itr++);
+	}
+}
+
+
+void sqlite3_dump_latency(std::ostream& os)
+{
+	ScopedLock lock(statementCacheLock());
+	StatementCache& cache = statementCache();
+	for (StatementCache::const_iterator itr = cache.begin(); itr != cache.end(); ++itr) {
+		os << itr->first.second << std::endl;
+		const unsigned *latency = itr->second.mLatency;
+		for (unsigned i=0; i<SQLITE3_LATENCY_BUCKETS; i++) {
+			if (!latency[i]) continue;
+			os << "  <" << (1UL<<(i+1)) << "us: " << latency[i] << std::endl;
+		}
+	}
+}
+
+
+
 bool sqlite3_exists(sqlite3* DB, const char *tableName,
 		const char* keyName, const char* keyData)
 {
-	size_t stringSize = 100 + strlen(tableName) + strlen(keyName) + strlen(keyData);
+	size_t stringSize = 100 + strlen(tableName) + strlen(keyName);
 	char query[stringSize];
-	sprintf(query,"SELECT * FROM %s WHERE %s == \"%s\"",tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query)) return false;
+	sprintf(query,"SELECT * FROM %s WHERE %s == ?",tableName,keyName);
+	// Get the statement.
+	sqlite3_stmt *stmt = sqlite3_checkout(DB,query);
+	if (!stmt) return false;
+	sqlite3_bind_text(stmt,1,keyData,-1,SQLITE_STATIC);
 	// Read the result.
 	int src = sqlite3_run_query(DB,stmt);
-	sqlite3_finalize(stmt);
+	sqlite3_checkin(stmt);
 	// Anything there?
 	return (src == SQLITE_ROW);
 }
@@ -69,12 +200,13 @@ bool sqlite3_single_lookup(sqlite3* DB, const char *tableName,
 		const char* keyName, const char* keyData,
 		const char* valueName, unsigned &valueData)
 {
-	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName) + strlen(keyData);
+	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName);
 	char query[stringSize];
-	sprintf(query,"SELECT %s FROM %s WHERE %s == \"%s\"",valueName,tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query)) return false;
+	sprintf(query,"SELECT %s FROM %s WHERE %s == ?",valueName,tableName,keyName);
+	// Get the statement.
+	sqlite3_stmt *stmt = sqlite3_checkout(DB,query);
+	if (!stmt) return false;
+	sqlite3_bind_text(stmt,1,keyData,-1,SQLITE_STATIC);
 	// Read the result.
 	int src = sqlite3_run_query(DB,stmt);
 	bool retVal = false;
@@ -82,7 +214,7 @@ bool sqlite3_single_lookup(sqlite3* DB, const char *tableName,
 		valueData = (unsigned)sqlite3_column_int64(stmt,0);
 		retVal = true;
 	}
-	sqlite3_finalize(stmt);
+	sqlite3_checkin(stmt);
 	return retVal;
 }
 
@@ -93,12 +225,13 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 		const char* valueName, char* &valueData)
 {
 	valueData=NULL;
-	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName) + strlen(keyData);
+	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName);
 	char query[stringSize];
-	sprintf(query,"SELECT %s FROM %s WHERE %s == \"%s\"",valueName,tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query)) return false;
+	sprintf(query,"SELECT %s FROM %s WHERE %s == ?",valueName,tableName,keyName);
+	// Get the statement.
+	sqlite3_stmt *stmt = sqlite3_checkout(DB,query);
+	if (!stmt) return false;
+	sqlite3_bind_text(stmt,1,keyData,-1,SQLITE_STATIC);
 	// Read the result.
 	int src = sqlite3_run_query(DB,stmt);
 	bool retVal = false;
@@ -107,7 +240,7 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 		if (ptr) valueData = strdup(ptr);
 		retVal = true;
 	}
-	sqlite3_finalize(stmt);
+	sqlite3_checkin(stmt);
 	return retVal;
 }
 
@@ -118,12 +251,13 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 		const char* valueName, char* &valueData)
 {
 	valueData=NULL;
-	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName) + 20;
+	size_t stringSize = 100 + strlen(valueName) + strlen(tableName) + strlen(keyName);
 	char query[stringSize];
-	sprintf(query,"SELECT %s FROM %s WHERE %s == %u",valueName,tableName,keyName,keyData);
-	// Prepare the statement.
-	sqlite3_stmt *stmt;
-	if (sqlite3_prepare_statement(DB,&stmt,query)) return false;
+	sprintf(query,"SELECT %s FROM %s WHERE %s == ?",valueName,tableName,keyName);
+	// Get the statement.
+	sqlite3_stmt *stmt = sqlite3_checkout(DB,query);
+	if (!stmt) return false;
+	sqlite3_bind_int64(stmt,1,keyData);
 	// Read the result.
 	int src = sqlite3_run_query(DB,stmt);
 	bool retVal = false;
@@ -132,7 +266,7 @@ bool sqlite3_single_lookup(sqlite3* DB, const char* tableName,
 		if (ptr) valueData = strdup(ptr);
 		retVal = true;
 	}
-	sqlite3_finalize(stmt);
+	sqlite3_checkin(stmt);
 	return retVal;
 }
 
@@ -149,6 +283,3 @@ bool sqlite3_command(sqlite3* DB, const char* query)
 	sqlite3_finalize(stmt);
 	return src==SQLITE_DONE;
 }
-
-
-
@@ -2,11 +2,52 @@
 #define SQLITE3UTIL_H
 
 #include <sqlite3.h>
+#include <iostream>
+
+/** Busy timeout for all of our connections, in ms. */
+const unsigned SQLITE3_BUSY_TIMEOUT = 2000;
+
+/**
+	Set up a newly opened connection:
+	WAL journaling, so readers do not block the writer, and a busy timeout,
+	so lock contention is handled inside sqlite3 instead of in retry loops.
+	@return true on success.
+*/
+bool sqlite3_setup(sqlite3* DB, unsigned busyTimeout=SQLITE3_BUSY_TIMEOUT);
 
 int sqlite3_prepare_statement(sqlite3* DB, sqlite3_stmt **stmt, const char* query);
 
 int sqlite3_run_query(sqlite3* DB, sqlite3_stmt *stmt);
 
+/**@name Prepared statement cache. */
+//@{
+
+/**
+	Get a prepared statement for a query template from the cache,
+	preparing it if there is no idle copy.
+	Parameters are bound by the caller with the sqlite3_bind_* functions.
+	The statement must be returned with sqlite3_checkin.
+	@return The statement, or NULL on failure.
+*/
+sqlite3_stmt* sqlite3_checkout(sqlite3* DB, const char* query);
+
+/**
+	Reset a statement from sqlite3_checkout, record its latency,
+	and return it to the cache.
+*/
+void sqlite3_checkin(sqlite3_stmt* stmt);
+
+/** Finalize all cached statements for a connection; call before sqlite3_close. */
+void sqlite3_release_statements(sqlite3* DB);
+
+/**
+	Dump the latency histogram of each cached query template.
+	Buckets are powers of two in microseconds, from checkout to checkin.
+*/
+void sqlite3_dump_latency(std::ostream&);
+
+//@}
+
 bool sqlite3_single_lookup(sqlite3* DB, const char *tableName,
 		const char* keyName, const char* keyData,
 		const char* valueName, unsigned &valueData);
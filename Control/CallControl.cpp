@@ -42,6 +42,7 @@
 #include "MobilityManagement.h"
 #include "SMSControl.h"
 #include "CallControl.h"
+#include "MediaEngine.h"
 #include "RRLPServer.h"
 
 #include <GSMCommon.h>
@@ -64,6 +65,10 @@ using namespace std;
 using namespace Control;
 
 
+/** How long pollInCall waits for FACCH signalling, in ms. */
+static const unsigned InCallSignallingTimeout = 50;
+
+
 
 // Forward refs.
 
@@ -333,8 +338,8 @@ bool callManagementDispatchGSM(TransactionEntry *transaction, GSM::LogicalChanne
 	// "Call Confirmed" is the GSM MTC counterpart to "Call Proceeding"
 	if (dynamic_cast<const GSM::L3CallConfirmed*>(message)) {
 		LOG(INFO) << "GSM Call Confirmed " << *transaction;
-		transaction->resetTimer("303");
-		transaction->setTimer("301");
+		transaction->resetTimer(T303);
+		transaction->setTimer(T301);
 		transaction->GSMState(GSM::MTCConfirmed);
 		return false;
 	}
@@ -343,8 +348,8 @@ bool callManagementDispatchGSM(TransactionEntry *transaction, GSM::LogicalChanne
 	// GSM 04.08 5.2.2.3.2
 	if (dynamic_cast<const GSM::L3Alerting*>(message)) {
 		LOG(INFO) << "GSM Alerting " << *transaction;
-		transaction->resetTimer("310");
-		transaction->setTimer("301");
+		transaction->resetTimer(T310);
+		transaction->setTimer(T301);
 		transaction->GSMState(GSM::CallReceived);
 		return false;
 	}
@@ -373,7 +378,7 @@ bool callManagementDispatchGSM(TransactionEntry *transaction, GSM::LogicalChanne
 		}
 		transaction->resetTimers();
 		LCH->send(GSM::L3Release(transaction->L3TI()));
-		transaction->setTimer("308");
+		transaction->setTimer(T308);
 		transaction->GSMState(GSM::ReleaseRequest);
 		//bug #172 fixed
 		if (transaction->SIPState()==SIP::Active){
@@ -512,7 +517,7 @@ bool callManagementDispatchGSM(TransactionEntry *transaction, GSM::LogicalChanne
 			transaction->MODSendCANCEL();
 			transaction->resetTimers();
 			LCH->send(GSM::L3Release(transaction->L3TI()));
-			transaction->setTimer("308");
+			transaction->setTimer(T308);
 			transaction->GSMState(GSM::ReleaseRequest);
 			return true;
 		}
@@ -548,44 +553,6 @@ bool callManagementDispatchGSM(TransactionEntry *transaction, GSM::LogicalChanne
 
 
 
-/**
-	Update vocoder data transfers in both directions.
-	@param transaction The transaction object for this call.
-	@param TCH The traffic channel for this call.
-	@return True if anything was transferred.
-*/
-bool updateCallTraffic(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel *TCH)
-{
-	bool activity = false;
-
-	// Transfer in the downlink direction (RTP->GSM).
-	// Blocking call.  On average returns 1 time per 20 ms.
-	// Returns non-zero if anything really happened.
-	// Make the rxFrame buffer big enough for G.711.
-	unsigned char rxFrame[160];
-	if (transaction->rxFrame(rxFrame)) {
-		activity = true;
-		TCH->sendTCH(rxFrame);
-	}
-
-	// Transfer in the uplink direction (GSM->RTP).
-	// Flush FIFO to limit latency.
-	unsigned maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
-	while (TCH->queueSize()>maxQ) delete[] TCH->recvTCH();
-	if (unsigned char *txFrame = TCH->recvTCH()) {
-		activity = true;
-		// Send on RTP.
-		transaction->txFrame(txFrame);
-		delete[] txFrame;
-	}
-
-	// Return a flag so the caller will know if anything transferred.
-	return activity;
-}
-
-
-
-
 /**
 	Check GSM signalling.
 	Can block for up to 52 GSM L1 frames (240 ms) because LCH::send is blocking.
@@ -647,7 +614,7 @@ bool updateSIPSignalling(TransactionEntry *transaction, GSM::LogicalChannel *LCH
 		if (!GSMClearedOrClearing) {
 			// Initiate clearing in the GSM side.
 			LCH->send(GSM::L3Disconnect(transaction->L3TI()));
-			transaction->setTimer("305");
+			transaction->setTimer(T305);
 			transaction->GSMState(GSM::DisconnectIndication);
 		} else {
 			// GSM already cleared?
@@ -680,8 +647,8 @@ bool updateSignalling(TransactionEntry *transaction, GSM::LogicalChannel *LCH, u
 
 
 /**
-	Poll for activity while in a call.
-	Sleep if needed to prevent fast spinning.
+	Poll for signalling activity while in a call.
+	Speech is moved by gMediaEngine, not here.
 	Will block for up to 250 ms.
 	@param transaction The call's TransactionEntry.
 	@param TCH The call's TCH+FACCH.
@@ -697,8 +664,9 @@ bool pollInCall(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel *TCH)
 	}
 
 	// Process pending SIP and GSM signalling.
+	// Waiting here on the FACCH replaces the old idle sleep.
 	// If this returns true, it means the call is fully cleared.
-	if (updateSignalling(transaction,TCH)) return true;
+	if (updateSignalling(transaction,TCH,InCallSignallingTimeout)) return true;
 
 	// Did an outside process request a termination?
 	if (transaction->terminationRequested()) {
@@ -712,12 +680,6 @@ bool pollInCall(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel *TCH)
 		return true;
 	}
 
-	// Transfer vocoder data.
-	// If anything happened, then the call is still up.
-	if (updateCallTraffic(transaction,TCH)) return false;
-
-	// If nothing happened, sleep so we don't burn up the CPU cycles.
-	msleep(50);
 	return false;
 }
 
@@ -752,26 +714,38 @@ bool waitInCall(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel *TCH,
 void callManagementLoop(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel* TCH)
 {
 	LOG(INFO) << " call connected " << *transaction;
-	gReports.incr("OpenBTS.GSM.CC.CallMinutes");
-	// poll everything until the call is finished
-	// A rough count of frames.
-	size_t fCount = 0;
-	while (!pollInCall(transaction,TCH)) {
-
-		if (transaction->deadOrRemoved()) {
-			LOG(ERR) << "attempting to use a defunct transaction";
-			TCH->send(GSM::L3ChannelRelease());
-			return;
-		}
+	static ReportingCounter& callMinutes = gReports.counter("OpenBTS.GSM.CC.CallMinutes");
+	callMinutes.incr();
+	// Hold a reference so the table cannot reap the entry out from under us.
+	TransactionRef ref(transaction);
+	bool defunct = false;
+	{
+		// Speech goes through the media engine; we just handle signalling.
+		// The guard takes the call out of the engine however this block exits,
+		// including the exceptions that go on to the DCCH dispatcher.
+		MediaStreamGuard media(gMediaEngine,transaction,TCH);
+		// poll everything until the call is finished
+		Timeval nextMinute(60*1000);
+		while (!pollInCall(transaction,TCH)) {
+
+			if (transaction->deadOrRemoved()) {
+				LOG(ERR) << "attempting to use a defunct transaction";
+				defunct = true;
+				break;
+			}
 
-		fCount++;
-		// On average, pollInCall blocks for 20 ms.
-		// Every minute, reset the watchdog timer.
-		if ((fCount%(60*50))==0) {
-			LOG(DEBUG) << fCount << " cycles of call management loop; resetting watchdog";
-			gReports.incr("OpenBTS.GSM.CC.CallMinutes");
+			// Every minute, reset the watchdog timer.
+			if (nextMinute.passed()) {
+				LOG(DEBUG) << "another minute of call management loop; resetting watchdog";
+				callMinutes.incr();
+				nextMinute.future(60*1000);
+			}
 		}
 	}
+	if (defunct) {
+		TCH->send(GSM::L3ChannelRelease());
+		return;
+	}
 	gTransactionTable.remove(transaction);
 }
 
@@ -897,7 +871,7 @@ void Control::MOCStarter(const GSM::L3CMServiceRequest* req, GSM::LogicalChannel
 	// The remote party will start ringing soon.
 	LOG(DEBUG) << "starting SIP (INVITE) Calling "<<bcdDigits;
 	unsigned basePort = allocateRTPPorts();
-	transaction->MOCSendINVITE(bcdDigits,gConfig.getStr("SIP.Local.IP").c_str(),basePort,SIP::RTPGSM610);
+	transaction->MOCSendINVITE(bcdDigits,gConfig.getStr("SIP.Local.IP").c_str(),basePort,SIP::preferredCodec());
 	LOG(DEBUG) << "transaction: " << *transaction;
 
 	// Once we can start SIP call setup, send Call Proceeding.
@@ -1067,7 +1041,7 @@ void Control::MOCController(TransactionEntry *transaction, GSM::TCHFACCHLogicalC
 	// Let the phone know the call is connected.
 	LOG(INFO) << "sending Connect to handset";
 	TCH->send(GSM::L3Connect(L3TI));
-	transaction->setTimer("313");
+	transaction->setTimer(T313);
 	transaction->GSMState(GSM::ConnectIndication);
 
 	// The call is open.
@@ -1134,7 +1108,7 @@ void Control::MTCStarter(TransactionEntry *transaction, GSM::LogicalChannel *LCH
 	LOG(INFO) << "sending GSM Setup to call " << transaction->calling();
 	LCH->send(GSM::L3Setup(L3TI,GSM::L3CallingPartyBCDNumber(transaction->calling())));
 	gReports.incr("OpenBTS.GSM.CC.MTC.Setup");
-	transaction->setTimer("303");
+	transaction->setTimer(T303);
 	transaction->GSMState(GSM::CallPresent);
 
 	// Wait for Call Confirmed message.
@@ -38,6 +38,8 @@
 #include <SIPUtility.h>
 #include <SIPInterface.h>
 
+#include <string.h>
+
 #include <Logger.h>
 #undef WARNING
 #include <Reporting.h>
@@ -50,74 +52,81 @@ using namespace Control;
 
 
 
-/**
-	Dispatch the appropriate controller for a Mobility Management message.
-	@param req A pointer to the initial message.
-	@param DCCH A pointer to the logical channel for the transaction.
-*/
-void DCCHDispatchMM(const L3MMMessage* req, LogicalChannel *DCCH)
+/**@name Controllers for the first message of a DCCH transaction. */
+//@{
+
+/** A controller, called with a message of the type registered for it. */
+typedef void (*DCCHHandler)(const L3Message*, LogicalChannel*);
+
+static void dispatchLocationUpdatingRequest(const L3Message* req, LogicalChannel* DCCH)
+	{ LocationUpdatingController(static_cast<const L3LocationUpdatingRequest*>(req),DCCH); }
+
+static void dispatchIMSIDetachIndication(const L3Message* req, LogicalChannel* DCCH)
+	{ IMSIDetachController(static_cast<const L3IMSIDetachIndication*>(req),DCCH); }
+
+static void dispatchCMServiceRequest(const L3Message* req, LogicalChannel* DCCH)
+	{ CMServiceResponder(static_cast<const L3CMServiceRequest*>(req),DCCH); }
+
+static void dispatchPagingResponse(const L3Message* req, LogicalChannel* DCCH)
+	{ PagingResponseHandler(static_cast<const L3PagingResponse*>(req),DCCH); }
+
+static void dispatchAssignmentComplete(const L3Message* req, LogicalChannel* DCCH)
 {
-	assert(req);
-	L3MMMessage::MessageType MTI = (L3MMMessage::MessageType)req->MTI();
-	switch (MTI) {
-		case L3MMMessage::LocationUpdatingRequest:
-			LocationUpdatingController(dynamic_cast<const L3LocationUpdatingRequest*>(req),DCCH);
-			break;
-		case L3MMMessage::IMSIDetachIndication:
-			IMSIDetachController(dynamic_cast<const L3IMSIDetachIndication*>(req),DCCH);
-			break;
-		case L3MMMessage::CMServiceRequest:
-			CMServiceResponder(dynamic_cast<const L3CMServiceRequest*>(req),DCCH);
-			break;
-		default:
-			LOG(NOTICE) << "unhandled MM message " << MTI << " on " << *DCCH;
-			throw UnsupportedMessage();
-	}
+	// Only a TCH/FACCH can complete an assignment.
+	TCHFACCHLogicalChannel *TCH = NULL;
+	if (DCCH->type()==FACCHType) TCH = static_cast<TCHFACCHLogicalChannel*>(DCCH);
+	AssignmentCompleteHandler(static_cast<const L3AssignmentComplete*>(req),TCH);
 }
 
+//@}
 
-/**
-	Dispatch the appropriate controller for a Radio Resource message.
-	@param req A pointer to the initial message.
-	@param DCCH A pointer to the logical channel for the transaction.
-*/
-void DCCHDispatchRR(const L3RRMessage* req, LogicalChannel *DCCH)
-{
-	LOG(DEBUG) << "checking MTI"<< (L3RRMessage::MessageType)req->MTI();
-
-	// TODO SMS -- This needs to handle SACCH Measurement Reports.
-
-	assert(req);
-	L3RRMessage::MessageType MTI = (L3RRMessage::MessageType)req->MTI();
-	switch (MTI) {
-		case L3RRMessage::PagingResponse:
-			PagingResponseHandler(dynamic_cast<const L3PagingResponse*>(req),DCCH);
-			break;
-		case L3RRMessage::AssignmentComplete:
-			AssignmentCompleteHandler(dynamic_cast<const L3AssignmentComplete*>(req),
-										dynamic_cast<TCHFACCHLogicalChannel*>(DCCH));
-			break;
-		default:
-			LOG(NOTICE) << "unhandled RR message " << MTI << " on " << *DCCH;
-			throw UnsupportedMessage();
+
+/** Controllers indexed by PD and MTI; NULL where there is none. */
+class DCCHDispatchTable {
+
+	private:
+
+	DCCHHandler mHandlers[16][256];
+
+	void add(L3PD PD, int MTI, DCCHHandler handler)
+		{ mHandlers[PD][MTI] = handler; }
+
+	public:
+
+	DCCHDispatchTable()
+	{
+		memset(mHandlers,0,sizeof(mHandlers));
+		add(L3MobilityManagementPD,L3MMMessage::LocationUpdatingRequest,dispatchLocationUpdatingRequest);
+		add(L3MobilityManagementPD,L3MMMessage::IMSIDetachIndication,dispatchIMSIDetachIndication);
+		add(L3MobilityManagementPD,L3MMMessage::CMServiceRequest,dispatchCMServiceRequest);
+		add(L3RadioResourcePD,L3RRMessage::PagingResponse,dispatchPagingResponse);
+		add(L3RadioResourcePD,L3RRMessage::AssignmentComplete,dispatchAssignmentComplete);
 	}
-}
+
+	DCCHHandler handler(unsigned PD, unsigned MTI) const
+	{
+		if (PD>=16 || MTI>=256) return NULL;
+		return mHandlers[PD][MTI];
+	}
+};
+
+static const DCCHDispatchTable sDCCHDispatchTable;
 
 
+/**
+	Dispatch the appropriate controller for the first message of a transaction.
+	@param msg A pointer to the initial message.
+	@param DCCH A pointer to the logical channel for the transaction.
+*/
 void DCCHDispatchMessage(const L3Message* msg, LogicalChannel* DCCH)
 {
-	// Each protocol has it's own sub-dispatcher.
-	switch (msg->PD()) {
-		case L3MobilityManagementPD:
-			DCCHDispatchMM(dynamic_cast<const L3MMMessage*>(msg),DCCH);
-			break;
-		case L3RadioResourcePD:
-			DCCHDispatchRR(dynamic_cast<const L3RRMessage*>(msg),DCCH);
-			break;
-		default:
-			LOG(NOTICE) << "unhandled protocol " << msg->PD() << " on " << *DCCH;
-			throw UnsupportedMessage();
+	assert(msg);
+	DCCHHandler handler = sDCCHDispatchTable.handler(msg->PD(),msg->MTI());
+	if (!handler) {
+		LOG(NOTICE) << "unhandled message PD=" << msg->PD() << " MTI=" << msg->MTI() << " on " << *DCCH;
+		throw UnsupportedMessage();
 	}
+	handler(msg,DCCH);
 }
 
 
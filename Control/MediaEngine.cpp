@@ -0,0 +1,317 @@
+/*
+* Copyright 2011 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#include "MediaEngine.h"
+#include "TransactionTable.h"
+#include "Transcoder.h"
+
+#include <GSMLogicalChannel.h>
+#include <SIPUtility.h>
+#include <Logger.h>
+#include <Globals.h>
+
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+
+using namespace std;
+using namespace Control;
+
+
+/**
+	The epoll tag for the frame clock.
+	Each RTP socket is tagged with its transaction ID, which fits in 32 bits.
+*/
+static const uint64_t MediaClockTag = ~(uint64_t)0;
+
+
+
+MediaEngine::~MediaEngine()
+{
+	// The service thread is never stopped; this is only invoked at exit.
+	// The streams are left for the OS to reclaim.
+	if (mTimerFD>=0) close(mTimerFD);
+	if (mEpollFD>=0) close(mEpollFD);
+}
+
+
+void MediaEngine::start()
+{
+	if (mRunning) return;
+
+	mEpollFD = epoll_create(1);
+	if (mEpollFD<0) {
+		LOG(ALERT) << "cannot create epoll set: " << strerror(errno);
+		return;
+	}
+
+	// The service clock.
+	mTimerFD = timerfd_create(CLOCK_MONOTONIC,0);
+	if (mTimerFD<0) {
+		LOG(ALERT) << "cannot create frame timer: " << strerror(errno);
+		return;
+	}
+	struct itimerspec period;
+	period.it_interval.tv_sec = 0;
+	period.it_interval.tv_nsec = MediaTickPeriod*1000000;
+	period.it_value = period.it_interval;
+	if (timerfd_settime(mTimerFD,0,&period,NULL)) {
+		LOG(ALERT) << "cannot start frame timer: " << strerror(errno);
+		return;
+	}
+
+	struct epoll_event event;
+	memset(&event,0,sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = MediaClockTag;
+	if (epoll_ctl(mEpollFD,EPOLL_CTL_ADD,mTimerFD,&event)) {
+		LOG(ALERT) << "cannot add frame timer to epoll set: " << strerror(errno);
+		return;
+	}
+
+	mRunning = true;
+	mServiceThread.start((void*(*)(void*))MediaEngineServiceLoopAdapter,this);
+}
+
+
+void MediaEngine::add(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel *TCH)
+{
+	assert(transaction);
+	assert(TCH);
+	LOG(DEBUG) << "adding " << *transaction;
+	ScopedLock lock(mLock);
+	MediaStream*& stream = mStreams[transaction->ID()];
+	if (stream) return;
+	stream = new MediaStream;
+	transaction->incRef();
+	stream->mTransaction = transaction;
+	stream->mTCH = TCH;
+	stream->mJitterBuffer.maxDepth(gConfig.getNum("GSM.MaxSpeechLatency"));
+	unsigned codec = transaction->codec();
+	if (SIP::transcodable(codec)) stream->mTranscoder = new Transcoder(codec);
+	// Wake up for downlink packets as they arrive.
+	// Without a socket, the stream is drained on each tick instead.
+	int sock = transaction->RTPSocket();
+	if (sock<0) {
+		LOG(NOTICE) << "no RTP socket for " << *transaction << ", polling on each tick";
+		return;
+	}
+	struct epoll_event event;
+	memset(&event,0,sizeof(event));
+	event.events = EPOLLIN;
+	event.data.u64 = transaction->ID();
+	if (epoll_ctl(mEpollFD,EPOLL_CTL_ADD,sock,&event)) {
+		LOG(ERR) << "cannot add RTP socket of " << *transaction << " to epoll set: " << strerror(errno);
+		return;
+	}
+	stream->mSocket = sock;
+}
+
+
+void MediaEngine::remove(TransactionEntry *transaction)
+{
+	assert(transaction);
+	MediaStream *stream;
+	mLock.lock();
+	MediaStreamMap::iterator itr = mStreams.find(transaction->ID());
+	if (itr == mStreams.end()) {
+		mLock.unlock();
+		return;
+	}
+	stream = itr->second;
+	mStreams.erase(itr);
+	if (stream->mSocket>=0) {
+		// The kernel needs a non-NULL event pointer here before 2.6.9.
+		struct epoll_event event;
+		epoll_ctl(mEpollFD,EPOLL_CTL_DEL,stream->mSocket,&event);
+	}
+	mLock.unlock();
+	// A pass may still hold the stream; wait for just this call's I/O to finish.
+	stream->mLock.lock();
+	LOG(INFO) << "removed " << *transaction << " " << stream->mJitterBuffer;
+	stream->mRemoved = true;
+	delete stream->mTranscoder;
+	stream->mTranscoder = NULL;
+	stream->mLock.unlock();
+	mLock.lock();
+	mRetired.push_back(stream);
+	mLock.unlock();
+	transaction->decRef();
+}
+
+
+size_t MediaEngine::size() const
+{
+	ScopedLock lock(mLock);
+	return mStreams.size();
+}
+
+
+void MediaEngine::dump(ostream& os) const
+{
+	ScopedLock lock(mLock);
+	for (MediaStreamMap::const_iterator itr = mStreams.begin(); itr != mStreams.end(); ++itr) {
+		ScopedLock streamLock(itr->second->mLock);
+		os << "TranID=" << itr->first << " " << itr->second->mJitterBuffer << endl;
+	}
+}
+
+
+bool MediaEngine::receive(MediaStream& stream)
+{
+	bool activity = false;
+	// Take every packet that has arrived; the jitter buffer sorts them out.
+	// Make the buffer big enough for G.711.
+	unsigned char rxFrame[160];
+	uint32_t timestamp;
+	// An empty payload is still a packet; only -1 means the socket is drained.
+	int length;
+	while ((length = stream.mTransaction->rxPacket(rxFrame,sizeof(rxFrame),timestamp)) >= 0) {
+		activity = true;
+		stream.mJitterBuffer.write(timestamp,rxFrame,length);
+	}
+	return activity;
+}
+
+
+bool MediaEngine::transfer(MediaStream& stream, unsigned maxQ)
+{
+	bool activity = false;
+	TransactionEntry *transaction = stream.mTransaction;
+	GSM::TCHFACCHLogicalChannel *TCH = stream.mTCH;
+	JitterBuffer& jitterBuffer = stream.mJitterBuffer;
+	Transcoder *transcoder = stream.mTranscoder;
+	jitterBuffer.maxDepth(maxQ);
+
+	// Transfer in the downlink direction (RTP->GSM).
+	// Packets were moved into the jitter buffer as their sockets became ready.
+	unsigned char rxFrame[160];
+	// Play out only when the encoder has taken its last frame,
+	// so the TDMA schedule sets the playout clock.
+	// If there is nothing to play, the encoder sends filler.
+	if (TCH->downlinkQueueSize()==0) {
+		unsigned length = jitterBuffer.read(rxFrame,sizeof(rxFrame));
+		if (transcoder) {
+			unsigned char gsmFrame[GSMFrameBytes];
+			if (length && transcoder->downlink(rxFrame,length,gsmFrame)) TCH->sendTCH(gsmFrame);
+		} else if (length==GSMFrameBytes) {
+			TCH->sendTCH(rxFrame);
+		}
+	}
+
+	// Transfer in the uplink direction (GSM->RTP).
+	// The decoder runs on the TDMA clock, so everything queued is current.
+	while (unsigned char *txFrame = TCH->recvTCH()) {
+		activity = true;
+		// Send on RTP.
+		if (transcoder) {
+			unsigned char payload[SpeechFrameSamples];
+			if (unsigned length = transcoder->uplink(txFrame,payload)) transaction->txFrame(payload,length);
+		} else {
+			transaction->txFrame(txFrame);
+		}
+		delete[] txFrame;
+	}
+
+	return activity;
+}
+
+
+void MediaEngine::serviceLoop()
+{
+	const int maxEvents = 64;
+	struct epoll_event events[maxEvents];
+	MediaStreamList readable;
+	MediaStreamList pass;
+	while (mRunning) {
+		int n = epoll_wait(mEpollFD,events,maxEvents,-1);
+		if (n<0) {
+			if (errno==EINTR) continue;
+			LOG(ALERT) << "epoll_wait failed: " << strerror(errno);
+			break;
+		}
+
+		// Pick the streams for this pass.
+		bool tick = false;
+		readable.clear();
+		pass.clear();
+		mLock.lock();
+		// The last pass is over, so nothing refers to the retired streams now.
+		for (MediaStreamList::iterator itr = mRetired.begin(); itr != mRetired.end(); ++itr) delete *itr;
+		mRetired.clear();
+		for (int i=0; i<n; i++) {
+			if (events[i].data.u64 != MediaClockTag) {
+				// An RTP socket is readable.
+				// The stream may have been removed since epoll_wait returned.
+				MediaStreamMap::iterator itr = mStreams.find((unsigned)events[i].data.u64);
+				if (itr != mStreams.end()) readable.push_back(itr->second);
+				continue;
+			}
+			// Read the expiration count to re-arm the event.
+			// If we fell behind, do not try to catch up;
+			// the jitter buffer and the TCH queues absorb it.
+			uint64_t expirations;
+			if (read(mTimerFD,&expirations,sizeof(expirations))==sizeof(expirations)) {
+				if (expirations>1) LOG(INFO) << "media engine missed " << expirations-1 << " tick(s)";
+				tick = true;
+			}
+		}
+		if (tick) {
+			for (MediaStreamMap::iterator itr = mStreams.begin(); itr != mStreams.end(); ++itr) {
+				pass.push_back(itr->second);
+			}
+		}
+		mLock.unlock();
+
+		// Do the I/O without mLock, skipping any stream removed in the meantime.
+		for (MediaStreamList::iterator itr = readable.begin(); itr != readable.end(); ++itr) {
+			ScopedLock lock((*itr)->mLock);
+			if (!(*itr)->mRemoved) receive(**itr);
+		}
+		if (!tick) continue;
+		// Playout and uplink run on the TDMA clock for every call.
+		unsigned maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
+		for (MediaStreamList::iterator itr = pass.begin(); itr != pass.end(); ++itr) {
+			ScopedLock lock((*itr)->mLock);
+			if ((*itr)->mRemoved) continue;
+			if ((*itr)->mSocket<0) receive(**itr);
+			transfer(**itr,maxQ);
+		}
+	}
+}
+
+
+void* Control::MediaEngineServiceLoopAdapter(MediaEngine* engine)
+{
+	engine->serviceLoop();
+	return NULL;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,212 @@
+/*
+* Copyright 2011 Free Software Foundation, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+
+#ifndef MEDIAENGINE_H
+#define MEDIAENGINE_H
+
+#include <map>
+#include <vector>
+#include <iostream>
+
+#include <Threads.h>
+#include <JitterBuffer.h>
+
+
+namespace GSM {
+class TCHFACCHLogicalChannel;
+}
+
+
+namespace Control {
+
+class TransactionEntry;
+class Transcoder;
+
+
+/** Speech frame period, in ms. */
+const unsigned MediaFramePeriod = 20;
+
+/** Media engine service period, in ms; half a frame, so the TCH never waits long. */
+const unsigned MediaTickPeriod = MediaFramePeriod/2;
+
+
+/**
+	The media engine moves speech frames between the RTP sessions and
+	the TCH speech queues of all active calls from a single thread.
+	The thread waits on an epoll set holding a timerfd that fires twice per frame period
+	and the RTP socket of each call.
+	Downlink RTP packets are read only from the sockets epoll reports as ready,
+	and go into a per-call adaptive jitter buffer as they arrive.
+	The buffer is played out only when the TCH encoder has used up its last frame,
+	so playout follows the TDMA schedule rather than the backhaul.
+	Call signalling stays in the per-call callManagementLoop.
+*/
+class MediaEngine {
+
+	private:
+
+	/** One active call. */
+	struct MediaStream {
+		Mutex mLock;					///< held while moving this call's frames
+		bool mRemoved;					///< set by remove(), under mLock
+		TransactionEntry *mTransaction;
+		GSM::TCHFACCHLogicalChannel *mTCH;
+		JitterBuffer mJitterBuffer;		///< downlink playout buffer
+		Transcoder *mTranscoder;		///< for G.711 calls, NULL for GSM 06.10
+		int mSocket;					///< RTP socket in the epoll set, or -1 to poll on each tick
+		MediaStream():mRemoved(false),mTransaction(NULL),mTCH(NULL),mTranscoder(NULL),mSocket(-1) {}
+	};
+
+	typedef std::map<unsigned,MediaStream*> MediaStreamMap;
+	typedef std::vector<MediaStream*> MediaStreamList;
+
+	MediaStreamMap mStreams;	///< active calls, by transaction ID
+	MediaStreamList mRetired;	///< removed streams, freed by the service thread between passes
+	mutable Mutex mLock;		///< protects mStreams and mRetired, but not the streams themselves
+	int mEpollFD;				///< epoll set for the service loop
+	int mTimerFD;				///< frame clock
+	Thread mServiceThread;
+	volatile bool mRunning;
+
+	public:
+
+	MediaEngine()
+		:mEpollFD(-1),mTimerFD(-1),mRunning(false)
+	{}
+
+	~MediaEngine();
+
+	/** Create the frame clock and start the service thread. */
+	void start();
+
+	/**
+		Start moving speech for a call.
+		The engine holds a reference to the transaction until remove() is called.
+		@param transaction The call.
+		@param TCH The call's traffic channel.
+	*/
+	void add(TransactionEntry *transaction, GSM::TCHFACCHLogicalChannel *TCH);
+
+	/**
+		Stop moving speech for a call.
+		When this returns, the engine is no longer using the transaction or TCH.
+	*/
+	void remove(TransactionEntry *transaction);
+
+	/** Return the number of active calls. */
+	size_t size() const;
+
+	/** Print the jitter buffer state and statistics of each active call. */
+	void dump(std::ostream&) const;
+
+	private:
+
+	/**
+		Wait on the clock and the RTP sockets; drain ready sockets and service all TCHs each tick.
+		mLock is held only to pick the streams for a pass, not across their I/O.
+	*/
+	void serviceLoop();
+
+	/**
+		Move every waiting downlink RTP packet into the call's jitter buffer, without blocking.
+		@return True if anything was received.
+	*/
+	bool receive(MediaStream&);
+
+	/**
+		Play out the jitter buffer and move uplink frames for one call, without blocking.
+		@param maxQ The maximum jitter buffer depth, GSM.MaxSpeechLatency.
+		@return True if anything was transferred.
+	*/
+	bool transfer(MediaStream&, unsigned maxQ);
+
+	friend void *MediaEngineServiceLoopAdapter(MediaEngine*);
+
+
+/**
+	Keeps a call in a media engine for the life of the guard,
+	so the call leaves the engine however its scope exits, exceptions included.
+*/
+class MediaStreamGuard {
+
+	private:
+	MediaEngine& mEngine;
+	TransactionEntry* mTransaction;
+
+	public:
+	MediaStreamGuard(MediaEngine& wEngine, TransactionEntry* wTransaction, GSM::TCHFACCHLogicalChannel* TCH)
+		:mEngine(wEngine),mTransaction(wTransaction)
+		{ mEngine.add(mTransaction,TCH); }
+
+	~MediaStreamGuard() { mEngine.remove(mTransaction); }
+
+	private:
+	MediaStreamGuard(const MediaStreamGuard&);
+	MediaStreamGuard& operator=(const MediaStreamGuard&);
+};
+};
+
+
+void *MediaEngineServiceLoopAdapter(MediaEngine*);
+
+
+/**
+	Keeps a call in a media engine for the life of the guard,
+	so the call leaves the engine however its scope exits, exceptions included.
+*/
+class MediaStreamGuard {
+
+	private:
+	MediaEngine& mEngine;
+	TransactionEntry* mTransaction;
+
+	public:
+	MediaStreamGuard(MediaEngine& wEngine, TransactionEntry* wTransaction, GSM::TCHFACCHLogicalChannel* TCH)
+		:mEngine(wEngine),mTransaction(wTransaction)
+		{ mEngine.add(mTransaction,TCH); }
+
+	~MediaStreamGuard() { mEngine.remove(mTransaction); }
+
+	private:
+	MediaStreamGuard(const MediaStreamGuard&);
+	MediaStreamGuard& operator=(const MediaStreamGuard&);
+};
+
+
+}	// Control
+
+
+/**@addtogroup Globals */
+//@{
+/** The global media engine. */
+extern Control::MediaEngine gMediaEngine;
+//@}
+
+
+#endif
+
+// vim: ts=4 sw=4
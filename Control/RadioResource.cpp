@@ -32,6 +32,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <list>
+#include <vector>
+#include <algorithm>
 
 #include "ControlCommon.h"
 #include "TransactionTable.h"
@@ -58,6 +60,29 @@ using namespace Control;
 
 
 
+/** Configuration for the access grant stage, read once per batch. */
+struct AccessGrantParams {
+	int NECI;					///< GSM.CellSelection.NECI
+	bool VEA;					///< Control.VEA is defined
+	int maxAge;					///< oldest RACH burst worth answering, in frames
+	int maxDelay;				///< GSM.MS.TA.Max
+	unsigned AGCHQMax;			///< GSM.CCCH.AGCH.QMax
+	int SDCCHReserve;			///< GSM.Channels.SDCCHReserve
+
+	AccessGrantParams()
+	{
+		NECI = gConfig.getNum("GSM.CellSelection.NECI");
+		VEA = gConfig.defines("Control.VEA");
+		// See GSM 04.08 3.3.1.1.2 for the logic here.
+		unsigned txInteger = gConfig.getNum("GSM.RACH.TxInteger");
+		maxAge = GSM::RACHSpreadSlots[txInteger] + GSM::RACHWaitSParam[txInteger];
+		maxDelay = gConfig.getNum("GSM.MS.TA.Max");
+		AGCHQMax = gConfig.getNum("GSM.CCCH.AGCH.QMax");
+		SDCCHReserve = gConfig.getNum("GSM.Channels.SDCCHReserve");
+	}
+};
+
+
 /**
 	Determine the channel type needed.
 	This is based on GSM 04.08 9.1.8, Table 9.3 and 9.3a.
@@ -65,9 +90,10 @@ using namespace Control;
 	- We do not support call reestablishment.
 	- We do not support GPRS.
 	@param RA The request reference from the channel request message.
+	@param params The access grant configuration.
 	@return channel type code, undefined if not a supported service
 */
-ChannelType decodeChannelNeeded(unsigned RA)
+ChannelType decodeChannelNeeded(unsigned RA, const AccessGrantParams& params)
 {
 	// This code is based on GSM 04.08 Table 9.9.
 
@@ -83,13 +109,12 @@ ChannelType decodeChannelNeeded(unsigned RA)
 	if (RA4 == 0x02) return TCHFType;		// TCH/F
 	if (RA4 == 0x03) return TCHFType;		// TCH/F
 
-	int NECI = gConfig.getNum("GSM.CellSelection.NECI");
-	if (NECI==0) {
+	if (params.NECI==0) {
 		if (RA5 == 0x07) return SDCCHType;		// MOC or SDCCH procedures
 		if (RA5 == 0x00) return SDCCHType;		// location updating
 	} else {
-		assert(NECI==1);
-		if (gConfig.defines("Control.VEA")) {
+		assert(params.NECI==1);
+		if (params.VEA) {
 			// Very Early Assignment
 			if (RA5 == 0x07) return TCHFType;		// MOC for TCH/F
 			if (RA4 == 0x04) return TCHFType;		// MOC, TCH/H sufficient
@@ -109,21 +134,62 @@ ChannelType decodeChannelNeeded(unsigned RA)
 
 
 /** Return true if RA indicates LUR. */
-bool requestingLUR(unsigned RA)
+bool requestingLUR(unsigned RA, const AccessGrantParams& params)
 {
-	int NECI = gConfig.getNum("GSM.CellSelection.NECI");
-	if (NECI==0) return ((RA>>5) == 0x00);
+	if (params.NECI==0) return ((RA>>5) == 0x00);
 	 else return ((RA>>4) == 0x00);
 }
 
 
+/**
+	Priority classes for RACH bursts, highest first.
+	When the AGCH cannot take the whole batch, the lower classes are shed.
+*/
+enum AccessPriority {
+	EmergencyAccess,
+	PagingResponseAccess,
+	OtherAccess,
+	LURAccess
+};
+
+
+/** Classify a RACH burst by its establishment cause, GSM 04.08 Table 9.9. */
+AccessPriority accessPriority(unsigned RA, const AccessGrantParams& params)
+{
+	unsigned RA4 = RA>>4;
+	unsigned RA5 = RA>>5;
+	if (RA5 == 0x05) return EmergencyAccess;
+	if (RA5 == 0x04 || RA4 == 0x02 || RA4 == 0x03) return PagingResponseAccess;
+	if (params.NECI==0 && RA4 == 0x01) return PagingResponseAccess;
+	if (requestingLUR(RA,params)) return LURAccess;
+	return OtherAccess;
+}
+
+
+/** A RACH burst in a batch, ordered by priority class. */
+struct AccessRequest {
+	AccessPriority mPriority;
+	ChannelRequestRecord *mRecord;
+
+	AccessRequest(AccessPriority wPriority, ChannelRequestRecord *wRecord)
+		:mPriority(wPriority),mRecord(wRecord)
+	{ }
 
+	bool operator<(const AccessRequest& other) const
+		{ return mPriority < other.mPriority; }
+};
 
 
-/** Decode RACH bits and send an immediate assignment; may block waiting for a channel. */
-void AccessGrantResponder(
+
+/**
+	Decode RACH bits and send an immediate assignment or rejection.
+	The burst has already passed the hold-off and age checks.
+	@return false if the AGCH is congested, so nothing more should be answered in this block.
+*/
+bool AccessGrantResponder(
 		unsigned RA, const GSM::Time& when,
-		float RSSI, float timingError)
+		float RSSI, float timingError,
+		const AccessGrantParams& params)
 {
 	// RR Establishment.
 	// Immediate Assignment procedure, "Answer from the Network"
@@ -136,32 +202,10 @@ void AccessGrantResponder(
 	gReports.incr("OpenBTS.GSM.RR.RACH.TA.All",(int)(timingError));
 	gReports.incr("OpenBTS.GSM.RR.RACH.RA.All",RA);
 
-	// Are we holding off new allocations?
-	if (gBTS.hold()) {
-		LOG(NOTICE) << "ignoring RACH due to BTS hold-off";
-		return;
-	}
-
-	// Check "when" against current clock to see if we're too late.
-	// Calculate maximum number of frames of delay.
-	// See GSM 04.08 3.3.1.1.2 for the logic here.
-	static const unsigned txInteger = gConfig.getNum("GSM.RACH.TxInteger");
-	static const int maxAge = GSM::RACHSpreadSlots[txInteger] + GSM::RACHWaitSParam[txInteger];
-	// Check burst age.
-	int age = gBTS.time() - when;
-	LOG(INFO) << "RA=0x" << hex << RA << dec
-		<< " when=" << when << " age=" << age
-		<< " delay=" << timingError << " RSSI=" << RSSI;
-	if (age>maxAge) {
-		LOG(WARNING) << "ignoring RACH bust with age " << age;
-		gBTS.growT3122()/1000;
-		return;
-	}
-
 	// Screen for delay.
-	if (timingError>gConfig.getNum("GSM.MS.TA.Max")) {
+	if (timingError>params.maxDelay) {
 		LOG(WARNING) << "ignoring RACH burst with delay " << timingError;
-		return;
+		return true;
 	}
 
 	// Get an AGCH to send on.
@@ -169,29 +213,29 @@ void AccessGrantResponder(
 	// Someone had better have created a least one AGCH.
 	assert(AGCH);
 	// Check AGCH load now.
-	if (AGCH->load()>gConfig.getNum("GSM.CCCH.AGCH.QMax")) {
+	if (AGCH->load()>params.AGCHQMax) {
 		LOG(WARNING) "AGCH congestion";
-		return;
+		return false;
 	}
 
 	// Check for location update.
 	// This gives LUR a lower priority than other services.
-	if (requestingLUR(RA)) {
+	if (requestingLUR(RA,params)) {
 		// Don't answer this LUR if it will not leave enough channels open for other operations.
-		if ((int)gBTS.SDCCHAvailable()<=gConfig.getNum("GSM.Channels.SDCCHReserve")) {
+		if ((int)gBTS.SDCCHAvailable()<=params.SDCCHReserve) {
 			unsigned waitTime = gBTS.growT3122()/1000;
 			LOG(WARNING) << "LUR congestion, RA=" << RA << " T3122=" << waitTime;
 			const L3ImmediateAssignmentReject reject(L3RequestReference(RA,when),waitTime);
 			LOG(DEBUG) << "LUR rejection, sending " << reject;
 			AGCH->send(reject);
-			return;
+			return true;
 		}
 	}
 
 	// Allocate the channel according to the needed type indicated by RA.
 	// The returned channel is already open and ready for the transaction.
 	LogicalChannel *LCH = NULL;
-	switch (decodeChannelNeeded(RA)) {
+	switch (decodeChannelNeeded(RA,params)) {
 		case TCHFType: LCH = gBTS.getTCH(); break;
 		case SDCCHType: LCH = gBTS.getSDCCH(); break;
 		// If we don't support the service, assign to an SDCCH and we can reject it in L3.
@@ -213,7 +257,7 @@ void AccessGrantResponder(
 		const L3ImmediateAssignmentReject reject(L3RequestReference(RA,when),waitTime);
 		LOG(DEBUG) << "rejection, sending " << reject;
 		AGCH->send(reject);
-		return;
+		return true;
 	}
 
 	// Set the channel physical parameters from the RACH burst.
@@ -236,28 +280,88 @@ void AccessGrantResponder(
 
 	// On successful allocation, shrink T3122.
 	gBTS.shrinkT3122();
+	return true;
+}
+
+
+/**
+	Answer one CCCH block's worth of RACH bursts.
+	Stale bursts are dropped before anything else is done with them,
+	then the rest are answered in priority order until the AGCH fills up.
+	The records are not deleted here.
+*/
+void AccessGrantBatch(vector<ChannelRequestRecord*>& batch)
+{
+	static ReportingCounter& shedAge = gReports.counter("OpenBTS.GSM.RR.RACH.Shed.Age");
+	static ReportingCounter& shedCongestion = gReports.counter("OpenBTS.GSM.RR.RACH.Shed.Congestion");
+
+	// Are we holding off new allocations?
+	if (gBTS.hold()) {
+		LOG(NOTICE) << "ignoring " << batch.size() << " RACH bursts due to BTS hold-off";
+		return;
+	}
+
+	const AccessGrantParams params;
+
+	// Check each burst's age against the current clock to see if we're too late.
+	// The MS has stopped listening for an answer to these.
+	const GSM::Time now = gBTS.time();
+	vector<AccessRequest> live;
+	live.reserve(batch.size());
+	unsigned stale = 0;
+	for (unsigned i=0; i<batch.size(); i++) {
+		ChannelRequestRecord *req = batch[i];
+		int age = now - req->frame();
+		LOG(INFO) << "RA=0x" << hex << req->RA() << dec
+			<< " when=" << req->frame() << " age=" << age
+			<< " delay=" << req->timingError() << " RSSI=" << req->RSSI();
+		if (age>params.maxAge) {
+			stale++;
+			continue;
+		}
+		live.push_back(AccessRequest(accessPriority(req->RA(),params),req));
+	}
+	if (stale) {
+		LOG(WARNING) << "ignoring " << stale << " RACH bursts older than " << params.maxAge << " frames";
+		shedAge.incr(stale);
+		gBTS.growT3122();
+	}
+
+	// Highest priority first; arrival order within a class.
+	stable_sort(live.begin(),live.end());
+	for (unsigned i=0; i<live.size(); i++) {
+		const ChannelRequestRecord *req = live[i].mRecord;
+		if (AccessGrantResponder(req->RA(),req->frame(),req->RSSI(),req->timingError(),params)) continue;
+		unsigned shed = live.size() - i;
+		LOG(WARNING) << "AGCH congestion, shedding " << shed << " RACH bursts";
+		shedCongestion.incr(shed);
+		break;
+	}
 }
 
 
 
 void* Control::AccessGrantServiceLoop(void*)
 {
+	vector<ChannelRequestRecord*> batch;
 	while (true) {
+		// Block for the first request, then gather everything else
+		// that arrives before the next CCCH block goes out.
 		ChannelRequestRecord *req = gBTS.nextChannelRequest();
 		if (!req) continue;
-		AccessGrantResponder(
-			req->RA(), req->frame(),
-			req->RSSI(), req->timingError()
-		);
-		delete req;
+		batch.push_back(req);
+		gBTS.clock().wait(gBTS.time() + AccessGrantBatchFrames);
+		while (ChannelRequestRecord *req = gBTS.nextChannelRequestNoBlock())
+			batch.push_back(req);
+		AccessGrantBatch(batch);
+		for (unsigned i=0; i<batch.size(); i++) delete batch[i];
+		batch.clear();
 	}
 	return NULL;
 }
 
 
 
-
-
 void Control::PagingResponseHandler(const L3PagingResponse* resp, LogicalChannel* DCCH)
 {
 	assert(resp);
@@ -295,7 +399,7 @@ void Control::PagingResponseHandler(const L3PagingResponse* resp, LogicalChannel
 	// erased before this handler was called.  That's too bad.
 	// HACK -- We also flush stray transactions until we find what we 
 	// are looking for.
-	TransactionEntry* transaction = gTransactionTable.answeredPaging(mobileID);
+	TransactionRef transaction = gTransactionTable.answeredPaging(mobileID);
 	if (!transaction) {
 		LOG(WARNING) << "Paging Reponse with no transaction record for " << mobileID;
 		// Cause 0x41 means "call already cleared".
@@ -309,16 +413,16 @@ void Control::PagingResponseHandler(const L3PagingResponse* resp, LogicalChannel
 	// The transaction controller will take it from here.
 	switch (transaction->service().type()) {
 		case L3CMServiceType::MobileTerminatedCall:
-			MTCStarter(transaction, DCCH);
+			MTCStarter(transaction.get(), DCCH);
 			return;
 		case L3CMServiceType::MobileTerminatedShortMessage:
-			MTSMSController(transaction, DCCH);
+			MTSMSController(transaction.get(), DCCH);
 			return;
 		default:
 			// Flush stray MOC entries.
 			// There should not be any, but...
 			LOG(ERR) << "non-valid paging-state transaction: " << *transaction;
-			gTransactionTable.remove(transaction);
+			gTransactionTable.remove(transaction.get());
 			// FIXME -- Send a channel release on the DCCH.
 	}
 }
@@ -336,7 +440,7 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 	LOG(DEBUG) << *confirm;
 
 	// Check the transaction table to know what to do next.
-	TransactionEntry* transaction = gTransactionTable.find(TCH);
+	TransactionRef transaction = gTransactionTable.find(TCH);
 	if (!transaction) {
 		LOG(WARNING) << "No transaction matching channel " << *TCH << " (" << TCH << ").";
 		throw UnexpectedMessage();
@@ -346,10 +450,10 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 	// These "controller" functions don't return until the call is cleared.
 	switch (transaction->service().type()) {
 		case L3CMServiceType::MobileOriginatedCall:
-			MOCController(transaction,TCH);
+			MOCController(transaction.get(),TCH);
 			break;
 		case L3CMServiceType::MobileTerminatedCall:
-			MTCController(transaction,TCH);
+			MTCController(transaction.get(),TCH);
 			break;
 		default:
 			LOG(WARNING) << "unsupported service " << transaction->service();
@@ -365,27 +469,33 @@ void Control::AssignmentCompleteHandler(const L3AssignmentComplete *confirm, TCH
 
 
 
+unsigned PagingEntry::pagingGroup() const
+{
+	if (mIMSI.type()!=IMSIType) return 0;
+	return gBTS.pagingGroup(mIMSI.digits());
+}
+
+
+
 void Pager::addID(const L3MobileIdentity& newID, ChannelType chanType,
 		TransactionEntry& transaction, unsigned wLife)
 {
 	transaction.GSMState(GSM::Paging);
-	transaction.setTimer("3113",wLife);
+	transaction.setTimer(T3113,wLife);
 	// Add a mobile ID to the paging list for a given lifetime.
 	ScopedLock lock(mLock);
 	// If this ID is already in the list, just reset its timer.
-	// Uhg, another linear time search.
-	// This would be faster if the paging list were ordered by ID.
-	// But the list should usually be short, so it may not be worth the effort.
-	for (PagingEntryList::iterator lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
-		if (lp->ID()==newID) {
-			LOG(DEBUG) << newID << " already in table";
-			lp->renew(wLife);
-			mPageSignal.signal();
-			return;
-		}
+	PagingEntryMap::iterator lp = mPageIDs.find(newID);
+	if (lp != mPageIDs.end()) {
+		LOG(DEBUG) << newID << " already in table";
+		lp->second.renew(wLife);
+		mPageSignal.signal();
+		return;
 	}
 	// If this ID is new, put it in the list.
-	mPageIDs.push_back(PagingEntry(newID,chanType,transaction.ID(),wLife));
+	// The paging group comes from the IMSI, even if we page by TMSI.
+	const L3MobileIdentity& IMSI = (newID.type()==IMSIType) ? newID : transaction.subscriber();
+	mPageIDs.insert(PagingEntryMap::value_type(newID,PagingEntry(newID,IMSI,chanType,transaction.ID(),wLife)));
 	LOG(INFO) << newID << " added to table";
 	mPageSignal.signal();
 }
@@ -396,14 +506,11 @@ unsigned Pager::removeID(const L3MobileIdentity& delID)
 	// Return the associated transaction ID, or 0 if none found.
 	LOG(INFO) << delID;
 	ScopedLock lock(mLock);
-	for (PagingEntryList::iterator lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
-		if (lp->ID()==delID) {
-			unsigned retVal = lp->transactionID();
-			mPageIDs.erase(lp);
-			return retVal;
-		}
-	}
-	return 0;
+	PagingEntryMap::iterator lp = mPageIDs.find(delID);
+	if (lp == mPageIDs.end()) return 0;
+	unsigned retVal = lp->second.transactionID();
+	mPageIDs.erase(lp);
+	return retVal;
 }
 
 
@@ -413,57 +520,106 @@ unsigned Pager::pageAll()
 	// Traverse the full list and page all IDs.
 	// Remove expired IDs.
 	// Return the number of IDs paged.
-	// This is a linear time operation.
 
 	ScopedLock lock(mLock);
 
 	// Clear expired entries.
-	PagingEntryList::iterator lp = mPageIDs.begin();
+	PagingEntryMap::iterator lp = mPageIDs.begin();
 	while (lp != mPageIDs.end()) {
-		bool expired = lp->expired();
-		bool defunct = gTransactionTable.find(lp->transactionID()) == NULL;
+		bool expired = lp->second.expired();
+		bool defunct = !gTransactionTable.find(lp->second.transactionID());
 		if (!expired && !defunct) ++lp;
 		else {
-			LOG(INFO) << "erasing " << lp->ID();
+			LOG(INFO) << "erasing " << lp->first;
 			// Non-responsive, dead transaction?
-			gTransactionTable.removePaging(lp->transactionID());
+			gTransactionTable.removePaging(lp->second.transactionID());
 			// remove from the list
-			lp=mPageIDs.erase(lp);
+			mPageIDs.erase(lp++);
 		}
 	}
 
 	LOG(INFO) << "paging " << mPageIDs.size() << " mobile(s)";
 
-	// Page remaining entries, two at a time if possible.
+	// Sort the remaining entries into paging groups, GSM 05.02 6.5.2.
+	// A mobile only listens to its own paging block, so each page goes out once,
+	// in the right block of the right multiframe.
+	unsigned numGroups = gBTS.pagingGroups();
+	std::vector< std::vector<const PagingEntry*> > TMSIs(numGroups);
+	std::vector< std::vector<const PagingEntry*> > others(numGroups);
+	for (lp = mPageIDs.begin(); lp != mPageIDs.end(); ++lp) {
+		const PagingEntry& entry = lp->second;
+		unsigned group = entry.pagingGroup();
+		if (entry.ID().type()==TMSIType) TMSIs[group].push_back(&entry);
+		else others[group].push_back(&entry);
+	}
+
 	// These PCH send operations are non-blocking.
-	lp = mPageIDs.begin();
-	while (lp != mPageIDs.end()) {
-		// FIXME -- This completely ignores the paging groups.
-		// HACK -- So we send every page twice.
-		// That will probably mean a different Pager for each subchannel.
-		// See GSM 04.08 10.5.2.11 and GSM 05.02 6.5.2.
-		const L3MobileIdentity& id1 = lp->ID();
-		ChannelType type1 = lp->type();
-		++lp;
-		if (lp==mPageIDs.end()) {
-			// Just one ID left?
-			LOG(DEBUG) << "paging " << id1;
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1));
-			break;
-		}
-		// Page by pairs when possible.
-		const L3MobileIdentity& id2 = lp->ID();
-		ChannelType type2 = lp->type();
-		++lp;
-		LOG(DEBUG) << "paging " << id1 << " and " << id2;
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
-		gBTS.getPCH(0)->send(L3PagingRequestType1(id1,type1,id2,type2));
+	for (unsigned group=0; group<numGroups; group++) {
+		if (TMSIs[group].size()==0 && others[group].size()==0) continue;
+		pageGroup(group,TMSIs[group],others[group]);
 	}
 
 	return mPageIDs.size();
 }
 
+
+void Pager::pageGroup(unsigned group,
+		const std::vector<const PagingEntry*>& TMSIs,
+		const std::vector<const PagingEntry*>& others)
+{
+	unsigned multiframe = gBTS.pagingMultiframe(group);
+	CCCHLogicalChannel *PCH = gBTS.getPCH(gBTS.pagingBlock(group) % gBTS.numPCHs());
+	LOG(DEBUG) << "paging group " << group << ": " << TMSIs.size() << " TMSI(s), " << others.size() << " other(s)";
+
+	size_t t = 0;
+	size_t o = 0;
+
+	// Type 3: 4 TMSIs.
+	while (TMSIs.size()-t >= 4) {
+		PCH->sendPage(L3PagingRequestType3(
+			TMSIs[t]->ID(),TMSIs[t]->type(),
+			TMSIs[t+1]->ID(),TMSIs[t+1]->type(),
+			TMSIs[t+2]->ID(),TMSIs[t+2]->type(),
+			TMSIs[t+3]->ID(),TMSIs[t+3]->type()),
+			multiframe);
+		t += 4;
+	}
+
+	// Type 2: 2 TMSIs, plus one more ID of any type.
+	if (TMSIs.size()-t >= 2) {
+		const PagingEntry *third = NULL;
+		if (TMSIs.size()-t == 3) third = TMSIs[t+2];
+		else if (o<others.size()) third = others[o++];
+		if (third) {
+			PCH->sendPage(L3PagingRequestType2(
+				TMSIs[t]->ID(),TMSIs[t]->type(),
+				TMSIs[t+1]->ID(),TMSIs[t+1]->type(),
+				third->ID(),third->type()),
+				multiframe);
+		} else {
+			PCH->sendPage(L3PagingRequestType2(
+				TMSIs[t]->ID(),TMSIs[t]->type(),
+				TMSIs[t+1]->ID(),TMSIs[t+1]->type()),
+				multiframe);
+		}
+		t = TMSIs.size();
+	}
+
+	// Type 1: whatever is left, 2 at a time.
+	std::vector<const PagingEntry*> rest(TMSIs.begin()+t,TMSIs.end());
+	rest.insert(rest.end(),others.begin()+o,others.end());
+	for (size_t i=0; i<rest.size(); i+=2) {
+		if (i+1==rest.size()) {
+			PCH->sendPage(L3PagingRequestType1(rest[i]->ID(),rest[i]->type()),multiframe);
+			break;
+		}
+		PCH->sendPage(L3PagingRequestType1(
+			rest[i]->ID(),rest[i]->type(),
+			rest[i+1]->ID(),rest[i+1]->type()),
+			multiframe);
+	}
+}
+
 size_t Pager::pagingEntryListSize()
 {
 	ScopedLock lock(mLock);
@@ -497,11 +653,15 @@ void Pager::serviceLoop()
 		// page everything
 		pageAll();
 
-		// Wait for pending activity to clear the channel.
-		// This wait is what causes PCH to have lower priority than AGCH.
-		unsigned load = gBTS.getPCH()->load();
-		LOG(DEBUG) << "Pager waiting for " << load << " multiframes";
-		if (load) sleepFrames(51*load);
+		// Every paging group gets one block per paging cycle,
+		// so wait at least one full cycle before paging again,
+		// and then longer if the PCHs are still backed up.
+		// This wait is also what causes PCH to have lower priority than AGCH.
+		unsigned cycle = gBTS.pagingMultiframes();
+		sleepFrames(51*cycle);
+		unsigned load = gBTS.PCHLoad();
+		LOG(DEBUG) << "Pager waiting for " << load << " queued frames";
+		if (load) sleepFrames(51*cycle*load/gBTS.pagingBlocks());
 	}
 }
 
@@ -510,9 +670,10 @@ void Pager::serviceLoop()
 void Pager::dump(ostream& os) const
 {
 	ScopedLock lock(mLock);
-	PagingEntryList::const_iterator lp = mPageIDs.begin();
+	PagingEntryMap::const_iterator lp = mPageIDs.begin();
 	while (lp != mPageIDs.end()) {
-		os << lp->ID() << " " << lp->type() << " " << lp->expired() << endl;
+		const PagingEntry& entry = lp->second;
+		os << entry.ID() << " " << entry.type() << " " << entry.expired() << " group=" << entry.pagingGroup() << endl;
 		++lp;
 	}
 }
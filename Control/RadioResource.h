@@ -29,6 +29,8 @@
 #define RADIORESOURCE_H
 
 #include <list>
+#include <map>
+#include <vector>
 #include <GSML3CommonElements.h>
 
 
@@ -90,7 +92,14 @@ class ChannelRequestRecord {
 };
 
 
-/** A thread to process contents of the channel request queue. */
+/**
+	Frames to gather RACH bursts before answering them as a batch.
+	This is one CCCH block, the granularity of the AGCH anyway.
+*/
+const unsigned AccessGrantBatchFrames = 4;
+
+
+/** A thread to process contents of the channel request queue, one batch per CCCH block. */
 void* AccessGrantServiceLoop(void*);
 
 
@@ -105,6 +114,7 @@ class PagingEntry {
 	private:
 
 	GSM::L3MobileIdentity mID;		///< The mobile ID.
+	GSM::L3MobileIdentity mIMSI;	///< The IMSI, if known, for the paging group.
 	GSM::ChannelType mType;			///< The needed channel type.
 	unsigned mTransactionID;		///< The associated transaction ID.
 	Timeval mExpiration;			///< The expiration time for this entry.
@@ -114,16 +124,23 @@ class PagingEntry {
 	/**
 		Create a new entry, with current timestamp.
 		@param wID The ID to be paged.
+		@param wIMSI The subscriber IMSI, used to find the paging group.
 		@param wLife The number of milliseconds to keep paging.
 	*/
-	PagingEntry(const GSM::L3MobileIdentity& wID, GSM::ChannelType wType,
-			unsigned wTransactionID, unsigned wLife)
-		:mID(wID),mType(wType),mTransactionID(wTransactionID),mExpiration(wLife)
+	PagingEntry(const GSM::L3MobileIdentity& wID, const GSM::L3MobileIdentity& wIMSI,
+			GSM::ChannelType wType, unsigned wTransactionID, unsigned wLife)
+		:mID(wID),mIMSI(wIMSI),mType(wType),mTransactionID(wTransactionID),mExpiration(wLife)
 	{}
 
 	/** Access the ID. */
 	const GSM::L3MobileIdentity& ID() const { return mID; }
 
+	/**
+		Return the paging group of this mobile, GSM 05.02 6.5.2.
+		Mobiles with no known IMSI are put in group 0.
+	*/
+	unsigned pagingGroup() const;
+
 	/** Access the channel type needed. */
 	GSM::ChannelType type() const { return mType; }
 
@@ -137,21 +154,22 @@ class PagingEntry {
 
 };
 
-typedef std::list<PagingEntry> PagingEntryList;
+typedef std::map<GSM::L3MobileIdentity,PagingEntry> PagingEntryMap;
 
 
 /**
 	The pager is a global object that generates paging messages on the CCCH.
 	To page a mobile, add the mobile ID to the pager.
 	The entry will be deleted automatically when it expires.
-	All pager operations are linear time.
-	Not much point in optimizing since the main operation is inherently linear.
+	Entries are indexed by mobile ID, so addID and removeID are log-time.
+	Each pass of pageAll sorts the entries into paging groups
+	and packs each group into as few paging requests as possible.
 */
 class Pager {
 
 	private:
 
-	PagingEntryList mPageIDs;				///< List of ID's to be paged.
+	PagingEntryMap mPageIDs;				///< IDs to be paged, indexed by ID.
 	mutable Mutex mLock;					///< Lock for thread-safe access.
 	Signal mPageSignal;						///< signal to wake the paging loop
 	Thread mPagingThread;					///< Thread for the paging loop.
@@ -195,6 +213,18 @@ class Pager {
 	*/
 	unsigned pageAll();
 
+	/**
+		Pack one paging group into paging requests and queue them on its PCH.
+		TMSIs go 4 per Type 3 request, then 2 (plus one other ID) per Type 2;
+		what remains goes 2 per Type 1 request.
+		@param group The paging group.
+		@param TMSIs Entries with TMSI identities.
+		@param others Entries with other identities.
+	*/
+	void pageGroup(unsigned group,
+		const std::vector<const PagingEntry*>& TMSIs,
+		const std::vector<const PagingEntry*>& others);
+
 	/** A loop that repeatedly calls pageAll. */
 	void serviceLoop();
 
@@ -203,7 +233,7 @@ class Pager {
 
 public:
 
-	/** return size of PagingEntryList */
+	/** return number of IDs being paged */
 	size_t pagingEntryListSize();
 
 	/** Dump the paging list to an ostream. */
@@ -49,6 +49,7 @@
 #include "ControlCommon.h"
 #include "TransactionTable.h"
 #include "RRLPServer.h"
+#include "SMSQueue.h"
 #include <Regexp.h>
 #include <Reporting.h>
 
@@ -58,6 +59,7 @@ using namespace std;
 using namespace Control;
 
 #include "SMSMessages.h"
+#include "SMSCodec.h"
 using namespace SMS;
 
 #include "SIPInterface.h"
@@ -118,46 +120,70 @@ bool sendSIP(TransactionEntry *transaction, const char* address, const char* bod
 	return state==SIP::Cleared;
 }
 
+/** Send an RPDU already written after the CP-DATA header in CPDU. */
+static void sendCPData(GSM::LogicalChannel *LCH, unsigned L3TI, unsigned char *CPDU, size_t RPDULength)
+{
+	size_t length = writeCPData(CPDU,L3TI,RPDULength);
+	LCH->send(GSM::L3Frame((const char*)CPDU,length),3);
+}
+
+/** Send CP-DATA containing RP-ACK. */
+static void sendRPAck(GSM::LogicalChannel *LCH, unsigned L3TI, unsigned ref)
+{
+	unsigned char CPDU[CPDataHeaderLength+2];
+	size_t RPDULength = writeRPAck(CPDU+CPDataHeaderLength,2,ref);
+	sendCPData(LCH,L3TI,CPDU,RPDULength);
+}
+
+/** Send CP-DATA containing RP-ERROR. */
+static void sendRPError(GSM::LogicalChannel *LCH, unsigned L3TI, unsigned cause, unsigned ref)
+{
+	unsigned char CPDU[CPDataHeaderLength+4];
+	size_t RPDULength = writeRPError(CPDU+CPDataHeaderLength,4,cause,ref);
+	sendCPData(LCH,L3TI,CPDU,RPDULength);
+}
+
+
 /**
 	Process the RPDU.
-	@param mobileID The sender's IMSI.
-	@param RPDU The RPDU to process.
+	@param transaction The MO-SMS transaction.
+	@param RPDU The RPDU to process, parsed in place.
 	@return true if successful.
 */
-bool handleRPDU(TransactionEntry *transaction, const RLFrame& RPDU)
+bool handleRPDU(TransactionEntry *transaction, const RPDUView& RPDU)
 {
-	LOG(DEBUG) << "SMS: handleRPDU MTI=" << RPDU.MTI();
-	switch ((RPMessage::MessageType)RPDU.MTI()) {
+	LOG(DEBUG) << "SMS: handleRPDU MTI=" << RPDU.mMTI;
+	switch ((RPMessage::MessageType)RPDU.mMTI) {
 		case RPMessage::Data: {
 			string contentType = gConfig.getStr("SMS.MIMEType");
-			ostringstream body;
+			// Big enough for the hex form of the largest RPDU.
+			char body[2*SMSMaxRPDU+1];
+			body[0] = '\0';
+
+			// Parse the TPDU only once, and only if we need it.
+			string SMSC;
+			const char* address = NULL;
+			if (gConfig.defines("SIP.SMSC")) {
+				SMSC = gConfig.getStr("SIP.SMSC");
+				address = SMSC.c_str();
+			}
+			TLSubmitView submit;
+			if (contentType == "text/plain" || address == NULL) {
+				if (!parseTLSubmit(RPDU.mTPDU,RPDU.mTPDULength,submit)) SMS_READ_ERROR;
+				LOG(INFO) << "SMS " << submit;
+			}
 
 			if (contentType == "text/plain") {
-				// TODO: Clean this mess up!
-				RPData data;
-				data.parse(RPDU);
-				TLSubmit submit;
-				submit.parse(data.TPDU());
-				
-				body << submit.UD().decode();
+				if (decodeText(submit,body)<0) SMS_READ_ERROR;
 			} else if (contentType == "application/vnd.3gpp.sms") {
-				RPDU.hex(body);
+				octetsToHex(RPDU.mRPDU,RPDU.mLength,body);
 			} else {
 				LOG(ALERT) << "\"" << contentType << "\" is not a valid SMS payload type";
 			}
-			const char* address = NULL;
-			if (gConfig.defines("SIP.SMSC")) address = gConfig.getStr("SIP.SMSC").c_str();
 
 			/* The SMSC is not defined, we are using an older version */
-			if (address == NULL) {
-				RPData data;
-				data.parse(RPDU);
-				TLSubmit submit;
-				submit.parse(data.TPDU());
-
-				address = submit.DA().addressValue();
-			}
-			return sendSIP(transaction, address, body.str().data(),contentType.c_str());
+			if (address == NULL) address = submit.mDA.mDigits;
+			return sendSIP(transaction, address, body, contentType.c_str());
 		}
 		case RPMessage::Ack:
 		case RPMessage::SMMA:
@@ -237,44 +263,37 @@ void Control::MOSMSController(const GSM::L3CMServiceRequest *req, GSM::LogicalCh
 
 	// Parse the message in CM and process RP part.
 	// This is where we actually parse the message and send it out.
-	// FIXME -- We need to set the message ref correctly,
-	// even if the parsing fails.
-	// The compiler gives a warning here.  Let it.  It will remind someone to fix it.
-	unsigned ref;
+	// The RPDU is parsed in place in CPDU, so CPDU must outlive it.
+	unsigned char CPDU[SMSMaxCPDU];
+	RPDUView RPDU;
+	bool parsed = parseCPData(*CM,CPDU,RPDU);
+	delete CM;
+	// If the parse failed, this is as much of the reference as we could get.
+	unsigned ref = RPDU.mReference;
 	bool success = false;
 	try {
-		CPData data;
-		data.parse(*CM);
-		LOG(INFO) << "CPData " << data;
-		// Transfer out the RPDU -> TPDU -> delivery.
-		ref = data.RPDU().reference();
+		if (!parsed) SMS_READ_ERROR;
+		LOG(INFO) << "RPDU " << RPDU;
 		// This handler invokes higher-layer parsers, too.
-		success = handleRPDU(transaction,data.RPDU());
+		success = handleRPDU(transaction,RPDU);
 	}
 	catch (SMSReadError) {
 		LOG(WARNING) << "SMS parsing failed (above L3)";
 		// Cause 95, "semantically incorrect message".
-		LCH->send(CPData(L3TI,RPError(95,ref)),3);
-		delete CM;
+		sendRPError(LCH,L3TI,95,ref);
 		throw UnexpectedMessage();
 	}
-	catch (GSM::L3ReadError) {
-		LOG(WARNING) << "SMS parsing failed (in L3)";
-		delete CM;
-		throw UnsupportedMessage();
-	}
-	delete CM;
 
 	// Step 3
 	// Send CP-DATA containing RP-ACK and message reference.
 	if (success) {
 		LOG(INFO) << "sending RPAck in CPData";
-		LCH->send(CPData(L3TI,RPAck(ref)),3);
+		sendRPAck(LCH,L3TI,ref);
 	} else {
 		LOG(INFO) << "sending RPError in CPData";
 		// Cause 127 is "internetworking error, unspecified".
 		// See GSM 04.11 Table 8.4.
-		LCH->send(CPData(L3TI,RPError(127,ref)),3);
+		sendRPError(LCH,L3TI,127,ref);
 	}
 
 	// Step 4
@@ -320,74 +339,48 @@ bool Control::deliverSMSToMS(const char *callingPartyDigits, const char* message
 		delete getFrameSMS(LCH,GSM::ESTABLISH);
 	}
 
-#if 0
-	// HACK -- Check for "Easter Eggs"
-	// TL-PID
-	unsigned TLPID=0;
-	if (strncmp(message,"#!TLPID",7)==0) sscanf(message,"#!TLPID%d",&TLPID);
-
 	// Step 1
 	// Send the first message.
 	// CP-DATA, containing RP-DATA.
-	unsigned reference = random() % 255;
-	CPData deliver(L3TI,
-		RPData(reference,
-			RPAddress(gConfig.getStr("SMS.FakeSrcSMSC").c_str()),
-			TLDeliver(callingPartyDigits,message,TLPID)));
-#else
 	// TODO: Read MIME Type from smqueue!!
 	unsigned reference = random() % 255;
-	RPData rp_data;
+	// The RPDU is written in place after the CP-DATA header.
+	unsigned char CPDU[SMSMaxCPDU];
+	unsigned char *RPDU = CPDU + CPDataHeaderLength;
+	size_t RPDULength = 0;
 
 	if (strncmp(contentType,"text/plain",10)==0) {
-		rp_data = RPData(reference,
-			RPAddress(gConfig.getStr("SMS.FakeSrcSMSC").c_str()),
-			TLDeliver(callingPartyDigits,message,0));
+		RPDULength = writeRPDeliver(RPDU,SMSMaxRPDU,reference,
+			gConfig.getStr("SMS.FakeSrcSMSC").c_str(),callingPartyDigits,message,0);
+		if (!RPDULength) {
+			LOG(WARNING) << "SMS does not fit in one RP-DATA (in incoming SIP MESSAGE)";
+			throw UnexpectedMessage();
+		}
 	} else if (strncmp(contentType,"application/vnd.3gpp.sms",24)==0) {
-		BitVector RPDUbits(strlen(message)*4);
-		if (!RPDUbits.unhex(message)) {
+		RPDULength = hexToOctets(message,RPDU,SMSMaxRPDU);
+		if (!RPDULength) {
 			LOG(WARNING) << "Hex string parsing failed (in incoming SIP MESSAGE)";
 			throw UnexpectedMessage();
 		}
-
-		try {
-			RLFrame RPDU(RPDUbits);
-			LOG(DEBUG) << "SMS RPDU: " << RPDU;
-
-			rp_data.parse(RPDU);
-			LOG(DEBUG) << "SMS RP-DATA " << rp_data;
-		}
-		catch (SMSReadError) {
+		RPDUView view;
+		if (!parseRPDU(RPDU,RPDULength,view) || view.mMTI!=RPMessage::Data) {
 			LOG(WARNING) << "SMS parsing failed (above L3)";
 			// Cause 95, "semantically incorrect message".
-			LCH->send(CPData(L3TI,RPError(95,reference)),3);
+			sendRPError(LCH,L3TI,95,reference);
 			throw UnexpectedMessage();
 		}
-		catch (GSM::L3ReadError) {
-			LOG(WARNING) << "SMS parsing failed (in L3)";
-			// TODO:: send error back to the phone
-			throw UnsupportedMessage();
-		}
+		LOG(DEBUG) << "SMS RPDU " << view;
+		// Whatever the SMSC sent, this goes network to MS.
+		RPDU[0] = RPMessage::Data + 1;
 	} else {
 		LOG(WARNING) << "Unsupported content type (in incoming SIP MESSAGE) -- type: " << contentType;
 		throw UnexpectedMessage();
 	}
 
-	CPData deliver(L3TI,rp_data);
-
-#endif
-
 	gReports.incr("OpenBTS.GSM.SMS.MTSMS.Start");
 
-	// Start ABM in SAP3.
-	//LCH->send(GSM::ESTABLISH,3);
-	// Wait for SAP3 ABM to connect.
-	// The next read on SAP3 should the ESTABLISH primitive.
-	// This won't return NULL.  It will throw an exception if it fails.
-	//delete getFrameSMS(LCH,GSM::ESTABLISH);
-
-	LOG(INFO) << "sending " << deliver;
-	LCH->send(deliver,3);
+	LOG(INFO) << "sending RP-DATA ref=" << reference << " length=" << RPDULength;
+	sendCPData(LCH,L3TI,CPDU,RPDULength);
 
 	// Step 2
 	// Get the CP-ACK.
@@ -417,28 +410,23 @@ bool Control::deliverSMSToMS(const char *callingPartyDigits, const char* message
 	// FIXME -- Check L3 TI.
 
 	// Parse to check for RP-ACK.
-	CPData data;
-	try {
-		data.parse(*CM);
-		LOG(DEBUG) << "CPData " << data;
-	}
-	catch (SMSReadError) {
+	// This reuses CPDU; we are done with the RP-DATA.
+	RPDUView reply;
+	bool parsed = parseCPData(*CM,CPDU,reply);
+	delete CM;
+	if (!parsed) {
 		LOG(WARNING) << "SMS parsing failed (above L3)";
 		// Cause 95, "semantically incorrect message".
 		LCH->send(CPError(L3TI,95),3);
 		throw UnexpectedMessage();
 	}
-	catch (GSM::L3ReadError) {
-		LOG(WARNING) << "SMS parsing failed (in L3)";
-		throw UnsupportedMessage();
-	}
-	delete CM;
+	LOG(DEBUG) << "RPDU " << reply;
 
 	// FIXME -- Check SMS reference.
 
 	bool success = true;
-	if (data.RPDU().MTI()!=RPMessage::Ack) {
-		LOG(WARNING) << "unexpected RPDU " << data.RPDU();
+	if (reply.mMTI!=RPMessage::Ack) {
+		LOG(WARNING) << "unexpected RPDU " << reply;
 		success = false;
 	}
 
@@ -492,17 +480,30 @@ void Control::MTSMSController(TransactionEntry *transaction, GSM::LogicalChannel
 	bool success = deliverSMSToMS(transaction->calling().digits(),transaction->message(),
 								transaction->messageType(),transaction->L3TI(),LCH);
 
+	// Ack in SIP domain.
+	// Messages from the SMS queue were accepted on SIP already; report to the queue instead.
+	if (success) transaction->MTSMSSendOK();
+	gSMSQueue.result(transaction->ID(),success);
+	GSM::L3MobileIdentity subscriber = transaction->subscriber();
+	gTransactionTable.remove(transaction);
+
+	// Deliver anything else queued for this subscriber while we have the channel,
+	// rather than releasing it and paging again.
+	while (success) {
+		transaction = gSMSQueue.next(subscriber,LCH);
+		if (!transaction) break;
+		LOG(INFO) << "transaction: "<< *transaction;
+		success = deliverSMSToMS(transaction->calling().digits(),transaction->message(),
+								transaction->messageType(),transaction->L3TI(),LCH);
+		gSMSQueue.result(transaction->ID(),success);
+		gTransactionTable.remove(transaction);
+	}
+
 	// Close the Dm channel?
 	if (LCH->type()!=GSM::SACCHType) {
 		LCH->send(GSM::L3ChannelRelease());
 		LOG(INFO) << "closing the Um channel";
 	}
-
-	// Ack in SIP domain.
-	if (success) transaction->MTSMSSendOK();
-
-	// Done.
-	gTransactionTable.remove(transaction);
 }
 
 
@@ -561,43 +562,38 @@ void Control::InCallMOSMSController(const CPData *cpData, TransactionEntry* tran
 	LOG(INFO) << "sending CPAck";
 	LCH->send(CPAck(L3TI),3);
 
-	// Parse the message in CM and process RP part.
+	// Parse the RP part and process it.
 	// This is where we actually parse the message and send it out.
-	// FIXME -- We need to set the message ref correctly,
-	// even if the parsing fails.
-	// The compiler gives a warning here.  Let it.  It will remind someone to fix it.
-	unsigned ref;
+	// The RPDU is parsed in place in RPDUBuffer, so RPDUBuffer must outlive it.
+	unsigned char RPDUBuffer[SMSMaxRPDU];
+	RPDUView RPDU;
+	bool parsed = parseRPDU(cpData->RPDU(),RPDUBuffer,RPDU);
+	// If the parse failed, this is as much of the reference as we could get.
+	unsigned ref = RPDU.mReference;
 	bool success = false;
 	try {
-		CPData data;
-		data.parse(*cpData);
-		LOG(INFO) << "CPData " << data;
-		// Transfer out the RPDU -> TPDU -> delivery.
-		ref = data.RPDU().reference();
+		if (!parsed) SMS_READ_ERROR;
+		LOG(INFO) << "RPDU " << RPDU;
 		// This handler invokes higher-layer parsers, too.
-		success = handleRPDU(transaction,data.RPDU());
+		success = handleRPDU(transaction,RPDU);
 	}
 	catch (SMSReadError) {
 		LOG(WARNING) << "SMS parsing failed (above L3)";
 		// Cause 95, "semantically incorrect message".
-		LCH->send(CPData(L3TI,RPError(95,ref)),3);
+		sendRPError(LCH,L3TI,95,ref);
 		throw UnexpectedMessage(transaction->ID());
 	}
-	catch (GSM::L3ReadError) {
-		LOG(WARNING) << "SMS parsing failed (in L3)";
-		throw UnsupportedMessage(transaction->ID());
-	}
 
 	// Step 3
 	// Send CP-DATA containing RP-ACK and message reference.
 	if (success) {
 		LOG(INFO) << "sending RPAck in CPData";
-		LCH->send(CPData(L3TI,RPAck(ref)),3);
+		sendRPAck(LCH,L3TI,ref);
 	} else {
 		LOG(INFO) << "sending RPError in CPData";
 		// Cause 127 is "internetworking error, unspecified".
 		// See GSM 04.11 Table 8.4.
-		LCH->send(CPData(L3TI,RPError(127,ref)),3);
+		sendRPError(LCH,L3TI,127,ref);
 	}
 
 	// Step 4
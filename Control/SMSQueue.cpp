@@ -0,0 +1,418 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "SMSQueue.h"
+#include "ControlCommon.h"
+#include "TransactionTable.h"
+#include "CallControl.h"
+
+#include <Logger.h>
+#include <Globals.h>
+#include <Reporting.h>
+#include <sqlite3.h>
+#include <sqlite3util.h>
+
+#include <GSMConfig.h>
+#include <GSMLogicalChannel.h>
+
+#include <string.h>
+
+
+using namespace std;
+using namespace Control;
+
+
+/** Record states in SMS_QUEUE. */
+enum SMSQueueState {
+	SMSPending = 0,
+	SMSDelivered = 1,
+	SMSFailed = 2
+};
+
+
+static const char* createSMSQueue = {
+	"CREATE TABLE IF NOT EXISTS SMS_QUEUE ("
+		"ID INTEGER PRIMARY KEY AUTOINCREMENT, "
+		"CREATED INTEGER NOT NULL, "			// Unix time the message was accepted
+		"IMSI TEXT NOT NULL, "					// recipient
+		"CALL_ID TEXT UNIQUE NOT NULL, "		// SIP call ID of the MESSAGE
+		"CALLER TEXT, "							// sender address
+		"CONTENT_TYPE TEXT, "					// MIME type of the body
+		"BODY BLOB, "							// message body from the SIP MESSAGE
+		"STATE INTEGER DEFAULT 0, "				// SMSQueueState
+		"ATTEMPTS INTEGER DEFAULT 0, "			// delivery attempts so far
+		"NEXT_ATTEMPT INTEGER DEFAULT 0, "		// Unix time of the next attempt
+		"FINISHED INTEGER "						// Unix time of delivery or failure
+	")"
+};
+
+
+
+int SMSQueue::open(const char* wPath)
+{
+	int rc = sqlite3_open(wPath,&mDB);
+	if (rc) {
+		LOG(EMERG) << "Cannot open SMS queue database at " << wPath << ": " << sqlite3_errmsg(mDB);
+		sqlite3_close(mDB);
+		mDB = NULL;
+		return 1;
+	}
+	if (!sqlite3_setup(mDB)) {
+		LOG(WARNING) << "Cannot set WAL mode or busy timeout on SMS queue";
+	}
+	if (!sqlite3_command(mDB,createSMSQueue)) {
+		LOG(EMERG) << "Cannot create SMS queue table";
+		close();
+		return 1;
+	}
+	if (sqlite3_prepare_statement(mDB,&mInsertStmt,
+			"INSERT OR IGNORE INTO SMS_QUEUE (CREATED,IMSI,CALL_ID,CALLER,CONTENT_TYPE,BODY) "
+			"VALUES (?,?,?,?,?,?)")) {
+		LOG(EMERG) << "Cannot prepare SMS queue insert";
+		close();
+		return 1;
+	}
+	if (sqlite3_prepare_statement(mDB,&mUpdateStmt,
+			"UPDATE SMS_QUEUE SET STATE=?,ATTEMPTS=?,NEXT_ATTEMPT=?,FINISHED=? WHERE ID=?")) {
+		LOG(EMERG) << "Cannot prepare SMS queue update";
+		close();
+		return 1;
+	}
+
+	// Drop old delivery reports.
+	char query[200];
+	sprintf(query,"DELETE FROM SMS_QUEUE WHERE STATE!=%u AND FINISHED<%lu",
+		SMSPending, (unsigned long)(time(NULL)-SMSQueueRetention));
+	if (!sqlite3_command(mDB,query)) LOG(WARNING) << "Cannot purge SMS queue";
+
+	// Load whatever was pending at the last shutdown.
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(mDB,&stmt,
+			"SELECT ID,IMSI,CALL_ID,CALLER,CONTENT_TYPE,BODY,ATTEMPTS,NEXT_ATTEMPT "
+			"FROM SMS_QUEUE WHERE STATE=0 ORDER BY ID")) {
+		LOG(EMERG) << "Cannot load SMS queue";
+		close();
+		return 1;
+	}
+	mLock.lock();
+	while (sqlite3_run_query(mDB,stmt)==SQLITE_ROW) {
+		QueuedSMS sms;
+		sms.mID = (unsigned)sqlite3_column_int64(stmt,0);
+		const char *IMSI = (const char*)sqlite3_column_text(stmt,1);
+		if (!IMSI) continue;
+		sms.mIMSI = IMSI;
+		const char *text = (const char*)sqlite3_column_text(stmt,2);
+		if (text) sms.mCallID = text;
+		text = (const char*)sqlite3_column_text(stmt,3);
+		if (text) sms.mCaller = text;
+		text = (const char*)sqlite3_column_text(stmt,4);
+		if (text) sms.mContentType = text;
+		const char *body = (const char*)sqlite3_column_blob(stmt,5);
+		if (body) sms.mBody.assign(body,sqlite3_column_bytes(stmt,5));
+		sms.mAttempts = (unsigned)sqlite3_column_int(stmt,6);
+		sms.mNextAttempt = (time_t)sqlite3_column_int64(stmt,7);
+		mPending[sms.mIMSI].push_back(sms);
+		mSize++;
+	}
+	mLock.unlock();
+	sqlite3_finalize(stmt);
+	LOG(INFO) << "loaded " << mSize << " queued SMS";
+
+	mServiceThread.start((void*(*)(void*))SMSQueueServiceLoopAdapter,this);
+	return 0;
+}
+
+
+
+SMSQueue::~SMSQueue()
+{
+	close();
+}
+
+
+void SMSQueue::close()
+{
+	if (!mDB) return;
+	sqlite3_finalize(mInsertStmt);
+	sqlite3_finalize(mUpdateStmt);
+	mInsertStmt = NULL;
+	mUpdateStmt = NULL;
+	sqlite3_release_statements(mDB);
+	sqlite3_close(mDB);
+	mDB = NULL;
+}
+
+
+
+bool SMSQueue::add(const char* IMSI, const char* callID, const char* caller,
+	const char* contentType, const char* body, size_t length)
+{
+	if (!mDB) return false;
+	ScopedLock lock(mLock);
+	time_t now = time(NULL);
+	sqlite3_bind_int64(mInsertStmt,1,now);
+	sqlite3_bind_text(mInsertStmt,2,IMSI,-1,SQLITE_STATIC);
+	sqlite3_bind_text(mInsertStmt,3,callID,-1,SQLITE_STATIC);
+	sqlite3_bind_text(mInsertStmt,4,caller,-1,SQLITE_STATIC);
+	sqlite3_bind_text(mInsertStmt,5,contentType,-1,SQLITE_STATIC);
+	sqlite3_bind_blob(mInsertStmt,6,body,length,SQLITE_STATIC);
+	int src = sqlite3_run_query(mDB,mInsertStmt);
+	sqlite3_reset(mInsertStmt);
+	sqlite3_clear_bindings(mInsertStmt);
+	if (src!=SQLITE_DONE) {
+		LOG(ALERT) << "cannot store SMS for IMSI" << IMSI;
+		return false;
+	}
+	if (sqlite3_changes(mDB)==0) {
+		// Same call ID as a message we already have.
+		LOG(INFO) << "repeated SIP MESSAGE " << callID << " for IMSI" << IMSI;
+		return true;
+	}
+
+	QueuedSMS sms;
+	sms.mID = (unsigned)sqlite3_last_insert_rowid(mDB);
+	sms.mIMSI = IMSI;
+	sms.mCallID = callID;
+	sms.mCaller = caller;
+	sms.mContentType = contentType;
+	sms.mBody.assign(body,length);
+	sms.mAttempts = 0;
+	sms.mNextAttempt = now;
+	mPending[sms.mIMSI].push_back(sms);
+	mSize++;
+	LOG(INFO) << "queued SMS " << sms.mID << " for IMSI" << IMSI << ", " << mPending[sms.mIMSI].size() << " pending for this IMSI";
+	gReports.incr("OpenBTS.SMS.Queue.Accepted");
+	mWakeup.signal();
+	return true;
+}
+
+
+
+bool SMSQueue::update(unsigned ID, unsigned state, unsigned attempts, time_t nextAttempt, time_t finished)
+{
+	sqlite3_bind_int(mUpdateStmt,1,state);
+	sqlite3_bind_int(mUpdateStmt,2,attempts);
+	sqlite3_bind_int64(mUpdateStmt,3,nextAttempt);
+	if (finished) sqlite3_bind_int64(mUpdateStmt,4,finished);
+	else sqlite3_bind_null(mUpdateStmt,4);
+	sqlite3_bind_int64(mUpdateStmt,5,ID);
+	int src = sqlite3_run_query(mDB,mUpdateStmt);
+	sqlite3_reset(mUpdateStmt);
+	return src==SQLITE_DONE;
+}
+
+
+
+TransactionEntry* SMSQueue::makeTransaction(const QueuedSMS& sms, GSM::LogicalChannel *LCH)
+{
+	TransactionEntry *transaction = new TransactionEntry(
+		gConfig.getStr("SIP.Proxy.SMS").c_str(),
+		GSM::L3MobileIdentity(sms.mIMSI.c_str()),
+		LCH,
+		GSM::L3CMServiceType::MobileTerminatedShortMessage,
+		GSM::L3CallingPartyBCDNumber(sms.mCaller.c_str()),
+		LCH ? GSM::SMSDelivering : GSM::Paging);
+	transaction->message(sms.mBody.data(),sms.mBody.size());
+	transaction->messageType(sms.mContentType.c_str());
+	return transaction;
+}
+
+
+
+void SMSQueue::finish(const std::string& IMSI, bool delivered, time_t now)
+{
+	map<string,Delivery>::iterator itr = mDelivering.find(IMSI);
+	assert(itr!=mDelivering.end());
+	mByTransaction.erase(itr->second.mTransactionID);
+	mDelivering.erase(itr);
+
+	SMSList& list = mPending[IMSI];
+	assert(!list.empty());
+	QueuedSMS& sms = list.front();
+	sms.mAttempts++;
+	bool done = delivered || sms.mAttempts>=SMSQueueMaxAttempts;
+	if (done) {
+		unsigned state = delivered ? SMSDelivered : SMSFailed;
+		if (delivered) {
+			LOG(INFO) << "SMS " << sms.mID << " delivered to IMSI" << IMSI << " after " << sms.mAttempts << " attempts";
+			gReports.incr("OpenBTS.SMS.Queue.Delivered");
+		} else {
+			LOG(NOTICE) << "SMS " << sms.mID << " to IMSI" << IMSI << " failed after " << sms.mAttempts << " attempts";
+			gReports.incr("OpenBTS.SMS.Queue.Failed");
+		}
+		if (!update(sms.mID,state,sms.mAttempts,sms.mNextAttempt,now)) LOG(ALERT) << "cannot update SMS " << sms.mID;
+		list.pop_front();
+		mSize--;
+		if (list.empty()) mPending.erase(IMSI);
+		return;
+	}
+
+	// Back off, doubling each time.
+	unsigned delay = SMSQueueRetryMin;
+	for (unsigned i=1; i<sms.mAttempts && delay<SMSQueueRetryMax; i++) delay *= 2;
+	if (delay>SMSQueueRetryMax) delay = SMSQueueRetryMax;
+	sms.mNextAttempt = now + delay;
+	LOG(INFO) << "SMS " << sms.mID << " to IMSI" << IMSI << " attempt " << sms.mAttempts << " failed, retry in " << delay << " s";
+	if (!update(sms.mID,SMSPending,sms.mAttempts,sms.mNextAttempt,0)) LOG(ALERT) << "cannot update SMS " << sms.mID;
+}
+
+
+
+void SMSQueue::result(unsigned transactionID, bool delivered)
+{
+	ScopedLock lock(mLock);
+	map<unsigned,string>::iterator itr = mByTransaction.find(transactionID);
+	if (itr==mByTransaction.end()) return;
+	string IMSI = itr->second;
+	finish(IMSI,delivered,time(NULL));
+	mWakeup.signal();
+}
+
+
+
+TransactionEntry* SMSQueue::next(const GSM::L3MobileIdentity& subscriber, GSM::LogicalChannel *LCH)
+{
+	ScopedLock lock(mLock);
+	string IMSI = subscriber.digits();
+	// Only one delivery at a time per subscriber, to keep them in order.
+	if (mDelivering.find(IMSI)!=mDelivering.end()) return NULL;
+	map<string,SMSList>::iterator itr = mPending.find(IMSI);
+	if (itr==mPending.end()) return NULL;
+	// The mobile is here now, so ignore any backoff.
+	TransactionEntry *transaction = makeTransaction(itr->second.front(),LCH);
+	gTransactionTable.add(transaction);
+	Delivery& delivery = mDelivering[IMSI];
+	delivery.mTransactionID = transaction->ID();
+	delivery.mDeadline = time(NULL) + SMSQueueDeliveryTime;
+	mByTransaction[transaction->ID()] = IMSI;
+	LOG(INFO) << "delivering SMS " << itr->second.front().mID << " on existing channel " << *LCH;
+	return transaction;
+}
+
+
+
+void SMSQueue::checkDeadlines(time_t now)
+{
+	map<string,Delivery>::iterator itr = mDelivering.begin();
+	while (itr!=mDelivering.end()) {
+		string IMSI = itr->first;
+		Delivery& delivery = itr->second;
+		++itr;
+		if (delivery.mDeadline > now) continue;
+		// If the mobile never answered, the transaction is still paging.
+		// If it did answer, it is still working, so give it more time.
+		if (!gTransactionTable.removePaging(delivery.mTransactionID) &&
+			gTransactionTable.find(delivery.mTransactionID).get()) {
+			delivery.mDeadline = now + SMSQueueDeliveryTime;
+			continue;
+		}
+		finish(IMSI,false,now);
+	}
+}
+
+
+
+void SMSQueue::startDeliveries(time_t now)
+{
+	unsigned pageTime = gConfig.getNum("GSM.Timer.T3113");
+	// Don't page for channels we don't have.
+	// A page does not take its SDCCH until it is answered, so every page
+	// still outstanding, ours or not, is counted against the free SDCCHs,
+	// and the LUR reserve is left alone.
+	// The PCH can carry far more pages than that, so the SDCCHs are the limit.
+	int budget = (int)gBTS.SDCCHAvailable()
+		- gConfig.getNum("GSM.Channels.SDCCHReserve",0)
+		- (int)gBTS.pager().pagingEntryListSize();
+	for (map<string,SMSList>::iterator itr = mPending.begin(); itr != mPending.end(); ++itr) {
+		const string& IMSI = itr->first;
+		if (mDelivering.find(IMSI)!=mDelivering.end()) continue;
+		const QueuedSMS& sms = itr->second.front();
+		if (sms.mNextAttempt > now) continue;
+		if (budget<=0) {
+			LOG(INFO) << "no paging budget for queued SMS, " << mSize << " pending";
+			return;
+		}
+		budget--;
+		TransactionEntry *transaction = makeTransaction(sms,NULL);
+		Delivery& delivery = mDelivering[IMSI];
+		delivery.mTransactionID = transaction->ID();
+		delivery.mDeadline = now + pageTime/1000 + SMSQueueDeliveryTime;
+		mByTransaction[transaction->ID()] = IMSI;
+		LOG(INFO) << "paging IMSI" << IMSI << " for SMS " << sms.mID << ", " << itr->second.size() << " queued";
+		initiateMTTransaction(transaction,GSM::SDCCHType,pageTime);
+	}
+}
+
+
+
+void SMSQueue::serviceLoop()
+{
+	while (true) {
+		mLock.lock();
+		mWakeup.wait(mLock,SMSQueueServiceInterval);
+		time_t now = time(NULL);
+		checkDeadlines(now);
+		startDeliveries(now);
+		mLock.unlock();
+	}
+}
+
+
+void *Control::SMSQueueServiceLoopAdapter(SMSQueue *queue)
+{
+	queue->serviceLoop();
+	return NULL;
+}
+
+
+
+unsigned SMSQueue::size() const
+{
+	ScopedLock lock(mLock);
+	return mSize;
+}
+
+
+
+void SMSQueue::dump(ostream& os) const
+{
+	ScopedLock lock(mLock);
+	time_t now = time(NULL);
+	for (map<string,SMSList>::const_iterator itr = mPending.begin(); itr != mPending.end(); ++itr) {
+		bool delivering = mDelivering.find(itr->first)!=mDelivering.end();
+		for (SMSList::const_iterator sms = itr->second.begin(); sms != itr->second.end(); ++sms) {
+			os << "IMSI" << itr->first << " ID=" << sms->mID << " from=" << sms->mCaller;
+			os << " type=" << sms->mContentType << " attempts=" << sms->mAttempts;
+			if (delivering && sms==itr->second.begin()) os << " delivering";
+			else if (sms->mNextAttempt > now) os << " retry in " << (sms->mNextAttempt-now) << " s";
+			os << endl;
+		}
+	}
+	os << mSize << " pending" << endl;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,214 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef SMSQUEUE_H
+#define SMSQUEUE_H
+
+#include <time.h>
+#include <list>
+#include <map>
+#include <string>
+#include <iostream>
+
+#include <Threads.h>
+
+
+struct sqlite3;
+struct sqlite3_stmt;
+
+namespace GSM {
+class L3MobileIdentity;
+class LogicalChannel;
+}
+
+
+namespace Control {
+
+class TransactionEntry;
+
+
+/** Interval between SMS queue service passes, in ms. */
+const unsigned SMSQueueServiceInterval = 1000;
+
+/** Time allowed for a delivery after the paging period, in seconds. */
+const unsigned SMSQueueDeliveryTime = 60;
+
+/** First retry delay after a failed delivery, in seconds; doubles on each failure. */
+const unsigned SMSQueueRetryMin = 60;
+
+/** Longest retry delay, in seconds. */
+const unsigned SMSQueueRetryMax = 3600;
+
+/** Delivery attempts before a message is given up. */
+const unsigned SMSQueueMaxAttempts = 12;
+
+/** How long finished records are kept as delivery reports, in seconds. */
+const unsigned SMSQueueRetention = 7*24*3600;
+
+
+/**
+	A persistent store-and-forward queue for MT-SMS.
+
+	Messages are written to sqlite before they are accepted on the SIP side,
+	so they survive restarts.  Each subscriber's messages are delivered
+	one at a time in arrival order.  Once a mobile has answered paging,
+	the rest of its queue goes out over the same SDCCH before release.
+	Failed deliveries are retried with exponential backoff, and
+	the outcome of every message stays in the table as a delivery report.
+*/
+class SMSQueue {
+
+	private:
+
+	/** A message waiting for delivery. */
+	struct QueuedSMS {
+		unsigned mID;				///< row ID in the database
+		std::string mIMSI;
+		std::string mCallID;		///< SIP call ID of the MESSAGE, for duplicate detection
+		std::string mCaller;
+		std::string mContentType;
+		std::string mBody;
+		unsigned mAttempts;
+		time_t mNextAttempt;
+	};
+
+	typedef std::list<QueuedSMS> SMSList;
+
+	/** A delivery in progress. */
+	struct Delivery {
+		unsigned mTransactionID;
+		time_t mDeadline;
+	};
+
+	sqlite3 *mDB;				///< database connection
+
+	/**@name Prepared statements, kept for the life of the connection. */
+	//@{
+	sqlite3_stmt *mInsertStmt;
+	sqlite3_stmt *mUpdateStmt;
+	//@}
+
+	/**@name Queue state, protected by mLock. */
+	//@{
+	mutable Mutex mLock;
+	std::map<std::string,SMSList> mPending;			///< pending messages by IMSI, oldest first
+	std::map<std::string,Delivery> mDelivering;		///< deliveries in progress by IMSI
+	std::map<unsigned,std::string> mByTransaction;	///< IMSI by delivery transaction ID
+	unsigned mSize;									///< total number of pending messages
+	//@}
+
+	Signal mWakeup;				///< signalled when there may be work
+	Thread mServiceThread;
+
+	public:
+
+	SMSQueue()
+		:mDB(NULL),mInsertStmt(NULL),mUpdateStmt(NULL),mSize(0)
+	{}
+
+	~SMSQueue();
+
+	/**
+		Open the database, load the pending messages and start delivery.
+		@param wPath Path to sqlite3 database file.
+		@return 0 on success, 1 otherwise.
+	*/
+	int open(const char* wPath);
+
+	/** Return true if open() succeeded, so messages can be queued. */
+	bool isOpen() const { return mDB!=NULL; }
+
+	/**
+		Store a message for delivery.
+		A message with a call ID already in the queue is taken as a SIP retransmission.
+		@return true if the message is stored, and can be accepted on the SIP side.
+	*/
+	bool add(const char* IMSI, const char* callID, const char* caller,
+		const char* contentType, const char* body, size_t length);
+
+	/**
+		Report the outcome of a delivery from the queue.
+		Transactions that did not come from the queue are ignored.
+	*/
+	void result(unsigned transactionID, bool delivered);
+
+	/**
+		Take the next message for a subscriber that is already on a channel.
+		@return A new transaction in the SMSDelivering state, in the transaction table, or NULL.
+	*/
+	TransactionEntry* next(const GSM::L3MobileIdentity& subscriber, GSM::LogicalChannel *LCH);
+
+	/** Number of pending messages. */
+	unsigned size() const;
+
+	/** Write the pending messages as text. */
+	void dump(std::ostream&) const;
+
+	private:
+
+	/**
+		Start paging for subscribers with a message due,
+		as many as the free SDCCHs can answer; caller holds mLock.
+	*/
+	void startDeliveries(time_t now);
+
+	/** Release the database after a failed open() or at exit. */
+	void close();
+
+	/** Handle deliveries that ran out of time; caller holds mLock. */
+	void checkDeadlines(time_t now);
+
+	/** Record a finished delivery attempt; caller holds mLock. */
+	void finish(const std::string& IMSI, bool delivered, time_t now);
+
+	/** Make the transaction for the first message in a list; caller holds mLock. */
+	TransactionEntry* makeTransaction(const QueuedSMS& sms, GSM::LogicalChannel *LCH);
+
+	/** Write the state of a record. */
+	bool update(unsigned ID, unsigned state, unsigned attempts, time_t nextAttempt, time_t finished);
+
+	void serviceLoop();
+
+	friend void *SMSQueueServiceLoopAdapter(SMSQueue*);
+};
+
+
+void *SMSQueueServiceLoopAdapter(SMSQueue*);
+
+
+}	// Control
+
+
+/**@addtogroup Globals */
+//@{
+/** The global MT-SMS queue. */
+extern Control::SMSQueue gSMSQueue;
+//@}
+
+
+#endif
+
+// vim: ts=4 sw=4
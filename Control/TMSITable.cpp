@@ -35,6 +35,7 @@
 #include <Globals.h>
 
 #include <string>
+#include <string.h>
 #include <iostream>
 #include <iomanip>
 
@@ -74,10 +75,31 @@ int TMSITable::open(const char* wPath)
 		mDB = NULL;
 		return 1;
 	}
+	if (!sqlite3_setup(mDB)) {
+		LOG(WARNING) << "Cannot set WAL mode or busy timeout on TMSITable";
+	}
 	if (!sqlite3_command(mDB,createTMSITable)) {
 		LOG(EMERG) << "Cannot create TMSI table";
         return 1;
 	}
+	// Unused columns are bound to NULL, which is also their default.
+	if (sqlite3_prepare_statement(mDB,&mInsertStmt,
+			"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED,PREV_MCC,PREV_MNC,PREV_LAC,OLD_TMSI) "
+			"VALUES (?,?,?,?,?,?,?)")) {
+		LOG(EMERG) << "Cannot prepare TMSI table insert";
+		return 1;
+	}
+	// MAX() keeps us from backdating a record updated by IMEI() or classmark().
+	if (sqlite3_prepare_statement(mDB,&mTouchStmt,
+			"UPDATE TMSI_TABLE SET ACCESSED=MAX(ACCESSED,?) WHERE TMSI=?")) {
+		LOG(EMERG) << "Cannot prepare TMSI table update";
+		return 1;
+	}
+	if (!load()) {
+		LOG(EMERG) << "Cannot load TMSI table";
+		return 1;
+	}
+	mFlushThread.start((void*(*)(void*))TMSITableFlushAdapter,this);
     return 0;
 }
 
@@ -85,7 +107,36 @@ int TMSITable::open(const char* wPath)
 
 TMSITable::~TMSITable()
 {
-	if (mDB) sqlite3_close(mDB);
+	ScopedLock lock(mLock);
+	if (!mDB) return;
+	innerFlush();
+	sqlite3_finalize(mInsertStmt);
+	sqlite3_finalize(mTouchStmt);
+	sqlite3_release_statements(mDB);
+	sqlite3_close(mDB);
+	// The flush thread may still wake up once.
+	mDB = NULL;
+}
+
+
+
+bool TMSITable::load()
+{
+	sqlite3_stmt *stmt;
+	if (sqlite3_prepare_statement(mDB,&stmt,"SELECT TMSI,IMSI FROM TMSI_TABLE")) return false;
+	ScopedLock lock(mLock);
+	mTMSIByIMSI.clear();
+	mIMSIByTMSI.clear();
+	while (sqlite3_run_query(mDB,stmt)==SQLITE_ROW) {
+		unsigned TMSI = (unsigned)sqlite3_column_int64(stmt,0);
+		const char* IMSI = (const char*)sqlite3_column_text(stmt,1);
+		if (!IMSI) continue;
+		mTMSIByIMSI[IMSI] = TMSI;
+		mIMSIByTMSI[TMSI] = IMSI;
+	}
+	sqlite3_finalize(stmt);
+	LOG(INFO) << "loaded " << mTMSIByIMSI.size() << " TMSI table entries";
+	return true;
 }
 
 
@@ -100,9 +151,12 @@ unsigned TMSITable::assign(const char* IMSI, const GSM::L3LocationUpdatingReques
 	gReports.incr("OpenBTS.GSM.MM.TMSI.Assigned");
 
 	LOG(DEBUG) << "IMSI=" << IMSI;
+	ScopedLock lock(mLock);
+
 	// Is there already a record?
-	unsigned TMSI;
-	if (sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"TMSI",TMSI)) {
+	IMSIMap::const_iterator itr = mTMSIByIMSI.find(IMSI);
+	if (itr != mTMSIByIMSI.end()) {
+		unsigned TMSI = itr->second;
 		LOG(DEBUG) << "found TMSI " << TMSI;
 		touch(TMSI);
 		return TMSI;
@@ -110,36 +164,31 @@ unsigned TMSITable::assign(const char* IMSI, const GSM::L3LocationUpdatingReques
 
 	// Create a new record.
 	LOG(NOTICE) << "new entry for IMSI " << IMSI;
-	char query[1000];
 	unsigned now = (unsigned)time(NULL);
+	sqlite3_bind_text(mInsertStmt,1,IMSI,-1,SQLITE_TRANSIENT);
+	sqlite3_bind_int64(mInsertStmt,2,now);
+	sqlite3_bind_int64(mInsertStmt,3,now);
 	if (!lur) {
-		sprintf(query,
-				"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED) "
-				"VALUES ('%s',%u,%u)",
-				IMSI,now,now);
+		for (int i=4; i<=7; i++) sqlite3_bind_null(mInsertStmt,i);
 	} else {
 		const GSM::L3LocationAreaIdentity &lai = lur->LAI();
 		const GSM::L3MobileIdentity &mid = lur->mobileID();
-		if (mid.type()==GSM::TMSIType) {
-			sprintf(query,
-					"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED,PREV_MCC,PREV_MNC,PREV_LAC,OLD_TMSI) "
-					"VALUES ('%s',%u,%u,%u,%u,%u,%u)",
-					IMSI,now,now,lai.MCC(),lai.MNC(),lai.LAC(),mid.TMSI());
-		} else {
-			sprintf(query,
-					"INSERT INTO TMSI_TABLE (IMSI,CREATED,ACCESSED,PREV_MCC,PREV_MNC,PREV_LAC) "
-					"VALUES ('%s',%u,%u,%u,%u,%u)",
-					IMSI,now,now,lai.MCC(),lai.MNC(),lai.LAC());
-		}
+		sqlite3_bind_int64(mInsertStmt,4,lai.MCC());
+		sqlite3_bind_int64(mInsertStmt,5,lai.MNC());
+		sqlite3_bind_int64(mInsertStmt,6,lai.LAC());
+		if (mid.type()==GSM::TMSIType) sqlite3_bind_int64(mInsertStmt,7,mid.TMSI());
+		else sqlite3_bind_null(mInsertStmt,7);
 	}
-	if (!sqlite3_command(mDB,query)) {
+	int src = sqlite3_run_query(mDB,mInsertStmt);
+	sqlite3_reset(mInsertStmt);
+	if (src!=SQLITE_DONE) {
 		LOG(ALERT) << "TMSI creation failed";
 		return 0;
 	}
-	if (!sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"TMSI",TMSI)) {
-		LOG(ERR) << "TMSI database inconsistancy";
-		return 0;
-	}
+	// TMSI is the rowid, and the connection is serialized by mLock.
+	unsigned TMSI = (unsigned)sqlite3_last_insert_rowid(mDB);
+	mTMSIByIMSI[IMSI] = TMSI;
+	mIMSIByTMSI[TMSI] = IMSI;
 	return TMSI;
 }
 	
@@ -147,11 +196,54 @@ unsigned TMSITable::assign(const char* IMSI, const GSM::L3LocationUpdatingReques
 
 void TMSITable::touch(unsigned TMSI) const
 {
-	// Update timestamp.
-	char query[100];
-	sprintf(query,"UPDATE TMSI_TABLE SET ACCESSED = %u WHERE TMSI == %u",
-		(unsigned)time(NULL),TMSI);
-	sqlite3_command(mDB,query);
+	// Update timestamp, to be written later.
+	mAccessed[TMSI] = (unsigned)time(NULL);
+}
+
+
+void TMSITable::flush() const
+{
+	ScopedLock lock(mLock);
+	innerFlush();
+}
+
+
+void TMSITable::innerFlush() const
+{
+	if (!mDB) return;
+	if (mAccessed.size()==0) return;
+	LOG(DEBUG) << "flushing " << mAccessed.size() << " ACCESSED times";
+	// One transaction for the whole batch.
+	sqlite3_command(mDB,"BEGIN TRANSACTION");
+	for (AccessMap::const_iterator itr = mAccessed.begin(); itr != mAccessed.end(); ++itr) {
+		sqlite3_bind_int64(mTouchStmt,1,itr->second);
+		sqlite3_bind_int64(mTouchStmt,2,itr->first);
+		sqlite3_run_query(mDB,mTouchStmt);
+		sqlite3_reset(mTouchStmt);
+	}
+	if (!sqlite3_command(mDB,"COMMIT TRANSACTION")) {
+		// Keep the times for the next try.
+		LOG(ERR) << "TMSI table ACCESSED flush failed";
+		sqlite3_command(mDB,"ROLLBACK TRANSACTION");
+		return;
+	}
+	mAccessed.clear();
+}
+
+
+void TMSITable::flushLoop()
+{
+	while (true) {
+		msleep(TMSITableFlushInterval);
+		flush();
+	}
+}
+
+
+void* Control::TMSITableFlushAdapter(TMSITable* table)
+{
+	table->flushLoop();
+	return NULL;
 }
 
 
@@ -159,16 +251,20 @@ void TMSITable::touch(unsigned TMSI) const
 // Returned string must be free'd by the caller.
 char* TMSITable::IMSI(unsigned TMSI) const
 {
-	char* IMSI = NULL;
-	if (sqlite3_single_lookup(mDB,"TMSI_TABLE","TMSI",TMSI,"IMSI",IMSI)) touch(TMSI);
-	return IMSI;
+	ScopedLock lock(mLock);
+	TMSIMap::const_iterator itr = mIMSIByTMSI.find(TMSI);
+	if (itr == mIMSIByTMSI.end()) return NULL;
+	touch(TMSI);
+	return strdup(itr->second.c_str());
 }
 
 unsigned TMSITable::TMSI(const char* IMSI) const
 {
-	unsigned TMSI=0;
-	if (sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"TMSI",TMSI)) touch(TMSI);
-	return TMSI;
+	ScopedLock lock(mLock);
+	IMSIMap::const_iterator itr = mTMSIByIMSI.find(IMSI);
+	if (itr == mTMSIByIMSI.end()) return 0;
+	touch(itr->second);
+	return itr->second;
 }
 
 
@@ -197,6 +293,8 @@ void printAge(unsigned seconds, ostream& os)
 
 void TMSITable::dump(ostream& os) const
 {
+	// Make the ACCESSED column current.
+	flush();
 	sqlite3_stmt *stmt;
 	if (sqlite3_prepare_statement(mDB,&stmt,"SELECT TMSI,IMSI,CREATED,ACCESSED FROM TMSI_TABLE")) {
 		LOG(ERR) << "sqlite3_prepare_statement failed";
@@ -217,13 +315,19 @@ void TMSITable::dump(ostream& os) const
 
 void TMSITable::clear()
 {
+	ScopedLock lock(mLock);
 	sqlite3_command(mDB,"DELETE FROM TMSI_TABLE WHERE 1");
+	mTMSIByIMSI.clear();
+	mIMSIByTMSI.clear();
+	mAccessed.clear();
 }
 
 
 
 bool TMSITable::IMEI(const char* IMSI, const char *IMEI)
 {
+	// Keep this out of the middle of a batched flush.
+	ScopedLock lock(mLock);
 	char query[100];
 	sprintf(query,"UPDATE TMSI_TABLE SET IMEI=\"%s\",ACCESSED=%u WHERE IMSI=\"%s\"",
 		IMEI,(unsigned)time(NULL),IMSI);
@@ -235,6 +339,8 @@ bool TMSITable::IMEI(const char* IMSI, const char *IMEI)
 bool TMSITable::classmark(const char* IMSI, const GSM::L3MobileStationClassmark2& classmark)
 {
 	int A5Bits = (classmark.A5_1()<<2) + (classmark.A5_2()<<1) + classmark.A5_3();
+	// Keep this out of the middle of a batched flush.
+	ScopedLock lock(mLock);
 	char query[100];
 	sprintf(query,
 		"UPDATE TMSI_TABLE SET A5_SUPPORT=%u,ACCESSED=%u,POWER_CLASS=%u "
@@ -247,7 +353,8 @@ bool TMSITable::classmark(const char* IMSI, const GSM::L3MobileStationClassmark2
 
 unsigned TMSITable::nextL3TI(const char* IMSI)
 {
-	// FIXME -- This should be a single atomic operation.
+	// mLock makes this read-modify-write atomic within this process.
+	ScopedLock lock(mLock);
 	unsigned l3ti;
 	if (!sqlite3_single_lookup(mDB,"TMSI_TABLE","IMSI",IMSI,"L3TI",l3ti)) {
 		LOG(ERR) << "cannot read L3TI from TMSI_TABLE, using random L3TI";
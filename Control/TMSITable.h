@@ -28,12 +28,14 @@
 #define TMSITABLE_H
 
 #include <map>
+#include <string>
 
 #include <Timeval.h>
 #include <Threads.h>
 
 
 struct sqlite3;
+struct sqlite3_stmt;
 
 namespace GSM {
 class L3LocationUpdatingRequest;
@@ -44,15 +46,53 @@ class L3MobileIdentity;
 
 namespace Control {
 
+
+/** Interval between batched writes of ACCESSED times, in ms. */
+const unsigned TMSITableFlushInterval = 10000;
+
+
+/**
+	The TMSI table maps IMSIs to locally assigned TMSIs.
+	The IMSI<->TMSI mapping is cached in memory in both directions
+	and loaded from the database when the table is opened,
+	so lookups never touch the database.
+	ACCESSED timestamps are kept in memory and written back
+	in batched transactions every TMSITableFlushInterval ms
+	by a thread started in open(), and again when the table is destroyed.
+*/
 class TMSITable {
 
 	private:
 
+	typedef std::map<std::string,unsigned> IMSIMap;
+	typedef std::map<unsigned,std::string> TMSIMap;
+	typedef std::map<unsigned,unsigned> AccessMap;
+
 	sqlite3 *mDB;			///< database connection
 
+	/**@name Prepared statements, kept for the life of the connection. */
+	//@{
+	sqlite3_stmt *mInsertStmt;		///< create a new record
+	sqlite3_stmt *mTouchStmt;		///< update ACCESSED
+	//@}
+
+	/**@name In-memory cache and pending updates, protected by mLock. */
+	//@{
+	mutable Mutex mLock;
+	IMSIMap mTMSIByIMSI;			///< IMSI -> TMSI
+	TMSIMap mIMSIByTMSI;			///< TMSI -> IMSI
+	mutable AccessMap mAccessed;	///< pending ACCESSED times, by TMSI
+	//@}
+
+	Thread mFlushThread;			///< periodic ACCESSED flushes
+
 
 	public:
 
+	TMSITable()
+		:mDB(NULL),mInsertStmt(NULL),mTouchStmt(NULL)
+	{}
+
 	/**
 			Open the database connection.  
 			@param wPath Path to sqlite3 database file.
@@ -72,7 +112,7 @@ class TMSITable {
 
 	/**
 		Find an IMSI in the table.
-		This is a log-time operation.
+		This is a log-time operation on the in-memory cache.
 		@param TMSI The TMSI to find.
 		@return Pointer to IMSI to be freed by the caller, or NULL.
 	*/
@@ -80,12 +120,15 @@ class TMSITable {
 
 	/**
 		Find a TMSI in the table.
-		This is a linear-time operation.
+		This is a log-time operation on the in-memory cache.
 		@param IMSI The IMSI to mach.
 		@return A TMSI value or zero on failure.
 	*/
 	unsigned TMSI(const char* IMSI) const;
 
+	/** Write any pending ACCESSED times to the database now. */
+	void flush() const;
+
 	/** Write entries as text to a stream. */
 	void dump(std::ostream&) const;
 	
@@ -103,11 +146,30 @@ class TMSITable {
 
 	private:
 
-	/** Update the "accessed" time on a record. */
+	/** Load the in-memory cache from the database. */
+	bool load();
+
+	/**
+		Update the "accessed" time on a record.
+		The update is deferred and written by the next periodic flush.
+		Caller must hold mLock.
+	*/
 	void touch(unsigned TMSI) const;
+
+	/** Flush ACCESSED times; caller must hold mLock. */
+	void innerFlush() const;
+
+	/** Flush every TMSITableFlushInterval. */
+	void flushLoop();
+
+	friend void* TMSITableFlushAdapter(TMSITable*);
 };
 
 
+/** A C-style adapter for the flush thread. */
+void* TMSITableFlushAdapter(TMSITable*);
+
+
 }
 
 #endif
@@ -71,21 +71,30 @@ static const char* createTransactionTable = {
 
 
 
+const char* Control::TransactionTimerName(TransactionTimer timer)
+{
+	static const char* names[TransactionTimers] = {
+		"301", "302", "303", "304", "305", "308", "310", "313", "3113", "TR1M"
+	};
+	return names[timer];
+}
+
+
 void TransactionEntry::initTimers()
 {
 	// Call this only once, from the constructor.
 	// TODO -- It would be nice if these were all configurable.
-	assert(mTimers.size()==0);
-	mTimers["301"] = Z100Timer(T301ms);
-	mTimers["302"] = Z100Timer(T302ms);
-	mTimers["303"] = Z100Timer(T303ms);
-	mTimers["304"] = Z100Timer(T304ms);
-	mTimers["305"] = Z100Timer(T305ms);
-	mTimers["308"] = Z100Timer(T308ms);
-	mTimers["310"] = Z100Timer(T310ms);
-	mTimers["313"] = Z100Timer(T313ms);
-	mTimers["3113"] = Z100Timer(gConfig.getNum("GSM.Timer.T3113"));
-	mTimers["TR1M"] = Z100Timer(TR1Mms);
+	static const long limits[TransactionTimers] = {
+		T301ms, T302ms, T303ms, T304ms, T305ms, T308ms, T310ms, T313ms, 0, TR1Mms
+	};
+	for (unsigned i=0; i<TransactionTimers; i++) {
+		mTimers[i].mHandle = 0;
+		mTimers[i].mTag = i;
+		mTimers[i].mLimit = limits[i];
+		mTimers[i].mActive = false;
+	}
+	mTimers[T3113].mLimit = gConfig.getNum("GSM.Timer.T3113");
+	mExpiredTimers = 0;
 }
 
 
@@ -112,6 +121,7 @@ TransactionEntry::TransactionEntry(
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mRemoved(false),
+	mRefCount(0),
 	mFake(wFake)
 	 
 {
@@ -138,6 +148,7 @@ TransactionEntry::TransactionEntry(
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mRemoved(false),
+	mRefCount(0),
 	mFake(false)
 {
 	assert(mSubscriber.type()==GSM::IMSIType);
@@ -162,6 +173,7 @@ TransactionEntry::TransactionEntry(
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mRemoved(false),
+	mRefCount(0),
 	mFake(false)
 {
 	mMessage.assign(""); //mMessage[0]='\0';
@@ -186,6 +198,7 @@ TransactionEntry::TransactionEntry(
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mRemoved(false),
+	mRefCount(0),
 	mFake(false)
 {
 	assert(mSubscriber.type()==GSM::IMSIType);
@@ -209,6 +222,7 @@ TransactionEntry::TransactionEntry(
 	mChannel(wChannel),
 	mTerminationRequested(false),
 	mRemoved(false),
+	mRefCount(0),
 	mFake(false)
 {
 	assert(mSubscriber.type()==GSM::IMSIType);
@@ -230,39 +244,81 @@ TransactionEntry::~TransactionEntry()
 	sprintf(query,"DELETE FROM TRANSACTION_TABLE WHERE ID=%u",mID);
 	runQuery(query);
 
+	// Clear any pending timers out of the wheel.
+	for (unsigned i=0; i<TransactionTimers; i++) stopTimer((TransactionTimer)i);
+}
+
+
+
+/**
+	Wheel callback for the transaction timers.
+	The object is the transaction ID rather than the entry,
+	since the entry may be deleted before its timer fires.
+*/
+static void TransactionTimerExpired(void *ID, unsigned tag)
+{
+	gTransactionTable.expireTimer((unsigned)(uintptr_t)ID,tag);
+}
+
+
+void TransactionEntry::stopTimer(TransactionTimer id)
+{
+	Timer& timer = mTimers[id];
+	if (timer.mHandle) gBTS.timers().cancel(timer.mHandle);
+	timer.mHandle = 0;
+	timer.mActive = false;
+	mExpiredTimers &= ~(1U<<id);
+}
+
+
+void TransactionEntry::expire(unsigned tag)
+{
+	ScopedLock lock(mLock);
+	TransactionTimer id = (TransactionTimer)(tag & 0x0f);
+	Timer& timer = mTimers[id];
+	// Ignore a timer that was stopped or restarted as it fired.
+	if (!timer.mActive || timer.mTag!=tag) return;
+	timer.mHandle = 0;
+	mExpiredTimers |= 1U<<id;
+	LOG(DEBUG) << TransactionTimerName(id) << " expired in transaction " << mID;
 }
 
 
-void TransactionEntry::resetTimer(const char* name)
+void TransactionEntry::resetTimer(TransactionTimer id)
 {
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
-	mTimers[name].reset();
+	stopTimer(id);
 }
 
 
-void TransactionEntry::setTimer(const char* name)
+void TransactionEntry::setTimer(TransactionTimer id)
 {
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
-	mTimers[name].set();
+	stopTimer(id);
+	Timer& timer = mTimers[id];
+	assert(timer.mLimit!=0);
+	// The low four bits of the tag are the timer ID.
+	timer.mTag += 0x10;
+	timer.mActive = true;
+	timer.mHandle = gBTS.timers().schedule(timer.mLimit,TransactionTimerExpired,(void*)(uintptr_t)mID,timer.mTag);
 }
 
-void TransactionEntry::setTimer(const char* name, long newLimit)
+void TransactionEntry::setTimer(TransactionTimer id, long newLimit)
 {
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
-	mTimers[name].set(newLimit);
+	mTimers[id].mLimit = newLimit;
+	setTimer(id);
 }
 
 
-bool TransactionEntry::timerExpired(const char* name) const
+bool TransactionEntry::timerExpired(TransactionTimer id) const
 {
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
-	TimerTable::const_iterator itr = mTimers.find(name);
-	assert(itr!=mTimers.end());
-	return (itr->second).expired();
+	return mExpiredTimers & (1U<<id);
 }
 
 
@@ -270,15 +326,14 @@ bool TransactionEntry::anyTimerExpired() const
 {
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
-	TimerTable::const_iterator itr = mTimers.begin();
-	while (itr!=mTimers.end()) {
-		if ((itr->second).expired()) {
-			LOG(INFO) << itr->first << " expired in " << *this;
-			return true;
+	if (!mExpiredTimers) return false;
+	for (unsigned i=0; i<TransactionTimers; i++) {
+		if (mExpiredTimers & (1U<<i)) {
+			LOG(INFO) << TransactionTimerName((TransactionTimer)i) << " expired in " << *this;
+			break;
 		}
-		++itr;
 	}
-	return false;
+	return true;
 }
 
 
@@ -286,11 +341,7 @@ void TransactionEntry::resetTimers()
 {
 	if (mRemoved) throw RemovedTransaction(mID);
 	ScopedLock lock(mLock);
-	TimerTable::iterator itr = mTimers.begin();
-	while (itr!=mTimers.end()) {
-		(itr->second).reset();
-		++itr;
-	}
+	for (unsigned i=0; i<TransactionTimers; i++) stopTimer((TransactionTimer)i);
 }
 
 
@@ -305,7 +356,8 @@ bool TransactionEntry::clearingGSM() const
 bool TransactionEntry::deadOrRemoved() const
 {
 	if (mRemoved) return true;
-	ScopedLock lock(mLock);
+	// dead() only tries the lock, so the table scans never wait
+	// behind a transaction that is busy; the reaper catches it later.
 	return dead();
 }
 
@@ -865,6 +917,7 @@ bool TransactionEntry::terminationRequested()
 	return retVal;
 }
 
+
 void TransactionTable::init(const char* path)
 {
 	// This assumes the main application uses sdevrandom.
@@ -877,6 +930,9 @@ void TransactionTable::init(const char* path)
 		mDB = NULL;
 		return;
 	}
+	if (!sqlite3_setup(mDB)) {
+		LOG(WARNING) << "Cannot set WAL mode or busy timeout on Transaction Table";
+	}
 	// Create a new table, if needed.
 	if (!sqlite3_command(mDB,createTransactionTable)) {
 		LOG(ALERT) << "Cannot create Transaction Table";
@@ -890,7 +946,9 @@ TransactionTable::~TransactionTable()
 {
 	// Don't bother disposing of the memory,
 	// since this is only invoked when the application exits.
-	if (mDB) sqlite3_close(mDB);
+	if (!mDB) return;
+	sqlite3_release_statements(mDB);
+	sqlite3_close(mDB);
 }
 
 
@@ -898,7 +956,9 @@ TransactionTable::~TransactionTable()
 
 unsigned TransactionTable::newID()
 {
-	ScopedLock lock(mLock);
+	ScopedLock lock(mIDLock);
+	// ID==0 is a non-valid special case.
+	if (mIDCounter==0) mIDCounter++;
 	return mIDCounter++;
 }
 
@@ -906,38 +966,56 @@ unsigned TransactionTable::newID()
 void TransactionTable::add(TransactionEntry* value)
 {
 	LOG(INFO) << "new transaction " << *value;
-	ScopedLock lock(mLock);
-	mTable[value->ID()]=value;
+	// Adding is a good time to get rid of old entries.
+	clearDeadEntries();
+	Shard& s = shard(value->ID());
+	ScopedWriteLock lock(s.mLock);
+	// The table's own reference.
+	value->incRef();
+	s.mMap[value->ID()]=value;
 	value->insertIntoDatabase();
 }
 
 
+size_t TransactionTable::size() const
+{
+	size_t sz = 0;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		ScopedReadLock lock(mShards[i].mLock);
+		sz += mShards[i].mMap.size();
+	}
+	return sz;
+}
 
-TransactionEntry* TransactionTable::find(unsigned key)
+
+
+void TransactionTable::expireTimer(unsigned key, unsigned tag)
 {
-	// Since this is a log-time operation, we don't screw that up by calling clearDeadEntries.
+	// The shard lock keeps the reaper from deleting the entry under us.
+	const Shard& s = shard(key);
+	ScopedReadLock lock(s.mLock);
+	TransactionMap::const_iterator itr = s.mMap.find(key);
+	// The entry may have been reaped, or never added.
+	if (itr==s.mMap.end()) return;
+	itr->second->expire(tag);
+}
 
+
+
+TransactionRef TransactionTable::find(unsigned key)
+{
 	// ID==0 is a non-valid special case.
 	LOG(DEBUG) << "by key: " << key;
 	assert(key);
-	ScopedLock lock(mLock);
-	TransactionMap::iterator itr = mTable.find(key);
-	if (itr==mTable.end()) return NULL;
+	const Shard& s = shard(key);
+	ScopedReadLock lock(s.mLock);
+	TransactionMap::const_iterator itr = s.mMap.find(key);
+	if (itr==s.mMap.end()) return NULL;
 	if (itr->second->deadOrRemoved()) return NULL;
 	return (itr->second);
 }
 
 
-void TransactionTable::innerRemove(TransactionMap::iterator itr)
-{
-	// This should not be called anywhere but from clearDeadEntries.
-	LOG(DEBUG) << "removing transaction: " << *(itr->second);
-	TransactionEntry *t = itr->second;
-	mTable.erase(itr);
-	delete t;
-}
-
-
 bool TransactionTable::remove(unsigned key)
 {
 	// ID==0 is a non-valid special case, and it shouldn't be passed here.
@@ -946,9 +1024,10 @@ bool TransactionTable::remove(unsigned key)
 		return false;
 	}
 
-	ScopedLock lock(mLock);
-	TransactionMap::iterator itr = mTable.find(key);
-	if (itr==mTable.end()) return false;
+	Shard& s = shard(key);
+	ScopedReadLock lock(s.mLock);
+	TransactionMap::iterator itr = s.mMap.find(key);
+	if (itr==s.mMap.end()) return false;
 	itr->second->remove();
 	return true;
 }
@@ -957,9 +1036,11 @@ bool TransactionTable::removePaging(unsigned key)
 {
 	// ID==0 is a non-valid special case and should not be passed here.
 	assert(key);
-	ScopedLock lock(mLock);
-	TransactionMap::iterator itr = mTable.find(key);
-	if (itr==mTable.end()) return false;
+	// Write lock, so that the state check and the removal are atomic.
+	Shard& s = shard(key);
+	ScopedWriteLock lock(s.mLock);
+	TransactionMap::iterator itr = s.mMap.find(key);
+	if (itr==s.mMap.end()) return false;
 	if (itr->second->removed()) return true;
 	if (itr->second->GSMState()!=GSM::Paging) return false;
 	//no one to respond to if we're fake
@@ -975,106 +1056,137 @@ bool TransactionTable::removePaging(unsigned key)
 
 void TransactionTable::clearDeadEntries()
 {
-	// Caller should hold mLock.
-	TransactionMap::iterator itr = mTable.begin();
-	while (itr!=mTable.end()) {
-		if (!itr->second->dead()) ++itr;
-		else {
+	// Caller should not hold any shard lock.
+	// Rate-limit the reaper so that lookups do not pay for it.
+	if (!mReapLock.trylock()) return;
+	if (mLastReap.elapsed() < (long)TransactionTableReapInterval) {
+		mReapLock.unlock();
+		return;
+	}
+	mLastReap.now();
+
+	// Unlink dead entries shard-by-shard,
+	// then delete them without holding any table lock,
+	// since the TransactionEntry destructor goes out to SIP and sqlite.
+	std::list<TransactionEntry*> reaped;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		Shard& s = mShards[i];
+		ScopedWriteLock lock(s.mLock);
+		TransactionMap::iterator itr = s.mMap.begin();
+		while (itr!=s.mMap.end()) {
+			TransactionEntry *t = itr->second;
+			if (!t->dead()) { ++itr; continue; }
+			if (t->refCount()>1) {
+				// Someone still holds it; hide it from lookups until released.
+				t->mRemoved = true;
+				++itr;
+				continue;
+			}
 			LOG(DEBUG) << "erasing " << itr->first;
-			TransactionMap::iterator old = itr;
-			itr++;
-			innerRemove(old);
+			s.mMap.erase(itr++);
+			reaped.push_back(t);
 		}
 	}
+	mReapLock.unlock();
+
+	while (reaped.size()) {
+		TransactionEntry *t = reaped.front();
+		reaped.pop_front();
+		LOG(DEBUG) << "removing transaction: " << *t;
+		t->decRef();
+	}
 }
 
 
 
 
-TransactionEntry* TransactionTable::find(const GSM::LogicalChannel *chan)
+TransactionRef TransactionTable::find(const GSM::LogicalChannel *chan)
 {
 	LOG(DEBUG) << "by channel: " << *chan << " (" << chan << ")";
 
-	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	// This search assumes in order by transaction ID.
-	TransactionEntry *retVal = NULL;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		const GSM::LogicalChannel* thisChan = itr->second->channel();
-		if ((void*)thisChan != (void*)chan) continue;
-		retVal = itr->second;
+	// Return the match with the highest transaction ID.
+	TransactionRef retVal;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			const GSM::LogicalChannel* thisChan = itr->second->channel();
+			if ((void*)thisChan != (void*)chan) continue;
+			if (retVal.get() && retVal->ID() > itr->first) continue;
+			retVal = itr->second;
+		}
 	}
 	//LOG(DEBUG) << "no match for " << *chan << " (" << chan << ")";
 	return retVal;
 }
 
 
-TransactionEntry* TransactionTable::findBySACCH(const GSM::SACCHLogicalChannel *chan)
+TransactionRef TransactionTable::findBySACCH(const GSM::SACCHLogicalChannel *chan)
 {
 	LOG(DEBUG) << "by SACCH: " << *chan << " (" << chan << ")";
 
-	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	TransactionEntry *retVal = NULL;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		const GSM::LogicalChannel* thisChan = itr->second->channel();
-		if (thisChan->SACCH() != chan) continue;
-		retVal = itr->second;
+	// Return the match with the highest transaction ID.
+	TransactionRef retVal;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			const GSM::LogicalChannel* thisChan = itr->second->channel();
+			if (thisChan->SACCH() != chan) continue;
+			if (retVal.get() && retVal->ID() > itr->first) continue;
+			retVal = itr->second;
+		}
 	}
 	return retVal;
 }
 
 
-TransactionEntry* TransactionTable::find(GSM::TypeAndOffset desc)
+TransactionRef TransactionTable::find(GSM::TypeAndOffset desc)
 {
 	LOG(DEBUG) << "by type and offset: " << desc;
 
-	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		const GSM::LogicalChannel* thisChan = itr->second->channel();
-		if (thisChan->typeAndOffset()!=desc) continue;
-		return itr->second;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			const GSM::LogicalChannel* thisChan = itr->second->channel();
+			if (thisChan->typeAndOffset()!=desc) continue;
+			return itr->second;
+		}
 	}
 	//LOG(DEBUG) << "no match for " << *chan << " (" << chan << ")";
 	return NULL;
 }
 
 
-TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, GSM::CallState state)
+TransactionRef TransactionTable::find(const L3MobileIdentity& mobileID, GSM::CallState state)
 {
 	LOG(DEBUG) << "by ID and state: " << mobileID << " in " << state;
 
-	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->GSMState() != state) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		return itr->second;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->GSMState() != state) continue;
+			if (itr->second->subscriber() != mobileID) continue;
+			return itr->second;
+		}
 	}
 	return NULL;
 }
@@ -1083,37 +1195,38 @@ bool TransactionTable::isBusy(const L3MobileIdentity& mobileID)
 {
 	LOG(DEBUG) << "id: " << mobileID << "?";
 
-	ScopedLock lock(mLock);
-
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		GSM::L3CMServiceType service = itr->second->service();
-		bool speech =
-			service==GSM::L3CMServiceType::EmergencyCall ||
-			service==GSM::L3CMServiceType::MobileOriginatedCall ||
-			service==GSM::L3CMServiceType::MobileTerminatedCall;
-		if (!speech) continue;
-		// OK, so we found a transaction for this call.
-		bool inCall =
-			itr->second->GSMState() == GSM::Paging ||
-			itr->second->GSMState() == GSM::AnsweredPaging ||
-			itr->second->GSMState() == GSM::MOCInitiated ||
-			itr->second->GSMState() == GSM::MOCProceeding ||
-			itr->second->GSMState() == GSM::MTCConfirmed ||
-			itr->second->GSMState() == GSM::CallReceived ||
-			itr->second->GSMState() == GSM::CallPresent ||
-			itr->second->GSMState() == GSM::ConnectIndication ||
-			itr->second->GSMState() == GSM::HandoverInbound ||
-			itr->second->GSMState() == GSM::HandoverProgress ||
-			itr->second->GSMState() == GSM::HandoverOutbound ||
-			itr->second->GSMState() == GSM::Active;
-		if (inCall) return true;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->subscriber() != mobileID) continue;
+			GSM::L3CMServiceType service = itr->second->service();
+			bool speech =
+				service==GSM::L3CMServiceType::EmergencyCall ||
+				service==GSM::L3CMServiceType::MobileOriginatedCall ||
+				service==GSM::L3CMServiceType::MobileTerminatedCall;
+			if (!speech) continue;
+			// OK, so we found a transaction for this call.
+			GSM::CallState state = itr->second->GSMState();
+			bool inCall =
+				state == GSM::Paging ||
+				state == GSM::AnsweredPaging ||
+				state == GSM::MOCInitiated ||
+				state == GSM::MOCProceeding ||
+				state == GSM::MTCConfirmed ||
+				state == GSM::CallReceived ||
+				state == GSM::CallPresent ||
+				state == GSM::ConnectIndication ||
+				state == GSM::HandoverInbound ||
+				state == GSM::HandoverProgress ||
+				state == GSM::HandoverOutbound ||
+				state == GSM::Active;
+			if (inCall) return true;
+		}
 	}
 	return false;
 }
@@ -1121,66 +1234,70 @@ bool TransactionTable::isBusy(const L3MobileIdentity& mobileID)
 
 
 
-TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, const char* callID)
+TransactionRef TransactionTable::find(const L3MobileIdentity& mobileID, const char* callID)
 {
 	assert(callID);
 	LOG(DEBUG) << "by ID and call-ID: " << mobileID << ", call " << callID;
 
 	string callIDString = string(callID);
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	ScopedLock lock(mLock);
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->mSIP.callID() != callIDString) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		return itr->second;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->SIPCallID() != callIDString) continue;
+			if (itr->second->subscriber() != mobileID) continue;
+			return itr->second;
+		}
 	}
 	return NULL;
 }
 
 
-TransactionEntry* TransactionTable::find(const L3MobileIdentity& mobileID, unsigned transactionID)
+TransactionRef TransactionTable::find(const L3MobileIdentity& mobileID, unsigned transactionID)
 {
 	LOG(DEBUG) << "by ID and transaction-ID: " << mobileID << ", transaction " << transactionID;
 
-	// Yes, it's linear time.
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	ScopedLock lock(mLock);
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		return itr->second;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->subscriber() != mobileID) continue;
+			return itr->second;
+		}
 	}
 	return NULL;
 }
 
 
-TransactionEntry* TransactionTable::answeredPaging(const L3MobileIdentity& mobileID)
+TransactionRef TransactionTable::answeredPaging(const L3MobileIdentity& mobileID)
 {
 	// Yes, it's linear time.
 	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
 
-	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->GSMState() != GSM::Paging) continue;
-		if (itr->second->subscriber() == mobileID) {
-			// Stop T3113 and change the state.
-			itr->second->GSMState(AnsweredPaging);
-			itr->second->resetTimer("3113");
-			return itr->second;
+	// Write locks, so that two paging responses cannot both claim the same entry.
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		Shard& s = mShards[i];
+		ScopedWriteLock lock(s.mLock);
+		for (TransactionMap::iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->GSMState() != GSM::Paging) continue;
+			if (itr->second->subscriber() == mobileID) {
+				// Stop T3113 and change the state.
+				itr->second->GSMState(AnsweredPaging);
+				itr->second->resetTimer(T3113);
+				return itr->second;
+			}
 		}
 	}
 	return NULL;
@@ -1192,19 +1309,20 @@ GSM::LogicalChannel* TransactionTable::findChannel(const L3MobileIdentity& mobil
 	// Yes, it's linear time.
 	// Even in a 6-ARFCN system, it should rarely be more than a dozen entries.
 
-	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		GSM::LogicalChannel* chan = itr->second->channel();
-		if (!chan) continue;
-		if (chan->type() == FACCHType) return chan;
-		if (chan->type() == SDCCHType) return chan;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->subscriber() != mobileID) continue;
+			GSM::LogicalChannel* chan = itr->second->channel();
+			if (!chan) continue;
+			if (chan->type() == FACCHType) return chan;
+			if (chan->type() == SDCCHType) return chan;
+		}
 	}
 	return NULL;
 }
@@ -1212,12 +1330,15 @@ GSM::LogicalChannel* TransactionTable::findChannel(const L3MobileIdentity& mobil
 
 unsigned TransactionTable::countChan(const GSM::LogicalChannel* chan)
 {
-	ScopedLock lock(mLock);
 	clearDeadEntries();
 	unsigned count = 0;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->channel() == chan) count++;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->channel() == chan) count++;
+		}
 	}
 	return count;
 }
@@ -1226,67 +1347,71 @@ unsigned TransactionTable::countChan(const GSM::LogicalChannel* chan)
 
 size_t TransactionTable::dump(ostream& os, bool showAll) const
 {
-	ScopedLock lock(mLock);
 	size_t sz = 0;
-	for (TransactionMap::const_iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if ((!showAll) && itr->second->deadOrRemoved()) continue;
-		sz++;
-		os << *(itr->second) << endl;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if ((!showAll) && itr->second->deadOrRemoved()) continue;
+			sz++;
+			os << *(itr->second) << endl;
+		}
 	}
 	return sz;
 }
 
 
-TransactionEntry* TransactionTable::findLongestCall()
+TransactionRef TransactionTable::findLongestCall()
 {
-	ScopedLock lock(mLock);
 	clearDeadEntries();
 	long longTime = 0;
-	TransactionMap::iterator longCall = mTable.end();
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (!(itr->second->channel())) continue;
-		if (itr->second->service() == GSM::L3CMServiceType::EmergencyCall) continue;
-		if (itr->second->GSMState() != GSM::Active) continue;
-		long runTime = itr->second->stateAge();
-		if (runTime > longTime) {
-			runTime = longTime;
-			longCall = itr;
+	TransactionRef longCall;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (!(itr->second->channel())) continue;
+			if (itr->second->service() == GSM::L3CMServiceType::EmergencyCall) continue;
+			if (itr->second->GSMState() != GSM::Active) continue;
+			long runTime = itr->second->stateAge();
+			if (runTime > longTime) {
+				longTime = runTime;
+				longCall = itr->second;
+			}
 		}
 	}
-	if (longCall == mTable.end()) return NULL;
-	return longCall->second;
+	return longCall;
 }
 
 /* linear, we should move the actual search into this structure */
 bool TransactionTable::RTPAvailable(short rtpPort)
 {
-	ScopedLock lock(mLock);
 	clearDeadEntries();
-	bool avail = true;
-	for (TransactionMap::iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->mSIP.RTPPort() == rtpPort){
-			avail = false;
-			break;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->mSIP.RTPPort() == rtpPort) return false;
 		}
 	}
-	return avail;
+	return true;
 }
 
 bool TransactionTable::duplicateMessage(const GSM::L3MobileIdentity& mobileID, const std::string& wMessage)
 {
-
-	ScopedLock lock(mLock);
-
-	// Since clearDeadEntries is also linear, do that here, too.
 	clearDeadEntries();
 
 	// Brute force search.
-	for (TransactionMap::const_iterator itr = mTable.begin(); itr!=mTable.end(); ++itr) {
-		if (itr->second->deadOrRemoved()) continue;
-		if (itr->second->subscriber() != mobileID) continue;
-		if (itr->second->message() == wMessage) return true;
+	for (unsigned i=0; i<TransactionTableShards; i++) {
+		const Shard& s = mShards[i];
+		ScopedReadLock lock(s.mLock);
+		for (TransactionMap::const_iterator itr = s.mMap.begin(); itr!=s.mMap.end(); ++itr) {
+			if (itr->second->deadOrRemoved()) continue;
+			if (itr->second->subscriber() != mobileID) continue;
+			if (itr->second->message() == wMessage) return true;
+		}
 	}
 	return false;
 
@@ -29,6 +29,7 @@
 #include <Logger.h>
 #include <Interthread.h>
 #include <Timeval.h>
+#include <TimerWheel.h>
 #include <Sockets.h>
 
 
@@ -51,7 +52,23 @@ struct sqlite3;
 /**@namespace Control This namepace is for use by the control layer. */
 namespace Control {
 
-typedef std::map<std::string, GSM::Z100Timer> TimerTable;
+/** The Z100-type state timers of a TransactionEntry. */
+enum TransactionTimer {
+	T301,						///< Q.931 alerting
+	T302,
+	T303,						///< Q.931 setup
+	T304,
+	T305,						///< Q.931 disconnect
+	T308,						///< Q.931 release
+	T310,						///< Q.931 call proceeding
+	T313,						///< Q.931 connect
+	T3113,						///< GSM 04.08 paging
+	TR1M,						///< GSM 04.11 RP-ACK
+	TransactionTimers
+};
+
+/** The name of a timer, for logging. */
+const char* TransactionTimerName(TransactionTimer);
 
 
 
@@ -88,7 +105,18 @@ class TransactionEntry {
 	mutable SIP::SIPState mPrevSIPState;	///< previous SIP state, prior to most recent transactions
 	GSM::CallState mGSMState;				///< the GSM/ISDN/Q.931 call state
 	Timeval mStateTimer;					///< timestamp of last state change.
-	TimerTable mTimers;						///< table of Z100-type state timers
+
+	/**@name Z100-type state timers, run by the BTS timer wheel. */
+	//@{
+	struct Timer {
+		TimerWheel::Handle mHandle;			///< pending wheel timer, or 0
+		unsigned mTag;						///< identifies the current wheel timer to the callback
+		long mLimit;						///< timeout in ms
+		bool mActive;
+	};
+	Timer mTimers[TransactionTimers];
+	unsigned mExpiredTimers;				///< expired timers, one bit per TransactionTimer
+	//@}
 
 	unsigned mNumSQLTries;					///< number of SQL tries for DB operations
 
@@ -98,6 +126,8 @@ class TransactionEntry {
 
 	volatile bool mRemoved;			///< true if ready for removal
 
+	volatile int mRefCount;			///< number of holders, including the table itself
+
 	bool mFake;					///true if this is a fake message generated internally	
 
 	public:
@@ -232,10 +262,21 @@ class TransactionEntry {
 
 	bool sendINFOAndWaitForOK(unsigned info);
 
-	void txFrame(unsigned char* frame) { ScopedLock lock(mLock); return mSIP.txFrame(frame); }
-	int rxFrame(unsigned char* frame) { ScopedLock lock(mLock); return mSIP.rxFrame(frame); }
-	bool startDTMF(char key) { ScopedLock lock(mLock); return mSIP.startDTMF(key); }
-	void stopDTMF() { ScopedLock lock(mLock); mSIP.stopDTMF(); }
+	unsigned codec() const { ScopedLock lock(mLock); return mSIP.codec(); }
+	int RTPSocket() const { ScopedLock lock(mLock); return mSIP.RTPSocket(); }
+
+	/**@name RTP and DTMF.
+		These are serialized by the SIP engine's RTP lock, not mLock,
+		so the media engine never waits on a transaction's signalling or database writes.
+	*/
+	//@{
+	void txFrame(unsigned char* frame, unsigned length=33) { mSIP.txFrame(frame,length); }
+	int rxFrame(unsigned char* frame) { return mSIP.rxFrame(frame); }
+	int rxPacket(unsigned char* frame, unsigned maxLength, uint32_t& timestamp)
+		{ return mSIP.rxPacket(frame,maxLength,timestamp); }
+	bool startDTMF(char key) { return mSIP.startDTMF(key); }
+	void stopDTMF() { mSIP.stopDTMF(); }
+	//@}
 
 	void SIPUser(const std::string& IMSI) { ScopedLock lock(mLock); SIPUser(IMSI.c_str()); }
 	void SIPUser(const char* IMSI);
@@ -259,15 +300,15 @@ class TransactionEntry {
 	/**@name Timer access. */
 	//@{
 
-	bool timerExpired(const char* name) const;
+	bool timerExpired(TransactionTimer) const;
 
-	void setTimer(const char* name);
+	void setTimer(TransactionTimer);
 
-	void setTimer(const char* name, long newLimit);
+	void setTimer(TransactionTimer, long newLimit);
 
-	void resetTimer(const char* name);
+	void resetTimer(TransactionTimer);
 
-	/** Return true if any Q.931 timer is expired. */
+	/** Return true if any Q.931 timer is expired; this does not read the clock. */
 	bool anyTimerExpired() const;
 
 	/** Reset all Q.931 timers. */
@@ -278,15 +319,36 @@ class TransactionEntry {
 	/** Return true if clearing is in progress in the GSM side. */
 	bool clearingGSM() const;
 
-	/** Retrns true if the transaction is "dead". */
+	/**
+		Retrns true if the transaction is "dead".
+		Never blocks; an entry whose lock is held is taken to be alive.
+	*/
 	bool dead() const;
 
-	/** Returns true if dead, or if removal already requested. */
+	/** Returns true if dead, or if removal already requested.  Never blocks, like dead(). */
 	bool deadOrRemoved() const;
 
 	/** Dump information as text for debugging. */
 	void text(std::ostream&) const;
 
+	/**@name Reference counting. */
+	//@{
+	/**
+		Take a reference to keep this entry from being reaped by the table,
+		even after it is removed or goes defunct.
+	*/
+	void incRef() { __sync_add_and_fetch(&mRefCount,1); }
+
+	/**
+		Release a reference.
+		The entry is deleted when the last reference is released.
+	*/
+	void decRef() { if (__sync_sub_and_fetch(&mRefCount,1)==0) delete this; }
+
+	/** Return the number of outstanding references. */
+	int refCount() const { return mRefCount; }
+	//@}
+
 	private:
 
 	friend class TransactionTable;
@@ -294,6 +356,12 @@ class TransactionEntry {
 	/** Create L3 timers from GSM and Q.931 (network side) */
 	void initTimers();
 
+	/** Stop a timer; caller holds mLock. */
+	void stopTimer(TransactionTimer);
+
+	/** Expiration of a wheel timer; tag identifies the timer. */
+	void expire(unsigned tag);
+
 	/** Set up a new entry in gTransactionTable's sqlite3 database. */
 	void insertIntoDatabase();
 
@@ -314,21 +382,84 @@ class TransactionEntry {
 std::ostream& operator<<(std::ostream& os, const TransactionEntry&);
 
 
+/**
+	A counted reference to a TransactionEntry.
+	The table lookups return these, taken under the table lock,
+	so the reaper cannot delete the entry while the caller is using it.
+	The reference is released when the last copy goes out of scope.
+*/
+class TransactionRef {
+
+	private:
+	TransactionEntry* mEntry;
+
+	public:
+	TransactionRef(TransactionEntry* wEntry=NULL)
+		:mEntry(wEntry)
+		{ if (mEntry) mEntry->incRef(); }
+
+	TransactionRef(const TransactionRef& other)
+		:mEntry(other.mEntry)
+		{ if (mEntry) mEntry->incRef(); }
+
+	~TransactionRef() { if (mEntry) mEntry->decRef(); }
+
+	TransactionRef& operator=(const TransactionRef& other)
+	{
+		if (other.mEntry) other.mEntry->incRef();
+		if (mEntry) mEntry->decRef();
+		mEntry = other.mEntry;
+		return *this;
+	}
+
+	TransactionEntry* get() const { return mEntry; }
+	TransactionEntry* operator->() const { return mEntry; }
+	TransactionEntry& operator*() const { return *mEntry; }
+	bool operator!() const { return mEntry==NULL; }
+};
+
+
 /** A map of transactions keyed by ID. */
 class TransactionMap : public std::map<unsigned,TransactionEntry*> {};
 
+
+/** Number of independently locked shards in the TransactionTable. */
+const unsigned TransactionTableShards = 16;
+
+/** Minimum interval between passes of the dead entry reaper, in ms. */
+const unsigned TransactionTableReapInterval = 1000;
+
+
 /**
 	A table for tracking the states of active transactions.
+	The table is sharded by transaction ID, each shard with its own reader/writer lock,
+	so that lookups only contend with writers on the same shard.
+	The table holds one reference on each entry; see TransactionEntry::incRef.
+	Lookups return a TransactionRef, so a caller holds its own reference.
+	Removed and defunct entries are skipped by lookups and
+	deleted by a periodic reaper once the table holds the only reference.
 */
 class TransactionTable {
 
 	private:
 
+	/** One independently locked partition of the table. */
+	struct Shard {
+		TransactionMap mMap;
+		mutable RWLock mLock;
+	};
+
 	sqlite3 *mDB;			///< database connection
 
-	TransactionMap mTable;
-	mutable Mutex mLock;
+	Shard mShards[TransactionTableShards];
+	Mutex mIDLock;			///< protects mIDCounter
 	unsigned mIDCounter;
+	Mutex mReapLock;		///< only one thread reaps at a time
+	Timeval mLastReap;		///< time of the last reaper pass
+
+	/** Return the shard that holds a given transaction ID. */
+	Shard& shard(unsigned wID) { return mShards[wID % TransactionTableShards]; }
+	const Shard& shard(unsigned wID) const { return mShards[wID % TransactionTableShards]; }
 
 	public:
 
@@ -354,17 +485,24 @@ class TransactionTable {
 	void add(TransactionEntry* value);
 
 	/**
-		Find an entry and return a pointer into the table.
+		Find an entry and return a reference to it.
 		@param wID The transaction ID to search
 		@return NULL if ID is not found or was dead
 	*/
-	TransactionEntry* find(unsigned wID);
+	TransactionRef find(unsigned wID);
+
+	/**
+		Deliver a timer expiration to an entry, if it is still in the table.
+		@param wID The transaction ID.
+		@param tag The tag of the wheel timer.
+	*/
+	void expireTimer(unsigned wID, unsigned tag);
 
 	/**
 		Find the longest-running non-SOS call.
 		@return NULL if there are no calls or if all are SOS.
 	*/
-	TransactionEntry* findLongestCall();
+	TransactionRef findLongestCall();
 
 	/**
 		Return the availability of this particular RTP port
@@ -394,43 +532,43 @@ class TransactionTable {
 		Find an entry by its channel pointer; returns first entry found.
 		Also clears dead entries during search.
 		@param chan The channel pointer.
-		@return pointer to entry or NULL if no active match
+		@return a reference to the entry, or NULL if no active match
 	*/
-	TransactionEntry* find(const GSM::LogicalChannel *chan);
+	TransactionRef find(const GSM::LogicalChannel *chan);
 
 	/**
 		Find an entry by its SACCH channel pointer; returns first entry found.
 		Also clears dead entries during search.
 		@param chan The channel pointer.
-		@return pointer to entry or NULL if no active match
+		@return a reference to the entry, or NULL if no active match
 	*/
-	TransactionEntry* findBySACCH(const GSM::SACCHLogicalChannel *chan);
+	TransactionRef findBySACCH(const GSM::SACCHLogicalChannel *chan);
 
 	/**
 		Find an entry by its channel type and offset.
 		Also clears dead entries during search.
 		@param chan The channel pointer to the first record found.
-		@return pointer to entry or NULL if no active match
+		@return a reference to the entry, or NULL if no active match
 	*/
-	TransactionEntry* find(GSM::TypeAndOffset chanDesc);
+	TransactionRef find(GSM::TypeAndOffset chanDesc);
 
 	/**
 		Find an entry in the given state by its mobile ID.
 		Also clears dead entries during search.
 		@param mobileID The mobile to search for.
-		@return pointer to entry or NULL if no match
+		@return a reference to the entry, or NULL if no match
 	*/
-	TransactionEntry* find(const GSM::L3MobileIdentity& mobileID, GSM::CallState state);
+	TransactionRef find(const GSM::L3MobileIdentity& mobileID, GSM::CallState state);
 
 	/** Return true if there is an ongoing call for this user. */
 	bool isBusy(const GSM::L3MobileIdentity& mobileID);
 
 
 	/** Find by subscriber and SIP call ID. */
-	TransactionEntry* find(const GSM::L3MobileIdentity& mobileID, const char* callID);
+	TransactionRef find(const GSM::L3MobileIdentity& mobileID, const char* callID);
 
 	/** Find by subscriber and handover other BS transaction ID. */
-	TransactionEntry* find(const GSM::L3MobileIdentity& mobileID, unsigned transactionID);
+	TransactionRef find(const GSM::L3MobileIdentity& mobileID, unsigned transactionID);
 
 	/** Check for duplicated SMS delivery attempts. */
 	bool duplicateMessage(const GSM::L3MobileIdentity& mobileID, const std::string& wMessage);
@@ -439,9 +577,9 @@ class TransactionTable {
 		Find an entry in the Paging state by its mobile ID, change state to AnsweredPaging and reset T3113.
 		Also clears dead entries during search.
 		@param mobileID The mobile to search for.
-		@return pointer to entry or NULL if no match
+		@return a reference to the entry, or NULL if no match
 	*/
-	TransactionEntry* answeredPaging(const GSM::L3MobileIdentity& mobileID);
+	TransactionRef answeredPaging(const GSM::L3MobileIdentity& mobileID);
 
 
 	/**
@@ -454,7 +592,7 @@ class TransactionTable {
 	/** Count the number of transactions using a particular channel. */
 	unsigned countChan(const GSM::LogicalChannel*);
 
-	size_t size() { ScopedLock lock(mLock); return mTable.size(); }
+	size_t size() const;
 
 	size_t dump(std::ostream& os, bool showAll=false) const;
 
@@ -467,16 +605,13 @@ class TransactionTable {
 
 	/**
 		Remove "dead" entries from the table.
-		A "dead" entry is a transaction that is no longer active.
-		The caller should hold mLock.
+		A "dead" entry is a transaction that is no longer active
+		and that is referenced by nothing but the table.
+		Rate-limited to one pass per TransactionTableReapInterval.
+		The caller should not hold any shard lock.
 	*/
 	void clearDeadEntries();
 
-	/**
-		Remove and entry from the table and from gSIPInterface.
-	*/
-	void innerRemove(TransactionMap::iterator);
-
 
 };
 
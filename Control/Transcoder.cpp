@@ -0,0 +1,110 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include <config.h>
+
+#include "Transcoder.h"
+#include "TransactionTable.h"
+
+#include <G711.h>
+#include <Logger.h>
+#include <SIPUtility.h>
+
+#include <string.h>
+
+#ifdef HAVE_LIBGSM
+#if defined(HAVE_GSM_H)
+#include <gsm.h>
+#elif defined(HAVE_GSM_GSM_H)
+#include <gsm/gsm.h>
+#endif
+#endif
+
+
+using namespace Control;
+
+
+Transcoder::Transcoder(unsigned wCodec)
+	:mCodec(wCodec),mEncoder(NULL),mDecoder(NULL)
+{
+	assert(SIP::transcodable(mCodec));
+#ifdef HAVE_LIBGSM
+	mEncoder = gsm_create();
+	mDecoder = gsm_create();
+#endif
+	if (!mEncoder || !mDecoder) LOG(ALERT) << "cannot create GSM 06.10 codec for payload type " << mCodec;
+}
+
+
+Transcoder::~Transcoder()
+{
+#ifdef HAVE_LIBGSM
+	if (mEncoder) gsm_destroy((gsm)mEncoder);
+	if (mDecoder) gsm_destroy((gsm)mDecoder);
+#endif
+}
+
+
+unsigned Transcoder::uplink(const unsigned char *gsmFrame, unsigned char *payload)
+{
+#ifdef HAVE_LIBGSM
+	if (!mDecoder) return 0;
+	// libgsm wants a non-const frame, but does not modify it.
+	gsm_byte frame[GSMFrameBytes];
+	memcpy(frame,gsmFrame,GSMFrameBytes);
+	gsm_signal pcm[SpeechFrameSamples];
+	if (gsm_decode((gsm)mDecoder,frame,pcm)) {
+		LOG(NOTICE) << "bad GSM 06.10 frame on uplink";
+		return 0;
+	}
+	if (mCodec==SIP::RTPuLaw) ulawEncode(pcm,payload,SpeechFrameSamples);
+	else alawEncode(pcm,payload,SpeechFrameSamples);
+	return SpeechFrameSamples;
+#else
+	return 0;
+#endif
+}
+
+
+bool Transcoder::downlink(const unsigned char *payload, unsigned length, unsigned char *gsmFrame)
+{
+#ifdef HAVE_LIBGSM
+	if (!mEncoder) return false;
+	if (length!=SpeechFrameSamples) {
+		LOG(NOTICE) << "unexpected G.711 payload length " << length;
+		return false;
+	}
+	gsm_signal pcm[SpeechFrameSamples];
+	if (mCodec==SIP::RTPuLaw) ulawDecode(payload,pcm,SpeechFrameSamples);
+	else alawDecode(payload,pcm,SpeechFrameSamples);
+	gsm_encode((gsm)mEncoder,pcm,gsmFrame);
+	return true;
+#else
+	return false;
+#endif
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,94 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef TRANSCODER_H
+#define TRANSCODER_H
+
+
+namespace Control {
+
+
+/** Size of a GSM 06.10 frame in RTP (RFC-3551 4.5.8) format, in bytes. */
+const unsigned GSMFrameBytes = 33;
+
+/** Samples per 20 ms speech frame at 8 kHz. */
+const unsigned SpeechFrameSamples = 160;
+
+
+/**
+	Converts speech between the GSM 06.10 full-rate frames on the TCH
+	and a G.711 RTP payload, so the switch does not have to.
+	GSM 06.10 coding is done by libgsm; if OpenBTS was built without it,
+	SIP::transcodingEnabled() is false and calls stay in GSM 06.10 end to end.
+	The payload types that need a Transcoder are given by SIP::transcodable().
+	Each call gets its own Transcoder, since the codec keeps state.
+*/
+class Transcoder {
+
+	private:
+
+	unsigned mCodec;		///< RTP payload type on the far side, SIP::RTPCodec
+	void *mEncoder;			///< libgsm encoder state
+	void *mDecoder;			///< libgsm decoder state
+
+	/** Not copyable; the codec states are owned. */
+	Transcoder(const Transcoder&);
+	Transcoder& operator=(const Transcoder&);
+
+	public:
+
+	/** @param wCodec The RTP payload type on the far side, PCMU or PCMA. */
+	Transcoder(unsigned wCodec);
+
+	~Transcoder();
+
+	unsigned codec() const { return mCodec; }
+
+	/**
+		Convert an uplink GSM 06.10 frame to the RTP payload.
+		@param gsmFrame GSMFrameBytes of GSM 06.10, in RTP format.
+		@param payload Buffer of at least SpeechFrameSamples bytes.
+		@return The payload length, or 0 on failure.
+	*/
+	unsigned uplink(const unsigned char *gsmFrame, unsigned char *payload);
+
+	/**
+		Convert a downlink RTP payload to a GSM 06.10 frame.
+		@param payload The G.711 payload.
+		@param length The payload length; must be SpeechFrameSamples.
+		@param gsmFrame Buffer of GSMFrameBytes, filled in RTP format.
+		@return True on success.
+	*/
+	bool downlink(const unsigned char *payload, unsigned length, unsigned char *gsmFrame);
+
+};
+
+
+}	// Control
+
+
+#endif
+
+// vim: ts=4 sw=4
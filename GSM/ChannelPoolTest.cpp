@@ -0,0 +1,185 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "GSMChannelPool.h"
+
+#include <iostream>
+
+using namespace std;
+using namespace GSM;
+
+
+unsigned gFailures = 0;
+
+void check(bool ok, const char *what)
+{
+	cout << (ok ? "OK   " : "FAIL ") << what << endl;
+	if (!ok) gFailures++;
+}
+
+
+/** Just enough of a logical channel for the pool. */
+class FakeChannel {
+
+	private:
+
+	unsigned mCN;
+	unsigned mTN;
+
+	public:
+
+	bool mRecyclable;
+
+	FakeChannel(unsigned wCN=0, unsigned wTN=0)
+		:mCN(wCN),mTN(wTN),mRecyclable(false)
+	{ }
+
+	unsigned CN() const { return mCN; }
+	unsigned TN() const { return mTN; }
+	bool recyclable() const { return mRecyclable; }
+
+	/** Recycle, the way L1 does, and report it. */
+	void recycle(ChannelPool<FakeChannel>& pool)
+	{
+		mRecyclable = true;
+		pool.recycled(this);
+	}
+};
+
+
+/** Allocate a channel and open it, the way GSMConfig does. */
+FakeChannel* take(ChannelPool<FakeChannel>& pool)
+{
+	FakeChannel *chan = pool.allocate();
+	if (chan) chan->mRecyclable = false;
+	return chan;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	// Channels still in use when they are added start out busy.
+	{
+		ChannelPool<FakeChannel> pool;
+		FakeChannel a, b;
+		pool.add(&a);
+		pool.add(&b);
+		check(pool.total()==2 && pool.available()==0 && pool.active()==2, "unrecyclable channels are added busy");
+		check(pool.allocate()==NULL, "nothing to allocate");
+		a.recycle(pool);
+		check(pool.available()==1 && pool.active()==1, "a recycled channel is available at once");
+		check(take(pool)==&a, "the recycled channel is allocated");
+		check(pool.available()==0 && pool.allocate()==NULL, "and is busy again");
+	}
+
+	// Reports that do not free anything.
+	{
+		ChannelPool<FakeChannel> pool;
+		FakeChannel a, other;
+		pool.add(&a);
+		pool.recycled(&a);
+		check(pool.available()==0, "a report for an unrecyclable channel is ignored");
+		a.recycle(pool);
+		pool.recycled(&a);
+		check(pool.available()==1, "a repeated report is ignored");
+		other.recycle(pool);
+		check(pool.available()==1 && pool.total()==1, "a report for a channel not in the pool is ignored");
+	}
+
+	// LRU within and across timeslots.
+	{
+		ChannelPool<FakeChannel> pool;
+		FakeChannel a(0,1), b(0,2), c(0,1);
+		a.mRecyclable = true;
+		b.mRecyclable = true;
+		c.mRecyclable = true;
+		pool.add(&a);
+		pool.add(&b);
+		pool.add(&c);
+		check(pool.available()==3, "recyclable channels are added free");
+		check(take(pool)==&a && take(pool)==&b, "LRU order as added");
+		a.recycle(pool);
+		check(take(pool)==&c && take(pool)==&a, "LRU order as recycled");
+		check(pool.allocate()==NULL, "pool empty");
+	}
+
+	// Pack fills the busiest timeslot first.
+	{
+		ChannelPool<FakeChannel> pool;
+		pool.policy(PackAllocation);
+		FakeChannel a(0,1), b(0,2), c(0,2);
+		a.mRecyclable = true;
+		b.mRecyclable = true;
+		pool.add(&a);
+		pool.add(&b);
+		pool.add(&c);
+		check(take(pool)==&b, "pack onto a busy timeslot");
+		c.recycle(pool);
+		check(take(pool)==&c, "pack onto the busiest timeslot");
+	}
+
+	// Spread takes the least loaded carrier.
+	{
+		ChannelPool<FakeChannel> pool;
+		pool.policy(SpreadAllocation);
+		FakeChannel a(0,1), b(0,2), c(1,1), d(1,2);
+		a.mRecyclable = true;
+		b.mRecyclable = true;
+		c.mRecyclable = true;
+		d.mRecyclable = true;
+		pool.add(&a);
+		pool.add(&b);
+		pool.add(&c);
+		pool.add(&d);
+		FakeChannel *first = take(pool);
+		FakeChannel *second = take(pool);
+		check(first->CN()!=second->CN(), "spread across carriers");
+		FakeChannel *third = take(pool);
+		FakeChannel *fourth = take(pool);
+		check(third->CN()!=fourth->CN() && pool.allocate()==NULL, "spread until the pool is empty");
+	}
+
+	// A free channel that was opened behind the pool's back is skipped.
+	{
+		ChannelPool<FakeChannel> pool;
+		FakeChannel a, b;
+		a.mRecyclable = true;
+		b.mRecyclable = true;
+		pool.add(&a);
+		pool.add(&b);
+		a.mRecyclable = false;
+		check(take(pool)==&b, "an opened free channel is skipped");
+		check(pool.available()==0 && pool.allocate()==NULL, "and is counted busy");
+		a.recycle(pool);
+		check(take(pool)==&a, "until it is recycled again");
+	}
+
+	cout << gFailures << " failures" << endl;
+	return gFailures ? 1 : 0;
+}
+
+// vim: ts=4 sw=4
@@ -0,0 +1,253 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef GSMCHANNELPOOL_H
+#define GSMCHANNELPOOL_H
+
+#include <deque>
+#include <map>
+#include <vector>
+#include <assert.h>
+#include <strings.h>
+
+#include <Threads.h>
+
+
+namespace GSM {
+
+
+/** How a ChannelPool chooses among free channels. */
+enum ChannelAllocationPolicy {
+	LRUAllocation,			///< the channel that has been free the longest
+	SpreadAllocation,		///< a channel on the least loaded carrier
+	PackAllocation			///< a channel on the busiest timeslot, so other slots stay idle
+};
+
+/** Decode a GSM.Channels.Allocation value; anything unknown is LRU. */
+inline ChannelAllocationPolicy channelAllocationPolicy(const char* name)
+{
+	if (strcasecmp(name,"spread")==0) return SpreadAllocation;
+	if (strcasecmp(name,"pack")==0) return PackAllocation;
+	return LRUAllocation;
+}
+
+
+/**
+	A pool of allocatable dedicated channels with per-timeslot free lists.
+	L1 reports each channel as it becomes recyclable, through recycled(),
+	and the reports are moved onto the free lists before the next allocation
+	or count, so nothing scans the pool.
+	ChanType needs CN(), TN() and recyclable().
+	Apart from recycled(), which any thread may call, the pool does no locking
+	of its own; GSMConfig serializes access.
+*/
+template <class ChanType> class ChannelPool {
+
+	private:
+
+	struct FreeChannel {
+		ChanType *mChan;
+		unsigned long mStamp;	///< release order, for LRU
+	};
+
+	/** The channels of this pool on one timeslot. */
+	struct Slot {
+		unsigned mCN;
+		unsigned mTN;
+		unsigned mBusy;
+		std::deque<FreeChannel> mFree;		///< oldest release first
+	};
+
+	/** Where a channel lives in the pool. */
+	struct Member {
+		unsigned mSlot;			///< index into mSlots
+		bool mBusy;				///< true unless the channel is on a free list
+	};
+
+	typedef std::map<ChanType*,Member> MemberMap;
+
+	std::vector<Slot> mSlots;
+	std::vector<unsigned> mCarrierBusy;		///< busy channels per CN
+	MemberMap mMembers;
+	Mutex mPendingLock;					///< protects mPending only
+	std::vector<ChanType*> mPending;	///< channels reported recyclable since the last drain
+	std::vector<ChanType*> mDraining;	///< scratch for drain()
+	unsigned mFreeCount;
+	unsigned long mStamp;
+	ChannelAllocationPolicy mPolicy;
+
+	public:
+
+	ChannelPool()
+		:mFreeCount(0),mStamp(0),
+		mPolicy(LRUAllocation)
+	{ }
+
+	void policy(ChannelAllocationPolicy wPolicy) { mPolicy = wPolicy; }
+
+	/**
+		Add a channel during initialization.
+		It starts out busy unless it is already recyclable.
+	*/
+	void add(ChanType *chan)
+	{
+		unsigned CN = chan->CN();
+		unsigned TN = chan->TN();
+		unsigned index = 0;
+		while (index<mSlots.size() && (mSlots[index].mCN!=CN || mSlots[index].mTN!=TN)) index++;
+		if (index==mSlots.size()) {
+			mSlots.push_back(Slot());
+			mSlots[index].mCN = CN;
+			mSlots[index].mTN = TN;
+			mSlots[index].mBusy = 0;
+		}
+		if (CN>=mCarrierBusy.size()) mCarrierBusy.resize(CN+1,0);
+		Member& member = mMembers[chan];
+		member.mSlot = index;
+		markBusy(member);
+		release(chan);
+	}
+
+	/**
+		Report that a channel has become recyclable.
+		This takes only a leaf lock, so L1 can call it from any thread with its own locks held.
+	*/
+	void recycled(ChanType *chan)
+	{
+		ScopedLock lock(mPendingLock);
+		mPending.push_back(chan);
+	}
+
+	/**
+		Take a recyclable channel according to the policy.
+		The caller opens it.
+		@return The channel, or NULL if none is free.
+	*/
+	ChanType* allocate()
+	{
+		drain();
+		while (mFreeCount) {
+			unsigned index = pick();
+			Slot &slot = mSlots[index];
+			ChanType *chan = slot.mFree.front().mChan;
+			slot.mFree.pop_front();
+			mFreeCount--;
+			markBusy(mMembers[chan]);
+			// Nothing else opens free channels, but be sure.
+			// If one was, it is reported again when it is recyclable again.
+			if (chan->recyclable()) return chan;
+		}
+		return NULL;
+	}
+
+	/** Number of channels on the free lists. */
+	unsigned available() { drain(); return mFreeCount; }
+
+	/** Number of channels in use. */
+	unsigned active() { drain(); return mMembers.size() - mFreeCount; }
+
+	unsigned total() const { return mMembers.size(); }
+
+	private:
+
+	/** Move the reported channels onto the free lists. */
+	void drain()
+	{
+		{
+			ScopedLock lock(mPendingLock);
+			if (mPending.empty()) return;
+			mDraining.swap(mPending);
+		}
+		for (unsigned i=0; i<mDraining.size(); i++) release(mDraining[i]);
+		mDraining.clear();
+	}
+
+	/**
+		Put a busy channel back on its free list if it is recyclable.
+		Channels that are not in the pool, not busy or not recyclable are ignored.
+	*/
+	void release(ChanType *chan)
+	{
+		typename MemberMap::iterator itr = mMembers.find(chan);
+		if (itr==mMembers.end()) return;
+		Member& member = itr->second;
+		if (!member.mBusy) return;
+		if (!chan->recyclable()) return;
+		Slot &slot = mSlots[member.mSlot];
+		member.mBusy = false;
+		slot.mBusy--;
+		mCarrierBusy[slot.mCN]--;
+		FreeChannel entry;
+		entry.mChan = chan;
+		entry.mStamp = mStamp++;
+		slot.mFree.push_back(entry);
+		mFreeCount++;
+	}
+
+	void markBusy(Member& member)
+	{
+		member.mBusy = true;
+		mSlots[member.mSlot].mBusy++;
+		mCarrierBusy[mSlots[member.mSlot].mCN]++;
+	}
+
+	/** Return the index of a slot with a free channel, by policy; there must be one. */
+	unsigned pick() const
+	{
+		unsigned best = mSlots.size();
+		for (unsigned i=0; i<mSlots.size(); i++) {
+			const Slot &slot = mSlots[i];
+			if (slot.mFree.empty()) continue;
+			if (best==mSlots.size()) { best = i; continue; }
+			const Slot &other = mSlots[best];
+			bool older = slot.mFree.front().mStamp < other.mFree.front().mStamp;
+			switch (mPolicy) {
+				case SpreadAllocation: {
+					unsigned load = mCarrierBusy[slot.mCN];
+					unsigned otherLoad = mCarrierBusy[other.mCN];
+					if (load<otherLoad || (load==otherLoad && older)) best = i;
+					break;
+				}
+				case PackAllocation:
+					if (slot.mBusy>other.mBusy) best = i;
+					break;
+				default:
+					if (older) best = i;
+			}
+		}
+		assert(best<mSlots.size());
+		return best;
+	}
+
+};
+
+
+}	// GSM
+
+
+#endif
+
+// vim: ts=4 sw=4
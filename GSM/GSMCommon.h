@@ -85,6 +85,9 @@ std::ostream& operator<<(std::ostream& os, CallState state);
 
 class GSMError {};
 
+/** Maximum number of 51-multiframes in a paging cycle, BS_PA_MFRMS, GSM 05.02 3.3.2.3. */
+const unsigned MaxPagingMultiframes = 9;
+
 /** Duration ofa GSM frame, in microseconds. */
 const unsigned gFrameMicroseconds = 4615;
 
@@ -160,6 +163,14 @@ const unsigned TR1Mms = 30000;		///< RP-ACK timeout
 //@}
 
 
+/**@name Resolution of the BTS timer wheel, which is driven by the TDMA frame clock. */
+//@{
+const unsigned TimerTickFrames = 13;	///< TDMA frames per tick
+const unsigned TimerTickms = 60;		///< tick length; 13 frames are exactly 60 ms
+const unsigned TimerResyncTicks = 4;	///< ticks the clock may jump before the wheel resyncs to it
+//@}
+
+
 
 
 /** GSM 04.08 Table 10.5.118 and GSM 03.40 9.1.2.5 */
@@ -31,6 +31,9 @@
 #include <Reporting.h>
 #include <Globals.h>
 
+#include <string.h>
+#include <ctype.h>
+
 
 using namespace std;
 using namespace GSM;
@@ -39,7 +42,10 @@ using namespace GSM;
 
 GSMConfig::GSMConfig()
 	:
+	mTimers(TimerTickms),
 	mSI5Frame(UNIT_DATA),mSI6Frame(UNIT_DATA),
+	mBeaconGeneration(0),
+	mPagingMultiframes(1),mPagingBlocks(1),
 	mStartTime(::time(NULL))
 {
 }
@@ -48,6 +54,9 @@ void GSMConfig::init()
 {
 	mBand = (GSMBand)gConfig.getNum("GSM.Radio.Band");
 	mT3122 = gConfig.getNum("GSM.Timer.T3122Min");
+	ChannelAllocationPolicy policy = channelAllocationPolicy(gConfig.getStr("GSM.Channels.Allocation","LRU").c_str());
+	mSDCCHFreePool.policy(policy);
+	mTCHFreePool.policy(policy);
 	regenerateBeacon();
 }
 
@@ -58,6 +67,29 @@ void GSMConfig::start()
 	mPager.start();
 	// Do not call this until AGCHs are installed.
 	mAccessGrantThread.start(Control::AccessGrantServiceLoop,NULL);
+	mTimerThread.start((void*(*)(void*))TimerServiceLoop,this);
+}
+
+
+void *GSM::TimerServiceLoop(GSMConfig *BTS)
+{
+	// Wait from the last tick, not from the frame we woke at,
+	// so that wake-up latency does not accumulate and slow every timer.
+	// If the clock jumps, resync to it rather than expire a burst of timers.
+	static const int resync = TimerResyncTicks*TimerTickFrames;
+	Clock& clock = BTS->clock();
+	Time next = clock.get() + TimerTickFrames;
+	while (true) {
+		clock.wait(next);
+		BTS->timers().tick();
+		next += TimerTickFrames;
+		int ahead = next - clock.get();
+		if (ahead<-resync || ahead>resync) {
+			LOG(NOTICE) << "clock jumped " << -ahead << " frames; resyncing the timer wheel";
+			next = clock.get() + TimerTickFrames;
+		}
+	}
+	return NULL;
 }
 
 
@@ -79,6 +111,12 @@ void GSMConfig::regenerateBeacon()
 	// MCC/MNC/LAC
 	mLAI = L3LocationAreaIdentity();
 
+	// Paging group parameters must track what we advertise in SI3.
+	L3ControlChannelDescription CCD;
+	mPagingMultiframes = CCD.pagingMultiframes();
+	mPagingBlocks = CCD.pagingBlocks();
+	LOG(INFO) << "paging groups: " << mPagingMultiframes << " multiframes x " << mPagingBlocks << " blocks";
+
 	// Now regenerate all of the system information messages.
 
 	// SI1
@@ -129,12 +167,32 @@ void GSMConfig::regenerateBeacon()
 	SI6.write(mSI6Frame);
 	LOG(DEBUG) "mSI6Frame " << mSI6Frame;
 
+	// Do this last, after the new frames are in place.
+	mBeaconGeneration++;
 }
 
 
 
 
 
+unsigned GSMConfig::pagingGroup(const char* IMSI) const
+{
+	// GSM 05.02 6.5.2: PAGING_GROUP = (IMSI mod 1000) mod (BS_CC_CHANS x N).
+	// We have BS_CC_CHANS=1, so only the last 3 digits matter.
+	if (!IMSI) return 0;
+	size_t len = strlen(IMSI);
+	if (len<3) return 0;
+	unsigned val = 0;
+	for (size_t i=len-3; i<len; i++) {
+		if (!isdigit(IMSI[i])) return 0;
+		val = val*10 + (IMSI[i]-'0');
+	}
+	return val % pagingGroups();
+}
+
+
+
+
 CCCHLogicalChannel* GSMConfig::minimumLoad(CCCHList &chanList)
 {
 	if (chanList.size()==0) return NULL;
@@ -158,30 +216,56 @@ CCCHLogicalChannel* GSMConfig::minimumLoad(CCCHList &chanList)
 
 
 
-template <class ChanType> ChanType* getChan(vector<ChanType*>& chanList)
+/** L1 recycling callbacks for the channel pools. */
+static void SDCCHRecyclable(void *chan)
 {
-	const unsigned sz = chanList.size();
-	if (sz==0) return NULL;
-	// Start the search from a random point in the list.
-	//unsigned pos = random() % sz;
-	// HACK -- Try in-order allocation for debugging.
-	for (unsigned i=0; i<sz; i++) {
-		ChanType *chan = chanList[i];
-		//ChanType *chan = chanList[pos];
-		if (chan->recyclable()) return chan;
-		//pos = (pos+1) % sz;
-	}
-	return NULL;
+	gBTS.recycleSDCCH((SDCCHLogicalChannel*)chan);
 }
 
+static void TCHRecyclable(void *chan)
+{
+	gBTS.recycleTCH((TCHFACCHLogicalChannel*)chan);
+}
 
 
+void GSMConfig::addSDCCH(SDCCHLogicalChannel *wSDCCH)
+{
+	mSDCCHPool.push_back(wSDCCH);
+	// The L1 timers are already running, so the callback may come at any time.
+	wSDCCH->recycleCallback(SDCCHRecyclable,wSDCCH);
+	ScopedLock lock(mLock);
+	mSDCCHFreePool.add(wSDCCH);
+}
+
+
+void GSMConfig::addTCH(TCHFACCHLogicalChannel *wTCH)
+{
+	mTCHPool.push_back(wTCH);
+	wTCH->recycleCallback(TCHRecyclable,wTCH);
+	ScopedLock lock(mLock);
+	mTCHFreePool.add(wTCH);
+}
+
+
+// These come from L1 with L1 and L2 locks held, so they do not take mLock.
+
+void GSMConfig::recycleSDCCH(SDCCHLogicalChannel *wSDCCH)
+{
+	mSDCCHFreePool.recycled(wSDCCH);
+}
+
+
+void GSMConfig::recycleTCH(TCHFACCHLogicalChannel *wTCH)
+{
+	mTCHFreePool.recycled(wTCH);
+}
+
 
 
 SDCCHLogicalChannel *GSMConfig::getSDCCH()
 {
 	ScopedLock lock(mLock);
-	SDCCHLogicalChannel *chan = getChan<SDCCHLogicalChannel>(mSDCCHPool);
+	SDCCHLogicalChannel *chan = mSDCCHFreePool.allocate();
 	if (chan) chan->open();
 	return chan;
 }
@@ -190,7 +274,7 @@ SDCCHLogicalChannel *GSMConfig::getSDCCH()
 TCHFACCHLogicalChannel *GSMConfig::getTCH()
 {
 	ScopedLock lock(mLock);
-	TCHFACCHLogicalChannel *chan = getChan<TCHFACCHLogicalChannel>(mTCHPool);
+	TCHFACCHLogicalChannel *chan = mTCHFreePool.allocate();
 	if (chan) {
 	    chan->open();
 	    gReports.incr("OpenBTS.GSM.RR.ChannelAssignment");
@@ -200,27 +284,16 @@ TCHFACCHLogicalChannel *GSMConfig::getTCH()
 
 
 
-template <class ChanType> size_t chanAvailable(const vector<ChanType*>& chanList)
-{
-	size_t count = 0;
-	for (unsigned i=0; i<chanList.size(); i++) {
-		if (chanList[i]->recyclable()) count++;
-	}
-	return count;
-}
-
-
-
 size_t GSMConfig::SDCCHAvailable() const
 {
 	ScopedLock lock(mLock);
-	return chanAvailable<SDCCHLogicalChannel>(mSDCCHPool);
+	return mSDCCHFreePool.available();
 }
 
 size_t GSMConfig::TCHAvailable() const
 {
 	ScopedLock lock(mLock);
-	return chanAvailable<TCHFACCHLogicalChannel>(mTCHPool);
+	return mTCHFreePool.available();
 }
 
 
@@ -235,26 +308,16 @@ size_t GSMConfig::totalLoad(const CCCHList& chanList) const
 
 
 
-template <class ChanType> unsigned countActive(const vector<ChanType*>& chanList)
-{
-	unsigned active = 0;
-	const unsigned sz = chanList.size();
-	// Start the search from a random point in the list.
-	for (unsigned i=0; i<sz; i++) {
-		if (!chanList[i]->recyclable()) active++;
-	}
-	return active;
-}
-
-
 unsigned GSMConfig::SDCCHActive() const
 {
-	return countActive(mSDCCHPool);
+	ScopedLock lock(mLock);
+	return mSDCCHFreePool.active();
 }
 
 unsigned GSMConfig::TCHActive() const
 {
-	return countActive(mTCHPool);
+	ScopedLock lock(mLock);
+	return mTCHFreePool.active();
 }
 
 
@@ -29,6 +29,7 @@
 
 #include <vector>
 #include <Interthread.h>
+#include <TimerWheel.h>
 
 //#include <ControlCommon.h>
 #include <RadioResource.h>
@@ -39,6 +40,7 @@
 #include "GSML3RRMessages.h"
 
 #include "TRXManager.h"
+#include "GSMChannelPool.h"
 
 
 namespace GSM {
@@ -78,6 +80,8 @@ class GSMConfig {
 	//@{
 	SDCCHList mSDCCHPool;
 	TCHList mTCHPool;
+	mutable ChannelPool<SDCCHLogicalChannel> mSDCCHFreePool;	///< free lists over mSDCCHPool
+	mutable ChannelPool<TCHFACCHLogicalChannel> mTCHFreePool;	///< free lists over mTCHPool
 	//@}
 
 	/**@name BSIC. */
@@ -90,6 +94,9 @@ class GSMConfig {
 
 	Clock mClock;		///< local copy of BTS master clock
 
+	TimerWheel mTimers;		///< protocol timers, ticked from mClock
+	Thread mTimerThread;
+
 	/**@name Encoded L2 frames to be sent on the BCCH. */
 	//@{
 	L2Frame mSI1Frame;
@@ -104,6 +111,15 @@ class GSMConfig {
 	L3Frame mSI6Frame;
 	//@}
 
+	/** Incremented each time the system information is regenerated. */
+	volatile unsigned mBeaconGeneration;
+
+	/**@name Paging group parameters, from the control channel description in SI3. */
+	//@{
+	unsigned mPagingMultiframes;	///< 51-multiframes per paging cycle
+	unsigned mPagingBlocks;			///< paging blocks per 51-multiframe
+	//@}
+
 	int mT3122;
 
 	time_t mStartTime;
@@ -150,6 +166,7 @@ class GSMConfig {
 	unsigned BCC() const { return mBCC; }
 	unsigned NCC() const { return mNCC; }
 	GSM::Clock& clock() { return mClock; }
+	TimerWheel& timers() { return mTimers; }
 	const L3LocationAreaIdentity& LAI() const { return mLAI; }
 	//@}
 
@@ -162,6 +179,12 @@ class GSMConfig {
 	*/
 	void regenerateBeacon();
 
+	/**
+		Return the number of times the system information has been regenerated.
+		Caches of encoded system information use this to know when to throw out old entries.
+	*/
+	unsigned beaconGeneration() const { return mBeaconGeneration; }
+
 	/**
 		Hold off on channel allocations; don't answer RACH.
 		@param val true to hold, false to clear hold
@@ -211,6 +234,9 @@ class GSMConfig {
 	/** Return the number of configured AGCHs */
 	unsigned numAGCHs() const { return mAGCHPool.size(); }
 
+	/** Return the number of configured PCHs */
+	unsigned numPCHs() const { return mPCHPool.size(); }
+
 	/** Enqueue a RACH channel request; to be deleted when dequeued later. */
 	void channelRequest(Control::ChannelRequestRecord *req)
 		{ mChannelRequestQueue.write(req); }
@@ -218,16 +244,48 @@ class GSMConfig {
 	Control::ChannelRequestRecord* nextChannelRequest()
 		{ return mChannelRequestQueue.read(); }
 
+	Control::ChannelRequestRecord* nextChannelRequestNoBlock()
+		{ return mChannelRequestQueue.readNoBlock(); }
+
 	void flushChannelRequests()
 		{ mChannelRequestQueue.clear(); }
 
 	//@}
 
+	/**@name Paging groups, GSM 05.02 6.5.2. */
+	//@{
+
+	/** Number of 51-multiframes in a paging cycle. */
+	unsigned pagingMultiframes() const { return mPagingMultiframes; }
+
+	/** Number of paging blocks in each 51-multiframe. */
+	unsigned pagingBlocks() const { return mPagingBlocks; }
+
+	/** Total number of paging groups, "N" in GSM 05.02 6.5.2. */
+	unsigned pagingGroups() const { return mPagingMultiframes * mPagingBlocks; }
+
+	/**
+		Return the paging group for an IMSI, GSM 05.02 6.5.2.
+		With a single CCCH on C0, this is (IMSI mod 1000) mod N.
+		@param IMSI The IMSI digits.
+		@return The paging group, or 0 if the IMSI is unusable.
+	*/
+	unsigned pagingGroup(const char* IMSI) const;
+
+	/** Return the 51-multiframe index within the paging cycle for a paging group. */
+	unsigned pagingMultiframe(unsigned group) const { return group / mPagingBlocks; }
+
+	/** Return the paging block index within the 51-multiframe for a paging group. */
+	unsigned pagingBlock(unsigned group) const { return group % mPagingBlocks; }
+	//@}
+
 
 	/**@name Manage SDCCH Pool. */
 	//@{
-	/** The add method is not mutex protected and should only be used during initialization. */
-	void addSDCCH(SDCCHLogicalChannel *wSDCCH) { mSDCCHPool.push_back(wSDCCH); }
+	/** The add method should only be used during initialization. */
+	void addSDCCH(SDCCHLogicalChannel *wSDCCH);
+	/** Called by L1, from any thread, when a channel becomes recyclable. */
+	void recycleSDCCH(SDCCHLogicalChannel *wSDCCH);
 	/** Return a pointer to a usable channel. */
 	SDCCHLogicalChannel *getSDCCH();
 	/** Return true if an SDCCH is available, but do not allocate it. */
@@ -242,8 +300,10 @@ class GSMConfig {
 
 	/**@name Manage TCH pool. */
 	//@{
-	/** The add method is not mutex protected and should only be used during initialization. */
-	void addTCH(TCHFACCHLogicalChannel *wTCH) { mTCHPool.push_back(wTCH); }
+	/** The add method should only be used during initialization. */
+	void addTCH(TCHFACCHLogicalChannel *wTCH);
+	/** Called by L1, from any thread, when a channel becomes recyclable. */
+	void recycleTCH(TCHFACCHLogicalChannel *wTCH);
 	/** Return a pointer to a usable channel. */
 	TCHFACCHLogicalChannel *getTCH();
 	/** Return true if an TCH is available, but do not allocate it. */
@@ -281,6 +341,10 @@ class GSMConfig {
 };
 
 
+/** Tick the BTS timer wheel every TimerTickFrames of the master clock. */
+void *TimerServiceLoop(GSMConfig*);
+
+
 
 };	// GSM
 
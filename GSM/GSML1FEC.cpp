@@ -37,6 +37,7 @@
 #include <Logger.h>
 #include <assert.h>
 #include <math.h>
+#include <string.h>
 
 #undef WARNING
 
@@ -209,6 +210,8 @@ void L1Encoder::rollForward()
 {
 	// Calculate the TDMA paramters for the next transmission.
 	// This implements GSM 05.02 Clause 7 for the transmit side.
+	// Lock, since other threads read mNextWriteTime.
+	ScopedLock lock(mLock);
 	mPrevWriteTime = mNextWriteTime;
 	mTotalBursts++;
 	mNextWriteTime.rollForward(mMapping.frameMapping(mTotalBursts),mMapping.repeatLength());
@@ -273,6 +276,7 @@ void L1Encoder::resync()
 	// If the encoder's clock is far from the current BTS clock,
 	// get it caught up to something reasonable.
 	Time now = gBTS.time();
+	ScopedLock lock(mLock);
 	int32_t delta = mNextWriteTime-now;
 	OBJLOG(DEBUG) << "L1Encoder next=" << mNextWriteTime << " now=" << now << " delta=" << delta;
 	if ((delta<0) || (delta>(51*26))) {
@@ -327,28 +331,40 @@ TypeAndOffset L1Decoder::typeAndOffset() const
 }
 
 
+L1Decoder::~L1Decoder()
+{
+	// These are not normally destroyed, so a callback already
+	// past its cancellation is not a concern.
+	ScopedLock lock(mLock);
+	for (unsigned i=0; i<TimerCount; i++) resetTimer((TimerID)i);
+}
+
+
 void L1Decoder::open()
 {
 	ScopedLock lock(mLock);
 	if (!mRunning) start();
 	mFER=0.0F;
-	mT3111.reset();
-	mT3109.reset();
-	mT3101.set();
+	resetTimer(T3111);
+	resetTimer(T3109);
+	setTimer(T3101,T3101ms);
 	mActive = true;
 }
 
 
 void L1Decoder::close(bool hardRelease)
 {
-	ScopedLock lock(mLock);
-	mT3101.reset();
-	mT3109.reset();
-	// For a hard release, force T3111 to an expired state.
-	// (At least one of these timers has to be expired for the channel to recycle.)
-	if (hardRelease) mT3111.expire();
-	else mT3111.set();
-	mActive = false;
+	{
+		ScopedLock lock(mLock);
+		resetTimer(T3101);
+		resetTimer(T3109);
+		// For a hard release, force T3111 to an expired state.
+		// (At least one of these timers has to be expired for the channel to recycle.)
+		if (hardRelease) expireTimer(T3111);
+		else setTimer(T3111,T3111ms);
+		mActive = false;
+	}
+	if (hardRelease) recycled();
 }
 
 bool L1Decoder::active() const
@@ -361,7 +377,81 @@ bool L1Decoder::active() const
 bool L1Decoder::recyclable() const
 {
 	ScopedLock lock(mLock);
-	return mT3101.expired() || mT3109.expired() || mT3111.expired();
+	return mTimers[T3101].mExpired || mTimers[T3109].mExpired || mTimers[T3111].mExpired;
+}
+
+
+
+/** Wheel callback for the L1 timers. */
+static void L1DecoderTimerExpired(void *decoder, unsigned tag)
+{
+	((L1Decoder*)decoder)->timerExpired(tag);
+}
+
+
+void L1Decoder::setTimer(TimerID id, unsigned ms)
+{
+	resetTimer(id);
+	Timer& timer = mTimers[id];
+	// The low two bits of the tag are the timer ID.
+	timer.mTag += 4;
+	timer.mActive = true;
+	timer.mHandle = gBTS.timers().schedule(ms,L1DecoderTimerExpired,this,timer.mTag);
+}
+
+
+void L1Decoder::resetTimer(TimerID id)
+{
+	Timer& timer = mTimers[id];
+	if (timer.mHandle) gBTS.timers().cancel(timer.mHandle);
+	timer.mHandle = 0;
+	timer.mActive = false;
+	timer.mExpired = false;
+}
+
+
+void L1Decoder::expireTimer(TimerID id)
+{
+	resetTimer(id);
+	mTimers[id].mActive = true;
+	mTimers[id].mExpired = true;
+}
+
+
+void L1Decoder::kickT3109(int32_t FN)
+{
+	mT3109FN = FN;
+	const Timer& timer = mTimers[T3109];
+	if (!timer.mActive || timer.mExpired) setTimer(T3109,T3109ms);
+}
+
+
+void L1Decoder::timerExpired(unsigned tag)
+{
+	{
+		ScopedLock lock(mLock);
+		TimerID id = (TimerID)(tag & 0x03);
+		Timer& timer = mTimers[id];
+		// Ignore a timer that was stopped or restarted as it fired.
+		if (!timer.mActive || timer.mTag!=tag) return;
+		timer.mHandle = 0;
+		if (id==T3109) {
+			// Move T3109 out to a full period after the latest good frame.
+			static const int32_t T3109Frames = T3109ms*1000/gFrameMicroseconds;
+			int32_t age = FNDelta(gBTS.time().FN(),mT3109FN);
+			if (age<0) age = 0;
+			if (age<T3109Frames) {
+				unsigned remaining = (T3109Frames-age)*gFrameMicroseconds/1000;
+				timer.mHandle = gBTS.timers().schedule(remaining,L1DecoderTimerExpired,this,tag);
+				return;
+			}
+		}
+		OBJLOG(INFO) << "L1Decoder timer " << id << " expired";
+		timer.mExpired = true;
+	}
+	// Every timer makes the channel recyclable.
+	// Reported outside mLock, since the callback takes the pool's lock.
+	recycled();
 }
 
 
@@ -651,11 +741,11 @@ void XCCHL1Decoder::handleGoodFrame()
 	{
 		ScopedLock lock(mLock);
 		// Keep T3109 from timing out.
-		mT3109.set();
+		kickT3109(mReadTime.FN());
 		// If this is the first good frame of a new transaction,
 		// stop T3101 and tell L2 we're alive down here.
-		if (mT3101.active()) {
-			mT3101.reset();
+		if (mTimers[T3101].mActive) {
+			resetTimer(T3101);
 			if (mUpstream!=NULL) mUpstream->writeLowSide(L2Frame(ESTABLISH));
 		}
 	}
@@ -837,6 +927,28 @@ void XCCHL1Encoder::sendFrame(const L2Frame& frame)
 
 
 
+void XCCHL1Encoder::sendCachedFrame(const L2Frame& frame, XCCHBurstCache& cache, unsigned generation)
+{
+	OBJLOG(DEBUG) << "XCCHL1Encoder cached " << frame;
+	if (mDownstream==NULL) {
+		LOG(WARNING) << "XCCHL1Encoder with no downstream";
+		return;
+	}
+
+	const unsigned headerBits = headerOffset();
+	unsigned header = headerBits ? mU.peekField(0,headerBits) : 0;
+
+	// Send to GSMTAP (must send mU = real bits !)
+	frame.copyToSegment(mU,headerBits);
+	gWriteGSMTAP(ARFCN(),TN(),mNextWriteTime.FN(),
+	             typeAndOffset(),mMapping.repeatLength()>51,false,mU);
+
+	cache.encode(frame,header,headerBits,generation,mI);
+	transmit();
+}
+
+
+
 void XCCHL1Encoder::encode()
 {
 	// Perform the FEC encoding of GSM 05.03 4.1.2 and 4.1.3
@@ -1020,17 +1132,21 @@ void BCCHL1Encoder::generate()
 	OBJLOG(DEBUG) << "BCCHL1Encoder " << mNextWriteTime;
 	// BCCH mapping, GSM 05.02 6.3.1.3
 	// Since we're not doing GPRS or VGCS, it's just SI1-4 over and over.
+	// They only change when the beacon is regenerated, so they come from the cache.
+	const L2Frame *frame;
 	switch (mNextWriteTime.TC()) {
-		case 0: writeHighSide(gBTS.SI1Frame()); return;
-		case 1: writeHighSide(gBTS.SI2Frame()); return;
-		case 2: writeHighSide(gBTS.SI3Frame()); return;
-		case 3: writeHighSide(gBTS.SI4Frame()); return;
-		case 4: writeHighSide(gBTS.SI3Frame()); return;
-		case 5: writeHighSide(gBTS.SI2Frame()); return;
-		case 6: writeHighSide(gBTS.SI3Frame()); return;
-		case 7: writeHighSide(gBTS.SI4Frame()); return;
+		case 0: frame = &gBTS.SI1Frame(); break;
+		case 1: frame = &gBTS.SI2Frame(); break;
+		case 2: frame = &gBTS.SI3Frame(); break;
+		case 3: frame = &gBTS.SI4Frame(); break;
+		case 4: frame = &gBTS.SI3Frame(); break;
+		case 5: frame = &gBTS.SI2Frame(); break;
+		case 6: frame = &gBTS.SI3Frame(); break;
+		case 7: frame = &gBTS.SI4Frame(); break;
 		default: assert(0);
 	}
+	resync();
+	sendCachedFrame(*frame,mCache,gBTS.beaconGeneration());
 }
 
 
@@ -1086,6 +1202,8 @@ bool TCHFACCHL1Decoder::processBurst( const RxBurst& inBurst)
 	// A negative value means that the demux is misconfigured.
 	assert(B>=0);
 	OBJLOG(DEBUG) << "TCHFACCHL1Decoder B=" << B << " " << inBurst;
+	// Save the time at each block boundary, for FACCH frames.
+	if (B%4==0) mReadTime = inBurst.time();
 
 	// Pull the data fields (e-bits) out of the burst and put them into i[B][].
 	// GSM 05.03 3.1.4
@@ -1125,7 +1243,7 @@ bool TCHFACCHL1Decoder::processBurst( const RxBurst& inBurst)
 		countGoodFrame();
 		// Don't let the channel timeout.
 		ScopedLock lock(mLock);
-		mT3109.set();
+		kickT3109(inBurst.time().FN());
 	}
 	else countBadFrame();
 
@@ -1352,7 +1470,8 @@ void TCHFACCHL1Encoder::dispatch()
 	bool currentFACCH = false; 
 	
 	// Speech latency control.
-	// Since Asterisk is local, latency should be small.
+	// The media engine's jitter buffer feeds this queue on demand,
+	// so this trim is only a safety net.
 	OBJLOG(DEBUG) <<"TCHFACCHL1Encoder speechQ.size=" << mSpeechQ.size();
 	int maxQ = gConfig.getNum("GSM.MaxSpeechLatency");
 	while (mSpeechQ.size() > maxQ) delete mSpeechQ.read();
@@ -1430,7 +1549,7 @@ void TCHFACCHL1Encoder::interleave(int blockOffset)
 bool TCHFACCHL1Decoder::uplinkLost() const
 {
 	ScopedLock lock(mLock);
-	return mT3109.expired();
+	return mTimers[T3109].mExpired;
 }
 
 
@@ -1557,55 +1676,31 @@ SACCHL1Decoder* SACCHL1Encoder::SACCHSibling()
 
 
 
+/** Encodings of the SACCH system information, shared by all SACCHs. */
+static XCCHBurstCache sSACCHCache;
+
+
 void SACCHL1Encoder::sendFrame(const L2Frame& frame)
 {
 	OBJLOG(INFO) << "SACCHL1Encoder " << frame;
 
 	// Physical header, GSM 04.04 6, 7.1
 	// Power and timing control, GSM 05.08 4, GSM 05.10 5, 6.
-
-	SACCHL1Decoder &sib = *SACCHSibling();
-//	if (sib.phyNew()) {
-		// Power.  GSM 05.08 4.
-		// Power expressed in dBm, RSSI in dB wrt max.
-		float RSSI = sib.RSSI();
-		float RSSITarget = gConfig.getNum("GSM.Radio.RSSITarget");
-		float deltaP = RSSI - RSSITarget;
-		float actualPower = sib.actualMSPower();
-		float targetMSPower = actualPower - deltaP;
-		float powerDamping = gConfig.getNum("GSM.MS.Power.Damping")*0.01F;
-		mOrderedMSPower = powerDamping*mOrderedMSPower + (1.0F-powerDamping)*targetMSPower;
-		float maxPower = gConfig.getNum("GSM.MS.Power.Max");
-		float minPower = gConfig.getNum("GSM.MS.Power.Min");
-		if (mOrderedMSPower>maxPower) mOrderedMSPower=maxPower;
-		else if (mOrderedMSPower<minPower) mOrderedMSPower=minPower;
-		OBJLOG(DEBUG) <<"SACCHL1Encoder RSSI=" << RSSI << " target=" << RSSITarget
-			<< " deltaP=" << deltaP << " actual=" << actualPower << " order=" << mOrderedMSPower;
-		// Timing.  GSM 05.10 5, 6.
-		// Time expressed in symbol periods.
-		float timingError = sib.timingError();
-		float actualTiming = sib.actualMSTiming();
-		float targetMSTiming = actualTiming + timingError;
-		float TADamping = gConfig.getNum("GSM.MS.TA.Damping")*0.01F;
-		mOrderedMSTiming = TADamping*mOrderedMSTiming + (1.0F-TADamping)*targetMSTiming;
-		float maxTiming = gConfig.getNum("GSM.MS.TA.Max");
-		if (mOrderedMSTiming<0.0F) mOrderedMSTiming=0.0F;
-		else if (mOrderedMSTiming>maxTiming) mOrderedMSTiming=maxTiming;
-		OBJLOG(DEBUG) << "SACCHL1Encoder timingError=" << timingError
-			<< " actual=" << actualTiming << " ordered=" << mOrderedMSTiming
-			<< " target=" << targetMSTiming;
-//	}
-
-	// Write physical header into mU and then call base class.
-
-	// SACCH physical header, GSM 04.04 6.1, 7.1.
+	// The orders are set by the measurement engine from each report;
+	// write them into mU and then call base class.
 	OBJLOG(INFO) <<"SACCHL1Encoder orders pow=" << mOrderedMSPower << " TA=" << mOrderedMSTiming;
 	mU.fillField(0,encodePower(mOrderedMSPower),8);
 	mU.fillField(8,(int)(mOrderedMSTiming+0.5F),8);	// timing (GSM 04.04 6.1)
 	OBJLOG(DEBUG) << "SACCHL1Encoder phy header " << mU.head(16);
 
 	// Encode the rest of the frame.
-	XCCHL1Encoder::sendFrame(frame);
+	// UI frames are the system information, the same on every SACCH,
+	// so share their encodings.
+	if (frame.controlFormat()==L2Control::UFormat && frame.UFrameType()==L2Control::UIFrame) {
+		sendCachedFrame(frame,sSACCHCache,gBTS.beaconGeneration());
+	} else {
+		XCCHL1Encoder::sendFrame(frame);
+	}
 }
 
 
@@ -29,6 +29,7 @@
 #define GSML1FEC_H
 
 #include "Threads.h"
+#include "TimerWheel.h"
 #include <assert.h>
 #include "BitVector.h"
 
@@ -37,6 +38,7 @@
 #include "GSMTDMA.h"
 
 #include "GSM610Tables.h"
+#include "XCCHBurstCache.h"
 
 #include <Globals.h>
 
@@ -147,6 +149,8 @@ class L1Encoder {
 	unsigned ARFCN() const;
 	TypeAndOffset typeAndOffset() const;	///< this comes from mMapping
 	//@}
+	/** Timestamp of the next burst this encoder will generate. */
+	GSM::Time nextWriteTime() const { ScopedLock lock(mLock); return mNextWriteTime; }
 	//@}
 
 	/** Close the channel after blocking for flush.  */
@@ -215,11 +219,22 @@ class L1Decoder {
 	/**@name Mutex-controlled state information. */
 	//@{
 	mutable Mutex mLock;				///< access control
-	/**@name Timers from GSM 04.08 11.1.2 */
+	/**@name Timers from GSM 04.08 11.1.2, run by the BTS timer wheel. */
 	//@{
-	Z100Timer mT3101;					///< timer for new channels
-	Z100Timer mT3109;					///< timer for existing channels
-	Z100Timer mT3111;					///< timer for reuse of a closed channel
+	enum TimerID {
+		T3101,							///< timer for new channels
+		T3109,							///< timer for existing channels
+		T3111,							///< timer for reuse of a closed channel
+		TimerCount
+	};
+	struct Timer {
+		TimerWheel::Handle mHandle;		///< pending wheel timer, or 0
+		unsigned mTag;					///< identifies the current wheel timer to the callback
+		bool mActive;
+		bool mExpired;
+	};
+	Timer mTimers[TimerCount];
+	int32_t mT3109FN;					///< frame of the latest restart of T3109
 	//@}
 	bool mActive;						///< true between open() and close()
 	//@}
@@ -240,6 +255,12 @@ class L1Decoder {
 	L1FEC* mParent;			///< a containing L1 processor, if any
 	//@}
 
+	/**@name Recycling notification, set once during initialization. */
+	//@{
+	void (*mRecycleCallback)(void*);
+	void *mRecycleObject;
+	//@}
+
 	ViterbiR2O4 mVCoder;	///< nearly all GSM channels use the same convolutional code
 
 
@@ -253,20 +274,27 @@ class L1Decoder {
 	*/
 	L1Decoder(unsigned wCN, unsigned wTN, const TDMAMapping& wMapping, L1FEC* wParent)
 			:mUpstream(NULL),
-			mT3101(T3101ms),mT3109(T3109ms),mT3111(T3111ms),
+			mT3109FN(0),
 			mActive(false),
 			mRunning(false),
 			mFER(0.0F),
 			mCN(wCN),mTN(wTN),
-			mMapping(wMapping),mParent(wParent)
+			mMapping(wMapping),mParent(wParent),
+			mRecycleCallback(NULL),mRecycleObject(NULL)
 	{
+		for (unsigned i=0; i<TimerCount; i++) {
+			mTimers[i].mHandle = 0;
+			mTimers[i].mTag = i;
+			mTimers[i].mActive = false;
+			mTimers[i].mExpired = false;
+		}
 		// Start T3101 so that the channel will
 		// become recyclable soon.
-		mT3101.set();
+		setTimer(T3101,T3101ms);
 	}
 
 
-	virtual ~L1Decoder() { }
+	virtual ~L1Decoder();
 
 
 	/**
@@ -290,6 +318,16 @@ class L1Decoder {
 	/** Return true if any timer is expired. */
 	bool recyclable() const;
 
+	/** Expiration of a wheel timer; tag identifies the timer. */
+	void timerExpired(unsigned tag);
+
+	/**
+		Set a function to call each time the decoder becomes recyclable.
+		It is called without mLock, from the timer thread or the thread that closes the channel.
+	*/
+	void recycleCallback(void (*wCallback)(void*), void *wObject)
+		{ mRecycleCallback = wCallback; mRecycleObject = wObject; }
+
 	/** Connect the upstream SAPMux and L2.  */
 	void upstream(SAPMux * wUpstream)
 	{
@@ -330,6 +368,24 @@ class L1Decoder {
 	void countGoodFrame();
 
 	void countBadFrame();
+
+	/** Run the recycling callback, if any; the caller does not hold mLock. */
+	void recycled() { if (mRecycleCallback) mRecycleCallback(mRecycleObject); }
+
+	/**@name Timer control; the caller holds mLock. */
+	//@{
+	/** Start or restart a timer. */
+	void setTimer(TimerID timer, unsigned ms);
+	/** Stop a timer. */
+	void resetTimer(TimerID timer);
+	/** Force a timer into an expired state. */
+	void expireTimer(TimerID timer);
+	/**
+		Restart T3109 on a good uplink frame.
+		Only the frame is recorded; the wheel timer is moved when it expires.
+	*/
+	void kickT3109(int32_t FN);
+	//@}
 };
 
 
@@ -402,6 +458,9 @@ class L1FEC {
 	bool recyclable() const
 		{ assert(mDecoder); return mDecoder->recyclable(); }
 
+	void recycleCallback(void (*wCallback)(void*), void *wObject)
+		{ assert(mDecoder); mDecoder->recycleCallback(wCallback,wObject); }
+
 	bool active() const;
 
 	const TDMAMapping& txMapping() const
@@ -678,6 +737,14 @@ class XCCHL1Encoder : public L1Encoder {
 	/** Send a single L2 frame.  */
 	virtual void sendFrame(const L2Frame&);
 
+	/**
+		Send a single L2 frame that is likely to repeat,
+		taking i[][] from the cache when possible.
+		Any physical header must already be in u[].
+		@param generation The cache generation; see XCCHBurstCache.
+	*/
+	void sendCachedFrame(const L2Frame&, XCCHBurstCache&, unsigned generation);
+
 	/**
 	  Encode u[] to c[].
 	  Includes LSB-MSB reversal within each octet.
@@ -738,6 +805,9 @@ public:
 	void sendTCH(const unsigned char *frame)
 		{ mSpeechQ.write(new VocoderFrame(frame)); }
 
+	/** Number of speech frames waiting for transmission. */
+	unsigned speechQueueSize() const { return mSpeechQ.size(); }
+
 	/** Extend open() to set up semaphores. */
 	void open();
 
@@ -971,6 +1041,8 @@ class BCCHL1Encoder : public NDCCHL1Encoder {
 
 	private:
 
+	XCCHBurstCache mCache;		///< encoded SI1-SI4
+
 	void generate();
 };
 
@@ -997,8 +1069,13 @@ class SACCHL1Encoder : public XCCHL1Encoder {
 
 	SACCHL1Encoder(unsigned wCN, unsigned wTN, const TDMAMapping& wMapping, SACCHL1FEC *wParent);
 
-	void orderedMSPower(int power) { mOrderedMSPower = power; }
-	void orderedMSTiming(int timing) { mOrderedMSTiming = timing; }
+	/**@name Ordered power and timing, set by the measurement engine. */
+	//@{
+	float orderedMSPower() const { return mOrderedMSPower; }
+	float orderedMSTiming() const { return mOrderedMSTiming; }
+	void orderedMSPower(float power) { mOrderedMSPower = power; }
+	void orderedMSTiming(float timing) { mOrderedMSTiming = timing; }
+	//@}
 
 	void setPhy(const SACCHL1Encoder&);
 	void setPhy(float RSSI, float timingError);
@@ -1125,6 +1202,10 @@ public:
 	void sendTCH(const unsigned char * frame)
 		{ assert(mTCHEncoder); mTCHEncoder->sendTCH(frame); }
 
+	/** Number of downlink speech frames waiting for transmission. */
+	unsigned downlinkQueueSize() const
+		{ assert(mTCHEncoder); return mTCHEncoder->speechQueueSize(); }
+
 	/**
 		Receive a traffic frame.
 		Returns a pointer that must be deleted by calls.
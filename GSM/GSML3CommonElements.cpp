@@ -80,6 +80,22 @@ void L3LocationAreaIdentity::parseV( const L3Frame& src, size_t &rp )
 }
 
 
+void L3LocationAreaIdentity::parseV(const L3Octets& src, size_t &rp)
+{
+	unsigned octet = src.readOctet(rp);
+	mMCC[1] = octet >> 4;
+	mMCC[0] = octet & 0x0f;
+	octet = src.readOctet(rp);
+	mMNC[2] = octet >> 4;
+	mMCC[2] = octet & 0x0f;
+	octet = src.readOctet(rp);
+	mMNC[1] = octet >> 4;
+	mMNC[0] = octet & 0x0f;
+	mLAC = src.readOctet(rp) << 8;
+	mLAC |= src.readOctet(rp);
+}
+
+
 bool L3LocationAreaIdentity::operator==(const L3LocationAreaIdentity& other) const
 {
 	// MCC
@@ -225,6 +241,46 @@ void L3MobileIdentity::parseV( const L3Frame& src, size_t &rp, size_t expectedLe
 	}
 }
 
+void L3MobileIdentity::parseV(const L3Octets& value)
+{
+	// See GSM 04.08 10.5.1.4.
+
+	unsigned first = value.octet(0);
+	bool oddCount = first & 0x08;
+	mType = (MobileIDType)(first & 0x07);
+
+	switch (mType) {
+		case TMSIType:
+			mDigits[0]='\0';
+			// GSM 03.03 2.4 tells us the TMSI is always 32 bits
+			mTMSI = value.octet(1)<<24;
+			mTMSI |= value.octet(2)<<16;
+			mTMSI |= value.octet(3)<<8;
+			mTMSI |= value.octet(4);
+			break;
+		case IMSIType:
+		case IMEISVType:
+		case IMEIType: {
+			int numDigits = 0;
+			mDigits[numDigits++] = (first>>4) + '0';
+			for (size_t i=1; i<value.size(); i++) {
+				unsigned octet = value.octet(i);
+				mDigits[numDigits++] = (octet & 0x0f) + '0';
+				mDigits[numDigits++] = (octet >> 4) + '0';
+				if (numDigits>15) L3_READ_ERROR;
+			}
+			if (!oddCount) numDigits--;
+			mDigits[numDigits]='\0';
+			break;
+		}
+		default:
+			LOG(NOTICE) << "non-standard identity type " << (int)mType;
+			mDigits[0]='\0';
+			mType = NoIDType;
+	}
+}
+
+
 void L3MobileIdentity::text(ostream& os) const
 {
 	os << mType << "=";
@@ -239,45 +295,22 @@ void L3MobileIdentity::text(ostream& os) const
 
 void L3MobileStationClassmark1::parseV(const L3Frame& src, size_t& rp)
 {
-	rp++;	// spare
-	mRevisionLevel = src.readField(rp,2);
-	mES_IND = src.readField(rp,1);
-	mA5_1 = src.readField(rp,1);
-	mRFPowerCapability = src.readField(rp,3);
+	mOctet = src.readField(rp,8);
 }
 
 void L3MobileStationClassmark1::text(ostream& os) const
 {
-	os << "revision=" << mRevisionLevel;
-	os << " ES-IND=" << mES_IND;
-	os << " A5/1=" << mA5_1;
-	os << " powerCap=" << mRFPowerCapability;
+	os << "revision=" << revisionLevel();
+	os << " ES-IND=" << ES_IND();
+	os << " A5/1=" << A5_1();
+	os << " powerCap=" << RFPowerCapability();
 }
 
 
 
 void L3MobileStationClassmark2::parseV(const L3Frame& src, size_t& rp)
 {
-	rp++;	// spare
-	mRevisionLevel = src.readField(rp,2);
-	mES_IND = src.readField(rp,1);
-	mA5_1 = src.readField(rp,1);
-	mRFPowerCapability = src.readField(rp,3);
-	rp++;	// spare
-	mPSCapability = src.readField(rp,1);
-	mSSScreenIndicator = src.readField(rp,2);
-	mSMCapability = src.readField(rp,1);
-	mVBS = src.readField(rp,1);
-	mVGCS = src.readField(rp,1);
-	mFC = src.readField(rp,1);
-	mCM3 = src.readField(rp,1);
-	rp++;	// spare
-	mLCSVACapability = src.readField(rp,1);
-	rp++;	// spare
-	mSoLSA = src.readField(rp,1);
-	mCMSF = src.readField(rp,1);
-	mA5_3 = src.readField(rp,1);
-	mA5_2 = src.readField(rp,1);
+	for (unsigned i=0; i<3; i++) mOctets[i] = src.readField(rp,8);
 }
 
 void L3MobileStationClassmark2::parseV(const L3Frame& src, size_t& rp, size_t len)
@@ -291,22 +324,22 @@ void L3MobileStationClassmark2::parseV(const L3Frame& src, size_t& rp, size_t le
 
 void L3MobileStationClassmark2::text(ostream& os) const
 {
-	os << "revision=" << mRevisionLevel;
-	os << " ES-IND=" << mES_IND;
-	os << " A5/1=" << mA5_1;
-	os << " A5/2=" << mA5_2;
-	os << " A5/3=" << mA5_3;
-	os << " powerCap=" << mRFPowerCapability;
-	os << " PS=" << mPSCapability;
-	os << " SSScrenInd=" << mSSScreenIndicator;
-	os << " SM=" << mSMCapability;
-	os << " VBS=" << mVBS;
-	os << " VGCS=" << mVGCS;
-	os << " FC=" << mFC;
-	os << " CM3=" << mCM3;
-	os << " LCSVA=" << mLCSVACapability;
-	os << " SoLSA=" << mSoLSA;
-	os << " CMSF=" << mCMSF;
+	os << "revision=" << revisionLevel();
+	os << " ES-IND=" << ES_IND();
+	os << " A5/1=" << field(4,1);
+	os << " A5/2=" << field(23,1);
+	os << " A5/3=" << field(22,1);
+	os << " powerCap=" << RFPowerCapability();
+	os << " PS=" << PSCapability();
+	os << " SSScrenInd=" << SSScreenIndicator();
+	os << " SM=" << SMCapability();
+	os << " VBS=" << VBS();
+	os << " VGCS=" << VGCS();
+	os << " FC=" << FC();
+	os << " CM3=" << CM3();
+	os << " LCSVA=" << LCSVACapability();
+	os << " SoLSA=" << SoLSA();
+	os << " CMSF=" << CMSF();
 }
 
 
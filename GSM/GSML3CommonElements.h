@@ -93,6 +93,7 @@ class L3LocationAreaIdentity : public L3ProtocolElement {
 
 	size_t lengthV() const { return 5; }
 	void parseV(const L3Frame& source, size_t &rp);
+	void parseV(const L3Octets& source, size_t &rp);
 	void parseV(const L3Frame&, size_t&, size_t) { abort(); }
 	void writeV(L3Frame& dest, size_t &wp) const;
 	void text(std::ostream&) const;
@@ -158,71 +159,109 @@ class L3MobileIdentity : public L3ProtocolElement {
 	void parseV( const L3Frame& src, size_t &rp, size_t expectedLength );
 	void parseV(const L3Frame&, size_t&) { abort(); }
 	void text(std::ostream&) const;
+
+	/**@name Octet parsers. */
+	//@{
+	using L3ProtocolElement::parseLV;
+	/** Decode a whole value part. */
+	void parseV(const L3Octets& value);
+	void parseLV(const L3Octets& src, size_t &rp) { parseV(src.readLV(rp)); }
+	//@}
 };
 
 
 
 /**
 	Mobile Station Classmark 1, GSM 04.08 10.5.1.5
+	The octet is kept as received and decoded only when a field is used.
 */
 class L3MobileStationClassmark1 : public L3ProtocolElement {
 
 	protected:
 
-	unsigned mRevisionLevel;
-	unsigned mES_IND;
-	unsigned mA5_1;
-	unsigned mRFPowerCapability;
+	unsigned char mOctet;
 
 	public:
 
+	L3MobileStationClassmark1()
+		:L3ProtocolElement(),mOctet(0)
+	{ }
+
 	size_t lengthV() const { return 1; }	
 	void writeV(L3Frame&, size_t&) const { assert(0); }
 	void parseV(const L3Frame &src, size_t &rp);
 	void parseV(const L3Frame&, size_t&, size_t) { assert(0); }
+	void parseV(const L3Octets& src, size_t &rp) { mOctet = src.readOctet(rp); }
 	void text(std::ostream&) const;
 
+	/**@name Accessors. */
+	//@{
+	unsigned revisionLevel() const { return (mOctet>>5) & 0x03; }
+	unsigned ES_IND() const { return (mOctet>>4) & 0x01; }
+	unsigned A5_1() const { return (mOctet>>3) & 0x01; }
+	unsigned RFPowerCapability() const { return mOctet & 0x07; }
+	//@}
+
 };
 
 /**
-	Mobile Station Classmark 2, GSM 04.08 10.5.1.5
+	Mobile Station Classmark 2, GSM 04.08 10.5.1.6
+	The octets are kept as received and decoded only when a field is used.
 */
 class L3MobileStationClassmark2 : public L3ProtocolElement {
 
 	protected:
 
-	unsigned mRevisionLevel;
-	unsigned mES_IND;
-	unsigned mA5_1;
-	unsigned mA5_3;
-	unsigned mA5_2;
-	unsigned mRFPowerCapability;
-	unsigned mPSCapability;
-	unsigned mSSScreenIndicator;
-	unsigned mSMCapability;
-	unsigned mVBS;
-	unsigned mVGCS;
-	unsigned mFC;
-	unsigned mCM3;
-	unsigned mLCSVACapability;
-	unsigned mSoLSA;
-	unsigned mCMSF;
+	unsigned char mOctets[3];
+
+	/** Return a field of the value part, by bit index from the MSB of the first octet. */
+	unsigned field(unsigned bitIndex, unsigned length) const
+		{ return packedField(mOctets,bitIndex,length); }
 
 	public:
 
+	L3MobileStationClassmark2()
+		:L3ProtocolElement()
+	{ memset(mOctets,0,sizeof(mOctets)); }
+
 	size_t lengthV() const { return 3; }	
 	void writeV(L3Frame&, size_t&) const { assert(0); }
 	void parseV(const L3Frame &src, size_t &rp);
 	void parseV(const L3Frame&, size_t&, size_t);
 	void text(std::ostream&) const;
 
+	/**@name Octet parsers. */
+	//@{
+	using L3ProtocolElement::parseLV;
+	void parseV(const L3Octets& src, size_t &rp) { src.copy(rp,3,mOctets); rp += 3; }
+	/** This is sometimes sent as LV, with extra bytes, which are skipped. */
+	void parseLV(const L3Octets& src, size_t &rp) { src.readLV(rp).copy(0,3,mOctets); }
+	//@}
+
+	/**@name Raw fields. */
+	//@{
+	unsigned revisionLevel() const { return field(1,2); }
+	unsigned ES_IND() const { return field(3,1); }
+	unsigned RFPowerCapability() const { return field(5,3); }
+	unsigned PSCapability() const { return field(9,1); }
+	unsigned SSScreenIndicator() const { return field(10,2); }
+	unsigned SMCapability() const { return field(12,1); }
+	unsigned VBS() const { return field(13,1); }
+	unsigned VGCS() const { return field(14,1); }
+	unsigned FC() const { return field(15,1); }
+	unsigned CM3() const { return field(16,1); }
+	unsigned LCSVACapability() const { return field(18,1); }
+	unsigned SoLSA() const { return field(20,1); }
+	unsigned CMSF() const { return field(21,1); }
+	//@}
+
 	// These return true if the encryption type is supported.
-	bool A5_1() const { return mA5_1==0; }
-	bool A5_2() const { return mA5_2!=0; }
-	bool A5_3() const { return mA5_3!=0; }
+	bool A5_1() const { return field(4,1)==0; }
+	bool A5_2() const { return field(23,1)!=0; }
+	bool A5_3() const { return field(22,1)!=0; }
 
 	// Returns the power class, based on power capability encoding.
-	int powerClass() const { return mRFPowerCapability+1; }
+	int powerClass() const { return RFPowerCapability()+1; }
 };
 
 
@@ -132,6 +132,15 @@ void L3LocationUpdatingRequest::parseBody( const  L3Frame &src, size_t &rp )
 		mMobileIdentity.parseLV(src, rp);
 }
 
+void L3LocationUpdatingRequest::parseBody(const L3Octets &src, size_t &rp)
+{
+	// skip updating type and ciphering key sequence number
+	rp++;
+	mLAI.parseV(src,rp);
+	mClassmark.parseV(src,rp);
+	mMobileIdentity.parseLV(src,rp);
+}
+
 
 void L3LocationUpdatingRequest::text(ostream& os) const
 {
@@ -193,6 +202,12 @@ void L3IMSIDetachIndication::parseBody(const L3Frame& src, size_t &rp)
 	mMobileIdentity.parseLV(src, rp);
 }
 
+void L3IMSIDetachIndication::parseBody(const L3Octets& src, size_t &rp)
+{
+	mClassmark.parseV(src, rp);
+	mMobileIdentity.parseLV(src, rp);
+}
+
 void L3IMSIDetachIndication::text(ostream& os) const
 {
 	L3MMMessage::text(os);
@@ -231,6 +246,16 @@ void L3CMServiceRequest::parseBody( const L3Frame &src, size_t &rp )
 	// ignore priority
 }
 
+void L3CMServiceRequest::parseBody(const L3Octets &src, size_t &rp)
+{
+	// ciphering key seq number in the high half, service type in the low
+	unsigned octet = src.readOctet(rp);
+	mServiceType = L3CMServiceType((L3CMServiceType::TypeCode)(octet & 0x0f));
+	mClassmark.parseLV(src,rp);
+	mMobileIdentity.parseLV(src, rp);
+	// ignore priority
+}
+
 void L3CMServiceRequest::text(ostream& os) const
 {
 	L3MMMessage::text(os);
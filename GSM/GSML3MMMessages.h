@@ -115,7 +115,8 @@ class L3LocationUpdatingRequest : public L3MMMessage
 	L3LocationAreaIdentity mLAI;
 
 public:
-	L3LocationUpdatingRequest():L3MMMessage() {}
+	/** The LAI is filled in by the parser, so don't look up the local one. */
+	L3LocationUpdatingRequest():L3MMMessage(),mLAI("000","00",0) {}
 
 	const L3MobileIdentity& mobileID() const
 		{ return mMobileIdentity; }
@@ -125,7 +126,9 @@ public:
 	int MTI() const { return (int)LocationUpdatingRequest; }
 	
 	size_t l2BodyLength() const;
+	bool parsesOctets() const { return true; }
 	void parseBody( const L3Frame &src, size_t &rp );	
+	void parseBody( const L3Octets &src, size_t &rp );
 	void text(std::ostream&) const;
 };
 
@@ -218,7 +221,9 @@ class L3IMSIDetachIndication : public L3MMMessage {
 	int MTI() const { return (int)IMSIDetachIndication; }
 
 	size_t l2BodyLength() const { return 1 + mMobileIdentity.lengthLV(); }
+	bool parsesOctets() const { return true; }
 	void parseBody( const L3Frame &src, size_t &rp );
+	void parseBody( const L3Octets &src, size_t &rp );
 	void text(std::ostream&) const;
 
 };
@@ -300,7 +305,9 @@ public:
 	// (1/2) + (1/2) + 4 + 
 	size_t l2BodyLength() const { return 5+mMobileIdentity.lengthLV(); }
 
+	bool parsesOctets() const { return true; }
 	void parseBody( const L3Frame &src, size_t &rp );
+	void parseBody( const L3Octets &src, size_t &rp );
 	void text(std::ostream&) const;
 };
 
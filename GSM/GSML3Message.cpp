@@ -29,6 +29,7 @@
 #include "GSML3MMMessages.h"
 #include "GSML3CCMessages.h"
 #include <Logger.h>
+#include <BlockPool.h>
 
 
 //#include <SMSTransfer.h>
@@ -44,6 +45,14 @@ using namespace GSM;
 // FIXME -- We actually should not be using this anymore.
 void L3Message::parse(const L3Frame& source)
 {
+	size_t octets = (source.size()+7)/8;
+	if (parsesOctets() && octets<=L3MaxPackedOctets) {
+		unsigned char packed[L3MaxPackedOctets];
+		source.pack(packed);
+		size_t rp = 2;
+		parseBody(L3Octets(packed,octets),rp);
+		return;
+	}
 	size_t rp = 16;
 	parseBody(source,rp);
 }
@@ -137,24 +146,74 @@ ostream& GSM::operator<<(ostream& os, const L3Message& msg)
 
 
 
+static BlockPool** makeL3MessagePools()
+{
+	BlockPool **pools = new BlockPool*[L3MessagePoolClasses];
+	for (unsigned i=0; i<L3MessagePoolClasses; i++)
+		pools[i] = new BlockPool((i+1)*L3MessagePoolGranularity,L3MessagePoolMax);
+	return pools;
+}
+
+// The pools are never deleted, since messages may be freed during static destruction.
+static BlockPool** L3MessagePools()
+{
+	static BlockPool **sPools = makeL3MessagePools();
+	return sPools;
+}
+
+
+void* L3Message::operator new(size_t size)
+{
+	unsigned index = (size-1) / L3MessagePoolGranularity;
+	if (index>=L3MessagePoolClasses) return ::operator new(size);
+	return L3MessagePools()[index]->get(size);
+}
+
+void L3Message::operator delete(void* msg, size_t size)
+{
+	unsigned index = (size-1) / L3MessagePoolGranularity;
+	if (index>=L3MessagePoolClasses) ::operator delete(msg);
+	else L3MessagePools()[index]->put(msg,size);
+}
+
+
+
+/** A parser for one protocol. */
+typedef L3Message* (*L3Parser)(const L3Frame&);
+
+static L3Message* parseRRMessage(const L3Frame& source) { return parseL3RR(source); }
+static L3Message* parseMMMessage(const L3Frame& source) { return parseL3MM(source); }
+static L3Message* parseCCMessage(const L3Frame& source) { return parseL3CC(source); }
+static L3Message* parseSMSMessage(const L3Frame& source) { return SMS::parseSMS(source); }
+
+/** Parsers indexed by PD, GSM 04.07 11.2.3.1.1; NULL for unsupported protocols. */
+static const L3Parser sL3Parsers[16] = {
+	NULL, NULL, NULL,
+	parseCCMessage,	// L3CallControlPD
+	NULL,
+	parseMMMessage,	// L3MobilityManagementPD
+	parseRRMessage,	// L3RadioResourcePD
+	NULL, NULL,
+	parseSMSMessage,	// L3SMSPD
+	NULL, NULL, NULL, NULL, NULL, NULL
+};
+
+
 GSM::L3Message* GSM::parseL3(const GSM::L3Frame& source)
 {
 	if (source.size()==0) return NULL;
 
 	LOG(DEBUG) << "GSM::parseL3 "<< source;
 	L3PD PD = source.PD();
+	L3Parser parser = sL3Parsers[PD & 0x0f];
+	if (!parser) {
+		LOG(NOTICE) << "L3 parsing failed for unsupported protocol " << PD;
+		return NULL;
+	}
 	
 	L3Message *retVal = NULL;
 	try {
-		switch (PD) {
-			case L3RadioResourcePD: retVal=parseL3RR(source); break;
-			case L3MobilityManagementPD: retVal=parseL3MM(source); break;
-			case L3CallControlPD: retVal=parseL3CC(source); break;
-			case L3SMSPD: retVal=SMS::parseSMS(source); break;
-			default:
-				LOG(NOTICE) << "L3 parsing failed for unsupported protocol " << PD;
-				return NULL;
-		}
+		retVal = parser(source);
 	}
 	catch (L3ReadError) {
 		LOG(NOTICE) << "L3 parsing failed for " << source;
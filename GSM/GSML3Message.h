@@ -53,9 +53,96 @@ class L3WriteError : public GSMError {
 
 
 
+/** Largest L3 frame that parse() will pack onto the stack for an octet parser. */
+const unsigned L3MaxPackedOctets = 256;
+
+
+/**
+	Return a field of up to 32 bits from MSB-first packed octets.
+	The caller is responsible for the bounds.
+*/
+inline unsigned packedField(const unsigned char *octets, size_t bitIndex, unsigned length)
+{
+	size_t index = bitIndex/8;
+	unsigned shift = bitIndex%8;
+	uint64_t accum = 0;
+	for (unsigned i=0; i<(shift+length+7)/8; i++) accum = (accum<<8) | octets[index+i];
+	unsigned tail = (8 - (shift+length)%8) % 8;
+	return (accum >> tail) & ((1ULL<<length)-1);
+}
+
+
+/**
+	A read-only view of packed L3 octets.
+	The view refers into the caller's buffer and copies nothing,
+	so it must not outlive the buffer.
+	Reads past the end throw L3ReadError, like the BitVector readers.
+*/
+class L3Octets {
+
+	private:
+
+	const unsigned char *mData;
+	size_t mLength;
+
+	public:
+
+	L3Octets(const unsigned char *wData, size_t wLength)
+		:mData(wData),mLength(wLength)
+	{}
+
+	size_t size() const { return mLength; }
+
+	/** Return octet i. */
+	unsigned octet(size_t i) const
+	{
+		if (i>=mLength) L3_READ_ERROR;
+		return mData[i];
+	}
+
+	/** Return an octet and advance the octet index. */
+	unsigned readOctet(size_t &rp) const { return octet(rp++); }
+
+	/** Return a view of length octets at index. */
+	L3Octets view(size_t index, size_t length) const
+	{
+		if (index+length>mLength) L3_READ_ERROR;
+		return L3Octets(mData+index,length);
+	}
+
+	/** Return the value part of an LV element and advance past it. */
+	L3Octets readLV(size_t &rp) const
+	{
+		size_t length = readOctet(rp);
+		L3Octets value = view(rp,length);
+		rp += length;
+		return value;
+	}
+
+	/** Copy out length octets at index. */
+	void copy(size_t index, size_t length, unsigned char *dest) const
+	{
+		L3Octets src = view(index,length);
+		memcpy(dest,src.mData,length);
+	}
+
+};
+
+
+
+/**@name Pooled allocation of L3 messages. */
+//@{
+const unsigned L3MessagePoolGranularity = 64;	///< size step between pools, in bytes
+const unsigned L3MessagePoolClasses = 16;		///< number of pools; larger messages use the heap
+const unsigned L3MessagePoolMax = 256;			///< most freed blocks kept by each pool
+//@}
+
+
 /**
 	This is virtual base class for the messages of GSM's L3 signalling layer.
 	It defines almost nothing, but is the origination of other classes.
+	Messages allocated with new come from size-class pools, since
+	one is parsed and deleted for nearly every signalling frame.
 */
 class L3Message {
 
@@ -63,6 +150,15 @@ class L3Message {
 
 	virtual ~L3Message() {}
 
+	/**@name Pooled allocation.  The size is of the most-derived class. */
+	//@{
+	static void* operator new(size_t);
+	static void operator delete(void*, size_t);
+	//@}
+
+	/** Return true if this message has an octet parser, parseBody(const L3Octets&, size_t&). */
+	virtual bool parsesOctets() const { return false; }
+
 	/** Return the expected message body length in bytes, not including L3 header or rest octets. */
 	virtual size_t l2BodyLength() const = 0;
 
@@ -85,6 +181,8 @@ class L3Message {
 	  The parse() method reads and decodes L3 message bits.
 	  This method invokes parseBody, assuming that the L3 header
 	  has already been read.
+	  If the message parses octets, the frame is packed once and
+	  the octet parseBody is used instead of the bit parser.
 	*/
 	virtual void parse(const L3Frame& source);
 
@@ -124,6 +222,13 @@ class L3Message {
 	*/
 	virtual void parseBody(const L3Frame& source, size_t &readPosition);
 
+	/**
+		Parse the body from packed octets; defined in subclasses that
+		override parsesOctets.  The read position is an octet index.
+		If not defined, this will assert at runtime.
+	*/
+	virtual void parseBody(const L3Octets& source, size_t &readPosition);
+
 
 	public:
 
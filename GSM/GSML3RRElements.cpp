@@ -556,68 +556,63 @@ void L3APDUData::text(ostream& os) const
 void L3MeasurementResults::parseV(const L3Frame& frame, size_t &rp)
 {
 	// GSM 04.08 10.5.2.20
-	mBA_USED = frame.readField(rp,1);
-	mDTX_USED = frame.readField(rp,1);
-	mRXLEV_FULL_SERVING_CELL = frame.readField(rp,6);
-	rp++;	// spare
-	mMEAS_VALID = frame.readField(rp,1);
-	mRXLEV_SUB_SERVING_CELL = frame.readField(rp,6);
-	rp++;	// spare
-	mRXQUAL_FULL_SERVING_CELL = frame.readField(rp,3);
-	mRXQUAL_SUB_SERVING_CELL = frame.readField(rp,3);
-	mNO_NCELL = frame.readField(rp,3);
-	for (unsigned i=0; i<6; i++) {
-		mRXLEV_NCELL[i] = frame.readField(rp,6);
-		mBCCH_FREQ_NCELL[i] = frame.readField(rp,5);
-		mBSIC_NCELL[i] = frame.readField(rp,6);
-	}
+	for (unsigned i=0; i<16; i++) mOctets[i] = frame.readField(rp,8);
 }
 
 
 void L3MeasurementResults::text(ostream& os) const
 {
 	// GSM 04.08 10.5.2.20
-	os << "BA_USED=" << mBA_USED;
-	os << " DTX_USED=" << mDTX_USED;
-	os << " MEAS_VALID=" << mMEAS_VALID;
+	os << "BA_USED=" << BA_USED();
+	os << " DTX_USED=" << DTX_USED();
+	os << " MEAS_VALID=" << MEAS_VALID();
 	// Note that the value of the MEAS-VALID bit is reversed
 	// from what you might expect.
-	if (mMEAS_VALID) return;
-	os << " RXLEV_FULL_SERVING_CELL=" << mRXLEV_FULL_SERVING_CELL;
-	os << " RXLEV_SUB_SERVING_CELL=" << mRXLEV_SUB_SERVING_CELL;
-	os << " RXQUAL_FULL_SERVING_CELL=" << mRXQUAL_FULL_SERVING_CELL;
-	os << " RXQUAL_SUB_SERVING_CELL=" << mRXQUAL_SUB_SERVING_CELL;
-	os << " NO_NCELL=" << mNO_NCELL;
+	if (MEAS_VALID()) return;
+	os << " RXLEV_FULL_SERVING_CELL=" << RXLEV_FULL_SERVING_CELL();
+	os << " RXLEV_SUB_SERVING_CELL=" << RXLEV_SUB_SERVING_CELL();
+	os << " RXQUAL_FULL_SERVING_CELL=" << RXQUAL_FULL_SERVING_CELL();
+	os << " RXQUAL_SUB_SERVING_CELL=" << RXQUAL_SUB_SERVING_CELL();
+	unsigned count = NO_NCELL();
+	os << " NO_NCELL=" << count;
 	// no measurements?
-	if (mNO_NCELL==0) return;
+	if (count==0) return;
 	// no neighbor list?
-	if (mNO_NCELL==7) return;
-	for (unsigned i=0; i<mNO_NCELL; i++) {
-		os << " RXLEV_NCELL" << i+1 << "=" << mRXLEV_NCELL[i];
-		os << " BCCH_FREQ_NCELL" << i+1 << "=" << mBCCH_FREQ_NCELL[i];
-		os << " BSIC_NCELL" << i+1 << "=" << mBSIC_NCELL[i];
+	if (count==7) return;
+	for (unsigned i=0; i<count; i++) {
+		os << " RXLEV_NCELL" << i+1 << "=" << RXLEV_NCELL(i);
+		os << " BCCH_FREQ_NCELL" << i+1 << "=" << BCCH_FREQ_NCELL(i);
+		os << " BSIC_NCELL" << i+1 << "=" << BSIC_NCELL(i);
 	}
 }
 
 
+// NO_NCELL==7 means there is no neighbor list, so there are no cells to copy.
+
 unsigned L3MeasurementResults::RXLEV_NCELL(unsigned * target) const
 {
-	for (unsigned i=0; i<mNO_NCELL; i++) target[i] = mRXLEV_NCELL[i];
-	return mNO_NCELL;
+	unsigned count = NO_NCELL();
+	if (count==7) return 0;
+	for (unsigned i=0; i<count; i++) target[i] = RXLEV_NCELL(i);
+	return count;
 }
 
 
 unsigned L3MeasurementResults::BCCH_FREQ_NCELL(unsigned * target) const
 {
-	for (unsigned i=0; i<mNO_NCELL; i++) target[i] = mBCCH_FREQ_NCELL[i];
-	return mNO_NCELL;
+	unsigned count = NO_NCELL();
+	if (count==7) return 0;
+	for (unsigned i=0; i<count; i++) target[i] = BCCH_FREQ_NCELL(i);
+	return count;
 }
 
 
 unsigned L3MeasurementResults::BSIC_NCELL(unsigned * target) const
 {
-	for (unsigned i=0; i<mNO_NCELL; i++) target[i] = mBSIC_NCELL[i];
-	return mNO_NCELL;
+	unsigned count = NO_NCELL();
+	if (count==7) return 0;
+	for (unsigned i=0; i<count; i++) target[i] = BSIC_NCELL(i);
+	return count;
 }
 
 
@@ -164,6 +164,27 @@ class L3ControlChannelDescription : public L3ProtocolElement {
 		mT3212=gConfig.getNum("GSM.Timer.T3212")/6;
 	}
 
+	/**@name Accessors. */
+	//@{
+	unsigned BS_AG_BLKS_RES() const { return mBS_AG_BLKS_RES; }
+	unsigned CCCH_CONF() const { return mCCCH_CONF; }
+	unsigned BS_PA_MFRMS() const { return mBS_PA_MFRMS; }
+	//@}
+
+	/** Number of 51-multiframes in a paging cycle, GSM 05.02 3.3.2.3. */
+	unsigned pagingMultiframes() const { return mBS_PA_MFRMS + 2; }
+
+	/**
+		Number of paging blocks in each 51-multiframe, GSM 05.02 Table 5.
+		A combined (C-V) beacon has 3 CCCH blocks, a non-combined beacon 9.
+	*/
+	unsigned pagingBlocks() const
+	{
+		unsigned blocks = (mCCCH_CONF==1) ? 3 : 9;
+		if (blocks<=mBS_AG_BLKS_RES) return 1;
+		return blocks - mBS_AG_BLKS_RES;
+	}
+
 	size_t lengthV() const { return 3; }
 	void writeV(L3Frame& dest, size_t &wp) const;
 	void parseV(const L3Frame&, size_t&) { assert(0); }
@@ -716,50 +737,49 @@ class L3MeasurementResults : public L3ProtocolElement {
 
 	private:
 
-	bool mBA_USED;
-	bool mDTX_USED;
-	bool mMEAS_VALID;		///< 0 for valid, 1 for non-valid
-	unsigned mRXLEV_FULL_SERVING_CELL;
-	unsigned mRXLEV_SUB_SERVING_CELL;
-	unsigned mRXQUAL_FULL_SERVING_CELL;
-	unsigned mRXQUAL_SUB_SERVING_CELL;
+	/**
+		The value part as received.  Fields are decoded only when used,
+		since most reports are only checked for the serving cell.
+	*/
+	unsigned char mOctets[16];
+
+	/** Return a field of the value part, by bit index from the MSB of the first octet. */
+	unsigned field(unsigned bitIndex, unsigned length) const
+		{ return packedField(mOctets,bitIndex,length); }
 
-	unsigned mNO_NCELL;
-	unsigned mRXLEV_NCELL[6];
-	unsigned mBCCH_FREQ_NCELL[6];
-	unsigned mBSIC_NCELL[6];
+	/** Bit index of the fields for neighbor cell i. */
+	static unsigned NCELLIndex(unsigned i) { assert(i<6); return 26 + 17*i; }
 
 	public:
 
 	L3MeasurementResults()
-		:L3ProtocolElement(),
-		mMEAS_VALID(false),
-		mNO_NCELL(0)
-	{ }
+		:L3ProtocolElement()
+	{ memset(mOctets,0,sizeof(mOctets)); }
 
 	size_t lengthV() const { return 16; }
 	void writeV(L3Frame&, size_t&) const { assert(0); }
 	void parseV(const L3Frame&, size_t&);
 	void parseV(const L3Frame&, size_t& , size_t) { assert(0); }
+	void parseV(const L3Octets& src, size_t &rp) { src.copy(rp,16,mOctets); rp += 16; }
 	void text(std::ostream& os) const;
 	
 	/**@name Accessors. */
 	//@{
 
-	bool BA_USED() const { return mBA_USED; }
-	bool DTX_USED() const { return mDTX_USED; }
-	bool MEAS_VALID() const { return mMEAS_VALID; }
-	unsigned RXLEV_FULL_SERVING_CELL() const { return mRXLEV_FULL_SERVING_CELL; }
-	unsigned RXLEV_SUB_SERVING_CELL() const { return mRXLEV_SUB_SERVING_CELL; }
-	unsigned RXQUAL_FULL_SERVING_CELL() const { return mRXQUAL_FULL_SERVING_CELL; }
-	unsigned RXQUAL_SUB_SERVING_CELL() const { return mRXQUAL_SUB_SERVING_CELL; }
+	bool BA_USED() const { return field(0,1); }
+	bool DTX_USED() const { return field(1,1); }
+	bool MEAS_VALID() const { return field(9,1); }
+	unsigned RXLEV_FULL_SERVING_CELL() const { return field(2,6); }
+	unsigned RXLEV_SUB_SERVING_CELL() const { return field(10,6); }
+	unsigned RXQUAL_FULL_SERVING_CELL() const { return field(17,3); }
+	unsigned RXQUAL_SUB_SERVING_CELL() const { return field(20,3); }
 
-	unsigned NO_NCELL() const { return mNO_NCELL; }
-	unsigned RXLEV_NCELL(unsigned i) const { assert(i<mNO_NCELL); return mRXLEV_NCELL[i]; }
+	unsigned NO_NCELL() const { return field(23,3); }
+	unsigned RXLEV_NCELL(unsigned i) const { assert(i<NO_NCELL()); return field(NCELLIndex(i),6); }
 	unsigned RXLEV_NCELL(unsigned *) const;
-	unsigned BCCH_FREQ_NCELL(unsigned i) const { assert(i<mNO_NCELL); return mBCCH_FREQ_NCELL[i]; }
+	unsigned BCCH_FREQ_NCELL(unsigned i) const { assert(i<NO_NCELL()); return field(NCELLIndex(i)+6,5); }
 	unsigned BCCH_FREQ_NCELL(unsigned *) const;
-	unsigned BSIC_NCELL(unsigned i) const { assert(i<mNO_NCELL); return mBSIC_NCELL[i]; }
+	unsigned BSIC_NCELL(unsigned i) const { assert(i<NO_NCELL()); return field(NCELLIndex(i)+11,6); }
 	unsigned BSIC_NCELL(unsigned *) const;
 	//@}
 
@@ -772,15 +792,15 @@ class L3MeasurementResults : public L3ProtocolElement {
 	/**@ Converted accessors. */
 	//@{
 	int RXLEV_FULL_SERVING_CELL_dBm() const
-		{ return decodeLevToDBm(mRXLEV_FULL_SERVING_CELL); }
+		{ return decodeLevToDBm(RXLEV_FULL_SERVING_CELL()); }
 	int RXLEV_SUB_SERVING_CELL_dBm() const
-		{ return decodeLevToDBm(mRXLEV_SUB_SERVING_CELL); }
+		{ return decodeLevToDBm(RXLEV_SUB_SERVING_CELL()); }
 	float RXQUAL_FULL_SERVING_CELL_BER() const
-		{ return decodeQualToBER(mRXQUAL_FULL_SERVING_CELL); }
+		{ return decodeQualToBER(RXQUAL_FULL_SERVING_CELL()); }
 	float RXQUAL_SUB_SERVING_CELL_BER() const
-		{ return decodeQualToBER(mRXQUAL_SUB_SERVING_CELL); }
+		{ return decodeQualToBER(RXQUAL_SUB_SERVING_CELL()); }
 	int RXLEV_NCELL_dBm(unsigned i) const
-		{ assert(i<mNO_NCELL); return decodeLevToDBm(mRXLEV_NCELL[i]); }
+		{ return decodeLevToDBm(RXLEV_NCELL(i)); }
 	//@}
 	//@}
 
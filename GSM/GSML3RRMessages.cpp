@@ -55,6 +55,12 @@ void L3Message::parseBody(const L3Frame&, size_t&)
 	assert(0);
 }
 
+void L3Message::parseBody(const L3Octets&, size_t&)
+{
+	LOG(ERR) << "not implemented for " << MTI();
+	assert(0);
+}
+
 
 
 
@@ -237,6 +243,91 @@ void L3PagingRequestType1::text(ostream& os) const
 }
 
 
+size_t L3PagingRequestType2::l2BodyLength() const
+{
+	size_t sum = 1 + 4 + 4;
+	if (mMobileIDs.size()>2) sum += mMobileIDs[2].lengthTLV();
+	return sum;
+}
+
+
+void L3PagingRequestType2::writeBody(L3Frame& dest, size_t &wp) const
+{
+	// See GSM 04.08 9.1.23.
+	// Page Mode  M V 1/2 10.5.2.26
+	// Channels Needed for Mobiles 1 and 2  M V 1/2 10.5.2.8
+	// Mobile Identity 1  M V 4 10.5.2.42 (packed TMSI)
+	// Mobile Identity 2  M V 4 10.5.2.42 (packed TMSI)
+	// 0x17 Mobile Identity 3  O TLV 3-10 10.5.1.4
+	// P2 Rest Octets  M V 1-11 10.5.2.24
+
+	// Remember to reverse orders of 1/2-octet fields.
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[1]),2);
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[0]),2);
+	// "normal paging", GSM 04.08 Table 10.5.63
+	dest.writeField(wp,0x0,4);
+	dest.writeField(wp,mMobileIDs[0].TMSI(),32);
+	dest.writeField(wp,mMobileIDs[1].TMSI(),32);
+	if (mMobileIDs.size()>2) mMobileIDs[2].writeTLV(0x17,dest,wp);
+	// P2 Rest Octets, GSM 04.08 10.5.2.24.
+	// Only the channel needed for mobile 3 is used.
+	if (mMobileIDs.size()>2) {
+		dest.writeH(wp);
+		dest.writeField(wp,channelNeededCode(mChannelsNeeded[2]),2);
+	} else {
+		dest.writeL(wp);
+	}
+	while (wp%8) dest.writeL(wp);
+}
+
+
+void L3PagingRequestType2::text(ostream& os) const
+{
+	L3RRMessage::text(os);
+	os << " mobileIDs=(";
+	for (unsigned i=0; i<mMobileIDs.size(); i++) {
+		os << "(" << mMobileIDs[i] << "," << mChannelsNeeded[i] << "),";
+	}
+	os << ")";
+}
+
+
+
+void L3PagingRequestType3::writeBody(L3Frame& dest, size_t &wp) const
+{
+	// See GSM 04.08 9.1.24.
+	// Page Mode  M V 1/2 10.5.2.26
+	// Channels Needed for Mobiles 1 and 2  M V 1/2 10.5.2.8
+	// Mobile Identity 1-4  M V 4 each 10.5.2.42 (packed TMSI)
+	// P3 Rest Octets  M V 3 10.5.2.25
+
+	// Remember to reverse orders of 1/2-octet fields.
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[1]),2);
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[0]),2);
+	// "normal paging", GSM 04.08 Table 10.5.63
+	dest.writeField(wp,0x0,4);
+	for (unsigned i=0; i<4; i++) dest.writeField(wp,mMobileIDs[i].TMSI(),32);
+	// P3 Rest Octets, GSM 04.08 10.5.2.25.
+	// Only the channels needed for mobiles 3 and 4 are used.
+	dest.writeH(wp);
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[2]),2);
+	dest.writeField(wp,channelNeededCode(mChannelsNeeded[3]),2);
+	// The rest of the 3 octets is spare padding.
+	while (wp<dest.size()) dest.writeL(wp);
+}
+
+
+void L3PagingRequestType3::text(ostream& os) const
+{
+	L3RRMessage::text(os);
+	os << " mobileIDs=(";
+	for (unsigned i=0; i<mMobileIDs.size(); i++) {
+		os << "(" << mMobileIDs[i] << "," << mChannelsNeeded[i] << "),";
+	}
+	os << ")";
+}
+
+
 size_t L3PagingResponse::l2BodyLength() const
 {
 	return 1 + mClassmark.lengthLV() + mMobileID.lengthLV();
@@ -252,6 +343,13 @@ void L3PagingResponse::parseBody(const L3Frame& src, size_t &rp)
 	mMobileID.parseLV(src,rp);
 }
 
+void L3PagingResponse::parseBody(const L3Octets& src, size_t &rp)
+{
+	rp++;				// skip cipher key seq # and spare half octet
+	mClassmark.parseLV(src,rp);
+	mMobileID.parseLV(src,rp);
+}
+
 void L3PagingResponse::text(ostream& os) const
 {
 	L3RRMessage::text(os);
@@ -618,6 +716,11 @@ void L3MeasurementReport::parseBody(const L3Frame& frame, size_t &rp)
 	mResults.parseV(frame,rp);
 }
 
+void L3MeasurementReport::parseBody(const L3Octets& src, size_t &rp)
+{
+	mResults.parseV(src,rp);
+}
+
 void L3MeasurementReport::text(ostream& os) const
 {
 	L3RRMessage::text(os);
@@ -217,6 +217,98 @@ class L3PagingRequestType1 : public L3RRMessageNRO {
 
 
 
+/**
+	Paging Request Type 2, GSM 04.08 9.1.23
+	Carries two TMSIs and an optional third mobile ID of any type.
+*/
+class L3PagingRequestType2 : public L3RRMessageRO {
+
+	private:
+
+	std::vector<L3MobileIdentity> mMobileIDs;
+	ChannelType mChannelsNeeded[3];
+
+	public:
+
+	L3PagingRequestType2(const L3MobileIdentity& wId1, ChannelType wType1,
+			const L3MobileIdentity& wId2, ChannelType wType2)
+		:L3RRMessageRO()
+	{
+		assert(wId1.type()==TMSIType);
+		assert(wId2.type()==TMSIType);
+		mMobileIDs.push_back(wId1);
+		mChannelsNeeded[0]=wType1;
+		mMobileIDs.push_back(wId2);
+		mChannelsNeeded[1]=wType2;
+		mChannelsNeeded[2]=AnyDCCHType;
+	}
+
+	L3PagingRequestType2(const L3MobileIdentity& wId1, ChannelType wType1,
+			const L3MobileIdentity& wId2, ChannelType wType2,
+			const L3MobileIdentity& wId3, ChannelType wType3)
+		:L3RRMessageRO()
+	{
+		assert(wId1.type()==TMSIType);
+		assert(wId2.type()==TMSIType);
+		mMobileIDs.push_back(wId1);
+		mChannelsNeeded[0]=wType1;
+		mMobileIDs.push_back(wId2);
+		mChannelsNeeded[1]=wType2;
+		mMobileIDs.push_back(wId3);
+		mChannelsNeeded[2]=wType3;
+	}
+
+	int MTI() const { return PagingRequestType2; }
+
+	size_t l2BodyLength() const;
+	size_t restOctetsLength() const { return 1; }
+	void writeBody(L3Frame& dest, size_t& wp) const;
+	void text(std::ostream&) const;
+};
+
+
+
+/**
+	Paging Request Type 3, GSM 04.08 9.1.24
+	Carries four TMSIs.
+*/
+class L3PagingRequestType3 : public L3RRMessageRO {
+
+	private:
+
+	std::vector<L3MobileIdentity> mMobileIDs;
+	ChannelType mChannelsNeeded[4];
+
+	public:
+
+	L3PagingRequestType3(const L3MobileIdentity& wId1, ChannelType wType1,
+			const L3MobileIdentity& wId2, ChannelType wType2,
+			const L3MobileIdentity& wId3, ChannelType wType3,
+			const L3MobileIdentity& wId4, ChannelType wType4)
+		:L3RRMessageRO()
+	{
+		mMobileIDs.push_back(wId1);
+		mChannelsNeeded[0]=wType1;
+		mMobileIDs.push_back(wId2);
+		mChannelsNeeded[1]=wType2;
+		mMobileIDs.push_back(wId3);
+		mChannelsNeeded[2]=wType3;
+		mMobileIDs.push_back(wId4);
+		mChannelsNeeded[3]=wType4;
+		for (unsigned i=0; i<4; i++) assert(mMobileIDs[i].type()==TMSIType);
+	}
+
+	int MTI() const { return PagingRequestType3; }
+
+	size_t l2BodyLength() const { return 1 + 4*4; }
+	size_t restOctetsLength() const { return 3; }
+	void writeBody(L3Frame& dest, size_t& wp) const;
+	void text(std::ostream&) const;
+};
+
+
+
+
 /** Paging Response, GSM 04.08 9.1.25 */
 class L3PagingResponse : public L3RRMessageNRO {
 
@@ -232,7 +324,9 @@ class L3PagingResponse : public L3RRMessageNRO {
 	int MTI() const { return PagingResponse; }
 
 	size_t l2BodyLength() const;
+	bool parsesOctets() const { return true; }
 	void parseBody(const L3Frame& source, size_t &rp);
+	void parseBody(const L3Octets& source, size_t &rp);
 	void text(std::ostream&) const;
 
 };
@@ -775,7 +869,9 @@ class L3MeasurementReport : public L3RRMessageNRO {
 	int MTI() const { return (int) MeasurementReport; }
 	size_t l2BodyLength() const { return mResults.lengthV(); }
 
+	bool parsesOctets() const { return true; }
 	void parseBody(const L3Frame&, size_t&);
+	void parseBody(const L3Octets&, size_t&);
 	void text(std::ostream&) const;
 
 	const L3MeasurementResults results() const { return mResults; }
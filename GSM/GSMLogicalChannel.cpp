@@ -33,6 +33,7 @@
 #include "GSML3RRMessages.h"
 #include "GSMLogicalChannel.h"
 #include "GSMConfig.h"
+#include "MeasurementEngine.h"
 
 #include <TransactionTable.h>
 #include <SMSControl.h>
@@ -97,7 +98,7 @@ void LogicalChannel::send(const L3Message& msg,
 
 
 CCCHLogicalChannel::CCCHLogicalChannel(const TDMAMapping& wMapping)
-	:mRunning(false)
+	:mRunning(false),mPagingMultiframes(0)
 {
 	mL1 = new CCCHL1FEC(wMapping);
 	mL2[0] = new CCCHL2;
@@ -124,7 +125,20 @@ void CCCHLogicalChannel::serviceLoop()
 	LogicalChannel::send(idleFrame);
 	// run the loop
 	while (true) {
+		// Access grants take priority over pages.
 		L3Frame* frame = mQ.readNoBlock();
+		// Pages queued for another paging cycle would go to the wrong groups,
+		// or never go at all.
+		unsigned cycle = gBTS.pagingMultiframes();
+		if (cycle!=mPagingMultiframes) {
+			flushPaging();
+			mPagingMultiframes = cycle;
+		}
+		if (!frame) {
+			// Pick the paging queue for the multiframe of the next block.
+			unsigned multiframe = (mL1->encoder()->nextWriteTime().FN() / 51) % cycle;
+			frame = mPagingQ[multiframe].readNoBlock();
+		}
 		if (frame) {
 			LogicalChannel::send(*frame);
 			OBJLOG(DEBUG) << "CCCHLogicalChannel::serviceLoop sending " << *frame;
@@ -138,6 +152,39 @@ void CCCHLogicalChannel::serviceLoop()
 }
 
 
+void CCCHLogicalChannel::sendPage(const L3RRMessage& msg, unsigned multiframe)
+{
+	assert(multiframe<MaxPagingMultiframes);
+	// The pager may have computed this for a cycle that just shrank.
+	if (multiframe>=gBTS.pagingMultiframes()) {
+		OBJLOG(NOTICE) << "dropping page for multiframe " << multiframe << " outside the paging cycle";
+		return;
+	}
+	mPagingQ[multiframe].write(new L3Frame((const L3Message&)msg,UNIT_DATA));
+}
+
+
+void CCCHLogicalChannel::flushPaging()
+{
+	unsigned count = 0;
+	for (unsigned i=0; i<MaxPagingMultiframes; i++) {
+		while (L3Frame *frame = mPagingQ[i].readNoBlock()) {
+			delete frame;
+			count++;
+		}
+	}
+	if (count) OBJLOG(INFO) << "paging cycle changed, discarded " << count << " pages";
+}
+
+
+unsigned CCCHLogicalChannel::load() const
+{
+	unsigned sum = mQ.size();
+	for (unsigned i=0; i<MaxPagingMultiframes; i++) sum += mPagingQ[i].size();
+	return sum;
+}
+
+
 void *GSM::CCCHLogicalChannelServiceLoopAdapter(CCCHLogicalChannel* chan)
 {
 	chan->serviceLoop();
@@ -189,7 +236,7 @@ SACCHLogicalChannel::SACCHLogicalChannel(
 		unsigned wCN,
 		unsigned wTN,
 		const MappingPair& wMapping)
-		: mRunning(false)
+		: mRunning(false),mGeneration(0)
 {
 	mSACCHL1 = new SACCHL1FEC(wCN,wTN,wMapping);
 	mL1 = mSACCHL1;
@@ -205,6 +252,9 @@ SACCHLogicalChannel::SACCHLogicalChannel(
 void SACCHLogicalChannel::open()
 {
 	LogicalChannel::open();
+	// Reports already queued belong to the previous generation.
+	mGeneration++;
+	gMeasurements.reset(this);
 	if (!mRunning) {
 		mRunning=true;
 		mServiceThread.start((void*(*)(void*))SACCHLogicalChannelServiceLoopAdapter,this);
@@ -271,9 +321,8 @@ void SACCHLogicalChannel::serviceLoop()
 				if (measurement) {
 					mMeasurementResults = measurement->results();
 					OBJLOG(DEBUG) << "SACCH measurement report " << mMeasurementResults;
-					// Add the measurement results to the table
-					// Note that the typeAndOffset of a SACCH match the host channel.
-					gPhysStatus.setPhysical(this, mMeasurementResults);
+					// Statistics and the physical status table are updated in the engine thread.
+					gMeasurements.post(this, mMeasurementResults);
 				} else {
 					OBJLOG(NOTICE) << "SACCH SAP0 sent unaticipated message " << rrMessage;
 				}
@@ -289,10 +338,10 @@ void SACCHLogicalChannel::serviceLoop()
 				const SMS::CPData* cpData = dynamic_cast<const SMS::CPData*>(smsMessage);
 				if (cpData) {
 					OBJLOG(INFO) << "SMS CPDU " << *cpData;
-					Control::TransactionEntry *transaction = gTransactionTable.find(this);
+					Control::TransactionRef transaction = gTransactionTable.find(this);
 					try {
-						if (transaction) {
-							Control::InCallMOSMSController(cpData,transaction,this);
+						if (transaction.get()) {
+							Control::InCallMOSMSController(cpData,transaction.get(),this);
 						} else {
 							OBJLOG(WARNING) << "in-call MOSMS CP-DATA with no corresponding transaction";
 						}
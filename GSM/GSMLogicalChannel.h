@@ -202,6 +202,10 @@ public:
 	/** Return true if the channel is safely abandoned (closed or orphaned). */
 	bool recyclable() const { assert(mL1); return mL1->recyclable(); }
 
+	/** Set a function to call each time the channel becomes recyclable. */
+	void recycleCallback(void (*wCallback)(void*), void *wObject)
+		{ assert(mL1); mL1->recycleCallback(wCallback,wObject); }
+
 	/** Return true if the channel is active. */
 	bool active() const { assert(mL1); return mL1->active(); }
 
@@ -353,6 +357,7 @@ class SACCHLogicalChannel : public LogicalChannel {
 	SACCHL1FEC *mSACCHL1;
 	Thread mServiceThread;	///< a thread for the service loop
 	bool mRunning;			///< true is the service loop is started
+	volatile unsigned mGeneration;	///< incremented each time the channel is opened
 
 	/** MeasurementResults from the MS. They are caught in serviceLoop, accessed
 	 for recording along with GPS and other data in MobilityManagement.cpp */
@@ -369,6 +374,9 @@ class SACCHLogicalChannel : public LogicalChannel {
 
 	void open();
 
+	/** Return the number of times the channel has been opened. */
+	unsigned generation() const { return mGeneration; }
+
 	friend void *SACCHLogicalChannelServiceLoopAdapter(SACCHLogicalChannel*);
 
 	/**@name Pass-through accoessors to L1. */
@@ -379,6 +387,14 @@ class SACCHLogicalChannel : public LogicalChannel {
 	int actualMSTiming() const { return mSACCHL1->actualMSTiming(); }
 	void setPhy(float RSSI, float timingError) { mSACCHL1->setPhy(RSSI,timingError); }
 	void setPhy(const SACCHLogicalChannel& other) { mSACCHL1->setPhy(*other.mSACCHL1); }
+	float orderedMSPower() const { return mSACCHL1->encoder()->orderedMSPower(); }
+	float orderedMSTiming() const { return mSACCHL1->encoder()->orderedMSTiming(); }
+	/** Set the power and timing advance ordered in the SACCH physical header. */
+	void orderPhy(float MSPower, float MSTiming)
+	{
+		mSACCHL1->encoder()->orderedMSPower(MSPower);
+		mSACCHL1->encoder()->orderedMSTiming(MSTiming);
+	}
 	//@}
 
 	/**@name Channel and neighbour cells stats as reported from MS */
@@ -425,6 +441,14 @@ class CCCHLogicalChannel : public NDCCHLogicalChannel {
 	L3FrameFIFO mQ;			///< because the CCCH is written by multiple threads
 	bool mRunning;			///< a flag to indication that the service loop is running
 
+	/**
+		Paging messages, queued by 51-multiframe within the paging cycle.
+		A message in mPagingQ[i] is sent only in a multiframe where
+		(FN div 51) mod BS_PA_MFRMS == i, GSM 05.02 6.5.3.
+	*/
+	L3FrameFIFO mPagingQ[MaxPagingMultiframes];
+	unsigned mPagingMultiframes;	///< the paging cycle the queues were filled for
+
 	public:
 
 	CCCHLogicalChannel(const TDMAMapping& wMapping);
@@ -436,11 +460,25 @@ class CCCHLogicalChannel : public NDCCHLogicalChannel {
 
 	void send(const L3Message&) { assert(0); }
 
-	/** This is a loop in its own thread that empties mQ. */
+	/**
+		Queue a paging message for a specific multiframe of the paging cycle.
+		Access grants in mQ take priority over paging in any given block.
+		@param msg The paging request.
+		@param multiframe The multiframe index within the paging cycle.
+	*/
+	void sendPage(const L3RRMessage& msg, unsigned multiframe);
+
+	/** This is a loop in its own thread that empties mQ and mPagingQ. */
 	void serviceLoop();
 
+	/**
+		Discard all queued pages.
+		Called when the paging cycle changes, since that moves every paging group.
+	*/
+	void flushPaging();
+
 	/** Return the number of messages waiting for transmission. */
-	unsigned load() const { return mQ.size(); }
+	unsigned load() const;
 
 	ChannelType type() const { return CCCHType; }
 
@@ -480,6 +518,9 @@ class TCHFACCHLogicalChannel : public LogicalChannel {
 	void sendTCH(const unsigned char* frame)
 		{ assert(mTCHL1); mTCHL1->sendTCH(frame); }
 
+	unsigned downlinkQueueSize() const
+		{ assert(mTCHL1); return mTCHL1->downlinkQueueSize(); }
+
 	unsigned char* recvTCH()
 		{ assert(mTCHL1); return mTCHL1->recvTCH(); }
 
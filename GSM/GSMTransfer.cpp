@@ -26,6 +26,9 @@
 
 
 #include <iostream>
+#include <string.h>
+
+#include <BlockPool.h>
 
 #include "GSMTransfer.h"
 #include "GSML3Message.h"
@@ -35,6 +38,23 @@ using namespace std;
 using namespace GSM;
 
 
+
+// Frames are created and deleted for every radio block in every LAPDm,
+// so their blocks are recycled rather than going back to the heap.
+// The pools are never deleted, since frames may be freed during static destruction.
+static BlockPool& L2FramePool()
+{
+	static BlockPool *sPool = new BlockPool(sizeof(L2Frame),FramePoolMax);
+	return *sPool;
+}
+
+static BlockPool& L3FramePool()
+{
+	static BlockPool *sPool = new BlockPool(sizeof(L3Frame),FramePoolMax);
+	return *sPool;
+}
+
+
 ostream& GSM::operator<<(ostream& os, const L2Frame& frame)
 {
 	os << "primitive=" << frame.primitive();
@@ -218,9 +238,36 @@ void L2Frame::idleFill()
 }
 
 
+void L2Frame::copyBits(const BitVector& other)
+{
+	if (other.size()!=L2FrameBits) {
+		clone(other);
+		return;
+	}
+	if (mData) {
+		delete[] mData;
+		mData = NULL;
+	}
+	useInline();
+	memcpy(mBits,other.begin(),L2FrameBits);
+}
+
+
+void* L2Frame::operator new(size_t size)
+{
+	return L2FramePool().get(size);
+}
+
+void L2Frame::operator delete(void* frame, size_t size)
+{
+	L2FramePool().put(frame,size);
+}
+
+
 L2Frame::L2Frame(const BitVector& bits, Primitive prim)
-	:BitVector(23*8),mPrimitive(prim)
+	:mPrimitive(prim)
 {
+	useInline();
 	idleFill();
 	assert(bits.size()<=this->size());
 	bits.copyTo(*this);
@@ -228,8 +275,9 @@ L2Frame::L2Frame(const BitVector& bits, Primitive prim)
 
 
 L2Frame::L2Frame(const L2Header& header, const BitVector& l3)
-	:BitVector(23*8),mPrimitive(DATA)
+	:mPrimitive(DATA)
 {
+	useInline();
 	idleFill();
 	assert((header.bitsNeeded()+l3.size())<=this->size());
 	size_t wp = header.write(*this);
@@ -238,8 +286,9 @@ L2Frame::L2Frame(const L2Header& header, const BitVector& l3)
 
 
 L2Frame::L2Frame(const L2Header& header)
-	:BitVector(23*8),mPrimitive(DATA)
+	:mPrimitive(DATA)
 {
+	useInline();
 	idleFill();
 	header.write(*this);
 }
@@ -451,20 +500,47 @@ ostream& GSM::operator<<(ostream& os, Primitive prim)
 
 
 L3Frame::L3Frame(const L3Message& msg, Primitive wPrimitive)
-	:BitVector(msg.bitsNeeded()),mPrimitive(wPrimitive),
+	:mPrimitive(wPrimitive),
 	mL2Length(msg.L2Length())
 {
+	allocate(msg.bitsNeeded());
 	msg.write(*this);
 }
 
 
+void L3Frame::allocate(size_t len)
+{
+	if (len>L2FrameBits) {
+		if (size()!=len || mData==NULL) resize(len);
+		return;
+	}
+	if (mData) {
+		delete[] mData;
+		mData = NULL;
+	}
+	mStart = mBits;
+	mEnd = mBits + len;
+}
+
+
+void* L3Frame::operator new(size_t size)
+{
+	return L3FramePool().get(size);
+}
+
+void L3Frame::operator delete(void* frame, size_t size)
+{
+	L3FramePool().put(frame,size);
+}
+
+
 
 L3Frame::L3Frame(const char* hexString)
 	:mPrimitive(DATA)
 {
 	size_t len = strlen(hexString);
 	mL2Length = len/2;
-	resize(len*4);
+	allocate(len*4);
 	size_t wp=0;
 	for (size_t i=0; i<len; i++) {
 		char c = hexString[i];
@@ -479,7 +555,7 @@ L3Frame::L3Frame(const char* binary, size_t len)
 	:mPrimitive(DATA)
 {
 	mL2Length = len;
-	resize(len*8);
+	allocate(len*8);
 	size_t wp=0;
 	for (size_t i=0; i<len; i++) {
 		writeField(wp,binary[i],8);
@@ -50,6 +50,12 @@ static const unsigned gHuIndex = 87;		///< index of second stealing bit, GSM 05.
 
 static const unsigned gSlotLen = 148;	///< number of symbols per slot, not counting guard periods
 
+/** Bits in an L2 frame, GSM 04.06 2.1; also the inline storage of an L3Frame. */
+static const unsigned L2FrameBits = 23*8;
+
+/** Most freed blocks kept by each frame pool; beyond this they go back to the heap. */
+static const unsigned FramePoolMax = 1024;
+
 
 
 
@@ -463,12 +469,21 @@ unsigned N201(ChannelType, L2Header::FrameFormat);
 /**
 	The bits of an L2Frame
 	Bit ordering is MSB-first in each octet.
+	The bits are stored in the object itself and frames allocated with new
+	come from a pool, so passing frames between layers does not touch the heap.
 */
 class L2Frame : public BitVector {
 
 	private:
 
 	GSM::Primitive mPrimitive;
+	char mBits[L2FrameBits];	///< the BitVector refers here unless it is resized
+
+	/** Point the BitVector at mBits. */
+	void useInline() { mData=NULL; mStart=mBits; mEnd=mBits+L2FrameBits; }
+
+	/** Copy bits in, using mBits if they fit. */
+	void copyBits(const BitVector&);
 
 	public:
 
@@ -477,15 +492,22 @@ class L2Frame : public BitVector {
 
 	/** Build an empty frame with a given primitive. */
 	L2Frame(GSM::Primitive wPrimitive=UNIT_DATA)
-		:BitVector(23*8),
-		mPrimitive(wPrimitive)
-	{ idleFill(); }
+		:mPrimitive(wPrimitive)
+	{ useInline(); idleFill(); }
 
 	/** Make a new L2 frame by copying an existing one. */
 	L2Frame(const L2Frame& other)
-		:BitVector((const BitVector&)other),
-		mPrimitive(other.mPrimitive)
-	{ }
+		:BitVector(),mPrimitive(other.mPrimitive)
+	{ copyBits(other); }
+
+	L2Frame& operator=(const L2Frame& other)
+	{
+		if (this!=&other) {
+			mPrimitive = other.mPrimitive;
+			copyBits(other);
+		}
+		return *this;
+	}
 
 	/**
 		Make an L2Frame from a block of bits.
@@ -565,6 +587,12 @@ class L2Frame : public BitVector {
 	/** This is used only for testing. */
 	void primitive(Primitive wPrimitive) { mPrimitive=wPrimitive; }
 
+	/**@name Pooled allocation. */
+	//@{
+	static void* operator new(size_t);
+	static void operator delete(void*, size_t);
+	//@}
+
 };
 
 std::ostream& operator<<(std::ostream& os, const L2Frame& msg);
@@ -578,6 +606,8 @@ typedef InterthreadQueueWithWait<L2Frame> L2FrameFIFO;
 	Representation of a GSM L3 message in a bit vector.
 	Bit ordering is MSB-first in each octet.
 	NOTE: This is for the GSM message bits, not the message content.  See L3Message.
+	Messages that fit in one L2 frame are stored in the object itself and frames
+	allocated with new come from a pool; longer messages use the heap.
 */
 class L3Frame : public BitVector {
 
@@ -585,30 +615,50 @@ class L3Frame : public BitVector {
 
 	Primitive mPrimitive;
 	size_t mL2Length;		///< length, or L2 pseudo-length, as appropriate
+	char mBits[L2FrameBits];	///< the BitVector refers here for short frames
+
+	/** Set up storage for len bits, in mBits if they fit. */
+	void allocate(size_t len);
+
+	/** Copy bits in, using mBits if they fit. */
+	void copyBits(const BitVector& source)
+		{ allocate(source.size()); source.copyTo(*this); }
 
 	public:
 
 	/** Empty frame with a primitive. */
 	L3Frame(Primitive wPrimitive=DATA, size_t len=0)
-		:BitVector(len),mPrimitive(wPrimitive),mL2Length(len)
-	{ }
+		:mPrimitive(wPrimitive),mL2Length(len)
+	{ allocate(len); }
 
 	/** Put raw bits into the frame. */
 	L3Frame(const BitVector& source, Primitive wPrimitive=DATA)
-		:BitVector(source),mPrimitive(wPrimitive),mL2Length(source.size()/8)
-	{ if (source.size()%8) mL2Length++; }
+		:mPrimitive(wPrimitive),mL2Length(source.size()/8)
+	{
+		copyBits(source);
+		if (source.size()%8) mL2Length++;
+	}
+
+	/** Make a new L3 frame by copying an existing one. */
+	L3Frame(const L3Frame& other)
+		:BitVector(),mPrimitive(other.mPrimitive),mL2Length(other.mL2Length)
+	{ copyBits(other); }
 
 	/** Concatenate 2 L3Frames */
 	L3Frame(const L3Frame& f1, const L3Frame& f2)
-		:BitVector(f1,f2),mPrimitive(DATA),
+		:mPrimitive(DATA),
 		mL2Length(f1.mL2Length + f2.mL2Length)
-	{}
+	{
+		allocate(f1.size()+f2.size());
+		f1.copyToSegment(*this,0);
+		f2.copyToSegment(*this,f1.size());
+	}
 
 	/** Build from an L2Frame. */
 	L3Frame(const L2Frame& source)
-		:BitVector(source.L3Part()),mPrimitive(DATA),
+		:mPrimitive(DATA),
 		mL2Length(source.L())
-	{ }
+	{ copyBits(source.L3Part()); }
 
 	/** Serialize a message into the frame. */
 	L3Frame(const L3Message& msg, Primitive wPrimitive=DATA);
@@ -642,6 +692,22 @@ class L3Frame : public BitVector {
 	// Methods for writing H/L bits into rest octets.
 	void writeH(size_t& wp);
 	void writeL(size_t& wp);
+
+	L3Frame& operator=(const L3Frame& other)
+	{
+		if (this!=&other) {
+			mPrimitive = other.mPrimitive;
+			mL2Length = other.mL2Length;
+			copyBits(other);
+		}
+		return *this;
+	}
+
+	/**@name Pooled allocation. */
+	//@{
+	static void* operator new(size_t);
+	static void operator delete(void*, size_t);
+	//@}
 };
 
 
@@ -0,0 +1,130 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "GSML3MMMessages.h"
+#include "GSML3RRMessages.h"
+
+#include <Configuration.h>
+#include <Logger.h>
+
+#include <iostream>
+#include <sstream>
+
+using namespace std;
+using namespace GSM;
+
+ConfigurationTable gConfig;
+
+
+unsigned gFailures = 0;
+
+void check(bool ok, const char *what)
+{
+	cout << (ok ? "OK   " : "FAIL ") << what << endl;
+	if (!ok) gFailures++;
+}
+
+
+/**
+	Parse a body through the bit parser and through the octet parser,
+	into two copies of the same message type, and compare the results.
+	MessageType must have public parseBody overloads.
+*/
+template <class MessageType>
+bool sameParse(const char *hex, MessageType& bits, MessageType& octets)
+{
+	L3Frame frame(hex);
+	size_t bitRP = 16;
+	bits.parseBody(frame,bitRP);
+	unsigned char packed[L3MaxPackedOctets];
+	frame.pack(packed);
+	size_t octetRP = 2;
+	octets.parseBody(L3Octets(packed,frame.size()/8),octetRP);
+	if (bitRP!=8*octetRP) return false;
+	ostringstream bitText, octetText;
+	bitText << bits;
+	octetText << octets;
+	return bitText.str()==octetText.str();
+}
+
+
+/** Run a sample through sameParse and record the result. */
+template <class MessageType>
+void checkSample(const char *hex, const char *what)
+{
+	MessageType bits, octets;
+	bool ok = false;
+	try {
+		ok = sameParse(hex,bits,octets);
+	} catch (L3ReadError) {
+	}
+	check(ok,what);
+}
+
+
+/**
+	Check that the octet parser rejects a truncated body.
+	The bit parser asserts on a short frame, so it is not tried here.
+*/
+template <class MessageType>
+void checkShort(const char *hex, const char *what)
+{
+	L3Frame frame(hex);
+	MessageType octets;
+	unsigned char packed[L3MaxPackedOctets];
+	frame.pack(packed);
+	bool rejected = false;
+	try {
+		size_t rp = 2;
+		octets.parseBody(L3Octets(packed,frame.size()/8),rp);
+	} catch (L3ReadError) {
+		rejected = true;
+	}
+	check(rejected,what);
+}
+
+
+int main(int argc, char *argv[])
+{
+	gLogInit("L3ParseTest","ERR",LOG_LOCAL7);
+
+	checkSample<L3LocationUpdatingRequest>("05080012f4100001330809100010000000001", "LUR with IMSI");
+	checkSample<L3LocationUpdatingRequest>("05080012f41000013305f412345678", "LUR with TMSI");
+	checkSample<L3MeasurementReport>("06153f3d0a15020311233ee90e94b8f1e7e2a1f", "MR with neighbors");
+	checkSample<L3MeasurementReport>("06153f3d0ad5020311233ee90e94b8f1e7e2a1", "MR with invalid serving cell results");
+	checkSample<L3PagingResponse>("0627000358a60505f412345678", "paging response with TMSI");
+	checkSample<L3CMServiceRequest>("052411035819a608291000100000000020", "CM service request with IMSI");
+	checkSample<L3IMSIDetachIndication>("050133080910001000000000", "IMSI detach");
+
+	checkShort<L3LocationUpdatingRequest>("05080012f4100001330809", "short LUR");
+	checkShort<L3PagingResponse>("0627000358a6", "short paging response");
+	checkShort<L3IMSIDetachIndication>("05013308091000", "short IMSI detach");
+
+	cout << gFailures << " failures" << endl;
+	return gFailures ? 1 : 0;
+}
+
+// vim: ts=4 sw=4
@@ -0,0 +1,226 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "MeasurementEngine.h"
+#include "GSMLogicalChannel.h"
+
+#include <Globals.h>
+#include <Logger.h>
+
+using namespace std;
+using namespace GSM;
+
+
+
+PhyControlParams::PhyControlParams()
+{
+	mRSSITarget = gConfig.getNum("GSM.Radio.RSSITarget");
+	mPowerDamping = gConfig.getNum("GSM.MS.Power.Damping")*0.01F;
+	mMaxPower = gConfig.getNum("GSM.MS.Power.Max");
+	mMinPower = gConfig.getNum("GSM.MS.Power.Min");
+	mHoldFER = gConfig.getNum("GSM.MS.Power.HoldFER",10)*0.01F;
+	mTADamping = gConfig.getNum("GSM.MS.TA.Damping")*0.01F;
+	mMaxTiming = gConfig.getNum("GSM.MS.TA.Max");
+}
+
+
+
+MeasurementSample::MeasurementSample(SACCHLogicalChannel *wChannel)
+	:mChannel(wChannel),mGeneration(wChannel->generation()),mReset(true),
+	mRSSI(0.0F),mTimingError(0.0F),
+	mActualMSPower(0),mActualMSTiming(0),
+	mFER(0.0F)
+{
+	mOrdered.mMSPower = 0.0F;
+	mOrdered.mMSTiming = 0.0F;
+}
+
+
+MeasurementSample::MeasurementSample(SACCHLogicalChannel *wChannel, const L3MeasurementResults& wResults)
+	:mChannel(wChannel),mGeneration(wChannel->generation()),mReset(false),
+	mResults(wResults),
+	mRSSI(wChannel->RSSI()),mTimingError(wChannel->timingError()),
+	mActualMSPower(wChannel->actualMSPower()),mActualMSTiming(wChannel->actualMSTiming()),
+	mFER(wChannel->FER())
+{
+	mOrdered.mMSPower = wChannel->orderedMSPower();
+	mOrdered.mMSTiming = wChannel->orderedMSTiming();
+}
+
+
+
+/** Exponentially weighted update, seeded by the first value. */
+static float average(float mean, float value, unsigned count)
+{
+	if (count==0) return value;
+	return mean + MeasurementAveraging*(value-mean);
+}
+
+
+void MeasurementStats::update(const MeasurementSample& sample)
+{
+	mRSSI = average(mRSSI,sample.mRSSI,mReports);
+	mTimingError = average(mTimingError,sample.mTimingError,mReports);
+	mFER = average(mFER,sample.mFER,mReports);
+	mActualMSPower = sample.mActualMSPower;
+	mActualMSTiming = sample.mActualMSTiming;
+	mReports++;
+	// Note that the MEAS-VALID bit is set for invalid measurements.
+	const L3MeasurementResults& results = sample.mResults;
+	if (results.MEAS_VALID()) return;
+	mRXLEV = average(mRXLEV,results.RXLEV_FULL_SERVING_CELL_dBm(),mValidReports);
+	mRXQUAL = average(mRXQUAL,results.RXQUAL_FULL_SERVING_CELL_BER(),mValidReports);
+	mValidReports++;
+}
+
+
+void MeasurementStats::control(const MeasurementSample& sample, const PhyControlParams& params, PhyOrder& order) const
+{
+	// Power, GSM 05.08 4.
+	// Power expressed in dBm, RSSI in dB wrt max.
+	// The RSSI is only meaningful against the power it was received at,
+	// so both come from the same report.
+	float targetMSPower = sample.mActualMSPower - (sample.mRSSI - params.mRSSITarget);
+	const float current = sample.mOrdered.mMSPower;
+	order.mMSPower = params.mPowerDamping*current + (1.0F-params.mPowerDamping)*targetMSPower;
+	// Back off only while the uplink is decoding well.
+	if (order.mMSPower<current && mFER>params.mHoldFER) order.mMSPower = current;
+	if (order.mMSPower>params.mMaxPower) order.mMSPower = params.mMaxPower;
+	else if (order.mMSPower<params.mMinPower) order.mMSPower = params.mMinPower;
+
+	// Timing, GSM 05.10 5, 6.
+	// Time expressed in symbol periods.
+	float targetMSTiming = sample.mActualMSTiming + sample.mTimingError;
+	order.mMSTiming = params.mTADamping*sample.mOrdered.mMSTiming + (1.0F-params.mTADamping)*targetMSTiming;
+	if (order.mMSTiming<0.0F) order.mMSTiming = 0.0F;
+	else if (order.mMSTiming>params.mMaxTiming) order.mMSTiming = params.mMaxTiming;
+}
+
+
+ostream& GSM::operator<<(ostream& os, const MeasurementStats& stats)
+{
+	os << "reports=" << stats.mReports;
+	os << " RXLEV=" << stats.mRXLEV;
+	os << " RXQUAL=" << stats.mRXQUAL;
+	os << " RSSI=" << stats.mRSSI;
+	os << " timingError=" << stats.mTimingError;
+	os << " FER=" << stats.mFER;
+	os << " MSPower=" << stats.mActualMSPower;
+	os << " MSTiming=" << stats.mActualMSTiming;
+	return os;
+}
+
+
+
+void MeasurementEngine::start()
+{
+	if (mRunning) return;
+	mRunning = true;
+	mThread.start((void*(*)(void*))MeasurementEngineServiceLoopAdapter,this);
+}
+
+
+bool MeasurementEngine::stats(const SACCHLogicalChannel* chan, MeasurementStats& stats) const
+{
+	ScopedLock lock(mLock);
+	StatsMap::const_iterator itr = mStats.find(chan);
+	if (itr==mStats.end()) return false;
+	if (itr->second.mReports==0) return false;
+	stats = itr->second;
+	return true;
+}
+
+
+void MeasurementEngine::serviceLoop()
+{
+	vector<MeasurementSample*> batch;
+	batch.reserve(MeasurementBatchMax);
+	while (true) {
+		// Wait for one report, then take whatever else has arrived.
+		batch.push_back(mQ.read());
+		while (batch.size()<MeasurementBatchMax) {
+			MeasurementSample *sample = mQ.readNoBlock();
+			if (!sample) break;
+			batch.push_back(sample);
+		}
+		processBatch(batch);
+		batch.clear();
+	}
+}
+
+
+void MeasurementEngine::processBatch(vector<MeasurementSample*>& batch)
+{
+	LOG(DEBUG) << "processing " << batch.size() << " reports";
+	const PhyControlParams params;
+	PhyOrder orders[MeasurementBatchMax];
+	bool ordered[MeasurementBatchMax];
+	mLock.lock();
+	for (unsigned i=0; i<batch.size(); i++) {
+		const MeasurementSample& sample = *batch[i];
+		MeasurementStats& stats = mStats[sample.mChannel];
+		ordered[i] = false;
+		if (sample.mReset) {
+			stats = MeasurementStats(sample.mGeneration);
+			continue;
+		}
+		// A report made around a reopen can be queued on the wrong side of its reset.
+		if (sample.mGeneration!=stats.mGeneration) continue;
+		stats.update(sample);
+		stats.control(sample,params,orders[i]);
+		ordered[i] = true;
+		LOG(DEBUG) << *sample.mChannel << " " << stats
+			<< " order pow=" << orders[i].mMSPower << " TA=" << orders[i].mMSTiming;
+	}
+	mLock.unlock();
+
+	// Post the orders to L1.
+	// The physical status table has its own lock.
+	for (unsigned i=0; i<batch.size(); i++) {
+		const MeasurementSample *sample = batch[i];
+		if (!sample->mReset) {
+			// A report can outlive its channel; don't order a released one,
+			// or one that has been reopened since the report was made.
+			SACCHLogicalChannel *chan = sample->mChannel;
+			if (ordered[i] && chan->active() && chan->generation()==sample->mGeneration) {
+				chan->orderPhy(orders[i].mMSPower,orders[i].mMSTiming);
+			}
+			// Note that the typeAndOffset of a SACCH match the host channel.
+			gPhysStatus.setPhysical(*sample);
+		}
+		delete sample;
+	}
+}
+
+
+void *GSM::MeasurementEngineServiceLoopAdapter(MeasurementEngine* engine)
+{
+	engine->serviceLoop();
+	return NULL;
+}
+
+
+// vim: ts=4 sw=4
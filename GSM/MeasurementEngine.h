@@ -0,0 +1,211 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef MEASUREMENTENGINE_H
+#define MEASUREMENTENGINE_H
+
+#include <map>
+#include <vector>
+
+#include <Threads.h>
+#include <Interthread.h>
+
+#include "GSML3RRElements.h"
+
+
+namespace GSM {
+
+class SACCHLogicalChannel;
+
+
+/** Weight of each new report in the rolling measurement statistics. */
+const float MeasurementAveraging = 0.25F;
+
+/** Most measurement reports handled in one batch. */
+const unsigned MeasurementBatchMax = 64;
+
+
+/**
+	Parameters of the MS power and timing advance loops, GSM 05.08 4, GSM 05.10 5, 6.
+	These are read from the configuration once per batch.
+*/
+struct PhyControlParams {
+	float mRSSITarget;				///< target uplink RSSI, dB wrt full scale
+	float mPowerDamping;			///< weight of the previous power order
+	float mMaxPower;				///< dBm
+	float mMinPower;				///< dBm
+	float mHoldFER;					///< don't lower power while the uplink FER is above this
+	float mTADamping;				///< weight of the previous timing order
+	float mMaxTiming;				///< symbols
+
+	PhyControlParams();
+};
+
+
+/** Power and timing advance orders for a channel. */
+struct PhyOrder {
+	float mMSPower;					///< dBm
+	float mMSTiming;				///< symbols
+};
+
+
+/** A measurement report, with the L1 physical parameters when it arrived. */
+struct MeasurementSample {
+
+	SACCHLogicalChannel *mChannel;
+	unsigned mGeneration;			///< the channel's generation when the sample was made
+	bool mReset;					///< true if the channel was opened; there are no results
+	L3MeasurementResults mResults;
+	float mRSSI;					///< uplink RSSI, dB wrt full scale
+	float mTimingError;				///< uplink timing error, symbols
+	int mActualMSPower;				///< MS power from the uplink SACCH header, dBm
+	int mActualMSTiming;			///< MS timing advance from the uplink SACCH header, symbols
+	float mFER;						///< uplink SACCH frame erasure rate
+	PhyOrder mOrdered;				///< power and timing advance in force
+
+	/** A reset marker for a channel. */
+	MeasurementSample(SACCHLogicalChannel *wChannel);
+
+	/** A report, with the channel's current L1 parameters. */
+	MeasurementSample(SACCHLogicalChannel *wChannel, const L3MeasurementResults& wResults);
+};
+
+
+/** Rolling statistics of the measurements on one channel. */
+struct MeasurementStats {
+
+	unsigned mGeneration;			///< the channel generation these statistics are for
+	unsigned mReports;				///< reports since the channel was opened
+	unsigned mValidReports;			///< reports with valid downlink measurements
+	float mRXLEV;					///< downlink RXLEV-FULL, dBm
+	float mRXQUAL;					///< downlink RXQUAL-FULL, BER
+	float mRSSI;					///< uplink RSSI, dB wrt full scale
+	float mTimingError;				///< uplink timing error, symbols
+	float mFER;						///< uplink SACCH frame erasure rate
+	int mActualMSPower;				///< latest reported MS power, dBm
+	int mActualMSTiming;			///< latest reported MS timing advance, symbols
+
+	MeasurementStats(unsigned wGeneration=0)
+		:mGeneration(wGeneration),
+		mReports(0),mValidReports(0),
+		mRXLEV(0.0F),mRXQUAL(0.0F),mRSSI(0.0F),mTimingError(0.0F),mFER(0.0F),
+		mActualMSPower(0),mActualMSTiming(0)
+	{ }
+
+	/** Fold a report into the averages. */
+	void update(const MeasurementSample&);
+
+	/**
+		Compute the next power and timing advance orders.
+		Power is driven by the report's uplink RSSI against the MS power
+		it was measured at, and timing by its timing error against the
+		timing advance it was measured at.  The damping against the order
+		in force is the only smoothing; the averages are for reporting
+		and for holding power while the FER is high.
+		@param sample The latest report, with the orders in force.
+		@param params The loop parameters.
+		@param order Receives the new orders.
+	*/
+	void control(const MeasurementSample& sample, const PhyControlParams& params, PhyOrder& order) const;
+};
+
+std::ostream& operator<<(std::ostream&, const MeasurementStats&);
+
+
+/**
+	Processes the measurement reports of all SACCHs in one thread.
+	The SACCH service loops post reports and return at once;
+	the engine keeps rolling statistics per channel, runs the closed
+	MS power and timing advance loops, and posts the orders and the
+	physical status table updates in batches.
+*/
+class MeasurementEngine {
+
+	private:
+
+	typedef std::map<const SACCHLogicalChannel*,MeasurementStats> StatsMap;
+
+	InterthreadQueue<MeasurementSample> mQ;	///< reports waiting to be processed
+	mutable Mutex mLock;					///< protects mStats
+	StatsMap mStats;						///< statistics, by channel
+	Thread mThread;							///< the processing thread
+	bool mRunning;
+
+	public:
+
+	MeasurementEngine()
+		:mRunning(false)
+	{ }
+
+	/** Start the processing thread. */
+	void start();
+
+	/** Queue a measurement report from a channel. */
+	void post(SACCHLogicalChannel* chan, const L3MeasurementResults& results)
+		{ mQ.write(new MeasurementSample(chan,results)); }
+
+	/** Discard the statistics of a channel, which is being reopened. */
+	void reset(SACCHLogicalChannel* chan)
+		{ mQ.write(new MeasurementSample(chan)); }
+
+	/**
+		Get the statistics of a channel.
+		@return false if the channel has no reports since it was opened.
+	*/
+	bool stats(const SACCHLogicalChannel* chan, MeasurementStats& stats) const;
+
+	/** Number of reports waiting. */
+	size_t backlog() const { return mQ.size(); }
+
+	private:
+
+	/** Read a batch of reports and process it. */
+	void serviceLoop();
+
+	/** Update the statistics, orders and physical status from a batch; deletes the samples. */
+	void processBatch(std::vector<MeasurementSample*>& batch);
+
+	friend void *MeasurementEngineServiceLoopAdapter(MeasurementEngine*);
+};
+
+
+/** A C-style adapter for the processing thread. */
+void *MeasurementEngineServiceLoopAdapter(MeasurementEngine*);
+
+
+}	// namespace GSM
+
+
+/**@addtogroup Globals */
+//@{
+/** The global measurement engine, in the global namespace. */
+extern GSM::MeasurementEngine gMeasurements;
+//@}
+
+
+#endif
+
+// vim: ts=4 sw=4
@@ -35,6 +35,7 @@
 
 #include <GSML3RRElements.h>
 #include <GSMLogicalChannel.h>
+#include <MeasurementEngine.h>
 
 #include <iostream>
 #include <iomanip>
@@ -62,6 +63,15 @@ static const char* createPhysicalStatus = {
 	")"
 };
 
+static const char* replacePhysicalStatus = {
+	"INSERT OR REPLACE INTO PHYSTATUS ("
+		"CN_TN_TYPE_AND_OFFSET, ARFCN, ACCESSED, "
+		"RXLEV_FULL_SERVING_CELL, RXLEV_SUB_SERVING_CELL, "
+		"RXQUAL_FULL_SERVING_CELL_BER, RXQUAL_SUB_SERVING_CELL_BER, "
+		"RSSI, TIME_ERR, TRANS_PWR, TIME_ADVC, FER"
+	") VALUES (?,?,?,?,?,?,?,?,?,?,?,?)"
+};
+
 int PhysicalStatus::open(const char* wPath)
 {
 	int rc = sqlite3_open(wPath, &mDB);
@@ -71,85 +81,133 @@ int PhysicalStatus::open(const char* wPath)
 		mDB = NULL;
 		return 1;
 	}
+	if (!sqlite3_setup(mDB)) {
+		LOG(WARNING) << "Cannot set WAL mode or busy timeout on PhysicalStatus";
+	}
 	if (!sqlite3_command(mDB, createPhysicalStatus)) {
-		LOG(EMERG) << "Cannot create TMSI table";
+		LOG(EMERG) << "Cannot create PHYSTATUS table";
 		return 1;
 	}
+	mWriterThread.start((void*(*)(void*))PhysicalStatusWriterAdapter,this);
 	return 0;
 }
 
 PhysicalStatus::~PhysicalStatus()
 {
-	if (mDB) sqlite3_close(mDB);
+	// The writer thread is never stopped; it will find mDB==NULL.
+	ScopedLock lock(mDBLock);
+	if (!mDB) return;
+	sqlite3_release_statements(mDB);
+	sqlite3_close(mDB);
+	mDB = NULL;
 }
 
-bool PhysicalStatus::createEntry(const LogicalChannel* chan)
+bool PhysicalStatus::setPhysical(const MeasurementSample& sample)
 {
-	assert(mDB);
+	const SACCHLogicalChannel *chan = sample.mChannel;
 	assert(chan);
+	const L3MeasurementResults& measResults = sample.mResults;
 
 	ScopedLock lock(mLock);
 
-	const char* chanString = chan->descriptiveString();
-	LOG(DEBUG) << chan->descriptiveString();
-
-	/* Check to see if the key exists. */
-	if (!sqlite3_exists(mDB, "PHYSTATUS", "CN_TN_TYPE_AND_OFFSET", chanString)) {
-		/* No? Ok, it should now. */
-		char query[500];
-		sprintf(query, "INSERT INTO PHYSTATUS (CN_TN_TYPE_AND_OFFSET, ACCESSED) VALUES "
-					   "(\"%s\", %u)",
-				chanString, (unsigned)time(NULL));
-		return sqlite3_command(mDB, query);
+	// This creates the record if it does not exist yet.
+	Record& rec = mRecords[chan->descriptiveString()];
+	rec.ARFCN = chan->ARFCN();
+	rec.accessed = (unsigned)time(NULL);
+	rec.RXLEVFull = measResults.RXLEV_FULL_SERVING_CELL_dBm();
+	rec.RXLEVSub = measResults.RXLEV_SUB_SERVING_CELL_dBm();
+	rec.RXQUALFullBER = measResults.RXQUAL_FULL_SERVING_CELL_BER();
+	rec.RXQUALSubBER = measResults.RXQUAL_SUB_SERVING_CELL_BER();
+	// The channel may have moved on since the report; use what was captured with it.
+	rec.RSSI = sample.mRSSI;
+	rec.timingError = sample.mTimingError;
+	rec.MSPower = sample.mActualMSPower;
+	rec.MSTiming = sample.mActualMSTiming;
+	rec.FER = sample.mFER;
+	rec.dirty = true;
+	rec.updates++;
+
+	return true;
+}
+
+
+bool PhysicalStatus::flush()
+{
+	// Take a snapshot of the changed records, so that
+	// setPhysical never waits for the database.
+	// They stay dirty until the snapshot is committed.
+	RecordMap snapshot;
+	mLock.lock();
+	for (RecordMap::const_iterator itr = mRecords.begin(); itr != mRecords.end(); ++itr) {
+		if (itr->second.dirty) snapshot.insert(*itr);
+	}
+	mLock.unlock();
+	if (snapshot.size()==0) return true;
+
+	ScopedLock lock(mDBLock);
+	if (!mDB) return false;
+	LOG(DEBUG) << "writing " << snapshot.size() << " records";
+	sqlite3_stmt *stmt = sqlite3_checkout(mDB,replacePhysicalStatus);
+	if (!stmt) return false;
+	if (!sqlite3_command(mDB,"BEGIN TRANSACTION")) {
+		sqlite3_checkin(stmt);
+		return false;
+	}
+	bool retVal = true;
+	for (RecordMap::const_iterator itr = snapshot.begin(); itr != snapshot.end(); ++itr) {
+		const Record& rec = itr->second;
+		sqlite3_bind_text(stmt,1,itr->first.c_str(),-1,SQLITE_STATIC);
+		sqlite3_bind_int64(stmt,2,rec.ARFCN);
+		sqlite3_bind_int64(stmt,3,rec.accessed);
+		sqlite3_bind_int(stmt,4,rec.RXLEVFull);
+		sqlite3_bind_int(stmt,5,rec.RXLEVSub);
+		sqlite3_bind_double(stmt,6,rec.RXQUALFullBER);
+		sqlite3_bind_double(stmt,7,rec.RXQUALSubBER);
+		sqlite3_bind_double(stmt,8,rec.RSSI);
+		sqlite3_bind_double(stmt,9,rec.timingError);
+		sqlite3_bind_int64(stmt,10,rec.MSPower);
+		sqlite3_bind_int64(stmt,11,rec.MSTiming);
+		sqlite3_bind_double(stmt,12,rec.FER);
+		if (sqlite3_run_query(mDB,stmt)!=SQLITE_DONE) {
+			retVal = false;
+			break;
+		}
+		sqlite3_reset(stmt);
+	}
+	sqlite3_reset(stmt);
+	sqlite3_checkin(stmt);
+	// Keep everything dirty for the next flush unless the whole batch goes in.
+	if (!retVal || !sqlite3_command(mDB,"COMMIT TRANSACTION")) {
+		sqlite3_command(mDB,"ROLLBACK TRANSACTION");
+		return false;
 	}
 
-	return false;
+	// Records updated during the write are still dirty.
+	ScopedLock recordsLock(mLock);
+	for (RecordMap::const_iterator itr = snapshot.begin(); itr != snapshot.end(); ++itr) {
+		Record& rec = mRecords[itr->first];
+		if (rec.updates==itr->second.updates) rec.dirty = false;
+	}
+	return true;
 }
 
-bool PhysicalStatus::setPhysical(const LogicalChannel* chan,
-								const L3MeasurementResults& measResults)
-{
-	// TODO -- It would be better if the argument what just the channel
-	// and the key was just the descriptiveString.
 
-	assert(mDB);
-	assert(chan);
+void PhysicalStatus::writerLoop()
+{
+	while (true) {
+		msleep(PhysicalStatusFlushInterval);
+		if (!flush()) LOG(ERR) << "cannot write PHYSTATUS snapshot";
+	}
+}
 
-	ScopedLock lock(mLock);
 
-	createEntry(chan);
-
-	char query[500];
-	sprintf(query,
-		"UPDATE PHYSTATUS SET "
-		"RXLEV_FULL_SERVING_CELL=%d, "
-		"RXLEV_SUB_SERVING_CELL=%d, "
-		"RXQUAL_FULL_SERVING_CELL_BER=%f, "
-		"RXQUAL_SUB_SERVING_CELL_BER=%f, "
-		"RSSI=%f, "
-		"TIME_ERR=%f, "
-		"TRANS_PWR=%u, "
-		"TIME_ADVC=%u, "
-		"FER=%f, "
-		"ACCESSED=%u, "
-		"ARFCN=%u "
-		"WHERE CN_TN_TYPE_AND_OFFSET==\"%s\"",
-		measResults.RXLEV_FULL_SERVING_CELL_dBm(),
-		measResults.RXLEV_SUB_SERVING_CELL_dBm(),
-		measResults.RXQUAL_FULL_SERVING_CELL_BER(),
-		measResults.RXQUAL_SUB_SERVING_CELL_BER(),
-		chan->RSSI(), chan->timingError(),
-		chan->actualMSPower(), chan->actualMSTiming(),
-		chan->FER(),
-		(unsigned)time(NULL),
-		chan->ARFCN(),
-		chan->descriptiveString());
-
-	LOG(DEBUG) << "Query: " << query;
-
-	return sqlite3_command(mDB, query);
+void *GSM::PhysicalStatusWriterAdapter(PhysicalStatus *table)
+{
+	table->writerLoop();
+	return NULL;
 }
 
+
 #if 0
 void PhysicalStatus::dump(ostream& os) const
 {
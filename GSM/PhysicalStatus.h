@@ -30,6 +30,7 @@
 #define PHYSICALSTATUS_H
 
 #include <map>
+#include <string>
 
 #include <Timeval.h>
 #include <Threads.h>
@@ -40,23 +41,59 @@ struct sqlite3;
 
 namespace GSM {
 
-class L3MeasurementResults;
-class LogicalChannel;
+struct MeasurementSample;
+
+
+/** Interval between snapshot writes of the physical status table, in ms. */
+const unsigned PhysicalStatusFlushInterval = 2000;
+
 
 /**
 	A table for tracking the state of channels.
+	Measurements are kept in memory and written to the database
+	in batched snapshots by a separate thread,
+	so that reporting never puts disk I/O on the SACCH path.
 */
 class PhysicalStatus {
 
 private:
 
-	Mutex mLock;		///< to reduce the load on the filesystem locking
+	/** The most recent measurements for one channel. */
+	struct Record {
+		unsigned ARFCN;
+		unsigned accessed;			///< Unix time of last update
+		int RXLEVFull;
+		int RXLEVSub;
+		float RXQUALFullBER;
+		float RXQUALSubBER;
+		float RSSI;
+		float timingError;
+		unsigned MSPower;
+		unsigned MSTiming;
+		float FER;
+		bool dirty;					///< true if not yet written to the database
+		unsigned updates;			///< count of setPhysical calls, to spot changes during a flush
+	};
+
+	typedef std::map<std::string,Record> RecordMap;
+
+	Mutex mLock;		///< protects mRecords
+	RecordMap mRecords;	///< in-memory table, indexed by channel descriptive string
+
+	Mutex mDBLock;		///< protects the database connection
 	sqlite3 *mDB;		///< database connection
 
+	Thread mWriterThread;	///< thread for the snapshot writer
+
 public:
 
+	PhysicalStatus()
+		:mDB(NULL)
+	{}
+
 	/**
-		Initialize a physical status reporting table.
+		Initialize a physical status reporting table
+		and start the snapshot writer.
 		@param path Path fto sqlite3 database file.
 		@return 0 if the database was successfully opened and initialized; 1 otherwise
 	*/
@@ -65,12 +102,18 @@ public:
 	~PhysicalStatus();
 
 	/** 
-		Add reporting information associated with a channel to the table.
-		@param chan The channel to report.
-		@param measResults The measurement report.
-		@return The result of the SQLite query: true for the query being executed successfully, false otherwise.
+		Add a measurement report and the L1 parameters captured with it to the table.
+		This updates the in-memory table only.
+		@param sample The report; only the name and ARFCN are read from its channel.
+		@return Always true; the database is written later.
+	*/
+	bool setPhysical(const MeasurementSample& sample);
+
+	/**
+		Write all changed records to the database in a single transaction.
+		@return true on success.
 	*/
-	bool setPhysical(const LogicalChannel* chan, const L3MeasurementResults& measResults);
+	bool flush();
 
 	/**
 		Dump the physical status table to the output stream.
@@ -80,17 +123,18 @@ public:
 
 	private:
 
-	/** 
-		Create entry in table. This is for the initial creation.
-		@param chan The channel to create an entry for.
-		@return The result of the SQLite query: true for the query being executed successfully, false otherwise.
-	*/
-	bool createEntry(const LogicalChannel* chan);
+	/** The snapshot writer loop. */
+	void writerLoop();
 
+	friend void *PhysicalStatusWriterAdapter(PhysicalStatus*);
 
 };
 
 
+/** C-style adapter for the writer thread. */
+void *PhysicalStatusWriterAdapter(PhysicalStatus*);
+
+
 }
 
 #endif
@@ -0,0 +1,150 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "XCCHBurstCache.h"
+#include <Logger.h>
+#include <assert.h>
+#include <string.h>
+
+using namespace std;
+using namespace GSM;
+
+
+
+XCCHCoder::XCCHCoder()
+	:mBlockCoder(0x10004820009ULL, 40, 224),
+	mC(456), mU(228),
+	mD(mU.head(184)),mP(mU.segment(184,40))
+{
+	// zero out u[] to take care of tail fields
+	mU.zero();
+}
+
+
+void XCCHCoder::encode(const BitVector& frame, unsigned header, unsigned headerBits, BitVector* I)
+{
+	// Same steps as XCCHL1Encoder::sendFrame, GSM 05.03 4.1.1-4.1.4.
+	if (headerBits) mU.fillField(0,header,headerBits);
+	frame.copyToSegment(mU,headerBits);
+	mD.LSB8MSB();
+	mBlockCoder.writeParityWord(mD,mP);
+	mU.encode(mVCoder,mC);
+	for (int k=0; k<456; k++) {
+		int B = k%4;
+		int j = 2*((49*k) % 57) + ((k%8)/4);
+		I[B][j] = mC[k];
+	}
+}
+
+
+
+
+void XCCHBurstCache::encode(const BitVector& frame, unsigned header, unsigned headerBits,
+	unsigned generation, BitVector* I)
+{
+	assert(headerBits<=XCCHBurstCacheHeaderBits);
+	ScopedLock lock(mLock);
+	if (!find(frame,generation,I)) {
+		LOG(DEBUG) << "XCCHBurstCache encoding " << frame;
+		if (mHeaderBits<headerBits) headerBasis(headerBits);
+		mCoder.encode(frame,0,headerBits,I);
+		add(frame,generation,I);
+	}
+	if (header) addHeader(header,headerBits,I);
+}
+
+
+bool XCCHBurstCache::find(const BitVector& frame, unsigned generation, BitVector* I) const
+{
+	for (unsigned e=0; e<XCCHBurstCacheSize; e++) {
+		const Entry& entry = mEntries[e];
+		if (entry.mGeneration!=generation) continue;
+		if (entry.mFrame.size()!=frame.size()) continue;
+		if (memcmp(entry.mFrame.begin(),frame.begin(),frame.size())) continue;
+		for (unsigned B=0; B<4; B++) entry.mI.segment(B*114,114).copyTo(I[B]);
+		return true;
+	}
+	return false;
+}
+
+
+void XCCHBurstCache::add(const BitVector& frame, unsigned generation, const BitVector* I)
+{
+	// Replace a stale entry if there is one.
+	unsigned e = 0;
+	while (e<XCCHBurstCacheSize && mEntries[e].mGeneration==generation && mEntries[e].mFrame.size()) e++;
+	if (e==XCCHBurstCacheSize) {
+		e = mNext;
+		mNext = (mNext+1) % XCCHBurstCacheSize;
+	}
+	Entry& entry = mEntries[e];
+	entry.mGeneration = generation;
+	entry.mFrame.clone(frame);
+	entry.mI.resize(4*114);
+	for (unsigned B=0; B<4; B++) I[B].copyToSegment(entry.mI,B*114);
+}
+
+
+void XCCHBurstCache::headerBasis(unsigned bits)
+{
+	// The coding is affine, so the contribution of header bit j
+	// is enc(e[j]) xor enc(0), with a zero frame.
+	BitVector frame(184-bits);
+	frame.zero();
+	BitVector zero[4];
+	BitVector one[4];
+	for (unsigned B=0; B<4; B++) {
+		zero[B] = BitVector(114);
+		one[B] = BitVector(114);
+	}
+	mCoder.encode(frame,0,bits,zero);
+	for (unsigned j=0; j<bits; j++) {
+		mCoder.encode(frame,1U<<(bits-1-j),bits,one);
+		mHeaderBasis[j].resize(4*114);
+		for (unsigned B=0; B<4; B++) {
+			for (unsigned k=0; k<114; k++) mHeaderBasis[j][B*114+k] = one[B][k] ^ zero[B][k];
+		}
+	}
+	mHeaderBits = bits;
+}
+
+
+void XCCHBurstCache::addHeader(unsigned header, unsigned bits, BitVector* I) const
+{
+	assert(bits<=mHeaderBits);
+	for (unsigned j=0; j<bits; j++) {
+		if (!((header>>(bits-1-j)) & 0x01)) continue;
+		const char *basis = mHeaderBasis[j].begin();
+		for (unsigned B=0; B<4; B++) {
+			char *dp = I[B].begin();
+			for (unsigned k=0; k<114; k++) dp[k] ^= *basis++;
+		}
+	}
+}
+
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,151 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#ifndef XCCHBURSTCACHE_H
+#define XCCHBURSTCACHE_H
+
+#include "Threads.h"
+#include "BitVector.h"
+
+
+namespace GSM {
+
+
+
+/** Number of frames kept in an XCCHBurstCache. */
+const unsigned XCCHBurstCacheSize = 4;
+
+/** Header bits an XCCHBurstCache can handle; the SACCH physical header, GSM 04.04 6. */
+const unsigned XCCHBurstCacheHeaderBits = 16;
+
+
+/**
+	The XCCH block coding, convolutional coding and interleaving of GSM 05.03 4.1,
+	without the channel around it.
+	Not thread-safe; it keeps its working vectors between calls.
+*/
+class XCCHCoder {
+
+	private:
+
+	/**@name FEC signal processing state, named as in GSM 05.03 2.2.  */
+	//@{
+	Parity mBlockCoder;
+	ViterbiR2O4 mVCoder;
+	BitVector mC;
+	BitVector mU;
+	BitVector mD;
+	BitVector mP;
+	//@}
+
+	public:
+
+	XCCHCoder();
+
+	/**
+		Encode a frame to i[][].
+		@param frame The L2 frame, 184 bits less the header.
+		@param header The header bits, first bit in the MSB.
+		@param headerBits The number of header bits.
+		@param I Four i[] vectors of 114 bits to receive the encoding.
+	*/
+	void encode(const BitVector& frame, unsigned header, unsigned headerBits, BitVector* I);
+};
+
+
+/**
+	Interleaved XCCH encodings, i[][], of frames that repeat, like the system information.
+	Entries are keyed by frame content and a generation number from the caller,
+	GSMConfig::beaconGeneration in the BTS, so everything is re-encoded
+	once after the beacon is regenerated.
+	The XCCH coding is affine over GF(2), so a channel with a physical header
+	can share entries encoded with a zero header and then add in
+	the contribution of each header bit that is set.
+	All methods are thread-safe; one cache can serve many encoders.
+*/
+class XCCHBurstCache {
+
+	private:
+
+	struct Entry {
+		unsigned mGeneration;		///< generation when encoded
+		BitVector mFrame;			///< the L2 frame, the key
+		BitVector mI;				///< i[0..3][] laid end to end
+		Entry():mGeneration(0) {}
+	};
+
+	mutable Mutex mLock;
+	Entry mEntries[XCCHBurstCacheSize];
+	unsigned mNext;					///< next entry to replace, if none are stale
+
+	/** i[][] contribution of each header bit, 0 until computed. */
+	BitVector mHeaderBasis[XCCHBurstCacheHeaderBits];
+	unsigned mHeaderBits;
+
+	XCCHCoder mCoder;				///< encodes the misses, under mLock
+
+	public:
+
+	XCCHBurstCache()
+		:mNext(0),mHeaderBits(0)
+	{}
+
+	/**
+		Encode a frame with a physical header, from the cache when possible.
+		@param frame The L2 frame.
+		@param header The header bits, first bit in the MSB.
+		@param headerBits The number of header bits, at most XCCHBurstCacheHeaderBits.
+		@param generation Entries from other generations are stale.
+		@param I Four i[] vectors to receive the encoding.
+	*/
+	void encode(const BitVector& frame, unsigned header, unsigned headerBits,
+		unsigned generation, BitVector* I);
+
+	private:
+
+	/**
+		Look up a frame.
+		@return true if found, with its zero-header encoding in I.
+	*/
+	bool find(const BitVector& frame, unsigned generation, BitVector* I) const;
+
+	/** Save the encoding of a frame of a generation, encoded with a zero header. */
+	void add(const BitVector& frame, unsigned generation, const BitVector* I);
+
+	/** Compute the i[][] contributions of the first bits header bits. */
+	void headerBasis(unsigned bits);
+
+	/** Add the contribution of a header into an encoding. */
+	void addHeader(unsigned header, unsigned bits, BitVector* I) const;
+};
+
+
+
+}	// namespace GSM
+
+
+#endif
+
+// vim: ts=4 sw=4
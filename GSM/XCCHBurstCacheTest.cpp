@@ -0,0 +1,182 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "XCCHBurstCache.h"
+#include <Configuration.h>
+#include <Logger.h>
+
+#include <iostream>
+#include <string.h>
+#include <stdio.h>
+
+using namespace std;
+using namespace GSM;
+
+
+ConfigurationTable gConfig;
+
+
+unsigned gFailures = 0;
+
+void check(bool ok, const char *what)
+{
+	cout << (ok ? "OK   " : "FAIL ") << what << endl;
+	if (!ok) gFailures++;
+}
+
+
+/** i[0..3][] of a frame, laid end to end. */
+class Bursts {
+
+	public:
+
+	BitVector mI[4];
+
+	Bursts()
+	{
+		for (unsigned B=0; B<4; B++) {
+			mI[B] = BitVector(114);
+			mI[B].zero();
+		}
+	}
+
+	bool operator==(const Bursts& other) const
+	{
+		for (unsigned B=0; B<4; B++) {
+			if (memcmp(mI[B].begin(),other.mI[B].begin(),114)) return false;
+		}
+		return true;
+	}
+
+	/** Compare to i[0..3][] packed MSB first, as hex. */
+	bool operator==(const char *hex) const
+	{
+		BitVector all(4*114);
+		for (unsigned B=0; B<4; B++) mI[B].copyToSegment(all,B*114);
+		for (unsigned i=0; i<4*114/8; i++) {
+			unsigned octet;
+			if (sscanf(hex+2*i,"%2x",&octet)!=1) return false;
+			if (all.peekField(8*i,8)!=octet) return false;
+		}
+		return true;
+	}
+};
+
+
+/**
+	i[][] from XCCHL1Encoder::sendFrame, recorded before the coding
+	was shared with the cache.
+*/
+//@{
+const char *idleReference =
+	"815f540815f50080555100155540aaf75022aff5102abf540aaffd40a05d54001175008055550a0175408000aafd540aff55422af55422bfd5";
+const char *rampReference =
+	"18618610618658608618618638618016da28147b6801536da80545a2039c79fbca59a34f7be6c539ef8f9d136ca0114da280473682053eca20";
+const char *ramp0503Reference =
+	"e08e184196b8310658608e1c499600536d801545f28105b682053eda0e39e7cd3dcf9f3ca59e74f6b66c500537821516daa044db20057b6800";
+const char *rampFFFFReference =
+	"e1c619498618310758e5861c6986801968a8016db201473388053eca2f71e6c539cf8f3ca59f3ef79e7c714736801516da00145b2a00737800";
+const char *idle1F3FReference =
+	"801f5508117510a155d008117d402ab7500abbfd108abd5508afdd44801d5408055d40a1555502045550a140abf54002bff5422bb55102bb75";
+//@}
+
+
+/** The L2 fill pattern, GSM 04.06 2.2, as in an empty L2Frame. */
+BitVector idleFrame(unsigned headerBits)
+{
+	BitVector frame(184-headerBits);
+	for (unsigned i=0; i<frame.size()/8; i++) frame.fillField(8*i,0x2B,8);
+	return frame;
+}
+
+
+/** An arbitrary frame that is not all repeats. */
+BitVector rampFrame(unsigned headerBits)
+{
+	BitVector frame(184-headerBits);
+	for (unsigned i=0; i<frame.size(); i++) frame[i] = ((i*7)/3) & 1;
+	return frame;
+}
+
+
+
+int main(int argc, char *argv[])
+{
+	gLogInit("XCCHBurstCacheTest","ERR",LOG_LOCAL7);
+
+	XCCHCoder coder;
+	Bursts direct;
+
+	// The coder against the channel encoder.
+	coder.encode(idleFrame(0),0,0,direct.mI);
+	check(direct==idleReference, "idle fill encoded");
+	coder.encode(rampFrame(0),0,0,direct.mI);
+	check(direct==rampReference, "ramp encoded");
+	coder.encode(rampFrame(16),0x0503,16,direct.mI);
+	check(direct==ramp0503Reference, "ramp encoded with a header");
+	coder.encode(rampFrame(16),0xFFFF,16,direct.mI);
+	check(direct==rampFFFFReference, "ramp encoded with every header bit set");
+
+	// No physical header, as on the BCCH.
+	XCCHBurstCache BCCHCache;
+	Bursts cached;
+	BCCHCache.encode(rampFrame(0),0,0,1,cached.mI);
+	check(cached==rampReference, "BCCH frame encoded into the cache");
+	cached = Bursts();
+	BCCHCache.encode(rampFrame(0),0,0,1,cached.mI);
+	check(cached==rampReference, "BCCH frame from the cache");
+	BCCHCache.encode(idleFrame(0),0,0,1,cached.mI);
+	check(cached==idleReference, "second BCCH frame encoded into the cache");
+	BCCHCache.encode(rampFrame(0),0,0,1,cached.mI);
+	check(cached==rampReference, "first BCCH frame still in the cache");
+
+	// A new generation re-encodes.
+	BCCHCache.encode(rampFrame(0),0,0,2,cached.mI);
+	check(cached==rampReference, "BCCH frame in a new generation");
+
+	// Different physical headers on channels sharing the cache, as on the SACCH.
+	XCCHBurstCache SACCHCache;
+	SACCHCache.encode(rampFrame(16),0x0503,16,1,cached.mI);
+	check(cached==ramp0503Reference, "SACCH frame encoded into the cache");
+	SACCHCache.encode(rampFrame(16),0xFFFF,16,1,cached.mI);
+	check(cached==rampFFFFReference, "SACCH frame from the cache with every header bit set");
+	SACCHCache.encode(idleFrame(16),0x1F3F,16,1,cached.mI);
+	check(cached==idle1F3FReference, "second SACCH frame encoded into the cache");
+	coder.encode(rampFrame(16),0,16,direct.mI);
+	SACCHCache.encode(rampFrame(16),0,16,1,cached.mI);
+	check(cached==direct, "SACCH frame from the cache with a zero header");
+	for (unsigned header=0; header<0x10000; header+=0x0101) {
+		coder.encode(idleFrame(16),header,16,direct.mI);
+		SACCHCache.encode(idleFrame(16),header,16,1,cached.mI);
+		if (!(cached==direct)) break;
+	}
+	check(cached==direct, "SACCH frame from the cache with other headers");
+
+	cout << gFailures << " failures" << endl;
+	return gFailures ? 1 : 0;
+}
+
+// vim: ts=4 sw=4
@@ -28,6 +28,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <iostream>
 
 #include <sys/types.h>
@@ -129,7 +130,9 @@ SIPEngine::SIPEngine(const char* proxy, const char* IMSI)
 	mSIPPort(gConfig.getNum("SIP.Local.Port")),
 	mSIPIP(gConfig.getStr("SIP.Local.IP")),
 	mINVITE(NULL), mLastResponse(NULL), mBYE(NULL),
-	mCANCEL(NULL), mERROR(NULL), mSession(NULL), 
+	mCANCEL(NULL), mERROR(NULL),
+	mRequestPending(false), mRequestStatus(0), mRequestTag(0), mRequestTimeout(0),
+	mCodec(RTPGSM610), mSession(NULL), 
 	mTxTime(0), mRxTime(0), mState(NullState), mInstigator(false),
 	mDTMF('\0'),mDTMFDuration(0)
 {
@@ -162,6 +165,8 @@ SIPEngine::SIPEngine(const char* proxy, const char* IMSI)
 
 SIPEngine::~SIPEngine()
 {
+	// The transaction layer must not call back into a deleted engine.
+	if (mRequestPending) gSIPInterface.transactions().cancel(mCallID);
 	if (mINVITE!=NULL) osip_message_free(mINVITE);
 	if (mLastResponse!=NULL) osip_message_free(mLastResponse);
 	if (mBYE!=NULL) osip_message_free(mBYE);
@@ -296,19 +301,13 @@ void SIPEngine::writePrivateHeaders(osip_message_t *msg, const GSM::LogicalChann
 #endif
 
 	// P-Access-Network-Info
-	// See 3GPP 24.229 7.2.
 	char cgi_3gpp[50];
-	sprintf(cgi_3gpp,"3GPP-GERAN; cgi-3gpp=%s%s%04x%04x",
-		gConfig.getStr("GSM.Identity.MCC").c_str(),gConfig.getStr("GSM.Identity.MNC").c_str(),
-		(unsigned)gConfig.getNum("GSM.Identity.LAC"),(unsigned)gConfig.getNum("GSM.Identity.CI"));
+	accessNetworkInfo(cgi_3gpp);
 	osip_message_set_header(msg,"P-Access-Network-Info",cgi_3gpp);
  
 	// P-Preferred-Identity
-	// See RFC-3325.
-	char pref_id[50];
-	sprintf(pref_id,"<sip:%s@%s>",
-		mSIPUsername.c_str(),
-		gConfig.getStr("SIP.Proxy.Speech").c_str());
+	char pref_id[100];
+	preferredIdentity(pref_id);
 	osip_message_set_header(msg,"P-Preferred-Identity",pref_id);
 
 	// FIXME -- Use the subscriber registry to look up the E.164
@@ -316,6 +315,76 @@ void SIPEngine::writePrivateHeaders(osip_message_t *msg, const GSM::LogicalChann
 
 }
 
+void SIPEngine::formatPrivateHeaders(char *buffer, size_t size, const GSM::LogicalChannel*)
+{
+	// See writePrivateHeaders.
+	char cgi_3gpp[50];
+	accessNetworkInfo(cgi_3gpp);
+	char pref_id[100];
+	preferredIdentity(pref_id);
+	snprintf(buffer,size,"P-Access-Network-Info: %s\r\nP-Preferred-Identity: %s\r\n",cgi_3gpp,pref_id);
+}
+
+void SIPEngine::accessNetworkInfo(char *buffer)
+{
+	// See 3GPP 24.229 7.2.
+	sprintf(buffer,"3GPP-GERAN; cgi-3gpp=%s%s%04x%04x",
+		gConfig.getStr("GSM.Identity.MCC").c_str(),gConfig.getStr("GSM.Identity.MNC").c_str(),
+		(unsigned)gConfig.getNum("GSM.Identity.LAC"),(unsigned)gConfig.getNum("GSM.Identity.CI"));
+}
+
+void SIPEngine::preferredIdentity(char *buffer)
+{
+	// See RFC-3325.
+	snprintf(buffer,100,"<sip:%s@%s>",
+		mSIPUsername.c_str(),
+		gConfig.getStr("SIP.Proxy.Speech").c_str());
+}
+
+void SIPEngine::startRequest(const char *request, size_t length, unsigned interval, unsigned timeout)
+{
+	// A new tag, so a late callback for an earlier request is ignored.
+	mRequestLock.lock();
+	unsigned tag = ++mRequestTag;
+	mRequestPending = true;
+	mRequestStatus = 0;
+	mRequestTimeout = timeout;
+	mRequestLock.unlock();
+	gSIPInterface.transactions().start(&mProxyAddr,mCallID,mViaBranch,mCSeq,request,length,
+		interval,timeout,SIPEngineRequestDone,this,tag);
+}
+
+unsigned SIPEngine::waitRequest(Mutex *lock)
+{
+	// The transaction layer finishes by Timer F at the latest.
+	// Allow a margin for the timer tick, then give up on it ourselves,
+	// so a lost callback never holds this thread.
+	if (lock) lock->unlock();
+	mRequestLock.lock();
+	Timeval deadline(mRequestTimeout + SIPRequestWaitMargin);
+	while (mRequestPending && !deadline.passed()) mRequestDone.wait(mRequestLock,deadline.remaining());
+	bool abandoned = mRequestPending;
+	mRequestPending = false;
+	unsigned status = abandoned ? 0 : mRequestStatus;
+	mRequestLock.unlock();
+	if (abandoned) {
+		LOG(ERR) << "SIP transaction for call ID " << mCallID << " did not finish by its timeout; abandoning it";
+		gSIPInterface.transactions().cancel(mCallID);
+	}
+	if (lock) lock->lock();
+	return status;
+}
+
+void SIP::SIPEngineRequestDone(void *wEngine, unsigned tag, unsigned status)
+{
+	SIPEngine *engine = (SIPEngine*)wEngine;
+	ScopedLock lock(engine->mRequestLock);
+	if (tag != engine->mRequestTag) return;
+	engine->mRequestStatus = status;
+	engine->mRequestPending = false;
+	engine->mRequestDone.signal();
+}
+
 bool SIPEngine::Register( Method wMethod )
 {
 	std::string RegisterBranch;
@@ -325,15 +394,8 @@ bool SIPEngine::Register( Method wMethod )
 
 	mViaBranch = tmp;
 
-	std::string RegisterURI;
-	RegisterURI = "sip:";
-	RegisterURI += mProxy;
-
 	LOG(INFO) << "user " << mSIPUsername << " state " << mState << " " << wMethod << " callID " << mCallID;
 
-	// Before start, need to add mCallID
-	gSIPInterface.addCall(mCallID);
-
 	// Initial configuration for sip message.
 	// Make a new from tag and new branch.
 	// make new mCSeq.
@@ -341,77 +403,46 @@ bool SIPEngine::Register( Method wMethod )
 	// Generate SIP Message 
 	// Either a register or unregister. Only difference 
 	// is expiration period.
-	osip_message_t * reg; 
-	if (wMethod == SIPRegister ){
-		reg = sip_register( mSIPUsername.c_str(), 
-			60*gConfig.getNum("SIP.RegistrationPeriod"),
-			mSIPPort, mSIPIP.c_str(), 
-			RegisterURI.c_str(), mMyTag.c_str(),
-			RegisterBranch.c_str(), mCallID.c_str(), mCSeq
-		); 
-	} else if (wMethod == SIPUnregister ) {
-		reg = sip_register( mSIPUsername.c_str(), 
-			0,
+	// This is rendered straight from a template; there is no osip object.
+	short expires = 0;
+	if (wMethod == SIPRegister ) expires = 60*gConfig.getNum("SIP.RegistrationPeriod");
+	else assert(wMethod == SIPUnregister);
+	char reg[MAX_UDP_LENGTH];
+	size_t regLength = sip_register_text(reg, sizeof(reg),
+			mSIPUsername.c_str(), expires,
 			mSIPPort, mSIPIP.c_str(), 
-			RegisterURI.c_str(), mMyTag.c_str(),
+			mProxy.c_str(), mMyTag.c_str(),
 			RegisterBranch.c_str(), mCallID.c_str(), mCSeq
 		);
-	} else { assert(0); }
+	if (!regLength) {
+		LOG(ALERT) << "cannot format SIP REGISTER for " << mSIPUsername;
+		return false;
+	}
 
-	//writePrivateHeaders(reg,chan);
 	gReports.incr("OpenBTS.SIP.REGISTER.Out");
  
 	LOG(DEBUG) << "writing registration " << reg;
-	gSIPInterface.write(&mProxyAddr,reg);	
-
-	bool success = false;
-	osip_message_t *msg = NULL;
-	Timeval timeout(gConfig.getNum("SIP.Timer.F"));
-	while (!timeout.passed()) {
-		try {
-			// SIPInterface::read will throw SIPTIimeout if it times out.
-			// It should not return NULL.
-			msg = gSIPInterface.read(mCallID, gConfig.getNum("SIP.Timer.E"));
-		} catch (SIPTimeout) {
-			// send again
-			LOG(NOTICE) << "SIP REGISTER packet to " << mProxyIP << ":" << mProxyPort << " timeout; resending"; 
-			gSIPInterface.write(&mProxyAddr,reg);	
-			continue;
-		}
-
-		assert(msg);
-		int status = msg->status_code;
-		LOG(INFO) << "received status " << msg->status_code << " " << msg->reason_phrase;
-		// specific status
-		if (status==200) {
-			LOG(INFO) << "REGISTER success";
-			success = true;
-			break;
-		}
-		if (status==401) {
-			LOG(INFO) << "REGISTER fail -- unauthorized";
-			break;
-		}
-		if (status==404) {
-			LOG(INFO) << "REGISTER fail -- not found";
-			break;
-		}
-		if (status>=200) {
-			LOG(NOTICE) << "REGISTER unexpected response " << status;
-			break;
-		}
-	}
-
-	if (!msg) {
+	gSIPInterface.recordSender(mSIPUsername.c_str(),mProxyIP.c_str());
+	// The transaction layer retransmits and matches the response.
+	startRequest(reg,regLength,gConfig.getNum("SIP.Timer.E"),gConfig.getNum("SIP.Timer.F"));
+	unsigned status = waitRequest();
+	if (!status) {
 		LOG(ALERT) << "SIP REGISTER timed out; is the registration server " << mProxyIP << ":" << mProxyPort << " OK?";
 		throw SIPTimeout();
 	}
 
-	osip_message_free(reg);
-	osip_message_free(msg);
-	// We remove the call FIFO here because there
-	// is no transaction entry associated with the REGISTER.
-	gSIPInterface.removeCall(mCallID);	
+	LOG(INFO) << "received status " << status;
+	bool success = false;
+	if (status==200) {
+		LOG(INFO) << "REGISTER success";
+		success = true;
+	} else if (status==401) {
+		LOG(INFO) << "REGISTER fail -- unauthorized";
+	} else if (status==404) {
+		LOG(INFO) << "REGISTER fail -- not found";
+	} else {
+		LOG(NOTICE) << "REGISTER unexpected response " << status;
+	}
 	return success;
 }
 
@@ -1105,7 +1136,8 @@ SIPState SIPEngine::MTCSendOK( short wRTPPort, unsigned wCodec, const GSM::Logic
 	assert(mINVITE);
 	gReports.incr("OpenBTS.SIP.INVITE-OK.Out");
 	mRTPPort = wRTPPort;
-	mCodec = wCodec;
+	// Answer with the first codec in the offer that we can carry.
+	mCodec = get_rtp_codec(mINVITE, wCodec);
 	LOG(DEBUG) << "port=" << wRTPPort << " codec=" << mCodec;
 	// Form ack from invite and new parameters.
 	osip_message_t * okay = sip_okay_sdp(mINVITE, mSIPUsername.c_str(),
@@ -1256,13 +1288,20 @@ void SIPEngine::InitRTP(const osip_message_t * msg )
 		rtp_session_set_send_profile(mSession,profile);
 	}
 
-	rtp_session_set_blocking_mode(mSession, TRUE);
-	rtp_session_set_scheduling_mode(mSession, TRUE);
+	// The media engine paces rxFrame and txFrame on its own 20 ms clock,
+	// so the session must not block or schedule.
+	rtp_session_set_blocking_mode(mSession, FALSE);
+	rtp_session_set_scheduling_mode(mSession, FALSE);
+	// The media engine has its own jitter buffer, keyed on the packet timestamps,
+	// so have oRTP hand over packets as they arrive.
+	rtp_session_enable_jitter_buffer(mSession, FALSE);
 	rtp_session_set_connected_mode(mSession, TRUE);
 	rtp_session_set_symmetric_rtp(mSession, TRUE);
-	// Hardcode RTP session type to GSM full rate (GSM 06.10).
-	// FIXME -- Make this work for multiple vocoder types.
-	rtp_session_set_payload_type(mSession, 3);
+	// Use the codec from the far end's SDP; anything other than
+	// GSM full rate (GSM 06.10) is transcoded by the media engine.
+	mCodec = get_rtp_codec(msg, mCodec);
+	LOG(DEBUG) << "codec=" << mCodec;
+	rtp_session_set_payload_type(mSession, mCodec);
 
 	char d_ip_addr[20];
 	char d_port[10];
@@ -1304,6 +1343,7 @@ void SIPEngine::MOCInitRTP()
 
 bool SIPEngine::startDTMF(char key)
 {
+	ScopedLock lock(mRTPLock);
 	LOG (DEBUG) << key;
 	if (mState!=Active) return false;
 	if (get_rtp_tev_type(key) < 0){
@@ -1327,6 +1367,7 @@ bool SIPEngine::startDTMF(char key)
 
 void SIPEngine::stopDTMF()
 {
+	ScopedLock lock(mRTPLock);
 	//false means not start
 	mblk_t *m = rtp_session_create_telephone_event_packet(mSession,false);
 	//volume 10 for some magic reason, end is true
@@ -1343,13 +1384,13 @@ void SIPEngine::stopDTMF()
 }
 
 
-void SIPEngine::txFrame(unsigned char* frame )
+void SIPEngine::txFrame(unsigned char* frame, unsigned length)
 {
+	ScopedLock lock(mRTPLock);
 	if(mState!=Active) return;
 
-	// HACK -- Hardcoded for GSM/8000.
-	// FIXME -- Make this work for multiple vocoder types.
-	rtp_session_send_with_ts(mSession, frame, 33, mTxTime);
+	// Every codec we support has 20 ms frames at 8 kHz.
+	rtp_session_send_with_ts(mSession, frame, length, mTxTime);
 	mTxTime += 160;
 
 	if (mDTMF) {
@@ -1371,6 +1412,7 @@ void SIPEngine::txFrame(unsigned char* frame )
 
 int SIPEngine::rxFrame(unsigned char* frame)
 {
+	ScopedLock lock(mRTPLock);
 	if(mState!=Active) return 0; 
 
 	int more;
@@ -1383,6 +1425,35 @@ int SIPEngine::rxFrame(unsigned char* frame)
 }
 
 
+int SIPEngine::RTPSocket() const
+{
+	if (!mSession) return -1;
+	return rtp_session_get_rtp_socket(mSession);
+}
+
+
+int SIPEngine::rxPacket(unsigned char* frame, unsigned maxLength, uint32_t& timestamp)
+{
+	ScopedLock lock(mRTPLock);
+	if(mState!=Active) return -1; 
+
+	// With the oRTP jitter buffer disabled, this returns the oldest
+	// queued packet, whatever the requested timestamp.
+	mblk_t *m = rtp_session_recvm_with_ts(mSession, mRxTime);
+	if (!m) return -1;
+	timestamp = rtp_get_timestamp(m);
+	unsigned char *payload;
+	int length = rtp_get_payload(m,&payload);
+	if (length<0) length = 0;
+	if ((unsigned)length>maxLength) length = maxLength;
+	memcpy(frame,payload,length);
+	freemsg(m);
+	// Keep the session's notion of time moving for RTCP.
+	mRxTime += 160;
+	return length;
+}
+
+
 
 
 SIPState SIPEngine::MOSMSSendMESSAGE(const char * wCalledUsername, 
@@ -1391,8 +1462,6 @@ SIPState SIPEngine::MOSMSSendMESSAGE(const char * wCalledUsername,
 {
 	LOG(DEBUG) << "mState=" << mState;
 	LOG(INFO) << "SIP send to " << wCalledUsername << "@" << wCalledDomain << " MESSAGE " << messageText;
-	// Before start, need to add mCallID
-	gSIPInterface.addCall(mCallID);
 	mInstigator = true;
 	gReports.incr("OpenBTS.SIP.MESSAGE.Out");
 	
@@ -1405,18 +1474,25 @@ SIPState SIPEngine::MOSMSSendMESSAGE(const char * wCalledUsername,
 	mRemoteUsername = wCalledUsername;
 	mRemoteDomain = wCalledDomain;
 
-	osip_message_t * message = sip_message(
+	// This is rendered straight from a template; there is no osip object.
+	char privateHeaders[256];
+	formatPrivateHeaders(privateHeaders,sizeof(privateHeaders),chan);
+	char message[MAX_UDP_LENGTH];
+	size_t length = sip_message_text(message, sizeof(message),
 		mRemoteUsername.c_str(), mSIPUsername.c_str(), 
 		mSIPPort, mSIPIP.c_str(), mProxyIP.c_str(), 
 		mMyTag.c_str(), mViaBranch.c_str(), mCallID.c_str(), mCSeq,
-		messageText, contentType); 
-
-	writePrivateHeaders(message,chan);
+		messageText, contentType, privateHeaders); 
+	if (!length) {
+		LOG(ALERT) << "SIP MESSAGE from " << mSIPUsername << " does not fit in a datagram";
+		mState = Fail;
+		return mState;
+	}
 
-	// Send Invite to the SIP proxy.
-	gSIPInterface.write(&mProxyAddr,message);
-	saveINVITE(message,true);
-	osip_message_free(message);
+	// Send MESSAGE to the SIP proxy.
+	// The transaction layer retransmits it and collects the response.
+	gSIPInterface.recordSender(mSIPUsername.c_str(),mProxyIP.c_str());
+	startRequest(message,length,gConfig.getNum("SIP.Timer.A"),gConfig.getNum("SIP.Timer.B"));
 	mState = MessageSubmit;
 	return mState;
 };
@@ -1426,60 +1502,29 @@ SIPState SIPEngine::MOSMSWaitForSubmit(Mutex *lock)
 {
 	LOG(INFO) << "user " << mSIPUsername << " state " << mState;
 
-	Timeval timeout(gConfig.getNum("SIP.Timer.B"));
-	assert(mINVITE);
-	osip_message_t *ok = NULL;
-	// have we received a 100 TRYING message? If so, don't retransmit after timeout
-	bool recv_trying = false;
-	while (!timeout.passed()) {
-		try {
-			// SIPInterface::read will throw SIPTIimeout if it times out.
-			// It should not return NULL.
-			ok = gSIPInterface.read(mCallID, gConfig.getNum("SIP.Timer.A"),lock);
-		}
-		catch (SIPTimeout& e) {
-			if (!recv_trying){
-				LOG(NOTICE) << "SIP MESSAGE packet to " << mProxyIP << ":" << mProxyPort << " timedout; resending"; 
-				gSIPInterface.write(&mProxyAddr,mINVITE);
-			} else {
-			  	LOG(NOTICE) << "SIP MESSAGE packet to " << mProxyIP << ":" << mProxyPort << " timedout; ignoring (got 100 TRYING)"; 
-			}
-			continue;
-		}
-		assert(ok);
-		if((ok->status_code==100)) {
-			recv_trying = true;
-			LOG(INFO) << "received TRYING MESSAGE";
-		}
-		if((ok->status_code==200) || (ok->status_code==202) ) {
-			mState = Cleared;
-			LOG(INFO) << "successful SIP MESSAGE SMS submit to " << mProxyIP << ":" << mProxyPort << ": " << mINVITE;
-			break;
-		}
-		//demonstrate that these are not forwarded correctly
-		if (ok->status_code >= 400){
-			mState = Fail;
-			gReports.incr("OpenBTS.SIP.Failed.Remote.4xx");
-			LOG (ALERT) << "SIP MESSAGE rejected: " << ok->status_code << " " << ok->reason_phrase;
-			break;
-		}
-		LOG(WARNING) << "unhandled response " << ok->status_code;
-		osip_message_free(ok);
-		ok = NULL;
-	}
+	// MOSMSSendMESSAGE fails without sending if the MESSAGE does not fit.
+	if (mState!=MessageSubmit) return mState;
 
-	if (!ok) {
+	unsigned status = waitRequest(lock);
+	if (status==200 || status==202) {
+		mState = Cleared;
+		LOG(INFO) << "successful SIP MESSAGE SMS submit to " << mProxyIP << ":" << mProxyPort << " for " << mSIPUsername;
+	} else if (status >= 400) {
+		mState = Fail;
+		gReports.incr("OpenBTS.SIP.Failed.Remote.4xx");
+		LOG (ALERT) << "SIP MESSAGE rejected: " << status;
+	} else if (status) {
+		mState = Fail;
+		LOG(WARNING) << "unhandled response " << status;
+	} else {
 		//changed from "throw SIPTimeout()", as this seems more correct -k
 		mState = Fail;
 		gReports.incr("OpenBTS.SIP.Failed.Local");
 		gReports.incr("OpenBTS.SIP.ReadTimeout");
 		LOG(ALERT) << "SIP MESSAGE timed out; is the smqueue server " << mProxyIP << ":" << mProxyPort << " OK?";
 		gReports.incr("OpenBTS.SIP.LostProxy");
-	} else {
-		osip_message_free(ok);
 	}
 	return mState;
-
 }
 
 
@@ -47,6 +47,10 @@ namespace SIP {
 class SIPInterface;
 
 
+/** Time to wait past a request's transaction timeout for its callback, in ms. */
+const unsigned SIPRequestWaitMargin = 1000;
+
+
 enum SIPState  {
 	NullState,
 	Timeout,
@@ -117,11 +121,22 @@ private:
 	osip_message_t * mERROR;	///< the ERROR message for this transaction
 	//@}
 
+	/**@name Completion of a request run by the SIP transaction layer. */
+	//@{
+	Mutex mRequestLock;
+	Signal mRequestDone;
+	bool mRequestPending;		///< true while the transaction is running
+	unsigned mRequestStatus;	///< final response code, or 0 for timeout
+	unsigned mRequestTag;		///< identifies the current request to the callback
+	unsigned mRequestTimeout;	///< the transaction timeout of the current request, ms
+	//@}
+
 	/**@name RTP state and parameters. */
 	//@{
 	short mRTPPort;
 	unsigned mCodec;
 	RtpSession * mSession;		///< RTP media session
+	Mutex mRTPLock;				///< serializes mSession between the media engine and in-call signalling
 	unsigned int mTxTime;		///< RTP transmission timestamp in 8 kHz samples
 	unsigned int mRxTime;		///< RTP receive timestamp in 8 kHz samples
 	//@}
@@ -149,6 +164,9 @@ public:
 
 	const std::string& callID() const { return mCallID; } 
 
+	/** The RTP payload type negotiated for the call, SIP::RTPCodec. */
+	unsigned codec() const { return mCodec; }
+
 	const std::string& proxyIP() const { return mProxyIP; }
 	unsigned proxyPort() const { return mProxyPort; }
 
@@ -158,6 +176,9 @@ public:
 	/** Return the RTP Port being used. */
 	short RTPPort() const { return mRTPPort; }
 
+	/** Return the RTP session's receive socket, or -1 if there is no session. */
+	int RTPSocket() const;
+
 	/** Return if the call has successfully finished */
 	bool finished() const { return (mState==Cleared || mState==Canceled || mState==Fail); }
 
@@ -323,8 +344,12 @@ public:
 	/** Send a DTMF end frame and turn off the DTMF events. */
 	void stopDTMF();
 
-	/** Send a vocoder frame over RTP. */
-	void txFrame(unsigned char* frame);
+	/**
+		Send a vocoder frame over RTP.
+		@param frame The payload, in the negotiated codec.
+		@param length The payload length; the default is a GSM 06.10 frame.
+	*/
+	void txFrame(unsigned char* frame, unsigned length=33);
 
 	/**
 		Receive a vocoder frame over RTP.
@@ -333,6 +358,16 @@ public:
 	*/
 	int  rxFrame(unsigned char* frame);
 
+	/**
+		Receive the next RTP packet as it arrived, without timestamp alignment.
+		Non-blocking.
+		@param frame Buffer for the payload.
+		@param maxLength Size of the buffer.
+		@param timestamp Set to the packet's RTP timestamp.
+		@return The payload length, which may be 0, or -1 if no packet is waiting.
+	*/
+	int rxPacket(unsigned char* frame, unsigned maxLength, uint32_t& timestamp);
+
 	void MOCInitRTP();
 	void MTCInitRTP();
 
@@ -383,9 +418,42 @@ public:
 	*/
 	void writePrivateHeaders(osip_message_t *msg, const GSM::LogicalChannel *chan);
 
+	/** Format the same private headers as complete header lines, for pre-rendered requests. */
+	void formatPrivateHeaders(char *buffer, size_t size, const GSM::LogicalChannel *chan);
+
+	/**
+		Start a non-INVITE request on the SIP transaction layer,
+		which does the retransmission and matches the response.
+		@param interval The initial retransmission interval, ms.
+		@param timeout The transaction timeout, ms.
+	*/
+	void startRequest(const char *request, size_t length, unsigned interval, unsigned timeout);
+
+	/**
+		Wait for the request from startRequest to finish.
+		The transaction layer reports the outcome through a callback;
+		this waits no longer than the transaction timeout, plus a margin,
+		and abandons the transaction if the callback has not come by then.
+		@param lock A lock to release while waiting.
+		@return The final response code, or 0 on timeout.
+	*/
+	unsigned waitRequest(Mutex *lock=NULL);
+
+	friend void SIPEngineRequestDone(void *engine, unsigned tag, unsigned status);
+
+	/**@name Values of the private headers. */
+	//@{
+	void accessNetworkInfo(char *buffer);	///< buffer of 50 bytes
+	void preferredIdentity(char *buffer);	///< buffer of 100 bytes
+	//@}
+
 };
 
 
+/** Transaction layer callback for SIPEngine::startRequest. */
+void SIPEngineRequestDone(void *engine, unsigned tag, unsigned status);
+
+
 }; 
 
 #endif // SIPENGINE_H
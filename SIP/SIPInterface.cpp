@@ -26,6 +26,7 @@
 #include <ControlCommon.h>
 #include <TransactionTable.h>
 #include <SubscriberRegistry.h>
+#include <SMSQueue.h>
 
 #include <Sockets.h>
 
@@ -48,23 +49,67 @@ using namespace Control;
 
 
 
+unsigned SIP::hashCallID(const char* callID, size_t length)
+{
+	// FNV-1a
+	unsigned hash = 2166136261U;
+	for (size_t i=0; i<length; i++) {
+		hash ^= (unsigned char)callID[i];
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+
+/**
+	Find the Call-ID header value in a raw SIP message without parsing it.
+	@param text The NUL-terminated message.
+	@param length Set to the length of the value.
+	@return A pointer to the value, or NULL if there is no Call-ID header.
+*/
+static const char* findCallID(const char* text, size_t& length)
+{
+	const char *line = text;
+	while ((line = strchr(line,'\n'))) {
+		line++;
+		// An empty line ends the headers.
+		if (*line=='\r' || *line=='\n') return NULL;
+		const char *value = NULL;
+		if (strncasecmp(line,"Call-ID",7)==0) value = line+7;
+		// "i" is the compact form.
+		else if ((*line=='i' || *line=='I') && (line[1]==':' || line[1]==' ' || line[1]=='\t')) value = line+1;
+		if (!value) continue;
+		while (*value==' ' || *value=='\t') value++;
+		if (*value!=':') continue;
+		value++;
+		while (*value==' ' || *value=='\t') value++;
+		length = strcspn(value," \t\r\n");
+		return value;
+	}
+	return NULL;
+}
+
+
+
+
 // SIPMessageMap method definitions.
 
 void SIPMessageMap::write(const std::string& call_id, osip_message_t * msg)
 {
 	LOG(DEBUG) << "call_id=" << call_id << " msg=" << msg;
 
+	// These are cached and written later, usually not at all.
 	string name = osip_message_get_from(msg)->url->username;
-	if (gSubscriberRegistry.imsiSet(name, "ipaddr", 
-					 osip_message_get_from(msg)->url->host) != SubscriberRegistry::SUCCESS){
+	if (gSubscriberRegistry.imsiUpdate(name, "ipaddr", 
+					 osip_message_get_from(msg)->url->host) == SubscriberRegistry::FAILURE){
 		LOG(INFO) << "SR ipaddr Update Problem";
 	}
-	if (gSubscriberRegistry.imsiSet(name, "port", 
-					 gConfig.getStr("SIP.Local.Port")) != SubscriberRegistry::SUCCESS){
+	if (gSubscriberRegistry.imsiUpdate(name, "port", 
+					 gConfig.getStr("SIP.Local.Port")) == SubscriberRegistry::FAILURE){
 		LOG(INFO) << "SR port Update Problem";
 	}
 
-	OSIPMessageFIFO * fifo = mMap.readNoBlock(call_id);
+	OSIPMessageFIFO * fifo = find(call_id);
 	if( fifo==NULL ) {
 		// FIXME -- If this write fails, send "call leg non-existent" response on SIP interface.
 		LOG(NOTICE) << "missing SIP FIFO "<<call_id;
@@ -77,7 +122,7 @@ void SIPMessageMap::write(const std::string& call_id, osip_message_t * msg)
 osip_message_t * SIPMessageMap::read(const std::string& call_id, unsigned readTimeout, Mutex *lock)
 { 
 	LOG(DEBUG) << "call_id=" << call_id;
-	OSIPMessageFIFO * fifo = mMap.readNoBlock(call_id);
+	OSIPMessageFIFO * fifo = find(call_id);
 	if (!fifo) {
 		LOG(NOTICE) << "missing SIP FIFO "<<call_id;
 		throw SIPError();
@@ -94,7 +139,7 @@ osip_message_t * SIPMessageMap::read(const std::string& call_id, unsigned readTi
 osip_message_t * SIPMessageMap::read(const std::string& call_id, Mutex *lock)
 { 
 	LOG(DEBUG) << "call_id=" << call_id;
-	OSIPMessageFIFO * fifo = mMap.readNoBlock(call_id);
+	OSIPMessageFIFO * fifo = find(call_id);
 	if (!fifo) {
 		LOG(NOTICE) << "missing SIP FIFO "<<call_id;
 		throw SIPError();
@@ -110,22 +155,16 @@ osip_message_t * SIPMessageMap::read(const std::string& call_id, Mutex *lock)
 
 bool SIPMessageMap::add(const std::string& call_id, const struct sockaddr_in* returnAddress)
 {
-	// Check for duplicates.
-	if (mMap.readNoBlock(call_id)) {
+	// Check for duplicates under the same lock as the insertion.
+	if (!shard(call_id).add(call_id,returnAddress)) {
 		LOG(WARNING) << "attempt to add duplicate SIP message FIFO for " << call_id;
-		return true;
 	}
-	OSIPMessageFIFO * fifo = new OSIPMessageFIFO(returnAddress);
-	mMap.write(call_id, fifo);
 	return true;
 }
 
 bool SIPMessageMap::remove(const std::string& call_id)
 {
-	OSIPMessageFIFO * fifo = mMap.readNoBlock(call_id);
-	if(fifo == NULL) return false;
-	mMap.remove(call_id);
-	return true;
+	return shard(call_id).remove(call_id);
 }
 
 
@@ -149,7 +188,7 @@ bool SIPInterface::removeCall(const string &call_id)
 
 int SIPInterface::fifoSize(const std::string& call_id )
 { 
-	OSIPMessageFIFO * fifo = mSIPMap.map().read(call_id,0);
+	OSIPMessageFIFO * fifo = mSIPMap.find(call_id);
 	if(fifo==NULL) return -1;
 	return fifo->size();
 }	
@@ -164,6 +203,24 @@ void SIP::driveLoop( SIPInterface * si){
 	}
 }
 
+
+void SIPParser::start(SIPInterface *wInterface)
+{
+	mInterface = wInterface;
+	mThread.start((void *(*)(void*))SIPParserLoop,this);
+}
+
+
+void* SIP::SIPParserLoop(SIPParser* parser)
+{
+	while (true) {
+		std::string *datagram = parser->mQ.read();
+		parser->mInterface->dispatch(*datagram);
+		delete datagram;
+	}
+	return NULL;
+}
+
 void SIPInterface::start(){
 	// Start all the osip/ortp stuff. 
 	parser_init();
@@ -171,6 +228,8 @@ void SIPInterface::start(){
 	ortp_scheduler_init();
 	// FIXME -- Can we coordinate this with the global logger?
 	//ortp_set_log_level_mask(ORTP_MESSAGE|ORTP_WARNING|ORTP_ERROR);
+	for (unsigned i=0; i<SIPParserThreads; i++) mParsers[i].start(this);
+	mTransactions.start();
 	mDriveThread.start((void *(*)(void*))driveLoop,this );
 }
 
@@ -188,35 +247,47 @@ void SIPInterface::write(const struct sockaddr_in* dest, osip_message_t *msg)
 	}
 	//if it's any of these transactions, record it in the database
 	// FIXME - We should really remove all direct access to the SR.
-	string name = osip_message_get_from(msg)->url->username;
 	if (msg->sip_method && 
 	    (!strncmp(msg->sip_method, "INVITE", 6) ||
 	     !strncmp(msg->sip_method, "REGISTER", 8) ||
 	     !strncmp(msg->sip_method, "MESSAGE", 7))) {
-		if (gSubscriberRegistry.imsiSet(name, "ipaddr", 
-						osip_message_get_from(msg)->url->host)){
-			LOG(INFO) << "SR ipaddr Update Problem";
-		}
-		if (gSubscriberRegistry.imsiSet(name, "port", 
-						gConfig.getStr("SIP.Local.Port"))){
-			LOG(INFO) << "SR port Update Problem";
-		}
+		osip_from_t *from = osip_message_get_from(msg);
+		recordSender(from->url->username,from->url->host);
 	}
+	write(dest,str,strlen(str));
+	free(str);
+}
+
+
+void SIPInterface::write(const struct sockaddr_in* dest, const char* message, size_t length)
+{
 	char firstLine[100];
-	sscanf(str,"%100[^\n]",firstLine);
+	sscanf(message,"%99[^\r\n]",firstLine);
 	LOG(INFO) << "write " << firstLine;
-	LOG(DEBUG) << "write " << str;
+	LOG(DEBUG) << "write " << message;
 
 	if (random()%100 < gConfig.getNum("Test.SIP.SimulatedPacketLoss",0)) {
 		LOG(NOTICE) << "simulating dropped outbound SIP packet: " << firstLine;
-		free(str);
 		return;
 	}
 
 	mSocketLock.lock();
-	mSIPSocket.send((const struct sockaddr*)dest,str,strlen(str));
+	mSIPSocket.send((const struct sockaddr*)dest,message,length);
 	mSocketLock.unlock();
-	free(str);
+}
+
+
+void SIPInterface::recordSender(const char* username, const char* host)
+{
+	// These are cached and written later, usually not at all,
+	// so they add no database latency to the send.
+	if (gSubscriberRegistry.imsiUpdate(username, "ipaddr", host) == SubscriberRegistry::FAILURE){
+		LOG(INFO) << "SR ipaddr Update Problem";
+	}
+	if (gSubscriberRegistry.imsiUpdate(username, "port", 
+					gConfig.getStr("SIP.Local.Port")) == SubscriberRegistry::FAILURE){
+		LOG(INFO) << "SR port Update Problem";
+	}
 }
 
 
@@ -224,43 +295,48 @@ void SIPInterface::write(const struct sockaddr_in* dest, osip_message_t *msg)
 
 void SIPInterface::drive() 
 {
-	// All inbound SIP messages go here for processing.
+	// All inbound SIP messages go here for distribution to the parsers.
+	// This thread does no parsing, so a burst of messages,
+	// like bulk MT-SMS from the SMSC, is drained from the socket quickly.
 
 	LOG(DEBUG) << "blocking on socket";
-	int numRead = mSIPSocket.read(mReadBuffer);
+	char *buffers[MAX_UDP_BATCH];
+	unsigned lengths[MAX_UDP_BATCH];
+	for (unsigned i=0; i<MAX_UDP_BATCH; i++) buffers[i] = mReadBuffers[i];
+	int numRead = mSIPSocket.read(buffers,lengths,MAX_UDP_BATCH);
 	if (numRead<0) {
 		LOG(ALERT) << "cannot read SIP socket.";
 		return;
 	}
-	if (numRead<10) {
-		LOG(WARNING) << "malformed packet (" << numRead << " bytes) on SIP socket";
-		return;
-	}
-	mReadBuffer[numRead] = '\0';
-	if (random()%100 < gConfig.getNum("Test.SIP.SimulatedPacketLoss",0)) {
-		LOG(NOTICE) << "simulating dropped inbound SIP packet: " << mReadBuffer;
-		return;
+
+	for (int i=0; i<numRead; i++) {
+		if (lengths[i]<10) {
+			LOG(WARNING) << "malformed packet (" << lengths[i] << " bytes) on SIP socket";
+			continue;
+		}
+		std::string *datagram = new std::string(buffers[i],lengths[i]);
+		// Keep all messages for a call on one parser, to keep them in order.
+		size_t callIDLength = 0;
+		const char *callID = findCallID(datagram->c_str(),callIDLength);
+		unsigned parser = callID ? hashCallID(callID,callIDLength) % SIPParserThreads : 0;
+		mParsers[parser].write(datagram);
 	}
+}
+
 
-	// Get the proxy from the inbound message.
-#if 0
-	const struct sockaddr_in* sourceAddr = mSIPSocket.source();
-	char msgHost[256];
-	const char* msgHostRet = inet_ntop(AF_INET,&(sourceAddr->sin_addr),msgHost,255);
-	if (!msgHostRet) {
-		LOG(ALERT) << "cannot translate SIP source address for " << mReadBuffer;
+
+void SIPInterface::dispatch(const std::string& datagram)
+{
+	const char *buffer = datagram.c_str();
+	if (random()%100 < gConfig.getNum("Test.SIP.SimulatedPacketLoss",0)) {
+		LOG(NOTICE) << "simulating dropped inbound SIP packet: " << buffer;
 		return;
 	}
-	unsigned msgPortNumber = sourceAddr->sin_port;
-	char msgPort[20];
-	sprintf(msgPort,"%u",msgPortNumber);
-	string proxy = string(msgHost) + string(":") + string(msgPort);
-#endif
 
 	char firstLine[101];
-	sscanf(mReadBuffer,"%100[^\n]",firstLine);
+	sscanf(buffer,"%100[^\n]",firstLine);
 	LOG(INFO) << "read " << firstLine;
-	LOG(DEBUG) << "read " << mReadBuffer;
+	LOG(DEBUG) << "read " << buffer;
 
 
 	try {
@@ -269,15 +345,15 @@ void SIPInterface::drive()
 		osip_message_t * msg;
 		int i = osip_message_init(&msg);
 		LOG(DEBUG) << "osip_message_init " << i;
-		int j = osip_message_parse(msg, mReadBuffer, strlen(mReadBuffer));
+		int j = osip_message_parse(msg, buffer, strlen(buffer));
 		// seems like it ought to do something more than display an error,
 		// but it used to not even do that.
 		LOG(DEBUG) << "osip_message_parse " << j;
 		// heroic efforts to get it to parse the www-authenticate header failed,
 		// so we'll just crowbar that sucker in.
-		char *p = strcasestr(mReadBuffer, "nonce");
+		const char *p = strcasestr(buffer, "nonce");
 		if (p) {
-			string RAND = string(mReadBuffer, p-mReadBuffer+6, 32);
+			string RAND = string(buffer, p-buffer+6, 32);
 			LOG(INFO) << "crowbar www-authenticate " << RAND;
 			osip_www_authenticate_t *auth;
 			osip_www_authenticate_init(&auth);
@@ -290,6 +366,19 @@ void SIPInterface::drive()
 
 		if (msg->sip_method) LOG(DEBUG) << "read method " << msg->sip_method;
 
+		// Responses to the client transactions do not go through the message map.
+		// They are matched on the top Via branch, the call ID and the CSeq.
+		if (MSG_IS_RESPONSE(msg) && msg->call_id && msg->call_id->number && msg->cseq && msg->cseq->number) {
+			osip_via_t *via = (osip_via_t*)osip_list_get(&msg->vias,0);
+			osip_generic_param_t *branch = NULL;
+			if (via) osip_via_param_get_byname(via,(char*)"branch",&branch);
+			if (branch && branch->gvalue &&
+				mTransactions.response(msg->call_id->number,branch->gvalue,atoi(msg->cseq->number),msg->status_code)) {
+				osip_message_free(msg);
+				return;
+			}
+		}
+
 		// Must check if msg is an invite.
 		// if it is, handle appropriatly.
 		// FIXME -- Check return value in case this failed.
@@ -314,7 +403,7 @@ void SIPInterface::drive()
 		mSIPMap.write(call_num, msg);
 	}
 	catch(SIPException) {
-		LOG(NOTICE) << "discarded out-of-place SIP message: " << mReadBuffer;
+		LOG(NOTICE) << "discarded out-of-place SIP message: " << buffer;
 	}
 }
 
@@ -368,6 +457,27 @@ void SIPInterface::sendEarlyError(osip_message_t * cause,
 }
 
 
+/**
+	Get the body and MIME type of an MT-SMS MESSAGE.
+	@return true if there is a body.
+*/
+static bool extractSMS(osip_message_t *msg, string& text, string& type)
+{
+	osip_body_t *body = NULL;
+	osip_message_get_body(msg,0,&body);
+	/* Ok, so osip does some funny stuff here. The MIME type is split into type and subType.
+		Basically, text/plain becomes type=text, subType=plain. We need to put those together...
+	*/
+	osip_content_type_t *contentType = osip_message_get_content_type(msg);
+	if (contentType && contentType->type && contentType->subtype) {
+		type = string(contentType->type) + "/" + contentType->subtype;
+	}
+	if (!body || !body->body) return false;
+	text.assign(body->body,body->length);
+	return true;
+}
+
+
 bool SIPInterface::checkInvite( osip_message_t * msg)
 {
 	LOG(DEBUG);
@@ -380,6 +490,10 @@ bool SIPInterface::checkInvite( osip_message_t * msg)
 	const char *method = msg->sip_method;
 	if (!method) return false;
 
+	// One request at a time, so two INVITEs for the same subscriber
+	// cannot both miss in the transaction table and both start a transaction.
+	ScopedLock lock(mInviteLock);
+
 	// Check for INVITE or MESSAGE methods.
 	// Check channel availability now, too,
 	// even if we are not actually assigning the channel yet.
@@ -447,9 +561,40 @@ bool SIPInterface::checkInvite( osip_message_t * msg)
 		}
 	}
 
+	// Get the caller ID if it's available.
+	const char *callerID = "";
+	const char *callerHost = "";
+	osip_from_t *from = osip_message_get_from(msg);
+	if (from) {
+		osip_uri_t* url = osip_contact_get_url(from);
+		if (url) {
+			if (url->username) callerID = url->username;
+			if (url->host) callerHost = url->host;
+		}
+	} else {
+		LOG(NOTICE) << "INVITE with no From: username for " << mobileID;
+	}
+	LOG(DEBUG) << "callerID " << callerID << "@" << callerHost;
+
+	// With the SMS queue, an MT-SMS is stored and accepted now,
+	// and the queue does the paging, retries and ordering.
+	// A mobile in a call still gets it right away on the SACCH.
+	// This comes before the congestion and busy checks, since the queue waits those out.
+	// If the queue could not be opened, delivery is direct, as without the queue.
+	if (serviceType==L3CMServiceType::MobileTerminatedShortMessage && !chan && gConfig.getBool("Control.SMS.Queue") && gSMSQueue.isOpen()) {
+		string text, type;
+		extractSMS(msg,text,type);
+		if (gSMSQueue.add(IMSI,callIDNum,callerID,type.c_str(),text.data(),text.size())) {
+			sendEarlyError(msg,proxy.c_str(),202,"Accepted");
+		} else {
+			sendEarlyError(msg,proxy.c_str(),500,"Server Internal Error");
+		}
+		return true;
+	}
+
 	// Check SIP map.  Repeated entry?  Page again.
-	if (mSIPMap.map().readNoBlock(callIDNum) != NULL) { 
-		TransactionEntry* transaction= gTransactionTable.find(mobileID,callIDNum);
+	if (mSIPMap.find(callIDNum) != NULL) { 
+		TransactionRef transaction = gTransactionTable.find(mobileID,callIDNum);
 		// There's a FIFO but no trasnaction record?
 		if (!transaction) {
 			LOG(WARNING) << "repeated INVITE/MESSAGE with no transaction record";
@@ -506,21 +651,6 @@ bool SIPInterface::checkInvite( osip_message_t * msg)
 	addCall(callIDNum);
 	LOG(DEBUG) << "callIDNum " << callIDNum << " IMSI " << IMSI;
 
-	// Get the caller ID if it's available.
-	const char *callerID = "";
-	const char *callerHost = "";
-	osip_from_t *from = osip_message_get_from(msg);
-	if (from) {
-		osip_uri_t* url = osip_contact_get_url(from);
-		if (url) {
-			if (url->username) callerID = url->username;
-			if (url->host) callerHost = url->host;
-		}
-	} else {
-		LOG(NOTICE) << "INVITE with no From: username for " << mobileID;
-	}
-	LOG(DEBUG) << "callerID " << callerID << "@" << callerHost;
-
 
 	// Build the transaction table entry.
 	// This constructor sets TI automatically for an MT transaction.
@@ -533,29 +663,11 @@ bool SIPInterface::checkInvite( osip_message_t * msg)
 
 	// SMS?  Get the text message body to deliver.
 	if (serviceType == L3CMServiceType::MobileTerminatedShortMessage) {
-		osip_body_t *body;
-		osip_content_type_t *contentType;
-		osip_message_get_body(msg,0,&body);
-		contentType = osip_message_get_content_type(msg);
-		const char *text = NULL;
-		char *type = NULL;
-		if (body) text = body->body;
-		if (text) transaction->message(text, body->length);
+		string text, type;
+		if (extractSMS(msg,text,type)) transaction->message(text.data(),text.size());
 		else LOG(NOTICE) << "MTSMS incoming MESSAGE method with no message body for " << mobileID;
-		/* Ok, so osip does some funny stuff here. The MIME type is split into type and subType.
-			Basically, text/plain becomes type=text, subType=plain. We need to put those together...
-		*/
-		if (contentType) {
-			type = (char *)malloc(strlen(contentType->type)+strlen(contentType->subtype)+2);
-		}
-		if (type) {
-			strcpy(type,contentType->type);
-			strcat(type,"/");
-			strcat(type,contentType->subtype);
-			transaction->messageType(type);
-			free(type);
-		}
-		else LOG(NOTICE) << "MTSMS incoming MESSAGE method with no content type (or memory error) for " << mobileID;
+		if (type.size()) transaction->messageType(type.c_str());
+		else LOG(NOTICE) << "MTSMS incoming MESSAGE method with no content type for " << mobileID;
 	}
 
 	LOG(INFO) << "MTC MTSMS make transaction and add to transaction table: "<< *transaction;
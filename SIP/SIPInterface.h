@@ -26,6 +26,8 @@
 
 #include <string>
 
+#include "SIPTransaction.h"
+
 
 namespace GSM {
 
@@ -37,6 +39,16 @@ class L3MobileIdentity;
 namespace SIP {
 
 
+/** Number of independently locked shards in the SIP message map. */
+const unsigned SIPMessageMapShards = 16;
+
+/** Number of threads parsing and dispatching inbound SIP messages. */
+const unsigned SIPParserThreads = 4;
+
+/** Hash a SIP call ID, for sharding. */
+unsigned hashCallID(const char* callID, size_t length);
+
+
 typedef InterthreadQueue<osip_message_t> _OSIPMessageFIFO;
 
 class OSIPMessageFIFO : public _OSIPMessageFIFO {
@@ -73,7 +85,23 @@ class OSIPMessageFIFO : public _OSIPMessageFIFO {
 
 
 
-class OSIPMessageFIFOMap : public InterthreadMap<std::string,OSIPMessageFIFO> {};
+class OSIPMessageFIFOMap : public InterthreadMap<std::string,OSIPMessageFIFO> {
+
+	public:
+
+	/**
+		Create a FIFO for a call ID if there is none, as one atomic operation.
+		@return False if the call ID already had a FIFO.
+	*/
+	bool add(const std::string& call_id, const struct sockaddr_in* returnAddress)
+	{
+		ScopedLock lock(mLock);
+		if (mMap.find(call_id)!=mMap.end()) return false;
+		mMap[call_id] = new OSIPMessageFIFO(returnAddress);
+		mWriteSignal.broadcast();
+		return true;
+	}
+};
 
 
 std::ostream& operator<<(std::ostream& os, const OSIPMessageFIFO& m);
@@ -83,13 +111,18 @@ std::ostream& operator<<(std::ostream& os, const OSIPMessageFIFO& m);
 	A Map the keeps a SIP message FIFO for each active SIP transaction.
 	Keyed by SIP call ID string.
 	Overall map is thread-safe.  Each FIFO is also thread-safe.
+	The map is split into shards by call ID hash, each with its own lock,
+	so the parser threads rarely contend.
 */
 class SIPMessageMap 
 {
 
 private:
 
-	OSIPMessageFIFOMap mMap;
+	OSIPMessageFIFOMap mMaps[SIPMessageMapShards];
+
+	OSIPMessageFIFOMap& shard(const std::string& call_id)
+		{ return mMaps[hashCallID(call_id.data(),call_id.size()) % SIPMessageMapShards]; }
 
 public:
 
@@ -112,9 +145,9 @@ public:
 	*/
 	bool remove(const std::string& call_id);
 
-	/** Direct access to the map. */
-	// FIXME -- This should probably be replaced with more specific methods.
-	OSIPMessageFIFOMap& map() {return mMap;}
+	/** Return the FIFO for a call_id, or NULL if there is none. */
+	OSIPMessageFIFO* find(const std::string& call_id)
+		{ return shard(call_id).readNoBlock(call_id); }
 
 };
 
@@ -123,18 +156,57 @@ std::ostream& operator<<(std::ostream& os, const SIPMessageMap& m);
 
 
 
+class SIPInterface;
+
+
+/** A raw inbound SIP message. */
+typedef InterthreadQueue<std::string> SIPDatagramFIFO;
+
+
+/**
+	One SIP parser thread and its input queue.
+	All messages for a given call ID go to the same parser,
+	so they are dispatched in the order they arrived.
+*/
+class SIPParser {
+
+	private:
+
+	SIPInterface *mInterface;
+	SIPDatagramFIFO mQ;
+	Thread mThread;
+
+	public:
+
+	SIPParser():mInterface(NULL) {}
+
+	void start(SIPInterface *wInterface);
+
+	/** Queue a raw message for parsing; takes ownership. */
+	void write(std::string *datagram) { mQ.write(datagram); }
+
+	friend void *SIPParserLoop(SIPParser*);
+};
+
+void *SIPParserLoop(SIPParser*);
+
+
+
 class SIPInterface 
 {
 
 private:
 
-	char mReadBuffer[2048];		///< buffer for UDP reads
+	char mReadBuffers[MAX_UDP_BATCH][MAX_UDP_LENGTH];	///< buffers for UDP reads
 
 	UDPSocket mSIPSocket;
 
 	Mutex mSocketLock;
+	Mutex mInviteLock;		///< serializes checkInvite across the parser threads
 	Thread mDriveThread;	
 	SIPMessageMap mSIPMap;	
+	SIPParser mParsers[SIPParserThreads];
+	SIPTransactionLayer mTransactions;	///< non-INVITE client transactions
 
 public:
 	// 2 ways to starte sip interface. 
@@ -151,18 +223,27 @@ public:
 		Create the SIP interface to watch for incoming SIP messages.
 	*/
 	SIPInterface()
-		:mSIPSocket(gConfig.getNum("SIP.Local.Port"))
+		:mSIPSocket(gConfig.getNum("SIP.Local.Port")),
+		mTransactions(this)
 	{ }
 
 	
-	/** Start the SIP drive loop. */
+	/** Start the SIP drive loop, the parser threads and the transaction timers. */
 	void start();
 
-	/** Receive, parse and dispatch a single SIP message. */
+	/**
+		Receive a batch of SIP messages and hand each
+		to the parser thread for its call ID.
+	*/
 	void drive();
 
+	/** Parse and dispatch a single SIP message; called from the parser threads. */
+	void dispatch(const std::string& datagram);
+
 	/**
 		Look for incoming INVITE messages to start MTC.
+		Calls are serialized on mInviteLock, since the parser threads run in parallel
+		and the transaction table, pager and registry lookups here were written for one thread.
 		@param msg The SIP message to check.
 		@return true if the message is a new INVITE
 	*/
@@ -188,6 +269,23 @@ public:
 
 	void write(const struct sockaddr_in*, osip_message_t*);
 
+	/**
+		Write an already-rendered message.
+		@param message The NUL-terminated message text.
+		@param length The message length.
+	*/
+	void write(const struct sockaddr_in*, const char* message, size_t length);
+
+	/**
+		Record the address of a subscriber that is sending through us.
+		write(osip_message_t*) does this for INVITE, REGISTER and MESSAGE;
+		senders of pre-rendered requests call it themselves.
+	*/
+	void recordSender(const char* username, const char* host);
+
+	/** Access the client transactions, for requests that do not need a message FIFO. */
+	SIPTransactionLayer& transactions() { return mTransactions; }
+
 	osip_message_t* read(const std::string& call_id, unsigned readTimeout, Mutex *lock=NULL)
 		{ return mSIPMap.read(call_id, readTimeout, lock); }
 
@@ -35,6 +35,7 @@
 #include "SIPInterface.h"
 #include "SIPUtility.h"
 #include "SIPMessage.h"
+#include "SIPTemplate.h"
 
 using namespace std;
 using namespace SIP;
@@ -51,6 +52,9 @@ void openbts_message_init(osip_message_t ** msg){
 	osip_message_set_user_agent(*msg, strdup(tag));
 }
 
+/** The User-Agent value, as set by openbts_message_init. */
+static const char openbts_user_agent[] = "OpenBTS " VERSION " Build Date " __DATE__;
+
 #define MSG_NO_ERROR		(0)
 #define MSG_INVALID_PARAM	(-1)
 #define MSG_EMPTY_HDR		(-2)
@@ -74,6 +78,40 @@ int openbts_message_set_sdp(osip_message_t *request, sdp_message_t *sdp)
 	return MSG_NO_ERROR;
 }
 
+/** Add one codec's payload type and rtpmap to the media line. */
+static void openbts_sdp_add_codec(sdp_message_t *sdp, unsigned codec)
+{
+	char payload[10];
+	sprintf(payload,"%u",codec);
+	sdp_message_m_payload_add(sdp,0,strdup(payload));
+	switch (codec) {
+		case RTPuLaw:
+			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("0 PCMU/8000"));
+			break;
+		case RTPGSM610:
+			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("3 GSM/8000"));
+			break;
+		case RTPaLaw:
+			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("8 PCMA/8000"));
+			break;
+		default: assert(0);
+	};
+}
+
+/**
+	Add the media line codecs: the given codec first, and,
+	in an offer, every other codec we support after it.
+*/
+static void openbts_sdp_add_codecs(sdp_message_t *sdp, unsigned codec, bool offer)
+{
+	openbts_sdp_add_codec(sdp,codec);
+	if (!offer) return;
+	static const unsigned others[] = { RTPuLaw, RTPaLaw, RTPGSM610 };
+	for (unsigned i=0; i<sizeof(others)/sizeof(others[0]); i++) {
+		if (others[i]!=codec && codecSupported(others[i])) openbts_sdp_add_codec(sdp,others[i]);
+	}
+}
+
 int openbts_message_set_via(osip_message_t *response, osip_message_t *orig)
 {
 	osip_via_t * via = NULL;
@@ -342,6 +380,76 @@ osip_message_t * SIP::sip_message( const char * dialed_number, const char * sip_
 }
 
 
+size_t SIP::sip_register_text(char *buffer, size_t size, const char * sip_username, short timeout, short wlocal_port, const char * local_ip, const char * registrar, const char * from_tag, const char * via_branch, const char * call_id, int cseq)
+{
+	static const SIPTemplate sTemplate(
+		"REGISTER sip:$0$ SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP $1$:$2$;branch=$3$\r\n"
+		"From: $4$ <sip:$4$@$0$>;tag=$5$\r\n"
+		"To: $4$ <sip:$4$@$0$>\r\n"
+		"Call-ID: $6$@$1$\r\n"
+		"CSeq: $7$ REGISTER\r\n"
+		"Contact: <sip:$4$@$1$:$2$>;expires=$8$\r\n"
+		"Max-Forwards: $9$\r\n"
+		"User-Agent: $10$\r\n"
+		"Content-Length: 0\r\n"
+		"\r\n");
+
+	char local_port[10];
+	sprintf(local_port,"%i",wlocal_port);
+	char cseq_buf[14];
+	sprintf(cseq_buf,"%i",cseq);
+	char expires[10];
+	sprintf(expires,"%d",timeout);
+	char max_forwards[14];
+	sprintf(max_forwards,"%u",(unsigned)gConfig.getNum("SIP.MaxForwards"));
+
+	const char* values[] = {
+		registrar, local_ip, local_port, via_branch, sip_username, from_tag,
+		call_id, cseq_buf, expires, max_forwards, openbts_user_agent };
+	assert(sTemplate.numFields()==sizeof(values)/sizeof(values[0]));
+	return sTemplate.render(buffer,size,values);
+}
+
+
+
+size_t SIP::sip_message_text(char *buffer, size_t size, const char * dialed_number, const char * sip_username, short wlocal_port, const char * local_ip, const char * proxy_ip, const char * from_tag, const char * via_branch, const char * call_id, int cseq, const char* message, const char* content_type, const char* extra_headers)
+{
+	static const SIPTemplate sTemplate(
+		"MESSAGE sip:$0$@$1$ SIP/2.0\r\n"
+		"Via: SIP/2.0/UDP $2$:$3$;branch=$4$\r\n"
+		"From: $5$ <sip:$5$@$1$>;tag=$6$\r\n"
+		"To: $0$ <sip:$0$@$1$>\r\n"
+		"Call-ID: $7$@$2$\r\n"
+		"CSeq: $8$ MESSAGE\r\n"
+		"Max-Forwards: $9$\r\n"
+		"User-Agent: $10$\r\n"
+		"Content-Type: $11$\r\n"
+		"$12$"
+		"Content-Length: $13$\r\n"
+		"\r\n"
+		"$14$");
+
+	char local_port[10];
+	sprintf(local_port,"%i",wlocal_port);
+	char cseq_buf[14];
+	sprintf(cseq_buf,"%i",cseq);
+	char max_forwards[14];
+	sprintf(max_forwards,"%u",(unsigned)gConfig.getNum("SIP.MaxForwards"));
+	char content_length[14];
+	sprintf(content_length,"%u",static_cast<unsigned>(strlen(message)));
+
+	const char* values[] = {
+		dialed_number, proxy_ip, local_ip, local_port, via_branch, sip_username, from_tag,
+		call_id, cseq_buf, max_forwards, openbts_user_agent,
+		content_type ? content_type : "text/plain",
+		extra_headers, content_length, message };
+	assert(sTemplate.numFields()==sizeof(values)/sizeof(values[0]));
+	return sTemplate.render(buffer,size,values);
+}
+
+
+
 osip_message_t * SIP::sip_invite5031(short rtp_port, const char * sip_username, short wlocal_port, const char * local_ip, const char* proxy_ip, const char * from_tag, const char * via_branch, const char * call_id, int cseq, unsigned codec)
 {
 	char local_port[10];
@@ -438,17 +546,7 @@ osip_message_t * SIP::sip_invite5031(short rtp_port, const char * sip_username,
 	sdp_message_c_connection_add
         (sdp, 0, strdup("IN"), strdup("IP4"), strdup(local_ip),NULL, NULL);
 
-	// FIXME -- This should also be inside the switch?
-	sdp_message_m_payload_add(sdp,0,strdup("3"));
-	switch (codec) {
-		case RTPuLaw:
-			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("0 PCMU/8000"));
-			break;
-		case RTPGSM610:
-			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("3 GSM/8000"));
-			break;
-		default: assert(0);
-	};
+	openbts_sdp_add_codecs(sdp, codec, true);
 
 	/*
 	 * We construct a sdp_message_t, turn it into a string, and then treat it
@@ -558,17 +656,7 @@ osip_message_t * SIP::sip_invite( const char * dialed_number, short rtp_port, co
 	sdp_message_c_connection_add
         (sdp, 0, strdup("IN"), strdup("IP4"), strdup(local_ip),NULL, NULL);
 
-	// FIXME -- This should also be inside the switch?
-	sdp_message_m_payload_add(sdp,0,strdup("3"));
-	switch (codec) {
-		case RTPuLaw:
-			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("0 PCMU/8000"));
-			break;
-		case RTPGSM610:
-			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("3 GSM/8000"));
-			break;
-		default: assert(0);
-	};
+	openbts_sdp_add_codecs(sdp, codec, true);
 
 	/*
 	 * We construct a sdp_message_t, turn it into a string, and then treat it
@@ -875,17 +963,7 @@ osip_message_t * SIP::sip_okay_sdp( osip_message_t * inv, const char * sip_usern
 	sdp_message_c_connection_add
         (sdp, 0, strdup("IN"), strdup("IP4"), strdup(local_ip),NULL, NULL);
 
-	// FIXME -- This should also be inside the switch?
-	sdp_message_m_payload_add(sdp,0,strdup("3"));
-	switch (audio_codec) {
-		case RTPuLaw:
-			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("0 PCMU/8000"));
-			break;
-		case RTPGSM610:
-			sdp_message_a_attribute_add(sdp,0,strdup("rtpmap"),strdup("3 GSM/8000"));
-			break;
-		default: assert(0);
-	};
+	openbts_sdp_add_codecs(sdp, audio_codec, false);
 
 	openbts_message_set_sdp(okay, sdp);
 
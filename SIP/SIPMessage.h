@@ -66,6 +66,21 @@ osip_message_t * sip_trying( osip_message_t * invite, const char * sip_username,
 osip_message_t * sip_ringing( osip_message_t * invite, const char * sip_username, const char * local_ip);
 
 
+/**@name Outbound requests rendered directly to text from pre-built templates.
+	These are for the high-rate requests that need no saved osip state.
+	Each returns the message length, or 0 if the buffer is too small.
+*/
+//@{
+
+/** Like sip_register, with the registrar given as host:port rather than as a URI. */
+size_t sip_register_text(char *buffer, size_t size, const char * sip_username, short timeout, short local_port, const char * local_ip, const char * registrar, const char * from_tag, const char * via_branch, const char * call_id, int cseq);
+
+/** Like sip_message, with extra_headers as complete CRLF-terminated header lines. */
+size_t sip_message_text(char *buffer, size_t size, const char * dialed_number, const char * sip_username, short local_port, const char * local_ip, const char * proxy_ip, const char * from_tag, const char * via_branch, const char * call_id, int cseq, const char* message, const char* content_type=NULL, const char* extra_headers="");
+
+//@}
+
+
 
 };
 #endif
@@ -0,0 +1,82 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "SIPTemplate.h"
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+using namespace std;
+using namespace SIP;
+
+
+SIPTemplate::SIPTemplate(const char *skeleton)
+	:mNumFields(0)
+{
+	string literal;
+	const char *cp = skeleton;
+	while (*cp) {
+		if (*cp!='$') {
+			literal += *cp++;
+			continue;
+		}
+		// A field reference: $N$.
+		char *end;
+		unsigned field = strtoul(cp+1,&end,10);
+		assert(end!=cp+1 && *end=='$');
+		mLiterals.push_back(literal);
+		mFields.push_back(field);
+		if (field>=mNumFields) mNumFields = field+1;
+		literal.clear();
+		cp = end+1;
+	}
+	mLiterals.push_back(literal);
+}
+
+
+size_t SIPTemplate::render(char *buffer, size_t size, const char* const *values) const
+{
+	size_t length = 0;
+	for (unsigned i=0; i<mLiterals.size(); i++) {
+		const string& literal = mLiterals[i];
+		if (length+literal.size() >= size) return 0;
+		memcpy(buffer+length,literal.data(),literal.size());
+		length += literal.size();
+		if (i==mFields.size()) break;
+		const char *value = values[mFields[i]];
+		size_t valueLength = strlen(value);
+		if (length+valueLength >= size) return 0;
+		memcpy(buffer+length,value,valueLength);
+		length += valueLength;
+	}
+	buffer[length] = '\0';
+	return length;
+}
+
+
+// vim: ts=4 sw=4
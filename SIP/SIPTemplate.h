@@ -0,0 +1,78 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef SIPTEMPLATE_H
+#define SIPTEMPLATE_H
+
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+
+namespace SIP {
+
+
+/**
+	A pre-rendered SIP message skeleton with fill-in fields.
+	The skeleton is split into literal text and field references once,
+	at construction, so rendering is a series of copies into
+	a caller-supplied buffer with no parsing and no allocation.
+	Fields are written in the skeleton as $N$, where N is the index
+	of the value supplied to render(); a field may appear more than once.
+	Header lines in the skeleton end with CRLF, as they go on the wire.
+*/
+class SIPTemplate {
+
+	private:
+
+	std::vector<std::string> mLiterals;	///< text before each field, plus the tail
+	std::vector<unsigned> mFields;		///< field index for each slot
+	unsigned mNumFields;				///< number of values render() expects
+
+	public:
+
+	SIPTemplate(const char *skeleton);
+
+	unsigned numFields() const { return mNumFields; }
+
+	/**
+		Render the message into a buffer.
+		@param buffer The output buffer; the result is NUL-terminated.
+		@param size The size of the buffer.
+		@param values numFields() NUL-terminated strings, indexed by field number.
+		@return The message length, or 0 if it does not fit.
+	*/
+	size_t render(char *buffer, size_t size, const char* const *values) const;
+
+};
+
+
+}	// SIP
+
+
+#endif
+
+// vim: ts=4 sw=4
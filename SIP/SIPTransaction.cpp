@@ -0,0 +1,181 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#include "SIPTransaction.h"
+#include "SIPInterface.h"
+
+#include <Logger.h>
+
+
+using namespace std;
+using namespace SIP;
+
+
+namespace SIP {
+
+void SIPTransactionRetransmit(void *layer, unsigned id)
+{
+	((SIPTransactionLayer*)layer)->retransmit(id);
+}
+
+void SIPTransactionTimeout(void *layer, unsigned id)
+{
+	((SIPTransactionLayer*)layer)->timeout(id);
+}
+
+}
+
+
+SIPTransactionLayer::SIPTransactionLayer(SIPInterface *wInterface)
+	:mInterface(wInterface),mNextID(1)
+{ }
+
+
+void SIPTransactionLayer::start(const struct sockaddr_in *dest, const std::string& callID,
+	const std::string& branch, unsigned CSeq,
+	const char *request, size_t length, unsigned interval, unsigned timeout,
+	SIPTransactionCallback callback, void *object, unsigned tag)
+{
+	ScopedLock lock(mLock);
+	// A new request on the same call ID replaces the old one.
+	// Its originator still gets a final status, so it is not left waiting.
+	map<string,unsigned>::iterator old = mCallIDs.find(callID);
+	if (old != mCallIDs.end()) {
+		LOG(WARNING) << "replacing running transaction for call ID " << callID;
+		SIPClientTransaction *replaced = mTransactions[old->second];
+		replaced->mCallback(replaced->mObject,replaced->mTag,SIPTransactionReplaced);
+		finish(replaced);
+	}
+
+	SIPClientTransaction *transaction = new SIPClientTransaction;
+	transaction->mID = mNextID++;
+	transaction->mCallID = callID;
+	transaction->mBranch = branch;
+	transaction->mCSeq = CSeq;
+	transaction->mRequest.assign(request,length);
+	transaction->mDest = *dest;
+	transaction->mCallback = callback;
+	transaction->mObject = object;
+	transaction->mTag = tag;
+	transaction->mInterval = interval;
+	transaction->mProceeding = false;
+	transaction->mRetransmitTimer = mTimers.schedule(interval,SIPTransactionRetransmit,this,transaction->mID);
+	transaction->mTimeoutTimer = mTimers.schedule(timeout,SIPTransactionTimeout,this,transaction->mID);
+	mTransactions[transaction->mID] = transaction;
+	mCallIDs[callID] = transaction->mID;
+	mBranches[branch] = transaction->mID;
+
+	mInterface->write(dest,request,length);
+}
+
+
+void SIPTransactionLayer::finish(SIPClientTransaction *transaction)
+{
+	if (transaction->mRetransmitTimer) mTimers.cancel(transaction->mRetransmitTimer);
+	if (transaction->mTimeoutTimer) mTimers.cancel(transaction->mTimeoutTimer);
+	mTransactions.erase(transaction->mID);
+	mCallIDs.erase(transaction->mCallID);
+	mBranches.erase(transaction->mBranch);
+	delete transaction;
+}
+
+
+bool SIPTransactionLayer::cancel(const std::string& callID)
+{
+	ScopedLock lock(mLock);
+	map<string,unsigned>::iterator itr = mCallIDs.find(callID);
+	if (itr == mCallIDs.end()) return false;
+	finish(mTransactions[itr->second]);
+	return true;
+}
+
+
+bool SIPTransactionLayer::response(const std::string& callID, const std::string& branch, unsigned CSeq, unsigned status)
+{
+	ScopedLock lock(mLock);
+	// RFC-3261 17.1.3: the branch identifies the transaction.
+	// The call ID and CSeq must agree too, or this is a response to some other request.
+	map<string,unsigned>::iterator itr = mBranches.find(branch);
+	if (itr == mBranches.end()) return false;
+	SIPClientTransaction *transaction = mTransactions[itr->second];
+	if (transaction->mCallID != callID || transaction->mCSeq != CSeq) {
+		LOG(NOTICE) << "response on branch " << branch << " does not match call ID " << transaction->mCallID << " CSeq " << transaction->mCSeq;
+		return false;
+	}
+	if (status < 200) {
+		// Proceeding, RFC-3261 17.1.2.2.  The far end has the request,
+		// but the final response can still be lost, so keep retransmitting at T2
+		// until it arrives or Timer F fires.
+		LOG(DEBUG) << "call ID " << callID << " proceeding, status " << status;
+		transaction->mProceeding = true;
+		transaction->mInterval = SIPTimerT2;
+		return true;
+	}
+	LOG(DEBUG) << "call ID " << callID << " completed, status " << status;
+	transaction->mCallback(transaction->mObject,transaction->mTag,status);
+	finish(transaction);
+	return true;
+}
+
+
+void SIPTransactionLayer::retransmit(unsigned id)
+{
+	ScopedLock lock(mLock);
+	map<unsigned,SIPClientTransaction*>::iterator itr = mTransactions.find(id);
+	// It may have finished while this timer was firing.
+	if (itr == mTransactions.end()) return;
+	SIPClientTransaction *transaction = itr->second;
+	LOG(NOTICE) << "SIP request for call ID " << transaction->mCallID << " timed out; resending";
+	mInterface->write(&transaction->mDest,transaction->mRequest.data(),transaction->mRequest.size());
+	// Timer E doubles up to T2 in Trying and stays at T2 in Proceeding.
+	if (transaction->mProceeding) transaction->mInterval = SIPTimerT2;
+	else transaction->mInterval *= 2;
+	if (transaction->mInterval > SIPTimerT2) transaction->mInterval = SIPTimerT2;
+	transaction->mRetransmitTimer = mTimers.schedule(transaction->mInterval,SIPTransactionRetransmit,this,id);
+}
+
+
+void SIPTransactionLayer::timeout(unsigned id)
+{
+	ScopedLock lock(mLock);
+	map<unsigned,SIPClientTransaction*>::iterator itr = mTransactions.find(id);
+	if (itr == mTransactions.end()) return;
+	SIPClientTransaction *transaction = itr->second;
+	LOG(NOTICE) << "SIP transaction for call ID " << transaction->mCallID << " timed out";
+	transaction->mTimeoutTimer = 0;
+	transaction->mCallback(transaction->mObject,transaction->mTag,0);
+	finish(transaction);
+}
+
+
+size_t SIPTransactionLayer::size() const
+{
+	ScopedLock lock(mLock);
+	return mTransactions.size();
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,169 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+
+#ifndef SIPTRANSACTION_H
+#define SIPTRANSACTION_H
+
+#include <TimerWheel.h>
+#include <Threads.h>
+
+#include <netinet/in.h>
+#include <map>
+#include <string>
+
+
+namespace SIP {
+
+
+class SIPInterface;
+
+
+/** Upper bound on the retransmission interval, RFC-3261 T2, in ms. */
+const unsigned SIPTimerT2 = 4000;
+
+/** The status given to the callback of a transaction replaced by a new request on its call ID. */
+const unsigned SIPTransactionReplaced = 500;
+
+
+/**
+	Completion callback for a client transaction.
+	It runs with the transaction layer locked, so it must be short,
+	and must not start or cancel transactions.
+	@param object The object given to SIPTransactionLayer::start.
+	@param tag The tag given to SIPTransactionLayer::start.
+	@param status The final response code, SIPTransactionReplaced, or 0 if the transaction timed out.
+*/
+typedef void (*SIPTransactionCallback)(void *object, unsigned tag, unsigned status);
+
+
+/**
+	The state of a non-INVITE client transaction, RFC-3261 17.1.2.
+	These are created and owned by SIPTransactionLayer.
+*/
+struct SIPClientTransaction {
+
+	unsigned mID;					///< tag for the timer callbacks
+	std::string mCallID;
+	std::string mBranch;			///< top Via branch of the request, RFC-3261 17.1.3
+	unsigned mCSeq;					///< CSeq number of the request
+	std::string mRequest;			///< the request as sent, for retransmission
+	struct ::sockaddr_in mDest;
+	SIPTransactionCallback mCallback;
+	void *mObject;
+	unsigned mTag;					///< second callback argument
+	unsigned mInterval;				///< current retransmission interval, ms
+	bool mProceeding;				///< true once a provisional response arrives
+	TimerWheel::Handle mRetransmitTimer;	///< Timer E
+	TimerWheel::Handle mTimeoutTimer;		///< Timer F
+};
+
+
+/**
+	Runs non-INVITE client transactions without a thread per transaction.
+	Retransmissions and timeouts are timers on a shared TimerWheel,
+	and responses are matched by Via branch, call ID and CSeq as the parser threads dispatch them.
+	The outcome goes to a callback, so the originator does not have
+	to sit in a read loop to drive the protocol.
+*/
+class SIPTransactionLayer {
+
+	private:
+
+	mutable Mutex mLock;
+	SIPInterface *mInterface;
+	TimerWheel mTimers;
+	unsigned mNextID;
+	std::map<unsigned,SIPClientTransaction*> mTransactions;
+	std::map<std::string,unsigned> mCallIDs;		///< the running transaction of each call ID
+	std::map<std::string,unsigned> mBranches;		///< the transaction of each Via branch
+
+	/** Remove a transaction and cancel its timers; caller holds mLock. */
+	void finish(SIPClientTransaction *transaction);
+
+	/** Timer callbacks. */
+	//@{
+	void retransmit(unsigned id);
+	void timeout(unsigned id);
+	friend void SIPTransactionRetransmit(void *layer, unsigned id);
+	friend void SIPTransactionTimeout(void *layer, unsigned id);
+	//@}
+
+	public:
+
+	SIPTransactionLayer(SIPInterface *wInterface);
+
+	/** Start the timer thread. */
+	void start() { mTimers.start(); }
+
+	/**
+		Send a request and run its transaction to completion.
+		A running transaction on the same call ID is replaced,
+		and its callback gets SIPTransactionReplaced.
+		@param dest Where to send it.
+		@param callID The call ID of the request.
+		@param branch The top Via branch of the request.
+		@param CSeq The CSeq number of the request.
+		@param request The complete request text.
+		@param length The request length.
+		@param interval The initial retransmission interval, ms.
+		@param timeout The transaction timeout, ms.
+		@param callback Called once, with the final status.
+		@param object The first callback argument.
+		@param tag The second callback argument.
+	*/
+	void start(const struct sockaddr_in *dest, const std::string& callID,
+		const std::string& branch, unsigned CSeq,
+		const char *request, size_t length, unsigned interval, unsigned timeout,
+		SIPTransactionCallback callback, void *object, unsigned tag);
+
+	/**
+		Abandon a transaction without a callback.
+		@return true if the transaction was still running.
+	*/
+	bool cancel(const std::string& callID);
+
+	/**
+		Offer a response to the running transactions.
+		@param callID The call ID of the response.
+		@param branch The top Via branch of the response.
+		@param CSeq The CSeq number of the response.
+		@param status The response code.
+		@return true if it belonged to one of them.
+	*/
+	bool response(const std::string& callID, const std::string& branch, unsigned CSeq, unsigned status);
+
+	/** Number of running transactions. */
+	size_t size() const;
+
+};
+
+
+}	// SIP
+
+
+#endif
+
+// vim: ts=4 sw=4
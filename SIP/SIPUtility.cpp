@@ -23,6 +23,8 @@
 */
 
 
+#include <config.h>
+
 #include <stdio.h>
 #include <stdlib.h>
 #include <signal.h>
@@ -37,6 +39,8 @@
 #include "SIPInterface.h"
 #include "SIPUtility.h"
 
+#include <Globals.h>
+
 
 using namespace SIP;
 using namespace std;
@@ -79,6 +83,63 @@ bool SIP::get_rtp_params(const osip_message_t * msg, char * port, char * ip_addr
 	return true;
 }
 
+bool SIP::transcodingEnabled()
+{
+#ifdef HAVE_LIBGSM
+	return gConfig.defines("SIP.Transcoding");
+#else
+	return false;
+#endif
+}
+
+
+bool SIP::transcodable(unsigned codec)
+{
+	return codec==RTPuLaw || codec==RTPaLaw;
+}
+
+
+bool SIP::codecSupported(unsigned codec)
+{
+	if (codec==RTPGSM610) return true;
+	return transcodable(codec) && transcodingEnabled();
+}
+
+
+unsigned SIP::preferredCodec()
+{
+	return transcodingEnabled() ? RTPuLaw : RTPGSM610;
+}
+
+
+unsigned SIP::get_rtp_codec(const osip_message_t * msg, unsigned defaultCodec)
+{
+	osip_body_t * sdp_body = (osip_body_t*)osip_list_get(&msg->bodies, 0);
+	if (!sdp_body) return defaultCodec;
+	char * sdp_str = sdp_body->body;
+	if (!sdp_str) return defaultCodec;
+
+	sdp_message_t * sdp;
+	sdp_message_init(&sdp);
+	if (sdp_message_parse(sdp, sdp_str)) {
+		sdp_message_free(sdp);
+		return defaultCodec;
+	}
+
+	unsigned codec = defaultCodec;
+	int pos = 0;
+	while (char * payload = sdp_message_m_payload_get(sdp,0,pos++)) {
+		unsigned candidate = atoi(payload);
+		if (codecSupported(candidate)) {
+			codec = candidate;
+			break;
+		}
+	}
+	sdp_message_free(sdp);
+	return codec;
+}
+
+
 void SIP::make_tag(char * tag)
 {
 	uint64_t r1 = random();
@@ -53,10 +53,40 @@ class SIPTimeout : public SIPException {};
 /** Codec codes, from RFC-3551, Table 4. */
 enum RTPCodec {
 	RTPuLaw=0,
-	RTPGSM610=3
+	RTPGSM610=3,
+	RTPaLaw=8
 };
 
 
+/**@name Codec negotiation. */
+//@{
+
+/**
+	Return true if G.711 calls are transcoded in the BTS,
+	as per SIP.Transcoding and if OpenBTS was built with libgsm.
+*/
+bool transcodingEnabled();
+
+/** Return true if this RTP payload type is G.711, which the BTS can transcode to GSM 06.10. */
+bool transcodable(unsigned codec);
+
+/** Return true if we can carry a call with this RTP payload type. */
+bool codecSupported(unsigned codec);
+
+/** The codec to list first in our offers. */
+unsigned preferredCodec();
+
+/**
+	Pick the codec for a call from the SDP of an offer or answer:
+	the first payload type in the media line that we support.
+	@param msg The message with the SDP body.
+	@param defaultCodec The codec to return if there is no usable SDP.
+*/
+unsigned get_rtp_codec(const osip_message_t * msg, unsigned defaultCodec);
+
+//@}
+
+
 /** Get owner IP address; return NULL if none found. */
 bool get_owner_ip( osip_message_t * msg, char * o_addr );
 
@@ -0,0 +1,530 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "SMSCodec.h"
+#include "SMSMessages.h"
+
+#include <GSMCommon.h>
+#include <Logger.h>
+
+#include <assert.h>
+#include <string.h>
+#include <time.h>
+
+
+using namespace std;
+using namespace GSM;
+using namespace SMS;
+
+
+
+/** Read one septet at any septet index. */
+static inline unsigned septet(const unsigned char *src, unsigned index)
+{
+	unsigned bit = index*7;
+	unsigned shift = bit & 0x07;
+	const unsigned char *p = src + (bit>>3);
+	unsigned v = p[0] >> shift;
+	if (shift>1) v |= p[1] << (8-shift);
+	return v & 0x7F;
+}
+
+
+void SMS::unpackGSM7(const unsigned char *src, unsigned first, unsigned count, char *text)
+{
+	unsigned i = first;
+	const unsigned end = first + count;
+	// Single septets up to a group boundary.
+	while (i<end && (i & 0x07)) *text++ = decodeGSMChar(septet(src,i++));
+	// Then eight septets out of every seven octets, through one 64-bit word.
+	while (i+8<=end) {
+		const unsigned char *p = src + (i>>3)*7;
+		uint64_t w = (uint64_t)p[0] | ((uint64_t)p[1]<<8) | ((uint64_t)p[2]<<16) |
+			((uint64_t)p[3]<<24) | ((uint64_t)p[4]<<32) | ((uint64_t)p[5]<<40) |
+			((uint64_t)p[6]<<48);
+		for (unsigned j=0; j<8; j++) {
+			*text++ = decodeGSMChar(w & 0x7F);
+			w >>= 7;
+		}
+		i += 8;
+	}
+	// And the tail.
+	while (i<end) *text++ = decodeGSMChar(septet(src,i++));
+}
+
+
+size_t SMS::packGSM7(const char *text, unsigned count, unsigned char *dest)
+{
+	unsigned char *wp = dest;
+	unsigned i = 0;
+	// Eight characters into seven octets, through one 64-bit word.
+	while (i+8<=count) {
+		uint64_t w = 0;
+		for (unsigned j=0; j<8; j++) w |= (uint64_t)encodeGSMChar(text[i+j]) << (7*j);
+		for (unsigned j=0; j<7; j++) {
+			*wp++ = w & 0xFF;
+			w >>= 8;
+		}
+		i += 8;
+	}
+	// The tail, with zero fill bits.
+	unsigned rem = count - i;
+	if (rem) {
+		uint64_t w = 0;
+		for (unsigned j=0; j<rem; j++) w |= (uint64_t)encodeGSMChar(text[i+j]) << (7*j);
+		unsigned octets = (rem*7+7)/8;
+		for (unsigned j=0; j<octets; j++) {
+			*wp++ = w & 0xFF;
+			w >>= 8;
+		}
+	}
+	return wp - dest;
+}
+
+
+
+/** Decode BCD digits, GSM 04.08 10.5.4.7; a final 0xF is filler. */
+static bool parseDigits(const unsigned char *src, unsigned octets, char *digits)
+{
+	unsigned i = 0;
+	for (unsigned n=0; n<octets; n++) {
+		if (i+2>SMSMaxAddress) return false;
+		digits[i++] = (src[n] & 0x0F) + '0';
+		unsigned d2 = src[n] >> 4;
+		if (d2!=0x0F) digits[i++] = d2 + '0';
+	}
+	digits[i] = '\0';
+	return true;
+}
+
+
+/** Encode BCD digits, with 0xF fill; return the octet count. */
+static size_t writeDigits(const char *digits, unsigned count, unsigned char *dest)
+{
+	size_t octets = 0;
+	for (unsigned i=0; i<count; i+=2) {
+		unsigned d1 = (digits[i]-'0') & 0x0F;
+		unsigned d2 = (i+1<count) ? ((digits[i+1]-'0') & 0x0F) : 0x0F;
+		dest[octets++] = (d2<<4) | d1;
+	}
+	return octets;
+}
+
+
+bool SMS::parseRPAddress(const unsigned char *value, size_t length, SMSAddress& address)
+{
+	if (length==0) {
+		address.mType = UnknownTypeOfNumber;
+		address.mPlan = UnknownPlan;
+		address.mDigits[0] = '\0';
+		return true;
+	}
+	// The ext bit must be set.
+	if (!(value[0] & 0x80)) return false;
+	address.mType = (value[0]>>4) & 0x07;
+	address.mPlan = value[0] & 0x0F;
+	return parseDigits(value+1,length-1,address.mDigits);
+}
+
+
+/** Parse a TP address, GSM 03.40 9.1.2.5, advancing rp. */
+static bool parseTLAddress(const unsigned char *src, size_t length, size_t& rp, SMSAddress& address)
+{
+	// Unlike GSM 04.08, the length is in semi-octets and excludes the type.
+	if (rp+2>length) return false;
+	unsigned addressLength = src[rp++];
+	unsigned octets = (addressLength+1)/2;
+	unsigned type = src[rp++];
+	if (!(type & 0x80)) return false;
+	if (rp+octets>length) return false;
+	address.mType = (type>>4) & 0x07;
+	address.mPlan = type & 0x0F;
+	switch (address.mType) {
+		case AlphanumericNumber: {
+			unsigned chars = addressLength*4/7;
+			if (chars>SMSMaxAddress) return false;
+			unpackGSM7(src+rp,0,chars,address.mDigits);
+			address.mDigits[chars] = '\0';
+			break;
+		}
+		case UnknownTypeOfNumber:
+		case InternationalNumber:
+		case NationalNumber:
+		case NetworkSpecificNumber:
+		case ShortCodeNumber:
+		case AbbreviatedNumber:
+			if (!parseDigits(src+rp,octets,address.mDigits)) return false;
+			break;
+		default:
+			return false;
+	}
+	rp += octets;
+	return true;
+}
+
+
+
+/** Take the value of an LV element, advancing rp. */
+static bool parseLV(const unsigned char *src, size_t length, size_t& rp, const unsigned char*& value, unsigned& valueLength)
+{
+	if (rp>=length) return false;
+	valueLength = src[rp++];
+	if (rp+valueLength>length) return false;
+	value = src + rp;
+	rp += valueLength;
+	return true;
+}
+
+
+bool SMS::parseRPDU(const unsigned char *RPDU, size_t length, RPDUView& view)
+{
+	memset(&view,0,sizeof(view));
+	view.mRPDU = RPDU;
+	view.mLength = length;
+	if (length<2) return false;
+	// The low bit of the MTI is the direction, GSM 04.11 8.2.2.
+	view.mMTI = RPDU[0] & 0x06;
+	view.mReference = RPDU[1];
+	size_t rp = 2;
+	switch (view.mMTI) {
+		case RPMessage::Data:
+			return parseLV(RPDU,length,rp,view.mOriginator,view.mOriginatorLength)
+				&& parseLV(RPDU,length,rp,view.mDestination,view.mDestinationLength)
+				&& parseLV(RPDU,length,rp,view.mTPDU,view.mTPDULength);
+		case RPMessage::Error: {
+			const unsigned char *cause;
+			unsigned causeLength;
+			if (!parseLV(RPDU,length,rp,cause,causeLength) || causeLength<1) return false;
+			view.mCause = cause[0] & 0x7F;
+			return true;
+		}
+		case RPMessage::Ack:
+		case RPMessage::SMMA:
+			// We ignore the optional user data.
+			return true;
+	}
+	return false;
+}
+
+
+bool SMS::parseCPData(const unsigned char *CPDU, size_t length, RPDUView& view)
+{
+	memset(&view,0,sizeof(view));
+	if (length<CPDataHeaderLength) return false;
+	if ((CPDU[0] & 0x0F)!=L3SMSPD) return false;
+	if (CPDU[1]!=CPMessage::DATA) return false;
+	size_t RPDULength = CPDU[2];
+	if (CPDataHeaderLength+RPDULength>length) return false;
+	return parseRPDU(CPDU+CPDataHeaderLength,RPDULength,view);
+}
+
+
+bool SMS::parseCPData(const L3Frame& frame, unsigned char *buffer, RPDUView& view)
+{
+	memset(&view,0,sizeof(view));
+	size_t length = frame.size()/8;
+	if (length>SMSMaxCPDU) {
+		LOG(NOTICE) << "oversized CP-DATA, " << length << " octets";
+		return false;
+	}
+	frame.pack(buffer);
+	return parseCPData(buffer,length,view);
+}
+
+
+bool SMS::parseRPDU(const RLFrame& frame, unsigned char *buffer, RPDUView& view)
+{
+	memset(&view,0,sizeof(view));
+	size_t length = frame.size()/8;
+	if (length>SMSMaxRPDU) {
+		LOG(NOTICE) << "oversized RPDU, " << length << " octets";
+		return false;
+	}
+	frame.pack(buffer);
+	return parseRPDU(buffer,length,view);
+}
+
+
+
+bool SMS::parseTLSubmit(const unsigned char *TPDU, size_t length, TLSubmitView& view)
+{
+	// GSM 03.40 9.2.2.2
+	if (length<2) return false;
+	unsigned header = TPDU[0];
+	if ((header & 0x03)!=TLMessage::SUBMIT) return false;
+	view.mRD = header & 0x04;
+	view.mVPF = (header>>3) & 0x03;
+	view.mSRR = header & 0x20;
+	view.mUDHI = header & 0x40;
+	view.mRP = header & 0x80;
+	size_t rp = 1;
+	view.mMR = TPDU[rp++];
+	if (!parseTLAddress(TPDU,length,rp,view.mDA)) return false;
+	if (rp+2>length) return false;
+	view.mPID = TPDU[rp++];
+	view.mDCS = TPDU[rp++];
+	// GSM 03.40 9.2.3.3; we do not use the validity period.
+	switch (view.mVPF) {
+		case 0: break;
+		case 2: rp += 1; break;
+		default: rp += 7; break;
+	}
+	if (rp+1>length) return false;
+	view.mUDL = TPDU[rp++];
+	view.mUD = TPDU + rp;
+	view.mUDLength = length - rp;
+	return true;
+}
+
+
+int SMS::decodeText(const TLSubmitView& submit, char *text)
+{
+	switch (submit.mDCS) {
+		case 0:
+		case 244:
+		case 245:
+		case 246:
+		case 247: {
+			// GSM 7-bit encoding, GSM 03.38 6.
+			unsigned septets = submit.mUDL;
+			if (septets>SMSMaxText || (septets*7+7)/8>submit.mUDLength) {
+				LOG(NOTICE) << "badly formatted TL-UD";
+				return -1;
+			}
+			// Skip the user data header, GSM 03.40 9.2.3.24, with its fill bits.
+			unsigned first = 0;
+			if (submit.mUDHI) {
+				if (submit.mUDLength==0) return -1;
+				unsigned udhl = submit.mUD[0];
+				first = (udhl*8 + 8 + 6) / 7;
+				if (first>septets) {
+					LOG(NOTICE) << "badly formatted TL-UDH";
+					return -1;
+				}
+			}
+			unsigned count = septets - first;
+			unpackGSM7(submit.mUD,first,count,text);
+			text[count] = '\0';
+			return count;
+		}
+		default:
+			LOG(NOTICE) << "unsupported DCS 0x" << hex << submit.mDCS << dec;
+			return -1;
+	}
+}
+
+
+
+/** Write the SCTS in local time, GSM 03.40 9.2.3.11. */
+static void writeTimestamp(unsigned char *dest, time_t seconds)
+{
+	struct tm fields;
+	localtime_r(&seconds,&fields);
+	unsigned values[6] = {
+		(unsigned)fields.tm_year % 100, (unsigned)fields.tm_mon + 1, (unsigned)fields.tm_mday,
+		(unsigned)fields.tm_hour, (unsigned)fields.tm_min, (unsigned)fields.tm_sec
+	};
+	for (unsigned i=0; i<6; i++) dest[i] = ((values[i]%10)<<4) | (values[i]/10);
+	// Time zone, in quarter hours with a sign bit.
+	int zone = fields.tm_gmtoff / (15*60);
+	unsigned sign = 0;
+	if (zone<0) {
+		sign = 0x08;
+		zone = -zone;
+	}
+	dest[6] = ((zone%10)<<4) | sign | ((zone/10) & 0x07);
+}
+
+
+size_t SMS::writeRPDeliver(unsigned char *dest, size_t size, unsigned reference,
+	const char *SMSC, const char *originator, const char *text, unsigned PID)
+{
+	unsigned SMSCDigits = strlen(SMSC);
+	unsigned originatorChars = strlen(originator);
+	unsigned textChars = strlen(text);
+	if (SMSCDigits>SMSMaxAddress || originatorChars>SMSMaxText || textChars>SMSMaxText) {
+		LOG(NOTICE) << "SMS-DELIVER fields too long";
+		return 0;
+	}
+
+	// Size everything up first.
+	size_t originatorOctets = (originatorChars*7+7)/8;
+	size_t textOctets = (textChars*7+7)/8;
+	size_t TPDULength = 1 + 2 + originatorOctets + 1 + 1 + 7 + 1 + textOctets;
+	size_t SMSCLength = SMSCDigits ? 1 + (SMSCDigits+1)/2 : 0;
+	size_t length = 2 + 1 + SMSCLength + 1 + 1 + TPDULength;
+	if (length>size || TPDULength>255) {
+		LOG(NOTICE) << "SMS-DELIVER does not fit in an RPDU";
+		return 0;
+	}
+
+	unsigned char *wp = dest;
+
+	// GSM 04.11 7.3.1.1, network to MS.
+	*wp++ = RPMessage::Data + 1;
+	*wp++ = reference;
+	// Originator, the SMSC, as a GSM 04.08 BCD number.
+	*wp++ = SMSCLength;
+	if (SMSCDigits) {
+		*wp++ = 0x80 | (NationalNumber<<4) | E164Plan;
+		wp += writeDigits(SMSC,SMSCDigits,wp);
+	}
+	// No destination.
+	*wp++ = 0;
+	*wp++ = TPDULength;
+
+	// GSM 03.40 9.2.2.1
+	// MMS is reversed-sense, so set means no more messages.
+	*wp++ = TLMessage::DELIVER | 0x04;
+	// The originator goes out as alphanumeric.
+	unsigned fillBits = originatorOctets*8 - originatorChars*7;
+	unsigned addressLength = originatorOctets*2;
+	if (fillBits>3) addressLength--;
+	*wp++ = addressLength;
+	*wp++ = 0x80 | (AlphanumericNumber<<4) | E164Plan;
+	wp += packGSM7(originator,originatorChars,wp);
+	*wp++ = PID;
+	// DCS 0, the default alphabet.
+	*wp++ = 0;
+	writeTimestamp(wp,time(NULL));
+	wp += 7;
+	*wp++ = textChars;
+	wp += packGSM7(text,textChars,wp);
+
+	assert((size_t)(wp-dest)==length);
+	return length;
+}
+
+
+size_t SMS::writeRPAck(unsigned char *dest, size_t size, unsigned reference)
+{
+	if (size<2) return 0;
+	dest[0] = RPMessage::Ack + 1;
+	dest[1] = reference;
+	return 2;
+}
+
+
+size_t SMS::writeRPError(unsigned char *dest, size_t size, unsigned cause, unsigned reference)
+{
+	if (size<4) return 0;
+	dest[0] = RPMessage::Error + 1;
+	dest[1] = reference;
+	dest[2] = 1;
+	dest[3] = cause;
+	return 4;
+}
+
+
+size_t SMS::writeCPData(unsigned char *dest, unsigned L3TI, size_t RPDULength)
+{
+	assert(RPDULength<=SMSMaxRPDU);
+	dest[0] = (L3TI<<4) | L3SMSPD;
+	dest[1] = CPMessage::DATA;
+	dest[2] = RPDULength;
+	return CPDataHeaderLength + RPDULength;
+}
+
+
+
+static int hexDigit(char c)
+{
+	if (c>='0' && c<='9') return c - '0';
+	if (c>='a' && c<='f') return c - 'a' + 10;
+	if (c>='A' && c<='F') return c - 'A' + 10;
+	return -1;
+}
+
+
+size_t SMS::hexToOctets(const char *hex, unsigned char *dest, size_t size)
+{
+	size_t length = 0;
+	while (hex[0]) {
+		if (length==size) return 0;
+		int hi = hexDigit(hex[0]);
+		if (hi<0) return 0;
+		int lo = hexDigit(hex[1]);
+		if (lo<0) return 0;
+		dest[length++] = (hi<<4) | lo;
+		hex += 2;
+	}
+	return length;
+}
+
+
+void SMS::octetsToHex(const unsigned char *src, size_t length, char *dest)
+{
+	static const char digits[] = "0123456789abcdef";
+	for (size_t i=0; i<length; i++) {
+		*dest++ = digits[src[i]>>4];
+		*dest++ = digits[src[i] & 0x0F];
+	}
+	*dest = '\0';
+}
+
+
+
+ostream& SMS::operator<<(ostream& os, const RPDUView& view)
+{
+	os << (RPMessage::MessageType)view.mMTI << " ref=" << view.mReference;
+	switch (view.mMTI) {
+		case RPMessage::Data: {
+			SMSAddress address;
+			if (parseRPAddress(view.mDestination,view.mDestinationLength,address)) {
+				os << " destSMSC=(" << address.mDigits << ")";
+			}
+			os << " TPDU=(" << hex;
+			for (unsigned i=0; i<view.mTPDULength; i++) {
+				os << (view.mTPDU[i]>>4) << (view.mTPDU[i] & 0x0F);
+			}
+			os << dec << ")";
+			break;
+		}
+		case RPMessage::Error:
+			os << " cause=(0x" << hex << view.mCause << dec << ")";
+			break;
+	}
+	return os;
+}
+
+
+ostream& SMS::operator<<(ostream& os, const TLSubmitView& view)
+{
+	os << "SMS-SUBMIT";
+	os << " RD=" << view.mRD;
+	os << " VPF=" << view.mVPF;
+	os << " RP=" << view.mRP;
+	os << " UDHI=" << view.mUDHI;
+	os << " SRR=" << view.mSRR;
+	os << " MR=" << view.mMR;
+	os << " DA=(type=" << view.mDA.mType << " plan=" << view.mDA.mPlan << " digits=" << view.mDA.mDigits << ")";
+	os << " PI=" << view.mPID;
+	os << " DCS=" << view.mDCS;
+	os << " UDL=" << view.mUDL;
+	return os;
+}
+
+
+// vim: ts=4 sw=4
@@ -0,0 +1,226 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+/*
+	A byte-oriented codec for the SMS messages on the SMS data path.
+
+	The classes in SMSMessages.h build a tree of heap objects and read
+	a bit at a time from BitVectors.  The functions here work on octets:
+	a parse fills a view struct on the stack whose pointers refer into
+	the caller's buffer, and an encoder writes into a caller's buffer.
+	Nothing here allocates.
+*/
+
+
+#ifndef SMS_CODEC_H
+#define SMS_CODEC_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <ostream>
+
+#include "SMSTransfer.h"
+
+
+namespace SMS {
+
+
+/** Largest CP-User-Data, which is the RPDU, GSM 04.11 8.1.4.3. */
+const unsigned SMSMaxRPDU = 248;
+
+/** CP-DATA header: PD/TI, MTI and the CP-User-Data length, GSM 04.11 7.2.1. */
+const unsigned CPDataHeaderLength = 3;
+
+/** Largest CP-DATA message. */
+const unsigned SMSMaxCPDU = CPDataHeaderLength + SMSMaxRPDU;
+
+/** Most septets in a single TP-UD, GSM 03.40 9.2.3.16. */
+const unsigned SMSMaxText = 160;
+
+/** Most characters in a decoded address, GSM 03.40 9.1.2.5. */
+const unsigned SMSMaxAddress = 20;
+
+
+/** A decoded GSM 03.40 9.1.2.5 or GSM 04.11 8.2.5.2 address. */
+struct SMSAddress {
+	unsigned mType;						///< GSM::TypeOfNumber
+	unsigned mPlan;						///< GSM::NumberingPlan
+	char mDigits[SMSMaxAddress+1];		///< digits, or text for an alphanumeric address
+};
+
+
+/**
+	An RPDU, GSM 04.11 7.3, parsed in place.
+	The pointers refer into the buffer that was parsed.
+*/
+struct RPDUView {
+	const unsigned char *mRPDU;			///< the whole RPDU
+	unsigned mLength;					///< length of the whole RPDU
+	unsigned mMTI;						///< RPMessage::MessageType; the direction bit is dropped
+	unsigned mReference;				///< RP-Message Reference
+	const unsigned char *mOriginator;	///< RP-Originator Address value, RP-DATA only
+	unsigned mOriginatorLength;
+	const unsigned char *mDestination;	///< RP-Destination Address value, RP-DATA only
+	unsigned mDestinationLength;
+	const unsigned char *mTPDU;			///< RP-User Data value, RP-DATA only
+	unsigned mTPDULength;
+	unsigned mCause;					///< RP-Cause value, RP-ERROR only
+};
+
+std::ostream& operator<<(std::ostream&, const RPDUView&);
+
+
+/**
+	An SMS-SUBMIT TPDU, GSM 03.40 9.2.2.2, parsed in place.
+	The user data pointer refers into the buffer that was parsed.
+*/
+struct TLSubmitView {
+	bool mRD;							///< reject duplicates
+	unsigned mVPF;						///< validity period format
+	bool mSRR;							///< status report request
+	bool mUDHI;							///< user data header indicator
+	bool mRP;							///< reply path
+	unsigned mMR;						///< message reference
+	SMSAddress mDA;						///< destination address
+	unsigned mPID;						///< protocol identifier
+	unsigned mDCS;						///< data coding scheme
+	unsigned mUDL;						///< TP-UDL, in septets for the 7-bit alphabet
+	const unsigned char *mUD;			///< packed user data
+	unsigned mUDLength;					///< octets available at mUD
+};
+
+std::ostream& operator<<(std::ostream&, const TLSubmitView&);
+
+
+/**@name GSM 03.38 6.1.2.1 default alphabet packing. */
+//@{
+
+/**
+	Unpack 7-bit characters and convert them to ASCII.
+	The caller is responsible for checking that the septets are present.
+	@param src The packed data.
+	@param first Index of the first septet to unpack.
+	@param count Number of septets to unpack.
+	@param text Receives count characters; not terminated.
+*/
+void unpackGSM7(const unsigned char *src, unsigned first, unsigned count, char *text);
+
+/**
+	Convert ASCII to the GSM alphabet and pack it, with zero fill bits.
+	@param text The characters.
+	@param count Number of characters.
+	@param dest Receives (count*7+7)/8 octets.
+	@return The number of octets written.
+*/
+size_t packGSM7(const char *text, unsigned count, unsigned char *dest);
+
+//@}
+
+
+/**@name Parsers.  All return false if the message is malformed or truncated. */
+//@{
+
+/** Parse an RPDU in place. */
+bool parseRPDU(const unsigned char *RPDU, size_t length, RPDUView& view);
+
+/** Parse the RPDU of a CP-DATA message in place. */
+bool parseCPData(const unsigned char *CPDU, size_t length, RPDUView& view);
+
+/**
+	Pack a CP-DATA frame from L3 into octets and parse the RPDU in place.
+	@param buffer Receives the octets; at least SMSMaxCPDU long.
+*/
+bool parseCPData(const GSM::L3Frame& frame, unsigned char *buffer, RPDUView& view);
+
+/**
+	Pack an RPDU already taken from a CP-DATA into octets and parse it in place.
+	@param buffer Receives the octets; at least SMSMaxRPDU long.
+*/
+bool parseRPDU(const RLFrame& frame, unsigned char *buffer, RPDUView& view);
+
+/** Parse an SMS-SUBMIT in place. */
+bool parseTLSubmit(const unsigned char *TPDU, size_t length, TLSubmitView& view);
+
+/** Decode an RP address value, GSM 04.11 8.2.5.2. */
+bool parseRPAddress(const unsigned char *value, size_t length, SMSAddress& address);
+
+/**
+	Decode the text of an SMS-SUBMIT, skipping any user data header.
+	@param text Receives the text, null-terminated; at least SMSMaxText+1 long.
+	@return The text length, or -1 if the DCS is unsupported or the data is short.
+*/
+int decodeText(const TLSubmitView& submit, char *text);
+
+//@}
+
+
+/**@name Encoders.  All return the length written, or 0 if it does not fit. */
+//@{
+
+/**
+	Write an RP-DATA containing an SMS-DELIVER with 7-bit text, GSM 04.11 7.3.1.1.
+	@param reference The RP-Message Reference.
+	@param SMSC The originating SMSC digits.
+	@param originator The sender, coded as an alphanumeric TP-OA.
+	@param text The message in ASCII.
+	@param PID The TP-PID.
+*/
+size_t writeRPDeliver(unsigned char *dest, size_t size, unsigned reference,
+	const char *SMSC, const char *originator, const char *text, unsigned PID=0);
+
+/** Write an RP-ACK, GSM 04.11 7.3.3. */
+size_t writeRPAck(unsigned char *dest, size_t size, unsigned reference);
+
+/** Write an RP-ERROR, GSM 04.11 7.3.4. */
+size_t writeRPError(unsigned char *dest, size_t size, unsigned cause, unsigned reference);
+
+/**
+	Fill in the CP-DATA header in front of an RPDU.
+	The RPDU must already be at dest+CPDataHeaderLength.
+	@return The length of the whole CP-DATA.
+*/
+size_t writeCPData(unsigned char *dest, unsigned L3TI, size_t RPDULength);
+
+//@}
+
+
+/**@name Hex conversion for application/vnd.3gpp.sms bodies. */
+//@{
+
+/** Convert hex to octets; return the octet count, or 0 if malformed or too long. */
+size_t hexToOctets(const char *hex, unsigned char *dest, size_t size);
+
+/** Write octets as lower-case hex, null-terminated; dest needs 2*length+1 bytes. */
+void octetsToHex(const unsigned char *src, size_t length, char *dest);
+
+//@}
+
+
+};  // namespace SMS
+
+
+#endif
+
+// vim: ts=4 sw=4
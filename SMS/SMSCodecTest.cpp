@@ -0,0 +1,203 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Affero Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+	This program is free software: you can redistribute it and/or modify
+	it under the terms of the GNU Affero General Public License as published by
+	the Free Software Foundation, either version 3 of the License, or
+	(at your option) any later version.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU Affero General Public License for more details.
+
+	You should have received a copy of the GNU Affero General Public License
+	along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+
+#include "SMSCodec.h"
+#include "SMSMessages.h"
+
+#include <Configuration.h>
+#include <Logger.h>
+
+#include <iostream>
+#include <string.h>
+
+using namespace std;
+using namespace SMS;
+
+ConfigurationTable gConfig;
+
+
+unsigned gFailures = 0;
+
+void check(bool ok, const char *what)
+{
+	cout << (ok ? "OK   " : "FAIL ") << what << endl;
+	if (!ok) gFailures++;
+}
+
+
+/**
+	Write an SMS-SUBMIT to destination 1234 with no validity period.
+	@return The TPDU length.
+*/
+size_t writeSubmit(unsigned char *dest, unsigned DCS, unsigned UDL, const unsigned char *UD, size_t UDLength)
+{
+	unsigned char *wp = dest;
+	*wp++ = TLMessage::SUBMIT;
+	*wp++ = 0x05;				// TP-MR
+	*wp++ = 4;					// TP-DA, 4 semi-octets
+	*wp++ = 0x81;				// unknown type, E.164 plan
+	*wp++ = 0x21;
+	*wp++ = 0x43;
+	*wp++ = 0;					// TP-PID
+	*wp++ = DCS;
+	*wp++ = UDL;
+	memcpy(wp,UD,UDLength);
+	wp += UDLength;
+	return wp - dest;
+}
+
+
+/**
+	Wrap a TPDU in an MS-to-network RP-DATA for SMSC 5551212, inside a CP-DATA.
+	@return The CP-DATA length.
+*/
+size_t writeCPSubmit(unsigned char *dest, const unsigned char *TPDU, size_t TPDULength)
+{
+	unsigned char *wp = dest + CPDataHeaderLength;
+	*wp++ = RPMessage::Data;
+	*wp++ = 0x42;				// RP-MR
+	*wp++ = 0;					// no RP-OA
+	*wp++ = 5;					// RP-DA
+	*wp++ = 0x91;
+	*wp++ = 0x55;
+	*wp++ = 0x15;
+	*wp++ = 0x12;
+	*wp++ = 0xF2;
+	*wp++ = TPDULength;
+	memcpy(wp,TPDU,TPDULength);
+	wp += TPDULength;
+	return writeCPData(dest,1,wp-dest-CPDataHeaderLength);
+}
+
+
+/**
+	Take an SMS-SUBMIT through CP-DATA, RP-DATA and TPDU parsing, and through the hex form.
+	The view points into CPDU, which is at least SMSMaxCPDU long.
+*/
+bool roundTrip(const unsigned char *TPDU, size_t TPDULength, unsigned char *CPDU, TLSubmitView& submit)
+{
+	size_t length = writeCPSubmit(CPDU,TPDU,TPDULength);
+	RPDUView RPDU;
+	if (!parseCPData(CPDU,length,RPDU)) return false;
+	if (RPDU.mMTI!=RPMessage::Data || RPDU.mReference!=0x42) return false;
+	SMSAddress SMSC;
+	if (!parseRPAddress(RPDU.mDestination,RPDU.mDestinationLength,SMSC)) return false;
+	if (strcmp(SMSC.mDigits,"5551212")) return false;
+	if (RPDU.mTPDULength!=TPDULength || memcmp(RPDU.mTPDU,TPDU,TPDULength)) return false;
+	// The application/vnd.3gpp.sms body.
+	char hex[2*SMSMaxRPDU+1];
+	octetsToHex(RPDU.mRPDU,RPDU.mLength,hex);
+	unsigned char octets[SMSMaxRPDU];
+	if (hexToOctets(hex,octets,sizeof(octets))!=RPDU.mLength) return false;
+	if (memcmp(octets,RPDU.mRPDU,RPDU.mLength)) return false;
+	if (!parseTLSubmit(RPDU.mTPDU,RPDU.mTPDULength,submit)) return false;
+	return submit.mMR==0x05 && !strcmp(submit.mDA.mDigits,"1234");
+}
+
+
+int main(int argc, char *argv[])
+{
+	gLogInit("SMSCodecTest","ERR",LOG_LOCAL7);
+
+	unsigned char TPDU[256];
+	TLSubmitView submit;
+	unsigned char CPDU[SMSMaxCPDU];
+	char text[SMSMaxText+1];
+
+	// 7-bit, long enough to use the word-at-a-time paths and a tail.
+	const char *message = "Hello, world! 0123456789 The quick brown fox.";
+	unsigned chars = strlen(message);
+	unsigned char packed[SMSMaxText];
+	size_t packedLength = packGSM7(message,chars,packed);
+	check(packedLength==(chars*7+7)/8, "7-bit packed length");
+	size_t length7 = writeSubmit(TPDU,0,chars,packed,packedLength);
+	check(roundTrip(TPDU,length7,CPDU,submit), "7-bit SMS-SUBMIT round trip");
+	check(decodeText(submit,text)==(int)chars && !strcmp(text,message), "7-bit text");
+
+	// 8-bit data, including the octets a text path might trip on.
+	unsigned char data[140];
+	for (unsigned i=0; i<sizeof(data); i++) data[i] = (i*37) & 0xFF;
+	size_t length8 = writeSubmit(TPDU,0x04,sizeof(data),data,sizeof(data));
+	check(roundTrip(TPDU,length8,CPDU,submit), "8-bit SMS-SUBMIT round trip");
+	check(submit.mDCS==0x04 && submit.mUDL==sizeof(data) && submit.mUDLength==sizeof(data)
+		&& !memcmp(submit.mUD,data,sizeof(data)), "8-bit user data");
+	// Not text, so it must go through as application/vnd.3gpp.sms.
+	check(decodeText(submit,text)<0, "8-bit is not decoded as text");
+
+	// UCS2, "Привет", UTF-16BE.
+	const unsigned char ucs2[] = { 0x04,0x1F, 0x04,0x40, 0x04,0x38, 0x04,0x32, 0x04,0x35, 0x04,0x42 };
+	size_t lengthUCS2 = writeSubmit(TPDU,0x08,sizeof(ucs2),ucs2,sizeof(ucs2));
+	check(roundTrip(TPDU,lengthUCS2,CPDU,submit), "UCS2 SMS-SUBMIT round trip");
+	check(submit.mDCS==0x08 && submit.mUDL==sizeof(ucs2) && submit.mUDLength==sizeof(ucs2)
+		&& !memcmp(submit.mUD,ucs2,sizeof(ucs2)), "UCS2 user data");
+	check(decodeText(submit,text)<0, "UCS2 is not decoded as text");
+
+	// Truncated TPDUs: every short form is rejected by the parser or the decoder.
+	length7 = writeSubmit(TPDU,0,chars,packed,packedLength);
+	bool rejected = true;
+	for (size_t len=0; len<length7; len++) {
+		if (parseTLSubmit(TPDU,len,submit) && decodeText(submit,text)>=0) rejected = false;
+	}
+	check(rejected, "truncated SMS-SUBMIT");
+	size_t CPLength = writeCPSubmit(CPDU,TPDU,length7);
+	rejected = true;
+	RPDUView RPDU;
+	for (size_t len=0; len<CPLength; len++) {
+		if (parseCPData(CPDU,len,RPDU)) rejected = false;
+	}
+	check(rejected, "truncated CP-DATA");
+
+	// SMS-DELIVER from the encoder, taken apart again.
+	unsigned char deliver[SMSMaxRPDU];
+	size_t deliverLength = writeRPDeliver(deliver,sizeof(deliver),7,"5551212","OpenBTS",message);
+	check(deliverLength && parseRPDU(deliver,deliverLength,RPDU), "RP-DATA SMS-DELIVER parses");
+	check(RPDU.mMTI==RPMessage::Data && RPDU.mReference==7, "RP-DATA header");
+	SMSAddress SMSC;
+	check(parseRPAddress(RPDU.mOriginator,RPDU.mOriginatorLength,SMSC) && !strcmp(SMSC.mDigits,"5551212"), "RP-OA");
+	const unsigned char *tp = RPDU.mTPDU;
+	check((tp[0] & 0x03)==TLMessage::DELIVER, "SMS-DELIVER MTI");
+	unsigned OALength = tp[1];
+	char originator[SMSMaxAddress+1];
+	unpackGSM7(tp+3,0,OALength*4/7,originator);
+	originator[OALength*4/7] = '\0';
+	check(!strcmp(originator,"OpenBTS"), "alphanumeric TP-OA");
+	size_t rp = 3 + (OALength+1)/2;
+	check(tp[rp]==0 && tp[rp+1]==0, "TP-PID and TP-DCS");
+	rp += 2 + 7;
+	check(tp[rp]==chars, "TP-UDL");
+	unpackGSM7(tp+rp+1,0,chars,text);
+	text[chars] = '\0';
+	check(!strcmp(text,message), "SMS-DELIVER text");
+	check(RPDU.mTPDULength==rp+1+(chars*7+7)/8, "SMS-DELIVER length");
+
+	// Encoders that do not fit.
+	check(writeRPDeliver(deliver,10,7,"5551212","OpenBTS",message)==0, "short RP-DATA buffer");
+	check(writeRPAck(deliver,1,7)==0 && writeRPError(deliver,3,111,7)==0, "short RP-ACK and RP-ERROR buffers");
+
+	cout << gFailures << " failures" << endl;
+	return gFailures ? 1 : 0;
+}
+
+// vim: ts=4 sw=4
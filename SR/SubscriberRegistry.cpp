@@ -162,6 +162,9 @@ int SubscriberRegistry::init()
 		mDB = NULL;
 		return FAILURE;
 	}
+	if (!sqlite3_setup(mDB)) {
+		LOG(WARNING) << "Cannot set WAL mode or busy timeout on SubscriberRegistry";
+	}
 	if (!sqlite3_command(mDB,createRRLPTable)) {
 		LOG(EMERG) << "Cannot create RRLP table";
 	  return FAILURE;
@@ -174,6 +177,7 @@ int SubscriberRegistry::init()
 		LOG(EMERG) << "Cannot create SIP_BUDDIES table";
 		return FAILURE;
 	}
+	mWriterThread.start((void*(*)(void*))SubscriberRegistryWriterAdapter,this);
 	return SUCCESS;
 }
 
@@ -181,7 +185,13 @@ int SubscriberRegistry::init()
 
 SubscriberRegistry::~SubscriberRegistry()
 {
-	if (mDB) sqlite3_close(mDB);
+	// The writer thread is never stopped; this is only invoked at exit.
+	if (!mDB) return;
+	flush();
+	ScopedLock lock(mDBLock);
+	sqlite3_release_statements(mDB);
+	sqlite3_close(mDB);
+	mDB = NULL;
 }
 
 
@@ -190,6 +200,7 @@ SubscriberRegistry::~SubscriberRegistry()
 SubscriberRegistry::Status SubscriberRegistry::sqlLocal(const char* query, char **resultptr)
 {
 	LOG(INFO) << query;
+	ScopedLock lock(mDBLock);
 
 	if (!resultptr) {
 		if (!sqlite3_command(db(), query)) return FAILURE;
@@ -244,16 +255,135 @@ SubscriberRegistry::Status SubscriberRegistry::sqlUpdate(string stmt)
 
 string SubscriberRegistry::imsiGet(string imsi, string key)
 {
-	string name = imsi.substr(0,4) == "IMSI" ? imsi : "IMSI" + imsi;
+	string name = buddyName(imsi);
+	// A queued write is newer than what is in the database.
+	mCacheLock.lock();
+	AttributeCache::const_iterator user = mCache.find(name);
+	if (user != mCache.end()) {
+		map<string,CachedAttribute>::const_iterator attr = user->second.find(key);
+		if (attr != user->second.end() && attr->second.dirty) {
+			string value = attr->second.value;
+			mCacheLock.unlock();
+			return value;
+		}
+	}
+	mCacheLock.unlock();
 	return sqlQuery(key, "sip_buddies", "name", imsi);
 }
 
 SubscriberRegistry::Status SubscriberRegistry::imsiSet(string imsi, string key, string value)
 {
-	string name = imsi.substr(0,4) == "IMSI" ? imsi : "IMSI" + imsi;
+	string name = buddyName(imsi);
 	ostringstream os;
 	os << "update sip_buddies set " << key << " = \"" << value << "\" where name = \"" << name << "\"";
-	return sqlUpdate(os.str());
+	// Hold the database across the write and the cache update,
+	// so a flush cannot write an older queued value in between.
+	ScopedLock dbLock(mDBLock);
+	Status st = sqlUpdate(os.str());
+	// Keep the cache coherent, and make sure a queued older value
+	// does not overwrite this one.
+	ScopedLock lock(mCacheLock);
+	CachedAttribute& attr = mCache[name][key];
+	if (attr.dirty) mDirtyCount--;
+	attr.value = value;
+	attr.written = st==SUCCESS ? time(NULL) : 0;
+	attr.dirty = false;
+	return st;
+}
+
+SubscriberRegistry::Status SubscriberRegistry::imsiUpdate(string imsi, string key, string value)
+{
+	string name = buddyName(imsi);
+	ScopedLock lock(mCacheLock);
+	// This creates the entry if it does not exist yet, with written==0.
+	CachedAttribute& attr = mCache[name][key];
+	if (attr.value==value) {
+		if (attr.dirty) return DELAYED;
+		if (attr.written + (time_t)SubscriberRegistryCacheTimeout > time(NULL)) return SUCCESS;
+	}
+	attr.value = value;
+	if (!attr.dirty) mDirtyCount++;
+	attr.dirty = true;
+	return DELAYED;
+}
+
+SubscriberRegistry::Status SubscriberRegistry::flush()
+{
+	// The transaction has the connection to itself, and imsiSet cannot
+	// change an attribute between the copy and the cleanup below.
+	ScopedLock dbLock(mDBLock);
+	// Copy the queued updates, so that imsiUpdate never waits for the database.
+	// The attributes stay dirty until the database has them.
+	typedef map<pair<string,string>,string> UpdateMap;
+	UpdateMap updates;
+	mCacheLock.lock();
+	if (mDirtyCount) {
+		for (AttributeCache::iterator user = mCache.begin(); user != mCache.end(); ++user) {
+			map<string,CachedAttribute>& attrs = user->second;
+			for (map<string,CachedAttribute>::iterator attr = attrs.begin(); attr != attrs.end(); ++attr) {
+				if (!attr->second.dirty) continue;
+				updates[make_pair(attr->first,user->first)] = attr->second.value;
+			}
+		}
+	}
+	mCacheLock.unlock();
+	if (updates.size()==0) return SUCCESS;
+	if (!mDB) return FAILURE;
+
+	LOG(DEBUG) << "writing " << updates.size() << " attributes";
+	if (!sqlite3_command(mDB,"BEGIN TRANSACTION")) return FAILURE;
+	Status st = SUCCESS;
+	UpdateMap written;
+	for (UpdateMap::const_iterator itr = updates.begin(); itr != updates.end(); ++itr) {
+		// The column name cannot be a parameter, so there is one cached statement per column.
+		// The map is sorted by column, but checking out per update is cheap.
+		string query = "UPDATE sip_buddies SET " + itr->first.first + " = ? WHERE name = ?";
+		sqlite3_stmt *stmt = sqlite3_checkout(mDB,query.c_str());
+		if (!stmt) {
+			st = FAILURE;
+			continue;
+		}
+		sqlite3_bind_text(stmt,1,itr->second.c_str(),-1,SQLITE_STATIC);
+		sqlite3_bind_text(stmt,2,itr->first.second.c_str(),-1,SQLITE_STATIC);
+		if (sqlite3_run_query(mDB,stmt)==SQLITE_DONE) written.insert(*itr);
+		else st = FAILURE;
+		sqlite3_checkin(stmt);
+	}
+	if (!sqlite3_command(mDB,"COMMIT TRANSACTION")) {
+		// Nothing was written; everything stays dirty for the next pass.
+		sqlite3_command(mDB,"ROLLBACK TRANSACTION");
+		return FAILURE;
+	}
+
+	// Mark clean only what is in the database and has not changed since we copied it.
+	// Failed updates stay dirty and are retried on the next pass.
+	time_t now = time(NULL);
+	ScopedLock lock(mCacheLock);
+	for (UpdateMap::const_iterator itr = written.begin(); itr != written.end(); ++itr) {
+		AttributeCache::iterator user = mCache.find(itr->first.second);
+		if (user == mCache.end()) continue;
+		map<string,CachedAttribute>::iterator attr = user->second.find(itr->first.first);
+		if (attr == user->second.end()) continue;
+		if (!attr->second.dirty || attr->second.value != itr->second) continue;
+		attr->second.dirty = false;
+		attr->second.written = now;
+		mDirtyCount--;
+	}
+	return st;
+}
+
+void SubscriberRegistry::writerLoop()
+{
+	while (true) {
+		msleep(SubscriberRegistryFlushInterval);
+		if (flush()!=SUCCESS) LOG(ERR) << "cannot write cached SubscriberRegistry attributes";
+	}
+}
+
+void *SubscriberRegistryWriterAdapter(SubscriberRegistry *registry)
+{
+	registry->writerLoop();
+	return NULL;
 }
 
 string SubscriberRegistry::getIMSI(string ISDN)
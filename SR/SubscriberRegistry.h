@@ -29,23 +29,57 @@
 #include <map>
 #include <stdlib.h>
 #include <Logger.h>
-// #include <Timeval.h>
-// #include <Threads.h>
+#include <Timeval.h>
+#include <Threads.h>
 #include <map>
 #include <string>
 #include "sqlite3.h"
 
 using namespace std;
 
+
+/** Interval between batched writes of cached subscriber attributes, in ms. */
+const unsigned SubscriberRegistryFlushInterval = 1000;
+
+/**
+	Lifetime of a cached subscriber attribute, in seconds.
+	Other programs share the database, so after this long
+	an unchanged value is written again anyway.
+*/
+const unsigned SubscriberRegistryCacheTimeout = 60;
+
+
 class SubscriberRegistry {
 
 	private:
 
 	sqlite3 *mDB;			///< database connection
+	Mutex mDBLock;			///< serializes all use of mDB, including the writer's transactions
+
+	/** A cached sip_buddies attribute. */
+	struct CachedAttribute {
+		string value;
+		time_t written;			///< when the value was last sent to the database
+		bool dirty;				///< true if not yet written to the database
+		CachedAttribute():written(0),dirty(false) {}
+	};
+
+	/** Cached attributes, by sip_buddies name, then by column. */
+	typedef map<string, map<string,CachedAttribute> > AttributeCache;
+
+	Mutex mCacheLock;			///< protects mCache
+	AttributeCache mCache;
+	unsigned mDirtyCount;		///< number of dirty entries in mCache
+
+	Thread mWriterThread;		///< thread for batched attribute writes
 
 
 	public:
 
+	SubscriberRegistry()
+		:mDB(NULL),mDirtyCount(0)
+	{}
+
 	~SubscriberRegistry();
 
 	/**
@@ -111,6 +145,23 @@ class SubscriberRegistry {
 	*/
 	Status imsiSet(string imsi, string key, string value);
 
+	/**
+		Set a specific variable indexed by imsi in sip_buddies, through the cache.
+		Nothing is written if the value is unchanged since the last write,
+		and real changes are written in batches by a separate thread.
+		@param imsi The user's IMSI or SIP username.
+		@param key to index into table
+		@param value to set indexed by the key
+		@return SUCCESS if there was nothing to do, DELAYED if the write is queued.
+	*/
+	Status imsiUpdate(string imsi, string key, string value);
+
+	/**
+		Write all queued attribute updates in a single transaction.
+		@return SUCCESS, or FAILURE if any update failed.
+	*/
+	Status flush();
+
 	/**
 		Add a new user to the SubscriberRegistry.
 		@param IMSI The user's IMSI or SIP username.
@@ -143,6 +194,15 @@ class SubscriberRegistry {
 
 	private:
 
+	/** Normalize an IMSI or SIP username to a sip_buddies name. */
+	static string buddyName(const string& imsi)
+		{ return imsi.substr(0,4) == "IMSI" ? imsi : "IMSI" + imsi; }
+
+	/** The batched writer loop. */
+	void writerLoop();
+
+	friend void *SubscriberRegistryWriterAdapter(SubscriberRegistry*);
+
 
 	/**
 		Run sql statments locally.
@@ -163,6 +223,10 @@ class SubscriberRegistry {
 };
 
 
+/** C-style adapter for the writer thread. */
+void *SubscriberRegistryWriterAdapter(SubscriberRegistry*);
+
+
 
 #endif
 
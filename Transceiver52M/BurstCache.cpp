@@ -0,0 +1,138 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#include "BurstCache.h"
+
+
+bool BurstCache::Key::operator<(const Key& other) const
+{
+  if (hash != other.hash) return hash < other.hash;
+  if (guardPeriodLength != other.guardPeriodLength)
+    return guardPeriodLength < other.guardPeriodLength;
+  if (attenuation != other.attenuation) return attenuation < other.attenuation;
+  return bits < other.bits;
+}
+
+
+void BurstCache::makeKey(Key& key, const BitVector& wBurst,
+			 int guardPeriodLength, int attenuation)
+{
+  const char *bit = wBurst.begin();
+  size_t len = wBurst.size();
+  // FNV-1a over the bits.
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; i++) {
+    hash ^= (unsigned char) bit[i];
+    hash *= 16777619u;
+  }
+  key.hash = hash;
+  key.guardPeriodLength = guardPeriodLength;
+  key.attenuation = attenuation;
+  key.bits.assign(bit,len);
+}
+
+
+BurstCache::BurstCache(unsigned wMaxEntries)
+  :mMaxEntries(wMaxEntries),
+   mHits(0),mMisses(0)
+{
+}
+
+
+BurstCache::~BurstCache()
+{
+  clear();
+}
+
+
+signalVector *BurstCache::find(const BitVector& wBurst,
+			       int guardPeriodLength,
+			       int attenuation)
+{
+  Key key;
+  makeKey(key,wBurst,guardPeriodLength,attenuation);
+  ScopedLock lock(mLock);
+  EntryMap::iterator itr = mEntries.find(key);
+  if (itr == mEntries.end()) {
+    mMisses++;
+    return NULL;
+  }
+  mHits++;
+  mAge.splice(mAge.begin(),mAge,itr->second.age);
+  return new signalVector(*(itr->second.burst));
+}
+
+
+void BurstCache::add(const BitVector& wBurst,
+		     int guardPeriodLength,
+		     int attenuation,
+		     const signalVector& modBurst)
+{
+  if (!mMaxEntries) return;
+  Key key;
+  makeKey(key,wBurst,guardPeriodLength,attenuation);
+  ScopedLock lock(mLock);
+  if (mEntries.find(key) != mEntries.end()) return;
+  if (mEntries.size() >= mMaxEntries) {
+    EntryMap::iterator oldest = mEntries.find(mAge.back());
+    delete oldest->second.burst;
+    mEntries.erase(oldest);
+    mAge.pop_back();
+  }
+  mAge.push_front(key);
+  Entry &entry = mEntries[key];
+  entry.burst = new signalVector(modBurst);
+  entry.age = mAge.begin();
+}
+
+
+void BurstCache::clear()
+{
+  ScopedLock lock(mLock);
+  for (EntryMap::iterator itr = mEntries.begin(); itr != mEntries.end(); ++itr)
+    delete itr->second.burst;
+  mEntries.clear();
+  mAge.clear();
+  mHits = 0;
+  mMisses = 0;
+}
+
+
+unsigned BurstCache::size() const
+{
+  ScopedLock lock(mLock);
+  return mEntries.size();
+}
+
+unsigned long BurstCache::hits() const
+{
+  ScopedLock lock(mLock);
+  return mHits;
+}
+
+unsigned long BurstCache::misses() const
+{
+  ScopedLock lock(mLock);
+  return mMisses;
+}
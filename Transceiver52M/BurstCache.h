@@ -0,0 +1,115 @@
+/*
+* Copyright 2012 Range Networks, Inc.
+*
+* This software is distributed under the terms of the GNU Public License.
+* See the COPYING file in the main directory for details.
+*
+* This use of this software may be subject to additional restrictions.
+* See the LEGAL file in the main directory for details.
+
+    This program is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+*/
+
+#ifndef BURSTCACHE_H
+#define BURSTCACHE_H
+
+#include "sigProcLib.h"
+#include "Threads.h"
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <map>
+
+/** Default number of modulated bursts held by a BurstCache. */
+const unsigned BurstCacheSize = 256;
+
+/**
+  An LRU cache of modulated, scaled transmit bursts, keyed on the burst bits,
+  the guard period and the per-burst attenuation.
+  On C0 most downlink bursts are bit-identical repeats (dummy bursts, FCCH,
+  BCCH and SACCH system information), so most of them need not be modulated again.
+  The pulse shape and samples-per-symbol are fixed for the life of a Transceiver,
+  which owns the cache, so they are not part of the key.
+*/
+class BurstCache {
+
+private:
+
+  /** Lookup key; the hash is compared first so most misses cost one integer compare. */
+  struct Key {
+    uint32_t hash;
+    int guardPeriodLength;
+    int attenuation;
+    std::string bits;          ///< one char per bit, as in BitVector
+
+    bool operator<(const Key& other) const;
+  };
+
+  typedef std::list<Key> KeyList;
+
+  struct Entry {
+    signalVector *burst;       ///< owned modulated burst
+    KeyList::iterator age;     ///< position in mAge
+  };
+
+  typedef std::map<Key,Entry> EntryMap;
+
+  mutable Mutex mLock;
+  EntryMap mEntries;
+  KeyList mAge;                ///< keys, most recently used first
+  unsigned mMaxEntries;
+  unsigned long mHits;
+  unsigned long mMisses;
+
+  static void makeKey(Key& key, const BitVector& wBurst,
+		      int guardPeriodLength, int attenuation);
+
+  /** Not copyable; the bursts are owned. */
+  BurstCache(const BurstCache&);
+  BurstCache& operator=(const BurstCache&);
+
+public:
+
+  BurstCache(unsigned wMaxEntries = BurstCacheSize);
+
+  ~BurstCache();
+
+  /**
+    Look up a modulated burst.
+    @return A new copy, owned by the caller, or NULL on a miss.
+  */
+  signalVector *find(const BitVector& wBurst,
+		     int guardPeriodLength,
+		     int attenuation);
+
+  /** Add a modulated burst, evicting the least recently used one if full. */
+  void add(const BitVector& wBurst,
+	   int guardPeriodLength,
+	   int attenuation,
+	   const signalVector& modBurst);
+
+  /** Drop all entries and reset the statistics. */
+  void clear();
+
+  /**@name Statistics. */
+  //@{
+  unsigned size() const;
+  unsigned long hits() const;
+  unsigned long misses() const;
+  //@}
+};
+
+#endif
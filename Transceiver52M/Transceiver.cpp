@@ -120,11 +120,16 @@ void Transceiver::addRadioVector(BitVector &burst,
 				 int RSSI,
 				 GSM::Time &wTime)
 {
-  // modulate and stick into queue 
-  signalVector* modBurst = modulateBurst(burst,*gsmPulse,
-					 8 + (wTime.TN() % 4 == 0),
-					 mSamplesPerSymbol);
-  scaleVector(*modBurst,txFullScale * pow(10,-RSSI/10));
+  // modulate, unless we sent the same bits recently, and stick into queue
+  int guardPeriodLength = 8 + (wTime.TN() % 4 == 0);
+  signalVector* modBurst = mBurstCache.find(burst,guardPeriodLength,RSSI);
+  if (!modBurst) {
+    modBurst = modulateBurst(burst,*gsmPulse,
+			     guardPeriodLength,
+			     mSamplesPerSymbol);
+    scaleVector(*modBurst,txFullScale * pow(10,-RSSI/10));
+    mBurstCache.add(burst,guardPeriodLength,RSSI,*modBurst);
+  }
   radioVector *newVec = new radioVector(*modBurst,wTime);
   mTransmitPriorityQueue.write(newVec);
 
@@ -611,6 +616,15 @@ void Transceiver::driveControl()
     sprintf(response,"RSP SETSLOT 0 %d %d",timeslot,corrCode);
 
   }
+  else if (strcmp(command,"BURSTCACHE")==0) {
+    // report modulated-burst cache statistics
+    unsigned long hits = mBurstCache.hits();
+    unsigned long misses = mBurstCache.misses();
+    unsigned long total = hits + misses;
+    sprintf(response,"RSP BURSTCACHE 0 %lu %lu %u %d",
+            hits,misses,mBurstCache.size(),
+            total ? (int) (100*hits/total) : 0);
+  }
   else {
     LOG(WARNING) << "bogus command " << command << " on control interface.";
     sprintf(response,"RSP ERR 1");
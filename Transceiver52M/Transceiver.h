@@ -30,6 +30,7 @@
 */
 
 #include "radioInterface.h"
+#include "BurstCache.h"
 #include "Interthread.h"
 #include "GSMCommon.h"
 #include "Sockets.h"
@@ -132,6 +133,7 @@ private:
   GSM::Time prevFalseDetectionTime;    ///< last timestamp of a false energy detection
   int fillerModulus[8];                ///< modulus values of all timeslots, in frames
   signalVector *fillerTable[102][8];   ///< table of modulated filler waveforms for all timeslots
+  BurstCache mBurstCache;              ///< recently modulated bursts, for repeated downlink content
   unsigned mMaxExpectedDelay;            ///< maximum expected time-of-arrival offset in GSM symbols
 
   GSM::Time    channelEstimateTime[8]; ///< last timestamp of each timeslot's channel estimate
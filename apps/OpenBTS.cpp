@@ -44,6 +44,8 @@ ReportingTable gReports(gConfig.getStr("Control.Reporting.StatsTable","/var/log/
 
 #include <ControlCommon.h>
 #include <TransactionTable.h>
+#include <MediaEngine.h>
+#include <SMSQueue.h>
 
 #include <SIPInterface.h>
 #include <Globals.h>
@@ -53,6 +55,7 @@ ReportingTable gReports(gConfig.getStr("Control.Reporting.StatsTable","/var/log/
 #include <PowerManager.h>
 #include <Configuration.h>
 #include <PhysicalStatus.h>
+#include <MeasurementEngine.h>
 #include <SubscriberRegistry.h>
 
 #include <sys/wait.h>
@@ -78,9 +81,18 @@ Control::TMSITable gTMSITable;
 // The transaction table.
 Control::TransactionTable gTransactionTable;
 
+// The media engine, for moving speech.
+Control::MediaEngine gMediaEngine;
+
+// The MT-SMS queue.
+Control::SMSQueue gSMSQueue;
+
 // Physical status reporting
 GSM::PhysicalStatus gPhysStatus;
 
+// Measurement report processing
+GSM::MeasurementEngine gMeasurements;
+
 // The global SIPInterface object.
 SIP::SIPInterface gSIPInterface;
 
@@ -235,6 +247,12 @@ void createStats()
 	gReports.create("OpenBTS.GSM.SMS.MTSMS.Start");
 	// count of mobile-temrinated SMS deliveries completed (got RP-ACK)
 	gReports.create("OpenBTS.GSM.SMS.MTSMS.Complete");
+	// count of MT-SMS stored in the SMS queue
+	gReports.create("OpenBTS.SMS.Queue.Accepted");
+	// count of queued MT-SMS delivered
+	gReports.create("OpenBTS.SMS.Queue.Delivered");
+	// count of queued MT-SMS given up after too many attempts
+	gReports.create("OpenBTS.SMS.Queue.Failed");
 
 	// count of mobile-originated setup messages
 	gReports.create("OpenBTS.GSM.CC.MOC.Setup");
@@ -265,6 +283,9 @@ void createStats()
 	//gReports.create("OpenBTS.GSM.RR.Handover.Outbound.Success");
 	// histogram of timing advance for accepted RACH bursts
 	gReports.create("OpenBTS.GSM.RR.RACH.TA.Accepted",0,63);
+	// RACH bursts dropped by the access grant stage without an answer
+	gReports.create("OpenBTS.GSM.RR.RACH.Shed.Age");
+	gReports.create("OpenBTS.GSM.RR.RACH.Shed.Congestion");
 
 	//gReports.create("Transceiver.StaleBurst");
 	//gReports.create("Transceiver.Command.Received");
@@ -292,6 +313,8 @@ int main(int argc, char *argv[])
 	}
 
 	createStats();
+	// Start writing the in-memory counters to the stats table.
+	gReports.start();
  
 	gReports.incr("OpenBTS.Starts");
 
@@ -314,7 +337,15 @@ int main(int argc, char *argv[])
 	COUT("\n\n" << gOpenBTSWelcome << "\n");
 	gTMSITable.open(gConfig.getStr("Control.Reporting.TMSITable").c_str());
 	gTransactionTable.init(gConfig.getStr("Control.Reporting.TransactionTable").c_str());
+	gMediaEngine.start();
+	if (gConfig.getBool("Control.SMS.Queue")) {
+		string path = gConfig.getStr("Control.SMS.Queue.Path","/etc/OpenBTS/SMSQueue.db");
+		if (gSMSQueue.open(path.c_str())) {
+			LOG(ALERT) << "cannot open the SMS queue at " << path << "; MT-SMS will be delivered directly";
+		}
+	}
 	gPhysStatus.open(gConfig.getStr("Control.Reporting.PhysStatusTable").c_str());
+	gMeasurements.start();
 	gBTS.init();
 	gSubscriberRegistry.init();
 	gParser.addCommands();
@@ -486,7 +517,8 @@ int main(int argc, char *argv[])
 
 	// Set up the pager.
 	// Set up paging channels.
-	// HACK -- For now, use a single paging channel, since paging groups are broken.
+	// The pager maps paging block b to PCH b mod (number of PCHs).
+	// With BS-AG-BLKS-RES=2 on a C-V beacon, CCCH2 is the only paging block.
 	gBTS.addPCH(&CCCH2);
 
 	// Be sure we are not over-reserving.
@@ -551,6 +583,9 @@ int main(int argc, char *argv[])
 	//if (gTransceiverPid) kill(gTransceiverPid, SIGKILL);
 	close(sock);
 
+	// Write back the cached TMSI access times.
+	gTMSITable.flush();
+
 }
 
 // vim: ts=4 sw=4